@@ -10,4 +10,25 @@
 #import "CIOAPISession.h"
 #import "CIOSourceRequests.h"
 #import "CIOV2Client.h"
-#import "CIOLiteClient.h"
\ No newline at end of file
+#import "CIOLiteClient.h"
+#import "CIOMIMEParser.h"
+#import "CIOHeaderTokenizer.h"
+#import "CIOAttachmentStore.h"
+#import "CIOFileLinkCache.h"
+#import "CIOMessageStore.h"
+#import "CIOMessageSync.h"
+#import "CIOMessageIndex.h"
+#import "CIOMessageMetadataFile.h"
+#import "CIOMessageThreader.h"
+#import "CIOContactCache.h"
+#import "CIOSyncStatusPoller.h"
+#import "CIOWebhookReceiver.h"
+#import "CIOLiteResultCache.h"
+#import "CIOFlagUpdateQueue.h"
+#import "CIOBulkFolderUpdate.h"
+#import "CIOClientPool.h"
+#import "CIOCredentials.h"
+#import "CIOCredentialStore.h"
+#import "CIOMessageFacetPlanner.h"
+#import "CIOJSONProjection.h"
+#import "CIORequestTemplate.h"
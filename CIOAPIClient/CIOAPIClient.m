@@ -8,31 +8,40 @@
 
 #import "CIOAPIClientHeader.h"
 
-#import <SSKeychain/SSKeychain.h>
 #import "TDOAuth.h"
+#import "CIOOAuthSigner.h"
 #import "CIOAPISession.h"
+#import "CIOMIMEParser.h"
+#import "CIOCredentials.h"
+#import "CIOCredentialStore.h"
+#import "CIOJSONProjection.h"
+
+NSString *const CIOAPIClientDidReceiveResponseNotification = @"CIOAPIClientDidReceiveResponseNotification";
+NSString *const CIOAPIClientRequestKey = @"request";
+NSString *const CIOAPIClientResponseObjectKey = @"responseObject";
 
 // Keychain keys
 static NSString *const kCIOKeyChainServicePrefix = @"Context-IO-";
-static NSString *const kCIOAccountIDKeyChainKey = @"kCIOAccountID";
-static NSString *const kCIOTokenKeyChainKey = @"kCIOToken";
-static NSString *const kCIOTokenSecretKeyChainKey = @"kCIOTokenSecret";
+
+static id<CIOCredentialStore> CIODefaultCredentialStore = nil;
 
 @interface CIOAPIClient () {
 
     NSString *_OAuthConsumerKey;
     NSString *_OAuthConsumerSecret;
-    NSString *_OAuthToken;
-    NSString *_OAuthTokenSecret;
-    NSString *_accountID;
-
-    NSString *_tmpOAuthToken;
-    NSString *_tmpOAuthTokenSecret;
 }
 
 @property (nonatomic) NSURL *baseURL;
 @property (nonatomic) NSString *basePath;
-@property (nonatomic) CIOAPISession *session;
+// Host of `baseURL`, with its port if it has one, as it is sent and signed
+@property (nonatomic) NSString *baseHost;
+// `basePath` percent-encoded with a trailing slash, prefixed to the paths of `requestForEncodedPath:...`
+@property (nonatomic) NSString *encodedBasePathPrefix;
+// Read without locking by signing threads, only ever replaced as a whole by `_updateCredentials:`. `nil` until the
+// saved credentials are loaded on first use.
+@property (nullable, atomic) CIOCredentials *credentialsSnapshot;
+@property (nullable, nonatomic) NSString *accountID;
+@property (nonatomic) BOOL isAuthorized;
 
 - (void)loadCredentials;
 - (void)saveCredentials;
@@ -63,20 +72,20 @@ static NSString *const kCIOTokenSecretKeyChainKey = @"kCIOTokenSecret";
 
     self.baseURL = [NSURL URLWithString:baseURLString];
     self.basePath = [self.baseURL path];
+    self.baseHost = self.baseURL.port
+                        ? [NSString stringWithFormat:@"%@:%@", self.baseURL.host, self.baseURL.port]
+                        : self.baseURL.host;
+    NSString *encodedBasePath = [self.basePath stringByAddingPercentEscapesUsingEncoding:NSUTF8StringEncoding];
+    self.encodedBasePathPrefix =
+        [encodedBasePath hasSuffix:@"/"] ? encodedBasePath : [encodedBasePath stringByAppendingString:@"/"];
 
     self.timeoutInterval = 60;
-
-    _isAuthorized = NO;
-
-    [self loadCredentials];
+    self.URLScheme = self.baseURL.scheme ?: @"https";
+    self.credentialStore = [CIOAPIClient defaultCredentialStore];
 
     if (accountID && token && tokenSecret) {
-
-        _OAuthToken = token;
-        _OAuthTokenSecret = tokenSecret;
-        _accountID = accountID;
-
-        _isAuthorized = YES;
+        self.credentialsSnapshot =
+            [CIOCredentials credentialsWithAccountID:accountID token:token tokenSecret:tokenSecret];
     }
 
     return self;
@@ -86,6 +95,105 @@ static NSString *const kCIOTokenSecretKeyChainKey = @"kCIOTokenSecret";
     return kCIOKeyChainServicePrefix;
 }
 
+#pragma mark - Credentials
+
++ (id<CIOCredentialStore>)defaultCredentialStore {
+    @synchronized([CIOAPIClient class]) {
+        if (!CIODefaultCredentialStore) {
+#if __has_include(<Security/Security.h>)
+            id<CIOCredentialStore> store = [CIOKeychainCredentialStore new];
+#else
+            NSURL *supportURL = [[[NSFileManager defaultManager] URLsForDirectory:NSApplicationSupportDirectory
+                                                                        inDomains:NSUserDomainMask] firstObject];
+            id<CIOCredentialStore> store = [[CIOFileCredentialStore alloc]
+                initWithDirectoryURL:[supportURL URLByAppendingPathComponent:@"CIOAPIClient/Credentials"]];
+#endif
+            CIODefaultCredentialStore = [[CIOCachingCredentialStore alloc] initWithStore:store];
+        }
+        return CIODefaultCredentialStore;
+    }
+}
+
++ (void)setDefaultCredentialStore:(id<CIOCredentialStore>)credentialStore {
+    @synchronized([CIOAPIClient class]) {
+        CIODefaultCredentialStore = credentialStore;
+    }
+}
+
+- (NSString *)_credentialService {
+    return [NSString stringWithFormat:@"%@-%@", [self keychainPrefix], _OAuthConsumerKey];
+}
+
+- (CIOCredentials *)credentials {
+    CIOCredentials *credentials = self.credentialsSnapshot;
+    if (!credentials) {
+        [self loadCredentials];
+        credentials = self.credentialsSnapshot;
+    }
+    return credentials;
+}
+
+- (NSString *)accountID {
+    return self.credentials.accountID;
+}
+
+- (BOOL)isAuthorized {
+    return self.credentials.isAuthorized;
+}
+
+// Writers are serialized so none of them loses another's change; readers just take the current snapshot
+- (void)_updateCredentials:(CIOCredentials * (^)(CIOCredentials *credentials))update {
+    @synchronized(self) {
+        self.credentialsSnapshot = update(self.credentials);
+    }
+}
+
+// Setters replacing the snapshot with one differing in a single value, also used through key-value coding
+
+- (void)setAccountID:(NSString *)accountID {
+    [self _updateCredentials:^CIOCredentials *(CIOCredentials *credentials) {
+      return [[CIOCredentials alloc] initWithAccountID:accountID
+                                                 token:credentials.token
+                                           tokenSecret:credentials.tokenSecret
+                                            authorized:credentials.isAuthorized
+                                        temporaryToken:credentials.temporaryToken
+                                  temporaryTokenSecret:credentials.temporaryTokenSecret];
+    }];
+}
+
+- (void)setOAuthToken:(NSString *)token {
+    [self _updateCredentials:^CIOCredentials *(CIOCredentials *credentials) {
+      return [[CIOCredentials alloc] initWithAccountID:credentials.accountID
+                                                 token:token
+                                           tokenSecret:credentials.tokenSecret
+                                            authorized:credentials.isAuthorized
+                                        temporaryToken:credentials.temporaryToken
+                                  temporaryTokenSecret:credentials.temporaryTokenSecret];
+    }];
+}
+
+- (void)setOAuthTokenSecret:(NSString *)tokenSecret {
+    [self _updateCredentials:^CIOCredentials *(CIOCredentials *credentials) {
+      return [[CIOCredentials alloc] initWithAccountID:credentials.accountID
+                                                 token:credentials.token
+                                           tokenSecret:tokenSecret
+                                            authorized:credentials.isAuthorized
+                                        temporaryToken:credentials.temporaryToken
+                                  temporaryTokenSecret:credentials.temporaryTokenSecret];
+    }];
+}
+
+- (void)setIsAuthorized:(BOOL)authorized {
+    [self _updateCredentials:^CIOCredentials *(CIOCredentials *credentials) {
+      return [[CIOCredentials alloc] initWithAccountID:credentials.accountID
+                                                 token:credentials.token
+                                           tokenSecret:credentials.tokenSecret
+                                            authorized:authorized
+                                        temporaryToken:credentials.temporaryToken
+                                  temporaryTokenSecret:credentials.temporaryTokenSecret];
+    }];
+}
+
 #pragma mark -
 
 - (CIODictionaryRequest *)beginAuthForProviderType:(CIOEmailProviderType)providerType
@@ -93,7 +201,7 @@ static NSString *const kCIOTokenSecretKeyChainKey = @"kCIOTokenSecret";
                                             params:(NSDictionary *)params {
 
     NSString *connectTokenPath = nil;
-    if (_isAuthorized) {
+    if (self.isAuthorized) {
         connectTokenPath = [[self accountPath] stringByAppendingPathComponent:@"connect_tokens"];
     } else {
         connectTokenPath = @"connect_tokens";
@@ -125,10 +233,17 @@ static NSString *const kCIOTokenSecretKeyChainKey = @"kCIOTokenSecret";
 }
 
 - (NSURL *)redirectURLFromResponse:(NSDictionary *)responseDict {
-    if (_isAuthorized == NO) {
-        _tmpOAuthToken = responseDict[@"access_token"];
-        _tmpOAuthTokenSecret = responseDict[@"access_token_secret"];
-    }
+    [self _updateCredentials:^CIOCredentials *(CIOCredentials *credentials) {
+      if (credentials.isAuthorized) {
+          return credentials;
+      }
+      return [[CIOCredentials alloc] initWithAccountID:credentials.accountID
+                                                 token:credentials.token
+                                           tokenSecret:credentials.tokenSecret
+                                            authorized:NO
+                                        temporaryToken:responseDict[@"access_token"]
+                                  temporaryTokenSecret:responseDict[@"access_token_secret"]];
+    }];
 
     return [NSURL URLWithString:responseDict[@"browser_redirect_url"]];
 }
@@ -150,11 +265,9 @@ static NSString *const kCIOTokenSecretKeyChainKey = @"kCIOTokenSecret";
         (OAuthTokenSecret && ![OAuthTokenSecret isEqual:[NSNull null]]) &&
         (accountID && ![accountID isEqual:[NSNull null]])) {
 
-        _OAuthToken = OAuthToken;
-        _OAuthTokenSecret = OAuthTokenSecret;
-        _accountID = accountID;
-
-        _isAuthorized = YES;
+        [self _updateCredentials:^CIOCredentials *(CIOCredentials *credentials) {
+          return [CIOCredentials credentialsWithAccountID:accountID token:OAuthToken tokenSecret:OAuthTokenSecret];
+        }];
         if (saveCredentials) {
             [self saveCredentials];
         }
@@ -165,68 +278,62 @@ static NSString *const kCIOTokenSecretKeyChainKey = @"kCIOTokenSecret";
 }
 
 - (void)loadCredentials {
-
-    NSString *serviceName = [NSString stringWithFormat:@"%@-%@", [self keychainPrefix], _OAuthConsumerKey];
-
-    NSString *accountID = [SSKeychain passwordForService:serviceName account:kCIOAccountIDKeyChainKey];
-    NSString *OAuthToken = [SSKeychain passwordForService:serviceName account:kCIOTokenKeyChainKey];
-    NSString *OAuthTokenSecret = [SSKeychain passwordForService:serviceName account:kCIOTokenSecretKeyChainKey];
-
-    if (accountID && OAuthToken && OAuthTokenSecret) {
-
-        _accountID = accountID;
-        _OAuthToken = OAuthToken;
-        _OAuthTokenSecret = OAuthTokenSecret;
-
-        _isAuthorized = YES;
+    @synchronized(self) {
+        if (self.credentialsSnapshot) {
+            return;
+        }
+        CIOCredentials *savedCredentials = [self.credentialStore credentialsForService:[self _credentialService]];
+        self.credentialsSnapshot = savedCredentials ?: [CIOCredentials new];
     }
 }
 
 - (void)saveCredentials {
 
-    if (_accountID && _OAuthToken && _OAuthTokenSecret) {
-
-        NSString *serviceName = [NSString stringWithFormat:@"%@-%@", [self keychainPrefix], _OAuthConsumerKey];
-        BOOL accountIDSaved =
-            [SSKeychain setPassword:_accountID forService:serviceName account:kCIOAccountIDKeyChainKey];
-        BOOL tokenSaved = [SSKeychain setPassword:_OAuthToken forService:serviceName account:kCIOTokenKeyChainKey];
-        BOOL secretSaved =
-            [SSKeychain setPassword:_OAuthTokenSecret forService:serviceName account:kCIOTokenSecretKeyChainKey];
-
-        if (accountIDSaved && tokenSaved && secretSaved) {
-            _isAuthorized = YES;
+    CIOCredentials *credentials = self.credentials;
+    if (credentials.accountID && credentials.token && credentials.tokenSecret) {
+        if ([self.credentialStore saveCredentials:credentials forService:[self _credentialService]]) {
+            self.isAuthorized = YES;
         }
     }
 }
 
 - (void)clearCredentials {
 
-    _isAuthorized = NO;
-    _accountID = nil;
+    [self _updateCredentials:^CIOCredentials *(CIOCredentials *credentials) {
+      return [[CIOCredentials alloc] initWithAccountID:nil
+                                                 token:credentials.token
+                                           tokenSecret:credentials.tokenSecret
+                                            authorized:NO
+                                        temporaryToken:credentials.temporaryToken
+                                  temporaryTokenSecret:credentials.temporaryTokenSecret];
+    }];
 
-    NSString *serviceName = [NSString stringWithFormat:@"%@-%@", [self keychainPrefix], _OAuthConsumerKey];
-    [SSKeychain deletePasswordForService:serviceName account:kCIOAccountIDKeyChainKey];
-    [SSKeychain deletePasswordForService:serviceName account:kCIOTokenKeyChainKey];
-    [SSKeychain deletePasswordForService:serviceName account:kCIOTokenSecretKeyChainKey];
+    [self.credentialStore removeCredentialsForService:[self _credentialService]];
 }
 
 #pragma mark -
 
+// A single read of the snapshot, so the token and secret of a request always belong together. Tokens which are not
+// authorized yet are not sent.
+- (CIOCredentials *)_signingCredentials {
+    CIOCredentials *credentials = self.credentials;
+    return credentials.isAuthorized ? credentials : [CIOCredentials new];
+}
+
 - (NSURLRequest *)signedRequestForPath:(NSString *)path
                                 method:(NSString *)method
                             parameters:(NSDictionary *)params
-                                 token:(NSString *)token
-                           tokenSecret:(NSString *)tokenSecret
+                           credentials:(CIOCredentials *)credentials
                            contentType:(TDOAuthContentType)contentType {
 
     NSMutableURLRequest *signedRequest = [[TDOAuth URLRequestForPath:[self.basePath stringByAppendingPathComponent:path]
                                                           parameters:params
-                                                                host:self.baseURL.host
+                                                                host:self.baseHost
                                                          consumerKey:_OAuthConsumerKey
                                                       consumerSecret:_OAuthConsumerSecret
-                                                         accessToken:token
-                                                         tokenSecret:tokenSecret
-                                                              scheme:@"https"
+                                                         accessToken:credentials.token
+                                                         tokenSecret:credentials.tokenSecret
+                                                              scheme:self.URLScheme
                                                        requestMethod:method
                                                         dataEncoding:contentType
                                                         headerValues:@{
@@ -244,23 +351,45 @@ static NSString *const kCIOTokenSecretKeyChainKey = @"kCIOTokenSecret";
 #pragma mark -
 
 - (NSURLRequest *)requestForPath:(NSString *)path method:(NSString *)method params:(NSDictionary *)params {
-    NSString *token = self.isAuthorized ? _OAuthToken : nil;
-    NSString *tokenSecret = self.isAuthorized ? _OAuthTokenSecret : nil;
-    return [self signedRequestForPath:path method:method parameters:params token:token tokenSecret:tokenSecret contentType:TDOAuthContentTypeUrlEncodedForm];
+    return [self signedRequestForPath:path method:method parameters:params credentials:[self _signingCredentials] contentType:TDOAuthContentTypeUrlEncodedForm];
+}
+
+- (NSURLRequest *)requestForEncodedPath:(NSString *)encodedPath
+                                 method:(NSString *)method
+                      encodedParameters:(NSDictionary *)encodedParameters {
+    NSMutableURLRequest *signedRequest =
+        [CIOOAuthSigner requestWithMethod:method
+                                   scheme:self.URLScheme
+                                     host:self.baseHost
+                              encodedPath:[self.encodedBasePathPrefix stringByAppendingString:encodedPath]
+                        encodedParameters:encodedParameters
+                              consumerKey:_OAuthConsumerKey
+                           consumerSecret:_OAuthConsumerSecret
+                              credentials:[self _signingCredentials]
+                             headerValues:@{
+                                 @"Accept": @"application/json"
+                             }];
+    signedRequest.timeoutInterval = self.timeoutInterval;
+    return signedRequest;
 }
 
 - (NSURLRequest *)requestForPath:(NSString *)path method:(NSString *)method body:(id)body {
     // TDOAuth does not support JSON encoded body for GETs
     NSParameterAssert(![method isEqualToString:@"GET"]);
-    NSString *token = self.isAuthorized ? _OAuthToken : nil;
-    NSString *tokenSecret = self.isAuthorized ? _OAuthTokenSecret : nil;
-    return [self signedRequestForPath:path method:method parameters:body token:token tokenSecret:tokenSecret contentType:TDOAuthContentTypeJsonObject];
+    return [self signedRequestForPath:path method:method parameters:body credentials:[self _signingCredentials] contentType:TDOAuthContentTypeJsonObject];
 }
 
 - (NSURLRequest *)requestForCIORequest:(CIORequest *)request {
     if ([request isKindOfClass:[CIOConnectTokenRequest class]]) {
         // This is a special case due to the use of the temporary token/secret during auth
-        return [self signedRequestForPath:request.path method:request.method parameters:request.parameters token:_tmpOAuthToken tokenSecret:_tmpOAuthTokenSecret contentType:TDOAuthContentTypeUrlEncodedForm];
+        CIOCredentials *credentials = self.credentials;
+        CIOCredentials *temporary = [[CIOCredentials alloc] initWithAccountID:nil
+                                                                        token:credentials.temporaryToken
+                                                                  tokenSecret:credentials.temporaryTokenSecret
+                                                                   authorized:NO
+                                                               temporaryToken:nil
+                                                         temporaryTokenSecret:nil];
+        return [self signedRequestForPath:request.path method:request.method parameters:request.parameters credentials:temporary contentType:TDOAuthContentTypeUrlEncodedForm];
     } else if (request.requestBody != nil) {
         return [self requestForPath:request.path method:request.method body:request.requestBody];
     } else {
@@ -297,13 +426,31 @@ static NSString *const kCIOTokenSecretKeyChainKey = @"kCIOTokenSecret";
     return _session;
 }
 
+- (void)prewarmWithCompletion:(void (^)(NSError *))completion {
+    // The origin requests go to, which differs from the base URL's when `URLScheme` was changed
+    NSURLComponents *components = [NSURLComponents componentsWithURL:self.baseURL resolvingAgainstBaseURL:NO];
+    components.scheme = self.URLScheme;
+    [self.session prewarmConnectionsToURL:components.URL count:1 completion:completion];
+}
+
 - (void)executeRequest:(CIORequest *)request success:(void (^)(id))success
                failure:(void (^)(NSError *))failure {
-    [self.session executeRequest:[self requestForCIORequest:request] success:^(id result) {
+    CIOJSONProjection *projection = nil;
+    if (request.projection) {
+        projection = [[CIOJSONProjection alloc] initWithKeyPaths:[request.projection setByAddingObject:@"success"]];
+    }
+    [self.session executeRequest:[self requestForCIORequest:request] projection:projection success:^(id result) {
         NSError *error = [request validateResponseObject:result];
         if (error) {
             failure(error);
+        } else if (projection) {
+            // Projected responses lack fields, and would poison caches keyed on the path and parameters alone
+            success(result);
         } else {
+            [[NSNotificationCenter defaultCenter] postNotificationName:CIOAPIClientDidReceiveResponseNotification
+                                                                object:self
+                                                              userInfo:@{CIOAPIClientRequestKey: request,
+                                                                         CIOAPIClientResponseObjectKey: result ?: [NSNull null]}];
             success(result);
         }
     } failure:failure];
@@ -328,11 +475,95 @@ static NSString *const kCIOTokenSecretKeyChainKey = @"kCIOTokenSecret";
 }
 
 - (void)downloadRequest:(CIORequest * __nonnull)request toFileURL:(NSURL * __nonnull)fileURL success:(nullable void (^)())successBlock failure:(nullable void (^)(NSError * __nonnull))failureBlock progress:(nullable CIOSessionDownloadProgressBlock)progressBlock {
+    [self downloadURLRequest:[self requestForCIORequest:request]
+                  contentKey:request.contentKey
+                   toFileURL:fileURL
+                     success:successBlock
+                     failure:failureBlock
+                    progress:progressBlock];
+}
+
+- (void)downloadURLRequest:(NSURLRequest *)urlRequest
+                contentKey:(NSString *)contentKey
+                 toFileURL:(NSURL *)fileURL
+                   success:(void (^)())successBlock
+                   failure:(void (^)(NSError *))failureBlock
+                  progress:(CIOSessionDownloadProgressBlock)progressBlock {
+    CIOAttachmentStore *store = self.attachmentStore;
+    if (!store || !contentKey) {
+        [self.session downloadRequest:urlRequest
+                            toFileURL:fileURL
+                              success:successBlock
+                              failure:failureBlock
+                             progress:progressBlock];
+        return;
+    }
+    dispatch_async(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^{
+      if ([store writeContentForKey:contentKey toFileURL:fileURL error:nil]) {
+          if (successBlock) {
+              dispatch_async(dispatch_get_main_queue(), successBlock);
+          }
+          return;
+      }
+      NSString *downloadPath = [NSTemporaryDirectory() stringByAppendingPathComponent:[[NSUUID UUID] UUIDString]];
+      NSURL *downloadURL = [NSURL fileURLWithPath:downloadPath];
+      [self.session downloadRequest:urlRequest
+          toFileURL:downloadURL
+          success:^{
+            dispatch_async(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^{
+              NSError *error = nil;
+              NSString *hash = [store storeFileAtURL:downloadURL forKey:contentKey error:&error];
+              BOOL written = hash && [store writeContentWithHash:hash toFileURL:fileURL error:&error];
+              if (!hash) {
+                  [[NSFileManager defaultManager] removeItemAtURL:downloadURL error:nil];
+              }
+              dispatch_async(dispatch_get_main_queue(), ^{
+                if (written) {
+                    if (successBlock) {
+                        successBlock();
+                    }
+                } else if (failureBlock) {
+                    failureBlock(error);
+                }
+              });
+            });
+          }
+          failure:failureBlock
+          progress:progressBlock];
+    });
+}
+
+- (void)downloadRequest:(CIORequest *)request
+    extractingMIMEPartAtIndex:(NSUInteger)partIndex
+                    toFileURL:(NSURL *)fileURL
+                      success:(void (^)())successBlock
+                      failure:(void (^)(NSError *))failureBlock
+                     progress:(CIOSessionDownloadProgressBlock)progressBlock {
+    NSString *sourcePath = [NSTemporaryDirectory() stringByAppendingPathComponent:[[NSUUID UUID] UUIDString]];
+    NSURL *sourceURL = [NSURL fileURLWithPath:sourcePath];
     [self.session downloadRequest:[self requestForCIORequest:request]
-                        toFileURL:fileURL
-                          success:successBlock
-                          failure:failureBlock
-                         progress:progressBlock];
+        toFileURL:sourceURL
+        success:^{
+          dispatch_async(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^{
+            NSError *error = nil;
+            CIOMIMEParser *parser = [[CIOMIMEParser alloc] initWithContentsOfURL:sourceURL error:&error];
+            BOOL written = [parser writeDecodedPartAtIndex:partIndex toFileURL:fileURL error:&error];
+            // Drop the mapping before removing the file behind it
+            parser = nil;
+            [[NSFileManager defaultManager] removeItemAtURL:sourceURL error:nil];
+            dispatch_async(dispatch_get_main_queue(), ^{
+              if (written) {
+                  if (successBlock) {
+                      successBlock();
+                  }
+              } else if (failureBlock) {
+                  failureBlock(error);
+              }
+            });
+          });
+        }
+        failure:failureBlock
+        progress:progressBlock];
 }
 
 @end
@@ -13,6 +13,9 @@
 #import "CIOFilesRequest.h"
 #import "CIOSourceRequests.h"
 #import "CIOAPISession.h"
+#import "CIOAttachmentStore.h"
+#import "CIOCredentials.h"
+#import "CIOCredentialStore.h"
 
 NS_ASSUME_NONNULL_BEGIN
 
@@ -29,6 +32,18 @@ typedef NS_ENUM(NSInteger, CIOEmailProviderType) {
  */
 extern NSString *const CIOAPISessionURLResponseErrorKey;
 
+/**
+ *  Posted by a `CIOAPIClient` on the main queue when a request succeeds, just before its success block is called. Lets
+ * local caches learn from responses as they pass through the client. The `userInfo` holds the `CIORequest` under
+ * `CIOAPIClientRequestKey` and the response object under `CIOAPIClientResponseObjectKey`. Not posted for requests
+ * with a `projection`, as their responses are incomplete.
+ */
+extern NSString *const CIOAPIClientDidReceiveResponseNotification;
+
+extern NSString *const CIOAPIClientRequestKey;
+
+extern NSString *const CIOAPIClientResponseObjectKey;
+
 /**
  `CIOAPIClient` provides an easy to use interface for constructing requests against the Context.IO API. The client
  handles authentication and all signing of requests.
@@ -46,12 +61,49 @@ extern NSString *const CIOAPISessionURLResponseErrorKey;
  */
 @property (nonatomic, readonly) BOOL isAuthorized;
 
+/**
+ The current credentials of the API client. The snapshot is replaced whenever credentials change, so it can be read
+ from any thread while requests are being signed on others.
+ */
+@property (readonly) CIOCredentials *credentials;
+
+/**
+ Where credentials are loaded from, and saved to by `completeLoginWithResponse:saveCredentials:`. Defaults to
+ `defaultCredentialStore`. Set it before the client's credentials are first used.
+ */
+@property (nonatomic) id<CIOCredentialStore> credentialStore;
+
+/**
+ The credential store of new clients: a `CIOCachingCredentialStore`, shared by all clients of the process, over a
+ `CIOKeychainCredentialStore`, or over a `CIOFileCredentialStore` in the application support directory on platforms
+ without a keychain.
+ */
++ (id<CIOCredentialStore>)defaultCredentialStore;
+
++ (void)setDefaultCredentialStore:(id<CIOCredentialStore>)credentialStore;
+
 /**
  The timeout interval for all requests made. Defaults to 60 seconds.
  */
 @property (nonatomic) NSTimeInterval timeoutInterval;
 
-@property (readonly, nonatomic) CIOAPISession *session;
+/**
+ The URL scheme requests are signed and sent with, and connections are prewarmed with. Defaults to the scheme of the
+ base URL, `https` for the API. Use `http` only to talk to a local server, such as a stub server serving fixtures in
+ tests and benchmarks.
+ */
+@property (nonatomic, copy) NSString *URLScheme;
+
+/**
+ The session requests are executed in. Clients may share one session, and with it its connection pool, e.g. through a
+ `CIOClientPool`. Defaults to a session of the client's own, created on first use.
+ */
+@property (nonatomic) CIOAPISession *session;
+
+/**
+ Local store for downloaded files and attachments. When set, `downloadRequest:toFileURL:success:failure:progress:` serves requests with a `contentKey` from the store when it can, and saves what it downloads to it. Defaults to `nil`.
+ */
+@property (nullable, nonatomic) CIOAttachmentStore *attachmentStore;
 
 @property (readonly, nonatomic) NSString *accountPath;
 
@@ -72,6 +124,9 @@ extern NSString *const CIOAPISessionURLResponseErrorKey;
  @param tokenSecret The auth token secret for the API client.
  @param accountID The account ID the client should use to construct requests.
 
+ When the token, token secret and account ID are all given, saved credentials are not read. Otherwise they are read
+ from `credentialStore` when first needed.
+
  @return The newly-initialized API client
  */
 - (instancetype)initWithBaseURLString:(NSString *)baseURLString
@@ -94,6 +149,17 @@ extern NSString *const CIOAPISessionURLResponseErrorKey;
  */
 - (NSURLRequest *)requestForPath:(NSString *)path method:(NSString *)method params:(nullable NSDictionary *)params;
 
+/**
+ *  Like `requestForPath:method:params:`, for a path and parameters which are already percent-encoded. Used by
+ * `CIORequestTemplate` to encode the constant parts of requests only once.
+ *
+ *  @param encodedPath       path in the API namespace, percent-encoded with `stringByAddingPercentEscapesUsingEncoding:`
+ *  @param encodedParameters parameter names and values, each percent-encoded with `+[CIOOAuthSigner percentEncode:]`
+ */
+- (NSURLRequest *)requestForEncodedPath:(NSString *)encodedPath
+                                 method:(NSString *)method
+                      encodedParameters:(NSDictionary *)encodedParameters;
+
 - (CIODictionaryRequest *)dictionaryRequestForPath:(NSString *)path
                                             method:(NSString *)method
                                             params:(nullable NSDictionary *)params;
@@ -135,20 +201,26 @@ extern NSString *const CIOAPISessionURLResponseErrorKey;
 
 /**
  Uses the connect token received from the API to complete the authentication process and optionally save the credentials
- to the keychain.
+ to the `credentialStore`, the keychain by default.
 
  @param responseObject The full response object returned by the API after calling `fetchAccountWithConnectToken:` with a valid connect token.
- @param saveCredentials This determines if credentials are saved to the device's keychain.
+ @param saveCredentials This determines if credentials are saved to the `credentialStore`.
  */
 - (BOOL)completeLoginWithResponse:(NSDictionary *)responseObject saveCredentials:(BOOL)saveCredentials;
 
 /**
- Clears the credentials stored in the keychain.
+ Clears the credentials stored in the `credentialStore`.
  */
 - (void)clearCredentials;
 
 #pragma mark - Executing Requests
 
+/**
+ *  Opens a connection to the API ahead of the first request, so it doesn't pay for connection setup. See
+ * `-[CIOAPISession prewarmConnectionsToURL:count:completion:]`.
+ */
+- (void)prewarmWithCompletion:(nullable void (^)(NSError *__nullable error))completion;
+
 /**
  *  Execute a request against the Context.IO API which returns a dictionary of JSON data in its response.
  *
@@ -198,6 +270,46 @@ extern NSString *const CIOAPISessionURLResponseErrorKey;
                 failure:(nullable void (^)(NSError *error))failureBlock
                progress:(nullable CIOSessionDownloadProgressBlock)progressBlock;
 
+/**
+ *  Download an already built `NSURLRequest`, such as an unsigned request for a temporary file link, to a file on disk.
+ * Used by `downloadRequest:toFileURL:success:failure:progress:`.
+ *
+ *  @param urlRequest    request to execute
+ *  @param contentKey    key of the downloaded contents in `attachmentStore`, or `nil` to bypass the store
+ *  @param fileURL       `URL` on disk to save the destination file to. An error will be returned if a file already exists
+ * at this path.
+ *  @param successBlock  block to be called when the file download completes
+ *  @param failureBlock  block to be called in the event of an error. No file will be written.
+ *  @param progressBlock block to receive periodic progress updates during the file download
+ */
+- (void)downloadURLRequest:(NSURLRequest *)urlRequest
+                contentKey:(nullable NSString *)contentKey
+                 toFileURL:(NSURL *)fileURL
+                   success:(nullable void (^)())successBlock
+                   failure:(nullable void (^)(NSError *error))failureBlock
+                  progress:(nullable CIOSessionDownloadProgressBlock)progressBlock;
+
+/**
+ *  Download a raw message source, such as `getSourceForMessageWithID:` or `-[CIOLiteMessageRequest getRawMessage]`,
+ * and save a single decoded MIME part of it to a file on disk. The source is streamed to a temporary file and the part
+ * is decoded from a memory mapping of it, so neither the message nor the attachment is held in memory.
+ *
+ *  @param request       request for a raw message source
+ *  @param partIndex     depth-first index of the part to extract, see `-[CIOMIMEParser parts]`
+ *  @param fileURL       `URL` on disk to save the decoded part to. An error will be returned if a file already exists
+ * at this path.
+ *  @param successBlock  block to be called when the part has been written
+ *  @param failureBlock  block to be called in the event of an error, including the message having no part at
+ * `partIndex`. No file will be written.
+ *  @param progressBlock block to receive periodic progress updates during the message download
+ */
+- (void)downloadRequest:(CIORequest *)request
+    extractingMIMEPartAtIndex:(NSUInteger)partIndex
+                    toFileURL:(NSURL *)fileURL
+                      success:(nullable void (^)())successBlock
+                      failure:(nullable void (^)(NSError *error))failureBlock
+                     progress:(nullable CIOSessionDownloadProgressBlock)progressBlock;
+
 @end
 
 
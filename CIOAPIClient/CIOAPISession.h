@@ -10,6 +10,8 @@
 
 NS_ASSUME_NONNULL_BEGIN
 
+@class CIOJSONProjection;
+
 typedef void (^CIOSessionDownloadProgressBlock)(int64_t bytesRead, int64_t totalBytesRead,
                                                 int64_t totalBytesExpectedToRead);
 
@@ -29,13 +31,39 @@ typedef void (^CIOSessionDownloadProgressBlock)(int64_t bytesRead, int64_t total
  */
 @interface CIOAPISession : NSObject
 
+/**
+ *  A session using the default `NSURLSessionConfiguration`.
+ */
+- (instancetype)init;
+
+/**
+ *  A session whose requests run in an `NSURLSession` with `configuration`, e.g. to tune connection reuse for a session
+ * shared by many clients.
+ */
+- (instancetype)initWithConfiguration:(NSURLSessionConfiguration *)configuration NS_DESIGNATED_INITIALIZER;
+
+/**
+ *  A copy of the configuration of the underlying `NSURLSession`.
+ */
+@property (readonly, nonatomic) NSURLSessionConfiguration *configuration;
+
 - (void)executeRequest:(NSURLRequest *)request
                success:(void (^)(id responseObject))successBlock
                failure:(void (^)(NSError *error))failureBlock;
 
+/**
+ *  Executes a request whose successful JSON response is decoded through `projection`, keeping only the values it
+ * projects. Error responses are decoded in full.
+ */
+- (void)executeRequest:(NSURLRequest *)request
+            projection:(nullable CIOJSONProjection *)projection
+               success:(void (^)(id responseObject))successBlock
+               failure:(void (^)(NSError *error))failureBlock;
+
 /**
  *  Execute a request against the Context.IO API and save the body of the response to a file on disk. Typically used for
- * saving attachments or raw message content.
+ * saving attachments or raw message content. Responses sent with a base64 or quoted-printable
+ * `Content-Transfer-Encoding` header are decoded as they are saved.
  *
  *  @param request       request to execute
  *  @param fileURL       `URL` on disk to save the destination file to. An error will be returned if a file already
@@ -50,12 +78,67 @@ typedef void (^CIOSessionDownloadProgressBlock)(int64_t bytesRead, int64_t total
                 failure:(nullable void (^)(NSError *error))failureBlock
                progress:(nullable CIOSessionDownloadProgressBlock)progressBlock;
 
+#pragma mark - Connections
+
+/**
+ *  Opens connections to the host of `URL` ahead of use, so the first requests don't pay for DNS, TCP and TLS setup.
+ * Sends `count` concurrent `HEAD` requests, each of which may open a connection, up to the configuration's
+ * `HTTPMaximumConnectionsPerHost`. One is enough for an HTTP/2 server.
+ *
+ *  @param completion called on the main queue once all requests finished, with the first transport error if any. Any
+ * HTTP response counts as success.
+ */
+- (void)prewarmConnectionsToURL:(NSURL *)URL
+                          count:(NSUInteger)count
+                     completion:(nullable void (^)(NSError *__nullable error))completion;
+
+/**
+ *  When nonzero, a `HEAD` request is sent to each recently used host which has seen no request for this long, so its
+ * connections are not dropped as idle between bursts of requests. Pick it below the server's idle timeout. Defaults to
+ * `0`, no heartbeats. The heartbeat timer only runs while some host is kept alive, see `keepAliveDuration`. Hosts are
+ * only tracked while it is nonzero, so requests sent before heartbeats were turned on don't keep their hosts alive.
+ */
+@property (nonatomic) NSTimeInterval heartbeatInterval;
+
+/**
+ *  How long after its last request or prewarm heartbeats keep a host's connections open. Heartbeats themselves don't
+ * extend it, so an app which stopped making requests also stops using the network. Defaults to 5 minutes.
+ */
+@property (nonatomic) NSTimeInterval keepAliveDuration;
+
+#pragma mark - Statistics
+
+/**
+ *  Number of requests, excluding prewarms and heartbeats, whose connection the system reported on. Connection metrics
+ * are only reported from iOS 10 and OS X 10.12; on earlier systems this and the other statistics below, except
+ * `heartbeatCount`, stay `0`.
+ */
+@property (readonly, nonatomic) NSUInteger requestCount;
+
+/**
+ *  Number of those requests sent over a connection opened earlier. Always `0` before iOS 10 and OS X 10.12.
+ */
+@property (readonly, nonatomic) NSUInteger reusedConnectionCount;
+
+/**
+ *  `reusedConnectionCount` divided by `requestCount`, or `0` before any request. Always `0` before iOS 10 and OS X
+ * 10.12.
+ */
+@property (readonly, nonatomic) double connectionReuseRate;
+
+@property (readonly, nonatomic) NSUInteger heartbeatCount;
+
 #pragma mark -
 
 - (NSError *)errorForResponse:(NSHTTPURLResponse *)response responseObject:(nullable id)responseObject;
 
 - (nullable id)parseResponse:(NSURLResponse *)response data:(NSData *)data error:(NSError **)error;
 
+- (nullable id)parseResponse:(NSURLResponse *)response
+                        data:(NSData *)data
+                  projection:(nullable CIOJSONProjection *)projection
+                       error:(NSError **)error;
+
 @end
 
 NS_ASSUME_NONNULL_END
@@ -7,9 +7,24 @@
 //
 
 #import "CIOAPISession.h"
+#import "CIOTransferDecoder.h"
+#import "CIOJSONProjection.h"
 
 NSString *const CIOAPISessionURLResponseErrorKey = @"io.context.error.response";
 
+// Description of prewarm and heartbeat tasks, which are left out of the statistics
+static NSString *const kCIOMaintenanceTaskDescription = @"io.context.session.maintenance";
+
+// The root URL of the host `URL` points to, which its connections are shared by
+static NSURL *CIOOriginURL(NSURL *URL) {
+    NSURLComponents *components = [NSURLComponents new];
+    components.scheme = URL.scheme;
+    components.host = URL.host;
+    components.port = URL.port;
+    components.path = @"/";
+    return components.URL;
+}
+
 @interface CIODownloadTask : NSObject
 
 @property (nullable, nonatomic) NSURL *saveToURL;
@@ -31,28 +46,52 @@ NSString *const CIOAPISessionURLResponseErrorKey = @"io.context.error.response";
 @property (nonatomic) NSIndexSet *acceptableStatusCodes;
 // Mapping from Task ID to CIODownloadTask. Must only be read/written on the underlying NSURLSession queue.
 @property (nonatomic) NSMutableDictionary *downloadTaskIDToCIOTask;
+// Origin URL -> NSDate of its last request or prewarm, and of its last request of any kind including heartbeats. Like
+// the heartbeat timer and statistics, guarded by @synchronized(self).
+@property (nonatomic) NSMutableDictionary *lastUseDates;
+@property (nonatomic) NSMutableDictionary *lastTrafficDates;
+@property (nullable, nonatomic) dispatch_source_t heartbeatTimer;
+@property (readwrite, nonatomic) NSUInteger requestCount;
+@property (readwrite, nonatomic) NSUInteger reusedConnectionCount;
+@property (readwrite, nonatomic) NSUInteger heartbeatCount;
 
 @end
 
 @implementation CIOAPISession
 
 - (instancetype)init {
+    return [self initWithConfiguration:[NSURLSessionConfiguration defaultSessionConfiguration]];
+}
+
+- (instancetype)initWithConfiguration:(NSURLSessionConfiguration *)configuration {
     if ((self = [super init])) {
-        self.urlSession = [NSURLSession sessionWithConfiguration:[NSURLSessionConfiguration defaultSessionConfiguration]
-                                                        delegate:self
-                                                   delegateQueue:nil];
+        self.urlSession = [NSURLSession sessionWithConfiguration:configuration delegate:self delegateQueue:nil];
         // Hat tip to AFNetworking
         self.acceptableStatusCodes = [NSIndexSet indexSetWithIndexesInRange:NSMakeRange(200, 100)];
         self.downloadTaskIDToCIOTask = [NSMutableDictionary dictionary];
+        self.lastUseDates = [NSMutableDictionary dictionary];
+        self.lastTrafficDates = [NSMutableDictionary dictionary];
+        _keepAliveDuration = 5 * 60;
     }
     return self;
 }
 
+- (void)dealloc {
+    if (_heartbeatTimer) {
+        dispatch_source_cancel(_heartbeatTimer);
+    }
+}
+
+- (NSURLSessionConfiguration *)configuration {
+    return self.urlSession.configuration;
+}
+
 - (void)downloadRequest:(NSURLRequest *)request
               toFileURL:(NSURL *)saveToURL
                 success:(void (^)())successBlock
                 failure:(void (^)(NSError *))failureBlock
                progress:(void (^)(int64_t, int64_t, int64_t))progressBlock {
+    [self _recordUseOfURL:request.URL];
     NSURLSessionDownloadTask *downloadTask = [self.urlSession downloadTaskWithRequest:request];
     CIODownloadTask *cioTask = [CIODownloadTask new];
     cioTask.saveToURL = saveToURL;
@@ -98,12 +137,41 @@ NSString *const CIOAPISessionURLResponseErrorKey = @"io.context.error.response";
                         userInfo:@{NSLocalizedDescriptionKey: errorString, CIOAPISessionURLResponseErrorKey: response}];
 }
 
+- (CIOTransferEncoding)transferEncodingForResponse:(NSURLResponse *)response {
+    if (![response isKindOfClass:[NSHTTPURLResponse class]]) {
+        return CIOTransferEncodingIdentity;
+    }
+    NSDictionary *headers = [(NSHTTPURLResponse *)response allHeaderFields];
+    for (NSString *name in headers) {
+        if ([name caseInsensitiveCompare:@"Content-Transfer-Encoding"] == NSOrderedSame) {
+            return [CIOTransferDecoder encodingForName:headers[name]];
+        }
+    }
+    return CIOTransferEncodingIdentity;
+}
+
 - (id)parseResponse:(NSURLResponse *)response data:(NSData *)data error:(NSError **)error {
+    return [self parseResponse:response data:data projection:nil error:error];
+}
+
+- (id)parseResponse:(NSURLResponse *)response
+               data:(NSData *)data
+         projection:(CIOJSONProjection *)projection
+              error:(NSError **)error {
+    if ([response isKindOfClass:[NSHTTPURLResponse class]] &&
+        ![self.acceptableStatusCodes containsIndex:(NSUInteger)[(NSHTTPURLResponse *)response statusCode]]) {
+        // Error descriptions are read from keys the projection may not keep
+        projection = nil;
+    }
     id responseObject = nil;
     if (data && [data length] > 0) {
         if ([[response MIMEType] isEqualToString:@"application/json"]) {
             NSError *jsonError;
-            responseObject = [NSJSONSerialization JSONObjectWithData:data options:0 error:&jsonError];
+            if (projection) {
+                responseObject = [projection objectWithData:data error:&jsonError];
+            } else {
+                responseObject = [NSJSONSerialization JSONObjectWithData:data options:0 error:&jsonError];
+            }
             if (jsonError) {
                 *error = jsonError;
                 return nil;
@@ -132,6 +200,14 @@ NSString *const CIOAPISessionURLResponseErrorKey = @"io.context.error.response";
 - (void)executeRequest:(NSURLRequest *)request
                success:(void (^)(id responseObject))successBlock
                failure:(void (^)(NSError *error))failureBlock {
+    [self executeRequest:request projection:nil success:successBlock failure:failureBlock];
+}
+
+- (void)executeRequest:(NSURLRequest *)request
+            projection:(CIOJSONProjection *)projection
+               success:(void (^)(id responseObject))successBlock
+               failure:(void (^)(NSError *error))failureBlock {
+    [self _recordUseOfURL:request.URL];
     NSURLSessionDataTask *dataTask =
     [self.urlSession dataTaskWithRequest:request
                        completionHandler:^(NSData *data, NSURLResponse *response, NSError *error) {
@@ -139,7 +215,8 @@ NSString *const CIOAPISessionURLResponseErrorKey = @"io.context.error.response";
                                [self _dispatchMain:failureBlock parameter:error];
                                return;
                            }
-                           id responseObject = [self parseResponse:response data:data error:&error];
+                           id responseObject =
+                               [self parseResponse:response data:data projection:projection error:&error];
                            if (error) {
                                [self _dispatchMain:failureBlock parameter:error];
                                return;
@@ -149,8 +226,164 @@ NSString *const CIOAPISessionURLResponseErrorKey = @"io.context.error.response";
     [dataTask resume];
 }
 
+#pragma mark - Connections
+
+- (void)_recordUseOfURL:(NSURL *)URL {
+    // Uses are only tracked for heartbeats; an unsynchronized read at worst records one use too many or too few
+    if (_heartbeatInterval <= 0) {
+        return;
+    }
+    NSURL *origin = CIOOriginURL(URL);
+    if (!origin) {
+        return;
+    }
+    NSDate *now = [NSDate date];
+    @synchronized(self) {
+        self.lastUseDates[origin] = now;
+        self.lastTrafficDates[origin] = now;
+        [self _startHeartbeatTimer];
+    }
+}
+
+- (void)prewarmConnectionsToURL:(NSURL *)URL
+                          count:(NSUInteger)count
+                     completion:(void (^)(NSError *))completion {
+    [self _recordUseOfURL:URL];
+    NSMutableURLRequest *request = [NSMutableURLRequest requestWithURL:URL];
+    request.HTTPMethod = @"HEAD";
+    dispatch_group_t group = dispatch_group_create();
+    __block NSError *firstError = nil;
+    for (NSUInteger i = 0; i < MAX(count, 1u); i++) {
+        dispatch_group_enter(group);
+        NSURLSessionDataTask *task =
+            [self.urlSession dataTaskWithRequest:request
+                               completionHandler:^(NSData *data, NSURLResponse *response, NSError *error) {
+                                 @synchronized(self) {
+                                     if (error && !firstError) {
+                                         firstError = error;
+                                     }
+                                 }
+                                 dispatch_group_leave(group);
+                               }];
+        task.taskDescription = kCIOMaintenanceTaskDescription;
+        [task resume];
+    }
+    dispatch_group_notify(group, dispatch_get_main_queue(), ^{
+      if (completion) {
+          completion(firstError);
+      }
+    });
+}
+
+- (void)setHeartbeatInterval:(NSTimeInterval)heartbeatInterval {
+    @synchronized(self) {
+        _heartbeatInterval = heartbeatInterval;
+        [self _stopHeartbeatTimer];
+        if (self.lastUseDates.count > 0) {
+            [self _startHeartbeatTimer];
+        }
+    }
+}
+
+// Runs the heartbeat timer while heartbeats are on and a host is kept alive. Must be called within @synchronized(self).
+- (void)_startHeartbeatTimer {
+    NSTimeInterval heartbeatInterval = self.heartbeatInterval;
+    if (self.heartbeatTimer || heartbeatInterval <= 0) {
+        return;
+    }
+    // Checking twice per interval keeps the gap between two requests to a host under the interval. The generous
+    // leeway lets the system coalesce the wakeups with others.
+    uint64_t period = (uint64_t)(heartbeatInterval / 2 * NSEC_PER_SEC);
+    dispatch_source_t timer = dispatch_source_create(DISPATCH_SOURCE_TYPE_TIMER, 0, 0,
+                                                     dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_BACKGROUND, 0));
+    dispatch_source_set_timer(timer, dispatch_time(DISPATCH_TIME_NOW, (int64_t)period), period, period / 4);
+    __weak CIOAPISession *weakSelf = self;
+    dispatch_source_set_event_handler(timer, ^{
+      [weakSelf _sendHeartbeats];
+    });
+    dispatch_resume(timer);
+    self.heartbeatTimer = timer;
+}
+
+// Must be called within @synchronized(self)
+- (void)_stopHeartbeatTimer {
+    if (self.heartbeatTimer) {
+        dispatch_source_cancel(self.heartbeatTimer);
+        self.heartbeatTimer = nil;
+    }
+}
+
+- (void)_sendHeartbeats {
+    NSMutableArray *origins = [NSMutableArray array];
+    NSDate *now = [NSDate date];
+    NSTimeInterval timeout = 0;
+    @synchronized(self) {
+        for (NSURL *origin in self.lastUseDates.allKeys) {
+            if ([now timeIntervalSinceDate:self.lastUseDates[origin]] >= self.keepAliveDuration) {
+                [self.lastUseDates removeObjectForKey:origin];
+                [self.lastTrafficDates removeObjectForKey:origin];
+            } else if ([now timeIntervalSinceDate:self.lastTrafficDates[origin]] >= self.heartbeatInterval / 2) {
+                self.lastTrafficDates[origin] = now;
+                [origins addObject:origin];
+            }
+        }
+        self.heartbeatCount += origins.count;
+        timeout = self.heartbeatInterval;
+        if (self.lastUseDates.count == 0) {
+            // No host is kept alive any more; the next request starts the timer again
+            [self _stopHeartbeatTimer];
+        }
+    }
+    for (NSURL *origin in origins) {
+        NSMutableURLRequest *request = [NSMutableURLRequest requestWithURL:origin];
+        request.HTTPMethod = @"HEAD";
+        request.timeoutInterval = timeout;
+        NSURLSessionDataTask *task =
+            [self.urlSession dataTaskWithRequest:request
+                               completionHandler:^(NSData *data, NSURLResponse *response, NSError *error){
+                               }];
+        task.taskDescription = kCIOMaintenanceTaskDescription;
+        [task resume];
+    }
+}
+
+#pragma mark - Statistics
+
+- (double)connectionReuseRate {
+    @synchronized(self) {
+        return self.requestCount > 0 ? (double)self.reusedConnectionCount / self.requestCount : 0;
+    }
+}
+
+#pragma mark - NSURLSessionDelegate
+
+- (void)URLSession:(NSURLSession *)session didBecomeInvalidWithError:(NSError *)error {
+    // No more requests or metrics can come through the session
+    @synchronized(self) {
+        [self _stopHeartbeatTimer];
+    }
+}
+
 #pragma mark - NSURLSessionTaskDelegate
 
+- (void)URLSession:(NSURLSession *)session
+                          task:(NSURLSessionTask *)task
+    didFinishCollectingMetrics:(NSURLSessionTaskMetrics *)metrics {
+    if ([task.taskDescription isEqualToString:kCIOMaintenanceTaskDescription]) {
+        return;
+    }
+    NSURLSessionTaskTransactionMetrics *transaction = metrics.transactionMetrics.lastObject;
+    if (transaction.resourceFetchType != NSURLSessionTaskMetricsResourceFetchTypeNetworkLoad) {
+        return;
+    }
+    @synchronized(self) {
+        self.requestCount++;
+        if (transaction.isReusedConnection) {
+            self.reusedConnectionCount++;
+        }
+    }
+}
+
 - (void)URLSession:(NSURLSession *)session task:(NSURLSessionTask *)task didCompleteWithError:(NSError *)error {
     CIODownloadTask *cioTask = self.downloadTaskIDToCIOTask[@(task.taskIdentifier)];
     if (cioTask) {
@@ -182,9 +415,24 @@ NSString *const CIOAPISessionURLResponseErrorKey = @"io.context.error.response";
                  downloadTask:(NSURLSessionDownloadTask *)downloadTask
     didFinishDownloadingToURL:(NSURL *)location {
     CIODownloadTask *cioTask = self.downloadTaskIDToCIOTask[@(downloadTask.taskIdentifier)];
+    if ([downloadTask.response isKindOfClass:[NSHTTPURLResponse class]]) {
+        NSHTTPURLResponse *response = (NSHTTPURLResponse *)downloadTask.response;
+        if (![self.acceptableStatusCodes containsIndex:(NSUInteger)response.statusCode]) {
+            // Don't save an error page as the requested file
+            [self _dispatchMain:cioTask.failureBlock parameter:[self errorForResponse:response responseObject:nil]];
+            [self.downloadTaskIDToCIOTask removeObjectForKey:@(downloadTask.taskIdentifier)];
+            return;
+        }
+    }
     if (cioTask.saveToURL) {
         NSError *error = nil;
-        [[NSFileManager defaultManager] moveItemAtURL:location toURL:cioTask.saveToURL error:&error];
+        CIOTransferEncoding encoding = [self transferEncodingForResponse:downloadTask.response];
+        if (encoding == CIOTransferEncodingIdentity) {
+            [[NSFileManager defaultManager] moveItemAtURL:location toURL:cioTask.saveToURL error:&error];
+        } else {
+            // Attachment bodies served still transfer-encoded are decoded on the way to disk
+            [CIOTransferDecoder decodeFileAtURL:location toFileURL:cioTask.saveToURL encoding:encoding error:&error];
+        }
         if (error) {
             [self _dispatchMain:cioTask.failureBlock parameter:error];
             [self.downloadTaskIDToCIOTask removeObjectForKey:@(downloadTask.taskIdentifier)];
@@ -0,0 +1,120 @@
+//
+//  CIOAttachmentStore.h
+//  CIOAPIClient
+//
+//  Copyright © 2015 Context.io. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+
+NS_ASSUME_NONNULL_BEGIN
+
+/**
+ `CIOAttachmentStore` is a local, content-addressed cache of downloaded files and attachments.
+
+ Each file is stored once under the SHA-256 hash of its contents, and any number of keys (usually the API path of a
+ file or attachment, see `-[CIORequest contentKey]`) point at it. The same attachment received in many messages, or
+ listed again by `getRevisionsForFileWithID:` and `getRelatedForFileWithID:`, is therefore only downloaded once per key
+ and only stored once on disk.
+
+ Files are handed out as copies, which cost no disk space on file systems supporting clones such as APFS, so writing
+ to them leaves the stored contents intact. When the store grows past `byteBudget` the least recently used
+ contents are evicted. Hits only update access times and statistics, whose saving to disk is delayed by a few
+ seconds so that bursts of hits share one save; pending changes are also saved when the store is deallocated.
+
+ All methods are thread safe, but may block on disk I/O so should not be called on the main thread.
+ */
+@interface CIOAttachmentStore : NSObject
+
+/**
+ *  Opens, or creates, a store in `directoryURL`.
+ *
+ *  @param directoryURL directory owned by the store, created if needed
+ *  @param byteBudget   size the store is trimmed back to after adding new contents
+ */
+- (instancetype)initWithDirectoryURL:(NSURL *)directoryURL byteBudget:(unsigned long long)byteBudget NS_DESIGNATED_INITIALIZER;
+
+- (instancetype)init NS_UNAVAILABLE;
+
+@property (readonly, nonatomic) NSURL *directoryURL;
+
+@property (nonatomic) unsigned long long byteBudget;
+
+/**
+ *  Whether files are cloned with `clonefile(2)` where the file system and OS support it, rather than always copied
+ * out of the store. Clones are copy-on-write, so either way the files handed out are independent of the store.
+ * Defaults to `YES`.
+ */
+@property (nonatomic) BOOL clonesFiles;
+
+/**
+ *  Whether contents are stored for `key`.
+ */
+- (BOOL)containsContentForKey:(NSString *)key;
+
+/**
+ *  SHA-256 of the contents stored for `key` as a lower-case hex string, or `nil`.
+ */
+- (nullable NSString *)contentHashForKey:(NSString *)key;
+
+/**
+ *  Places the contents stored for `key` at `fileURL`, marking them as recently used.
+ *
+ *  @param fileURL `URL` on disk to write to. An error will be returned if a file already exists at this path.
+ *
+ *  @return `YES` on success, `NO` if nothing is stored for `key` or the file could not be written
+ */
+- (BOOL)writeContentForKey:(NSString *)key toFileURL:(NSURL *)fileURL error:(NSError **)error;
+
+/**
+ *  Places the contents with SHA-256 `hash`, as returned by `storeFileAtURL:forKey:error:`, at `fileURL`. Unlike
+ * `writeContentForKey:toFileURL:error:` this is not counted as a hit.
+ */
+- (BOOL)writeContentWithHash:(NSString *)hash toFileURL:(NSURL *)fileURL error:(NSError **)error;
+
+/**
+ *  Moves a freshly downloaded file in to the store under `key`. If identical contents are already stored the file is
+ * discarded and `key` points at the existing copy.
+ *
+ *  @return the content hash of the file, or `nil` on failure
+ */
+- (nullable NSString *)storeFileAtURL:(NSURL *)fileURL forKey:(NSString *)key error:(NSError **)error;
+
+/**
+ *  Forgets `key`. Its contents are removed once no other key refers to them.
+ */
+- (void)removeContentForKey:(NSString *)key;
+
+- (void)removeAllContents;
+
+#pragma mark - Statistics
+
+/**
+ *  Number of `writeContentForKey:toFileURL:error:` calls which were served from the store.
+ */
+@property (readonly, nonatomic) NSUInteger hitCount;
+
+/**
+ *  Number of `writeContentForKey:toFileURL:error:` calls for keys with nothing stored.
+ */
+@property (readonly, nonatomic) NSUInteger missCount;
+
+/**
+ *  Bytes on disk used by stored contents.
+ */
+@property (readonly, nonatomic) unsigned long long storedBytes;
+
+/**
+ *  Bytes not downloaded or not stored thanks to the store: the size of every hit, plus the size of every stored file
+ * whose contents were already present.
+ */
+@property (readonly, nonatomic) unsigned long long bytesSaved;
+
+/**
+ *  Total size of the contents of all keys divided by `storedBytes`. `1` when nothing is shared, or the store is empty.
+ */
+@property (readonly, nonatomic) double deduplicationRatio;
+
+@end
+
+NS_ASSUME_NONNULL_END
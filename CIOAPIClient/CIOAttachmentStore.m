@@ -0,0 +1,402 @@
+//
+//  CIOAttachmentStore.m
+//  CIOAPIClient
+//
+//  Copyright © 2015 Context.io. All rights reserved.
+//
+
+#import "CIOAttachmentStore.h"
+
+#import <CommonCrypto/CommonDigest.h>
+#if __has_include(<sys/clonefile.h>)
+#import <sys/clonefile.h>
+#endif
+
+static NSString *const CIOAttachmentStoreErrorDomain = @"io.context.error.store";
+
+static NSString *const kCIOAttachmentStoreIndexName = @"index.plist";
+static NSString *const kCIOAttachmentStoreBlobsName = @"blobs";
+
+// Index plist keys
+static NSString *const kCIOIndexKeysKey = @"keys";
+static NSString *const kCIOIndexBlobsKey = @"blobs";
+static NSString *const kCIOIndexBytesSavedKey = @"bytesSaved";
+static NSString *const kCIOBlobSizeKey = @"size";
+static NSString *const kCIOBlobAccessedKey = @"accessed";
+
+static const NSUInteger kCIOAttachmentStoreHashChunkSize = 256 * 1024;
+
+// Hits only change access dates and statistics, so their index saves are coalesced
+static const NSTimeInterval kCIOAttachmentStoreIndexSaveDelay = 5;
+
+// Whether `sourceURL` could be cloned to `destinationURL`, which needs iOS 10 or OS X 10.12 and a file system with
+// clones on the volume of both
+static BOOL CIOCloneFile(NSURL *sourceURL, NSURL *destinationURL) {
+#if __has_include(<sys/clonefile.h>)
+    if (clonefile != NULL) {
+        return clonefile(sourceURL.fileSystemRepresentation, destinationURL.fileSystemRepresentation, 0) == 0;
+    }
+#endif
+    return NO;
+}
+
+static NSString *CIOSHA256OfFile(NSURL *fileURL, unsigned long long *outSize, NSError **error) {
+    NSInputStream *input = [NSInputStream inputStreamWithURL:fileURL];
+    [input open];
+    CC_SHA256_CTX context;
+    CC_SHA256_Init(&context);
+    NSMutableData *buffer = [NSMutableData dataWithLength:kCIOAttachmentStoreHashChunkSize];
+    unsigned long long size = 0;
+    NSInteger read;
+    while ((read = [input read:buffer.mutableBytes maxLength:buffer.length]) > 0) {
+        CC_SHA256_Update(&context, buffer.bytes, (CC_LONG)read);
+        size += (unsigned long long)read;
+    }
+    NSError *streamError = input.streamError;
+    [input close];
+    if (read < 0) {
+        if (error) {
+            *error = streamError;
+        }
+        return nil;
+    }
+    unsigned char digest[CC_SHA256_DIGEST_LENGTH];
+    CC_SHA256_Final(digest, &context);
+    NSMutableString *hash = [NSMutableString stringWithCapacity:CC_SHA256_DIGEST_LENGTH * 2];
+    for (int i = 0; i < CC_SHA256_DIGEST_LENGTH; i++) {
+        [hash appendFormat:@"%02x", digest[i]];
+    }
+    *outSize = size;
+    return hash;
+}
+
+@interface CIOAttachmentStore () {
+
+    // Guarded by `queue`
+    NSUInteger _hitCount;
+    NSUInteger _missCount;
+    unsigned long long _bytesSaved;
+}
+
+@property (nonatomic) dispatch_queue_t queue;
+@property (nonatomic) NSURL *blobsURL;
+@property (nonatomic) NSURL *indexURL;
+
+// Key -> content hash
+@property (nonatomic) NSMutableDictionary *keys;
+// Content hash -> mutable dictionary of kCIOBlob* values
+@property (nonatomic) NSMutableDictionary *blobs;
+@property (nonatomic) BOOL indexSaveScheduled;
+
+@end
+
+@implementation CIOAttachmentStore
+
+- (instancetype)initWithDirectoryURL:(NSURL *)directoryURL byteBudget:(unsigned long long)byteBudget {
+    if ((self = [super init])) {
+        _directoryURL = directoryURL;
+        _byteBudget = byteBudget;
+        _clonesFiles = YES;
+        _queue = dispatch_queue_create("io.context.attachmentstore", DISPATCH_QUEUE_SERIAL);
+        _blobsURL = [directoryURL URLByAppendingPathComponent:kCIOAttachmentStoreBlobsName isDirectory:YES];
+        _indexURL = [directoryURL URLByAppendingPathComponent:kCIOAttachmentStoreIndexName];
+        [[NSFileManager defaultManager] createDirectoryAtURL:_blobsURL
+                                 withIntermediateDirectories:YES
+                                                  attributes:nil
+                                                       error:nil];
+        [self _loadIndex];
+    }
+    return self;
+}
+
+- (void)dealloc {
+    // Nothing else can be on the queue once the last reference is gone
+    if (_indexSaveScheduled) {
+        [self _saveIndex];
+    }
+}
+
+- (NSURL *)_URLForHash:(NSString *)hash {
+    return [self.blobsURL URLByAppendingPathComponent:hash];
+}
+
+#pragma mark - Index
+
+- (void)_loadIndex {
+    self.keys = [NSMutableDictionary dictionary];
+    self.blobs = [NSMutableDictionary dictionary];
+    NSData *data = [NSData dataWithContentsOfURL:self.indexURL];
+    if (!data) {
+        return;
+    }
+    NSDictionary *index = [NSPropertyListSerialization propertyListWithData:data
+                                                                    options:NSPropertyListMutableContainers
+                                                                     format:NULL
+                                                                      error:nil];
+    if (![index isKindOfClass:[NSDictionary class]]) {
+        return;
+    }
+    NSFileManager *fileManager = [NSFileManager defaultManager];
+    [index[kCIOIndexBlobsKey] enumerateKeysAndObjectsUsingBlock:^(NSString *hash, NSMutableDictionary *blob, BOOL *stop) {
+      // Contents removed from disk behind our back are dropped, along with the keys pointing at them
+      if ([fileManager fileExistsAtPath:[self _URLForHash:hash].path]) {
+          self.blobs[hash] = blob;
+      }
+    }];
+    [index[kCIOIndexKeysKey] enumerateKeysAndObjectsUsingBlock:^(NSString *key, NSString *hash, BOOL *stop) {
+      if (self.blobs[hash]) {
+          self.keys[key] = hash;
+      }
+    }];
+    _bytesSaved = [index[kCIOIndexBytesSavedKey] unsignedLongLongValue];
+}
+
+- (void)_saveIndex {
+    NSDictionary *index = @{
+        kCIOIndexKeysKey: self.keys,
+        kCIOIndexBlobsKey: self.blobs,
+        kCIOIndexBytesSavedKey: @(_bytesSaved)
+    };
+    self.indexSaveScheduled = NO;
+    NSData *data = [NSPropertyListSerialization dataWithPropertyList:index
+                                                              format:NSPropertyListBinaryFormat_v1_0
+                                                             options:0
+                                                               error:nil];
+    [data writeToURL:self.indexURL atomically:YES];
+}
+
+// Saves the index a little later, along with any other changes made meanwhile. Must be called on `queue`.
+- (void)_setNeedsSaveIndex {
+    if (self.indexSaveScheduled) {
+        return;
+    }
+    self.indexSaveScheduled = YES;
+    __weak CIOAttachmentStore *weakSelf = self;
+    dispatch_time_t when = dispatch_time(DISPATCH_TIME_NOW, (int64_t)(kCIOAttachmentStoreIndexSaveDelay * NSEC_PER_SEC));
+    dispatch_after(when, self.queue, ^{
+      CIOAttachmentStore *store = weakSelf;
+      if (store.indexSaveScheduled) {
+          [store _saveIndex];
+      }
+    });
+}
+
+- (void)_touchHash:(NSString *)hash {
+    self.blobs[hash][kCIOBlobAccessedKey] = [NSDate date];
+}
+
+- (void)_removeBlobWithHash:(NSString *)hash {
+    [self.blobs removeObjectForKey:hash];
+    for (NSString *key in [self.keys allKeysForObject:hash]) {
+        [self.keys removeObjectForKey:key];
+    }
+    [[NSFileManager defaultManager] removeItemAtURL:[self _URLForHash:hash] error:nil];
+}
+
+- (unsigned long long)_storedBytes {
+    unsigned long long total = 0;
+    for (NSDictionary *blob in self.blobs.allValues) {
+        total += [blob[kCIOBlobSizeKey] unsignedLongLongValue];
+    }
+    return total;
+}
+
+// Evicts least recently used contents until the store fits its budget, keeping `keptHash` regardless
+- (void)_trimToBudgetKeeping:(NSString *)keptHash {
+    unsigned long long stored = [self _storedBytes];
+    if (stored <= self.byteBudget) {
+        return;
+    }
+    NSArray *hashes = [self.blobs keysSortedByValueUsingComparator:^NSComparisonResult(NSDictionary *a, NSDictionary *b) {
+      return [a[kCIOBlobAccessedKey] compare:b[kCIOBlobAccessedKey]];
+    }];
+    for (NSString *hash in hashes) {
+        if (stored <= self.byteBudget) {
+            break;
+        }
+        if ([hash isEqualToString:keptHash]) {
+            continue;
+        }
+        stored -= [self.blobs[hash][kCIOBlobSizeKey] unsignedLongLongValue];
+        [self _removeBlobWithHash:hash];
+    }
+}
+
+#pragma mark - Contents
+
+- (BOOL)containsContentForKey:(NSString *)key {
+    return [self contentHashForKey:key] != nil;
+}
+
+- (NSString *)contentHashForKey:(NSString *)key {
+    __block NSString *hash = nil;
+    dispatch_sync(self.queue, ^{
+      hash = self.keys[key];
+    });
+    return hash;
+}
+
+- (BOOL)writeContentForKey:(NSString *)key toFileURL:(NSURL *)fileURL error:(NSError **)error {
+    __block NSURL *blobURL = nil;
+    dispatch_sync(self.queue, ^{
+      NSString *hash = self.keys[key];
+      if (hash) {
+          blobURL = [self _URLForHash:hash];
+          [self _touchHash:hash];
+          _hitCount++;
+          _bytesSaved += [self.blobs[hash][kCIOBlobSizeKey] unsignedLongLongValue];
+          [self _setNeedsSaveIndex];
+      } else {
+          _missCount++;
+      }
+    });
+    if (!blobURL) {
+        if (error) {
+            *error = [NSError errorWithDomain:CIOAttachmentStoreErrorDomain
+                                         code:NSURLErrorResourceUnavailable
+                                     userInfo:@{NSLocalizedDescriptionKey: @"No stored content for key"}];
+        }
+        return NO;
+    }
+    return [self _placeBlobAtURL:blobURL toFileURL:fileURL error:error];
+}
+
+- (BOOL)writeContentWithHash:(NSString *)hash toFileURL:(NSURL *)fileURL error:(NSError **)error {
+    __block NSURL *blobURL = nil;
+    dispatch_sync(self.queue, ^{
+      if (self.blobs[hash]) {
+          blobURL = [self _URLForHash:hash];
+          [self _touchHash:hash];
+      }
+    });
+    if (!blobURL) {
+        if (error) {
+            *error = [NSError errorWithDomain:CIOAttachmentStoreErrorDomain
+                                         code:NSURLErrorResourceUnavailable
+                                     userInfo:@{NSLocalizedDescriptionKey: @"No stored content with hash"}];
+        }
+        return NO;
+    }
+    return [self _placeBlobAtURL:blobURL toFileURL:fileURL error:error];
+}
+
+- (BOOL)_placeBlobAtURL:(NSURL *)blobURL toFileURL:(NSURL *)fileURL error:(NSError **)error {
+    NSFileManager *fileManager = [NSFileManager defaultManager];
+    if (self.clonesFiles && CIOCloneFile(blobURL, fileURL)) {
+        return YES;
+    }
+    // Copying also reports an existing destination for us
+    return [fileManager copyItemAtURL:blobURL toURL:fileURL error:error];
+}
+
+- (NSString *)storeFileAtURL:(NSURL *)fileURL forKey:(NSString *)key error:(NSError **)error {
+    // Hash outside the queue so large files don't hold up other callers
+    unsigned long long size = 0;
+    NSString *hash = CIOSHA256OfFile(fileURL, &size, error);
+    if (!hash) {
+        return nil;
+    }
+    __block BOOL stored = YES;
+    __block NSError *moveError = nil;
+    dispatch_sync(self.queue, ^{
+      NSFileManager *fileManager = [NSFileManager defaultManager];
+      if (self.blobs[hash]) {
+          _bytesSaved += size;
+          [fileManager removeItemAtURL:fileURL error:nil];
+      } else if ([fileManager moveItemAtURL:fileURL toURL:[self _URLForHash:hash] error:&moveError]) {
+          self.blobs[hash] = [@{kCIOBlobSizeKey: @(size)} mutableCopy];
+      } else {
+          stored = NO;
+          return;
+      }
+      NSString *previousHash = self.keys[key];
+      self.keys[key] = hash;
+      if (previousHash && ![previousHash isEqualToString:hash] && [self.keys allKeysForObject:previousHash].count == 0) {
+          [self _removeBlobWithHash:previousHash];
+      }
+      [self _touchHash:hash];
+      [self _trimToBudgetKeeping:hash];
+      [self _saveIndex];
+    });
+    if (!stored) {
+        if (error) {
+            *error = moveError;
+        }
+        return nil;
+    }
+    return hash;
+}
+
+- (void)removeContentForKey:(NSString *)key {
+    dispatch_sync(self.queue, ^{
+      NSString *hash = self.keys[key];
+      if (!hash) {
+          return;
+      }
+      [self.keys removeObjectForKey:key];
+      if ([self.keys allKeysForObject:hash].count == 0) {
+          [self _removeBlobWithHash:hash];
+      }
+      [self _saveIndex];
+    });
+}
+
+- (void)removeAllContents {
+    dispatch_sync(self.queue, ^{
+      for (NSString *hash in self.blobs.allKeys) {
+          [self _removeBlobWithHash:hash];
+      }
+      [self _saveIndex];
+    });
+}
+
+#pragma mark - Statistics
+
+- (NSUInteger)hitCount {
+    __block NSUInteger count = 0;
+    dispatch_sync(self.queue, ^{
+      count = self->_hitCount;
+    });
+    return count;
+}
+
+- (NSUInteger)missCount {
+    __block NSUInteger count = 0;
+    dispatch_sync(self.queue, ^{
+      count = self->_missCount;
+    });
+    return count;
+}
+
+- (unsigned long long)bytesSaved {
+    __block unsigned long long bytes = 0;
+    dispatch_sync(self.queue, ^{
+      bytes = self->_bytesSaved;
+    });
+    return bytes;
+}
+
+- (unsigned long long)storedBytes {
+    __block unsigned long long stored = 0;
+    dispatch_sync(self.queue, ^{
+      stored = [self _storedBytes];
+    });
+    return stored;
+}
+
+- (double)deduplicationRatio {
+    __block double ratio = 1;
+    dispatch_sync(self.queue, ^{
+      unsigned long long stored = [self _storedBytes];
+      unsigned long long logical = 0;
+      for (NSString *hash in self.keys.allValues) {
+          logical += [self.blobs[hash][kCIOBlobSizeKey] unsignedLongLongValue];
+      }
+      if (stored > 0) {
+          ratio = (double)logical / stored;
+      }
+    });
+    return ratio;
+}
+
+@end
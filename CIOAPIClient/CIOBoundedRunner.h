@@ -0,0 +1,51 @@
+//
+//  CIOBoundedRunner.h
+//  CIOAPIClient
+//
+//  Copyright © 2015 Context.io. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+
+NS_ASSUME_NONNULL_BEGIN
+
+/**
+ *  Starts an operation, calling `finish` once when it is done, possibly before returning. Returns `NO` when no operation
+ * can be started right now.
+ */
+typedef BOOL (^CIOBoundedRunnerStartBlock)(void (^finish)(void));
+
+/**
+ `CIOBoundedRunner` keeps up to `maximumConcurrentOperations` asynchronous operations running, such as the requests of a
+ bulk update. The operations are pulled from `startBlock` whenever a slot is free, so callers can decide what to start
+ at the last moment, e.g. to merge queued changes or to hold back work which must not overlap.
+
+ Internal to the library. A runner must be used from a single queue, normally the main one. It keeps its blocks, but
+ not itself, alive: operations in flight retain the runner until they finish.
+ */
+@interface CIOBoundedRunner : NSObject
+
+- (instancetype)initWithStartBlock:(CIOBoundedRunnerStartBlock)startBlock NS_DESIGNATED_INITIALIZER;
+
+- (instancetype)init NS_UNAVAILABLE;
+
+/**
+ *  Defaults to `4`. `0` is treated as `1`.
+ */
+@property (nonatomic) NSUInteger maximumConcurrentOperations;
+
+@property (readonly, nonatomic) NSUInteger runningCount;
+
+/**
+ *  Called whenever no operation is running and `startBlock` has none to start.
+ */
+@property (nullable, nonatomic, copy) void (^idleBlock)(void);
+
+/**
+ *  Starts operations until every slot is taken or `startBlock` returns `NO`. Finished operations run it again.
+ */
+- (void)run;
+
+@end
+
+NS_ASSUME_NONNULL_END
@@ -0,0 +1,56 @@
+//
+//  CIOBoundedRunner.m
+//  CIOAPIClient
+//
+//  Copyright © 2015 Context.io. All rights reserved.
+//
+
+#import "CIOBoundedRunner.h"
+
+@interface CIOBoundedRunner ()
+
+@property (nonatomic, copy) CIOBoundedRunnerStartBlock startBlock;
+@property (readwrite, nonatomic) NSUInteger runningCount;
+// Set while `run` loops, so operations finishing synchronously leave their slot to the loop instead of recursing
+@property (nonatomic, getter=isRunning) BOOL running;
+
+@end
+
+@implementation CIOBoundedRunner
+
+- (instancetype)initWithStartBlock:(CIOBoundedRunnerStartBlock)startBlock {
+    if ((self = [super init])) {
+        _startBlock = [startBlock copy];
+        _maximumConcurrentOperations = 4;
+    }
+    return self;
+}
+
+- (void)run {
+    if (self.running) {
+        return;
+    }
+    self.running = YES;
+    BOOL exhausted = NO;
+    while (self.runningCount < MAX(self.maximumConcurrentOperations, 1u)) {
+        self.runningCount++;
+        __block BOOL finished = NO;
+        BOOL started = self.startBlock(^{
+          NSAssert(!finished, @"An operation finished twice");
+          finished = YES;
+          self.runningCount--;
+          [self run];
+        });
+        if (!started) {
+            self.runningCount--;
+            exhausted = YES;
+            break;
+        }
+    }
+    self.running = NO;
+    if (exhausted && self.runningCount == 0 && self.idleBlock) {
+        self.idleBlock();
+    }
+}
+
+@end
@@ -0,0 +1,75 @@
+//
+//  CIOBulkFolderUpdate.h
+//  CIOAPIClient
+//
+//  Copyright © 2015 Context.io. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+
+NS_ASSUME_NONNULL_BEGIN
+
+@class CIOV2Client;
+@class CIOMessageThreader;
+
+/**
+ `CIOBulkFolderUpdate` adds many messages and threads to folders, or removes them from folders, in as few requests as
+ possible, e.g. to archive thousands of messages.
+
+ Message ids are deduplicated, and dropped when one of the given threads already covers them. When a threader is set,
+ messages which make up a whole Gmail thread, as far as the threader knows it completely, are updated with a single
+ `updateFoldersForThreadWithID:addToFolder:removeFromFolder:` call. The other messages get
+ `updateFoldersForMessageWithID:addToFolder:removeFromFolder:` calls. As the API adds and removes at most one folder per
+ call, each message or thread gets one call per folder added or removed, with an added and a removed folder sharing a
+ call.
+
+ Requests run `maximumConcurrentRequests` at a time, and a failed request does not stop the others.
+ */
+@interface CIOBulkFolderUpdate : NSObject
+
+/**
+ *  @param threader optional threader used to update whole threads at once
+ */
+- (instancetype)initWithClient:(CIOV2Client *)client
+                      threader:(nullable CIOMessageThreader *)threader NS_DESIGNATED_INITIALIZER;
+
+- (instancetype)init NS_UNAVAILABLE;
+
+@property (readonly, nonatomic) CIOV2Client *client;
+
+@property (nullable, readonly, nonatomic) CIOMessageThreader *threader;
+
+/**
+ *  Defaults to `4`.
+ */
+@property (nonatomic) NSUInteger maximumConcurrentRequests;
+
+/**
+ *  The requests an update is made of, in the order they are sent.
+ *
+ *  @param messageIDs    ids of messages to update
+ *  @param threadIDs     ids of threads to update, `gmail_thread_id` values prefixed with `gm-`
+ *  @param addFolders    folders the messages and threads should appear in
+ *  @param removeFolders folders the messages and threads should be removed from
+ */
+- (NSArray *)requestsForMessagesWithIDs:(NSArray *)messageIDs
+                              threadIDs:(nullable NSArray *)threadIDs
+                             addFolders:(nullable NSArray *)addFolders
+                          removeFolders:(nullable NSArray *)removeFolders;
+
+/**
+ *  Updates the folders of messages and threads, see `requestsForMessagesWithIDs:threadIDs:addFolders:removeFolders:`.
+ *
+ *  @param completion called on the main queue once every request finished, with the errors of the messages and threads
+ * which could not be updated completely, keyed by the ids they were given with. The dictionary is empty when all
+ * succeeded.
+ */
+- (void)updateMessagesWithIDs:(NSArray *)messageIDs
+                    threadIDs:(nullable NSArray *)threadIDs
+                   addFolders:(nullable NSArray *)addFolders
+                removeFolders:(nullable NSArray *)removeFolders
+                   completion:(nullable void (^)(NSDictionary *errors))completion;
+
+@end
+
+NS_ASSUME_NONNULL_END
@@ -0,0 +1,192 @@
+//
+//  CIOBulkFolderUpdate.m
+//  CIOAPIClient
+//
+//  Copyright © 2015 Context.io. All rights reserved.
+//
+
+#import "CIOBulkFolderUpdate.h"
+#import "CIOV2Client.h"
+#import "CIOMessageThreader.h"
+#import "CIOBoundedRunner.h"
+
+// A request of a bulk update, and the ids given to the update which it applies to
+@interface CIOBulkFolderStep : NSObject
+
+@property (nonatomic) CIODictionaryRequest *request;
+@property (nonatomic) NSArray *updatedIDs;
+
+@end
+
+@implementation CIOBulkFolderStep
+
+@end
+
+// The progress of one `updateMessagesWithIDs:...` call
+@interface CIOBulkFolderRun : NSObject
+
+@property (nonatomic) NSArray *steps;
+@property (nonatomic) NSUInteger nextStep;
+@property (nonatomic) NSMutableDictionary *errors;
+@property (nullable, nonatomic, copy) void (^completion)(NSDictionary *errors);
+
+@end
+
+@implementation CIOBulkFolderRun
+
+@end
+
+// The `gmail_thread_id` shared by all messages, or nil
+static NSString *CIOCommonGmailThreadID(NSArray *messages) {
+    NSString *threadID = nil;
+    for (NSDictionary *message in messages) {
+        NSString *messageThreadID = message[@"gmail_thread_id"];
+        if (![messageThreadID isKindOfClass:[NSString class]] || messageThreadID.length == 0 ||
+            (threadID && ![threadID isEqualToString:messageThreadID])) {
+            return nil;
+        }
+        threadID = messageThreadID;
+    }
+    return threadID;
+}
+
+@implementation CIOBulkFolderUpdate
+
+- (instancetype)initWithClient:(CIOV2Client *)client threader:(CIOMessageThreader *)threader {
+    if ((self = [super init])) {
+        _client = client;
+        _threader = threader;
+        _maximumConcurrentRequests = 4;
+    }
+    return self;
+}
+
+#pragma mark - Planning
+
+- (NSArray *)requestsForMessagesWithIDs:(NSArray *)messageIDs
+                              threadIDs:(NSArray *)threadIDs
+                             addFolders:(NSArray *)addFolders
+                          removeFolders:(NSArray *)removeFolders {
+    return [[self _stepsForMessagesWithIDs:messageIDs threadIDs:threadIDs addFolders:addFolders removeFolders:removeFolders]
+        valueForKey:@"request"];
+}
+
+- (NSArray *)_stepsForMessagesWithIDs:(NSArray *)messageIDs
+                            threadIDs:(NSArray *)threadIDs
+                           addFolders:(NSArray *)addFolders
+                        removeFolders:(NSArray *)removeFolders {
+    NSOrderedSet *threads = [NSOrderedSet orderedSetWithArray:threadIDs ?: @[]];
+    NSOrderedSet *messages = [NSOrderedSet orderedSetWithArray:messageIDs];
+
+    // Thread id -> ids given to the update which it covers, in the order threads are updated
+    NSMutableArray *threadTargets = [NSMutableArray array];
+    NSMutableDictionary *threadUpdatedIDs = [NSMutableDictionary dictionary];
+    for (NSString *threadID in threads) {
+        [threadTargets addObject:threadID];
+        threadUpdatedIDs[threadID] = [NSMutableArray arrayWithObject:threadID];
+    }
+    NSMutableArray *messageTargets = [NSMutableArray array];
+    NSMutableSet *covered = [NSMutableSet set];
+    for (NSString *messageID in messages) {
+        if ([covered containsObject:messageID]) {
+            continue;
+        }
+        NSArray *thread = [self.threader messagesInThreadOfMessageWithID:messageID];
+        NSString *gmailThreadID = CIOCommonGmailThreadID(thread);
+        if (gmailThreadID) {
+            NSString *threadID = [@"gm-" stringByAppendingString:gmailThreadID];
+            NSArray *threadMessageIDs = [thread valueForKey:@"message_id"];
+            if ([threads containsObject:threadID]) {
+                [threadUpdatedIDs[threadID] addObject:messageID];
+                [covered addObject:messageID];
+                continue;
+            }
+            if ([[NSSet setWithArray:threadMessageIDs] isSubsetOfSet:messages.set] &&
+                [self.threader isThreadCompleteForMessageWithID:messageID]) {
+                [threadTargets addObject:threadID];
+                threadUpdatedIDs[threadID] = [threadMessageIDs mutableCopy];
+                [covered addObjectsFromArray:threadMessageIDs];
+                continue;
+            }
+        }
+        [messageTargets addObject:messageID];
+    }
+
+    NSMutableArray *steps = [NSMutableArray array];
+    NSUInteger callsPerTarget = MAX(addFolders.count, removeFolders.count);
+    for (NSString *threadID in threadTargets) {
+        for (NSUInteger i = 0; i < callsPerTarget; i++) {
+            CIOBulkFolderStep *step = [CIOBulkFolderStep new];
+            step.request = [self.client updateFoldersForThreadWithID:threadID
+                                                         addToFolder:i < addFolders.count ? addFolders[i] : nil
+                                                    removeFromFolder:i < removeFolders.count ? removeFolders[i] : nil];
+            step.updatedIDs = threadUpdatedIDs[threadID];
+            [steps addObject:step];
+        }
+    }
+    for (NSString *messageID in messageTargets) {
+        for (NSUInteger i = 0; i < callsPerTarget; i++) {
+            CIOBulkFolderStep *step = [CIOBulkFolderStep new];
+            step.request = [self.client updateFoldersForMessageWithID:messageID
+                                                          addToFolder:i < addFolders.count ? addFolders[i] : nil
+                                                     removeFromFolder:i < removeFolders.count ? removeFolders[i] : nil];
+            step.updatedIDs = @[messageID];
+            [steps addObject:step];
+        }
+    }
+    return steps;
+}
+
+#pragma mark - Running
+
+- (void)updateMessagesWithIDs:(NSArray *)messageIDs
+                    threadIDs:(NSArray *)threadIDs
+                   addFolders:(NSArray *)addFolders
+                removeFolders:(NSArray *)removeFolders
+                   completion:(void (^)(NSDictionary *))completion {
+    CIOBulkFolderRun *run = [CIOBulkFolderRun new];
+    run.steps =
+        [self _stepsForMessagesWithIDs:messageIDs threadIDs:threadIDs addFolders:addFolders removeFolders:removeFolders];
+    run.errors = [NSMutableDictionary dictionary];
+    run.completion = completion;
+    if (run.steps.count == 0) {
+        dispatch_async(dispatch_get_main_queue(), ^{
+          if (completion) {
+              completion(run.errors);
+          }
+        });
+        return;
+    }
+    CIOBoundedRunner *runner = [[CIOBoundedRunner alloc] initWithStartBlock:^BOOL(void (^finish)(void)) {
+      return [self _startNextStepOfRun:run finish:finish];
+    }];
+    runner.maximumConcurrentOperations = self.maximumConcurrentRequests;
+    runner.idleBlock = ^{
+      if (run.completion) {
+          run.completion(run.errors);
+      }
+    };
+    dispatch_async(dispatch_get_main_queue(), ^{
+      [runner run];
+    });
+}
+
+- (BOOL)_startNextStepOfRun:(CIOBulkFolderRun *)run finish:(void (^)(void))finish {
+    if (run.nextStep == run.steps.count) {
+        return NO;
+    }
+    CIOBulkFolderStep *step = run.steps[run.nextStep++];
+    [step.request executeWithSuccess:^(NSDictionary *response) {
+      finish();
+    } failure:^(NSError *error) {
+      for (NSString *updatedID in step.updatedIDs) {
+          if (!run.errors[updatedID]) {
+              run.errors[updatedID] = error;
+          }
+      }
+      finish();
+    }];
+    return YES;
+}
+
+@end
@@ -0,0 +1,85 @@
+//
+//  CIOClientPool.h
+//  CIOAPIClient
+//
+//  Copyright © 2015 Context.io. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+
+NS_ASSUME_NONNULL_BEGIN
+
+@class CIOAPIClient;
+@class CIOV2Client;
+@class CIOLiteClient;
+@class CIOAPISession;
+
+/**
+ `CIOClientPool` hands out the clients of many accounts of one API key, all executing their requests in a single
+ `CIOAPISession`. Instead of a session, TLS handshakes and idle connections per account, every account reuses the
+ connections of the shared session, which also multiplexes requests over HTTP/2 where the system supports it.
+
+ Clients are made from credentials the app already holds, so making one does not touch the keychain. The pool keeps
+ each account's client until it is removed. The pool may be used from any thread.
+ */
+@interface CIOClientPool : NSObject
+
+/**
+ *  A pool whose session uses `+defaultSessionConfiguration`.
+ */
+- (instancetype)initWithConsumerKey:(NSString *)consumerKey consumerSecret:(NSString *)consumerSecret;
+
+- (instancetype)initWithConsumerKey:(NSString *)consumerKey
+                     consumerSecret:(NSString *)consumerSecret
+               sessionConfiguration:(NSURLSessionConfiguration *)sessionConfiguration NS_DESIGNATED_INITIALIZER;
+
+- (instancetype)init NS_UNAVAILABLE;
+
+/**
+ *  The default session configuration, allowing `8` connections to the API host instead of the system's default of
+ * `4`, since they are shared by all accounts.
+ */
++ (NSURLSessionConfiguration *)defaultSessionConfiguration;
+
+@property (readonly, nonatomic) NSString *consumerKey;
+
+/**
+ *  The session shared by all clients of the pool.
+ */
+@property (readonly, nonatomic) CIOAPISession *session;
+
+/**
+ *  Number of accounts with a client in the pool.
+ */
+@property (readonly, nonatomic) NSUInteger clientCount;
+
+/**
+ *  The 2.0 API client of an account, made on first use.
+ *
+ *  The credentials are only used when the client is made: to change the credentials of an account, remove its client
+ * first.
+ */
+- (CIOV2Client *)V2ClientWithAccountID:(NSString *)accountID token:(NSString *)token tokenSecret:(NSString *)tokenSecret;
+
+/**
+ *  The Lite API client of a user, made on first use.
+ *
+ *  The credentials are only used when the client is made: to change the credentials of a user, remove its client
+ * first.
+ */
+- (CIOLiteClient *)liteClientWithAccountID:(NSString *)accountID
+                                     token:(NSString *)token
+                               tokenSecret:(NSString *)tokenSecret;
+
+/**
+ *  The client of an account in the pool, or `nil`.
+ */
+- (nullable CIOAPIClient *)clientForAccountID:(NSString *)accountID;
+
+- (void)removeClientForAccountID:(NSString *)accountID;
+
+- (void)removeAllClients;
+
+@end
+
+NS_ASSUME_NONNULL_END
@@ -0,0 +1,118 @@
+//
+//  CIOClientPool.m
+//  CIOAPIClient
+//
+//  Copyright © 2015 Context.io. All rights reserved.
+//
+
+#import "CIOClientPool.h"
+#import "CIOV2Client.h"
+#import "CIOLiteClient.h"
+
+@interface CIOClientPool ()
+
+@property (nonatomic) NSString *consumerSecret;
+@property (nonatomic) dispatch_queue_t queue;
+// account id -> CIOAPIClient. Must only be accessed on `queue`.
+@property (nonatomic) NSMutableDictionary *clients;
+
+@end
+
+@implementation CIOClientPool
+
++ (NSURLSessionConfiguration *)defaultSessionConfiguration {
+    NSURLSessionConfiguration *configuration = [NSURLSessionConfiguration defaultSessionConfiguration];
+    configuration.HTTPMaximumConnectionsPerHost = 8;
+    return configuration;
+}
+
+- (instancetype)initWithConsumerKey:(NSString *)consumerKey consumerSecret:(NSString *)consumerSecret {
+    return [self initWithConsumerKey:consumerKey
+                      consumerSecret:consumerSecret
+                sessionConfiguration:[[self class] defaultSessionConfiguration]];
+}
+
+- (instancetype)initWithConsumerKey:(NSString *)consumerKey
+                     consumerSecret:(NSString *)consumerSecret
+               sessionConfiguration:(NSURLSessionConfiguration *)sessionConfiguration {
+    if ((self = [super init])) {
+        _consumerKey = [consumerKey copy];
+        _consumerSecret = [consumerSecret copy];
+        _session = [[CIOAPISession alloc] initWithConfiguration:sessionConfiguration];
+        _queue = dispatch_queue_create("io.context.clientpool", DISPATCH_QUEUE_SERIAL);
+        _clients = [NSMutableDictionary dictionary];
+    }
+    return self;
+}
+
+- (NSUInteger)clientCount {
+    __block NSUInteger count = 0;
+    dispatch_sync(self.queue, ^{
+      count = self.clients.count;
+    });
+    return count;
+}
+
+- (CIOV2Client *)V2ClientWithAccountID:(NSString *)accountID token:(NSString *)token tokenSecret:(NSString *)tokenSecret {
+    return (CIOV2Client *)[self _clientOfClass:[CIOV2Client class]
+                                     accountID:accountID
+                                       factory:^CIOAPIClient * {
+                                         return [[CIOV2Client alloc] initWithConsumerKey:self.consumerKey
+                                                                          consumerSecret:self.consumerSecret
+                                                                                   token:token
+                                                                             tokenSecret:tokenSecret
+                                                                               accountID:accountID];
+                                       }];
+}
+
+- (CIOLiteClient *)liteClientWithAccountID:(NSString *)accountID
+                                     token:(NSString *)token
+                               tokenSecret:(NSString *)tokenSecret {
+    return (CIOLiteClient *)[self _clientOfClass:[CIOLiteClient class]
+                                       accountID:accountID
+                                         factory:^CIOAPIClient * {
+                                           return [[CIOLiteClient alloc] initWithConsumerKey:self.consumerKey
+                                                                              consumerSecret:self.consumerSecret
+                                                                                       token:token
+                                                                                 tokenSecret:tokenSecret
+                                                                                   accountID:accountID];
+                                         }];
+}
+
+- (CIOAPIClient *)_clientOfClass:(Class)clientClass
+                       accountID:(NSString *)accountID
+                         factory:(CIOAPIClient * (^)(void))factory {
+    NSParameterAssert(accountID);
+    __block CIOAPIClient *client = nil;
+    dispatch_sync(self.queue, ^{
+      client = self.clients[accountID];
+      if (![client isKindOfClass:clientClass]) {
+          client = factory();
+          client.session = self.session;
+          self.clients[accountID] = client;
+      }
+    });
+    return client;
+}
+
+- (CIOAPIClient *)clientForAccountID:(NSString *)accountID {
+    __block CIOAPIClient *client = nil;
+    dispatch_sync(self.queue, ^{
+      client = self.clients[accountID];
+    });
+    return client;
+}
+
+- (void)removeClientForAccountID:(NSString *)accountID {
+    dispatch_sync(self.queue, ^{
+      [self.clients removeObjectForKey:accountID];
+    });
+}
+
+- (void)removeAllClients {
+    dispatch_sync(self.queue, ^{
+      [self.clients removeAllObjects];
+    });
+}
+
+@end
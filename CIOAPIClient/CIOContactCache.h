@@ -0,0 +1,98 @@
+//
+//  CIOContactCache.h
+//  CIOAPIClient
+//
+//  Copyright © 2015 Context.io. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+
+NS_ASSUME_NONNULL_BEGIN
+
+@class CIOV2Client;
+
+/**
+ `CIOContactCache` keeps a local copy of an account's contacts for autocomplete, so lookups are answered from memory
+ in well under a millisecond and never wait on the network.
+
+ Contacts are indexed by every word of their name and email address for prefix matches, and by trigram for matches
+ in the middle of a word. `refreshWithCompletion:` fetches only the contacts active since the last refresh using
+ `active_after`. In between refreshes, messages listed through the client (see
+ `CIOAPIClientDidReceiveResponseNotification`) update contact counts and last seen dates, and add contacts which are
+ not cached yet. They are added on the cache's own queue, so the requests' success blocks don't wait for them.
+
+ Contacts are dictionaries in the shape returned by `getContacts`: `email`, `name`, `count`, `sent_count`,
+ `received_count`, `last_sent` and `last_received`. All methods are thread safe.
+ */
+@interface CIOContactCache : NSObject
+
+/**
+ *  @param client  client whose account's contacts are cached, and whose message listings are followed
+ *  @param fileURL optional file the cache is saved to after each refresh and loaded from when created
+ */
+- (instancetype)initWithClient:(CIOV2Client *)client fileURL:(nullable NSURL *)fileURL NS_DESIGNATED_INITIALIZER;
+
+- (instancetype)init NS_UNAVAILABLE;
+
+@property (readonly, nonatomic, weak) CIOV2Client *client;
+
+@property (nullable, readonly, nonatomic) NSURL *fileURL;
+
+/**
+ *  Email addresses of the account owner. Messages from one of these count as sent to their recipients, any other
+ * message counts as received from its sender. Defaults to none.
+ */
+@property (copy) NSArray *ownerEmailAddresses;
+
+/**
+ *  Number of cached contacts.
+ */
+@property (readonly) NSUInteger count;
+
+/**
+ *  When the last successful refresh started, or `nil` before the first one.
+ */
+@property (nullable, readonly) NSDate *lastRefreshDate;
+
+/**
+ *  Contacts whose name or email address contains `query`, case-insensitively. Contacts with a name or address word
+ * starting with `query` come first; within each group contacts are ordered by `count`, then by when they were last
+ * seen. Queries shorter than three characters only match the start of words.
+ *
+ *  @param limit maximum number of contacts to return, `0` for all
+ */
+- (NSArray *)contactsMatching:(NSString *)query limit:(NSUInteger)limit;
+
+/**
+ *  The cached contact with an email address, matched case-insensitively.
+ */
+- (nullable NSDictionary *)contactWithEmail:(NSString *)email;
+
+/**
+ *  Adds or replaces contacts, e.g. from a `getContacts` response.
+ */
+- (void)addContacts:(NSArray *)contacts;
+
+/**
+ *  Updates counts and last seen dates from messages as returned by the API. Each message is counted once, and only if
+ * it was indexed after the last refresh, as older messages are already included in the counts returned by the API.
+ */
+- (void)addMessages:(NSArray *)messages;
+
+/**
+ *  Fetches contacts active since the last refresh, or all contacts the first time.
+ *
+ *  @param completion called on the main queue with the number of contacts fetched, or an error
+ */
+- (void)refreshWithCompletion:(nullable void (^)(NSUInteger fetchedCount, NSError *__nullable error))completion;
+
+/**
+ *  Writes the cache to `fileURL`.
+ *
+ *  @return `YES` on success, or when there is no `fileURL`
+ */
+- (BOOL)save:(NSError **)error;
+
+@end
+
+NS_ASSUME_NONNULL_END
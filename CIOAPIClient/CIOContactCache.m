@@ -0,0 +1,551 @@
+//
+//  CIOContactCache.m
+//  CIOAPIClient
+//
+//  Copyright © 2015 Context.io. All rights reserved.
+//
+
+#import "CIOContactCache.h"
+#import "CIOV2Client.h"
+
+static const NSInteger kCIOContactCachePageSize = 250;
+
+// Separates the indexed word from the email address in `prefixKeys`, and sorts before any printable character
+static NSString *const kCIOPrefixKeySeparator = @"\u0001";
+
+static NSArray *CIOWords(NSString *string) {
+    NSCharacterSet *separators = [[NSCharacterSet alphanumericCharacterSet] invertedSet];
+    NSMutableArray *words = [NSMutableArray array];
+    for (NSString *word in [string.lowercaseString componentsSeparatedByCharactersInSet:separators]) {
+        if (word.length > 0) {
+            [words addObject:word];
+        }
+    }
+    return words;
+}
+
+static NSSet *CIOTrigrams(NSString *string) {
+    NSMutableSet *trigrams = [NSMutableSet set];
+    for (NSUInteger i = 0; i + 3 <= string.length; i++) {
+        [trigrams addObject:[string substringWithRange:NSMakeRange(i, 3)]];
+    }
+    return trigrams;
+}
+
+static double CIOLastSeen(NSDictionary *contact) {
+    return MAX([contact[@"last_sent"] doubleValue], [contact[@"last_received"] doubleValue]);
+}
+
+static NSComparisonResult CIOComparePrefixKeys(NSString *a, NSString *b) {
+    return [a compare:b options:NSLiteralSearch];
+}
+
+// A copy of an API contact without null values, or nil if it has no email address
+static NSDictionary *CIOCachedContact(NSDictionary *contact) {
+    if (![contact isKindOfClass:[NSDictionary class]] || ![contact[@"email"] isKindOfClass:[NSString class]]) {
+        return nil;
+    }
+    NSMutableDictionary *cached = [NSMutableDictionary dictionary];
+    [contact enumerateKeysAndObjectsUsingBlock:^(id key, id value, BOOL *stop) {
+      if (value != [NSNull null]) {
+          cached[key] = value;
+      }
+    }];
+    return cached;
+}
+
+static NSComparisonResult CIOCompareContacts(NSDictionary *a, NSDictionary *b) {
+    NSInteger countA = [a[@"count"] integerValue];
+    NSInteger countB = [b[@"count"] integerValue];
+    if (countA != countB) {
+        return countA > countB ? NSOrderedAscending : NSOrderedDescending;
+    }
+    double seenA = CIOLastSeen(a);
+    double seenB = CIOLastSeen(b);
+    if (seenA != seenB) {
+        return seenA > seenB ? NSOrderedAscending : NSOrderedDescending;
+    }
+    return [a[@"email"] compare:b[@"email"]];
+}
+
+@interface CIOContactCache ()
+
+@property (nonatomic) dispatch_queue_t queue;
+// Lower-case email -> contact
+@property (nonatomic) NSMutableDictionary *contacts;
+// Lower-case email -> array of keys in `prefixKeys`
+@property (nonatomic) NSMutableDictionary *contactKeys;
+// "word<separator>email" for every word of every contact, sorted
+@property (nonatomic) NSMutableArray *prefixKeys;
+// Trigram -> NSMutableSet of lower-case emails
+@property (nonatomic) NSMutableDictionary *trigrams;
+// message_id -> date_indexed of messages counted since the last refresh
+@property (nonatomic) NSMutableDictionary *countedMessages;
+@property (nullable, readwrite) NSDate *lastRefreshDate;
+
+@property (nonatomic, getter=isRefreshing) BOOL refreshing;
+@property (nonatomic) NSMutableArray *completions;
+
+@end
+
+@implementation CIOContactCache
+
+- (instancetype)initWithClient:(CIOV2Client *)client fileURL:(NSURL *)fileURL {
+    if ((self = [super init])) {
+        _client = client;
+        _fileURL = fileURL;
+        _ownerEmailAddresses = @[];
+        _queue = dispatch_queue_create("io.context.contactcache", DISPATCH_QUEUE_SERIAL);
+        _contacts = [NSMutableDictionary dictionary];
+        _contactKeys = [NSMutableDictionary dictionary];
+        _prefixKeys = [NSMutableArray array];
+        _trigrams = [NSMutableDictionary dictionary];
+        _countedMessages = [NSMutableDictionary dictionary];
+        _completions = [NSMutableArray array];
+        [self _load];
+        [[NSNotificationCenter defaultCenter] addObserver:self
+                                                 selector:@selector(clientDidReceiveResponse:)
+                                                     name:CIOAPIClientDidReceiveResponseNotification
+                                                   object:client];
+    }
+    return self;
+}
+
+- (void)dealloc {
+    [[NSNotificationCenter defaultCenter] removeObserver:self];
+}
+
+// Posted before the request's success block runs, so responses are added on the cache's queue rather than waited for
+- (void)clientDidReceiveResponse:(NSNotification *)notification {
+    CIORequest *request = notification.userInfo[CIOAPIClientRequestKey];
+    id response = notification.userInfo[CIOAPIClientResponseObjectKey];
+    if ([request isKindOfClass:[CIOContactsRequest class]] && [response isKindOfClass:[NSDictionary class]]) {
+        NSArray *contacts = response[@"matches"];
+        if ([contacts isKindOfClass:[NSArray class]]) {
+            dispatch_async(self.queue, ^{
+              [self _addContacts:contacts];
+            });
+        }
+        return;
+    }
+    NSArray *messages = nil;
+    if ([request isKindOfClass:[CIOMessageThreadRequest class]] && [response isKindOfClass:[NSDictionary class]]) {
+        messages = response[@"messages"];
+    } else if ([response isKindOfClass:[NSArray class]]) {
+        // Message listings; other arrays are skipped by `_addMessages:owners:` as they have no addresses
+        messages = response;
+    }
+    if ([messages isKindOfClass:[NSArray class]]) {
+        NSSet *owners = [self _ownerEmailSet];
+        dispatch_async(self.queue, ^{
+          [self _addMessages:messages owners:owners];
+        });
+    }
+}
+
+#pragma mark - Index
+
+- (NSUInteger)_prefixKeyPosition:(NSString *)key {
+    return [self.prefixKeys indexOfObject:key
+                            inSortedRange:NSMakeRange(0, self.prefixKeys.count)
+                                  options:NSBinarySearchingInsertionIndex | NSBinarySearchingFirstEqual
+                          usingComparator:^NSComparisonResult(NSString *a, NSString *b) {
+                            return CIOComparePrefixKeys(a, b);
+                          }];
+}
+
+- (NSArray *)_keysForContact:(NSDictionary *)contact email:(NSString *)email {
+    NSMutableOrderedSet *words = [NSMutableOrderedSet orderedSet];
+    NSString *name = [contact[@"name"] isKindOfClass:[NSString class]] ? [contact[@"name"] lowercaseString] : nil;
+    if (name.length > 0) {
+        // The whole name too, so "john sm" finds "John Smith"
+        [words addObject:name];
+        [words addObjectsFromArray:CIOWords(name)];
+    }
+    [words addObject:email];
+    [words addObjectsFromArray:CIOWords(email)];
+    NSMutableArray *keys = [NSMutableArray arrayWithCapacity:words.count];
+    for (NSString *word in words) {
+        [keys addObject:[NSString stringWithFormat:@"%@%@%@", word, kCIOPrefixKeySeparator, email]];
+    }
+    return keys;
+}
+
+- (NSSet *)_trigramsForContact:(NSDictionary *)contact email:(NSString *)email {
+    NSMutableSet *trigrams = [CIOTrigrams(email) mutableCopy];
+    if ([contact[@"name"] isKindOfClass:[NSString class]]) {
+        [trigrams unionSet:CIOTrigrams([contact[@"name"] lowercaseString])];
+    }
+    return trigrams;
+}
+
+- (void)_unindexContactWithEmail:(NSString *)email {
+    NSDictionary *contact = self.contacts[email];
+    if (!contact) {
+        return;
+    }
+    for (NSString *key in self.contactKeys[email]) {
+        NSUInteger position = [self _prefixKeyPosition:key];
+        if (position < self.prefixKeys.count && [self.prefixKeys[position] isEqualToString:key]) {
+            [self.prefixKeys removeObjectAtIndex:position];
+        }
+    }
+    [self.contactKeys removeObjectForKey:email];
+    for (NSString *trigram in [self _trigramsForContact:contact email:email]) {
+        NSMutableSet *emails = self.trigrams[trigram];
+        [emails removeObject:email];
+        if (emails.count == 0) {
+            [self.trigrams removeObjectForKey:trigram];
+        }
+    }
+}
+
+// Keys are appended unsorted unless `sorted`, for the caller to sort `prefixKeys` once it indexed every contact
+- (void)_indexContact:(NSDictionary *)contact email:(NSString *)email sorted:(BOOL)sorted {
+    NSArray *keys = [self _keysForContact:contact email:email];
+    self.contactKeys[email] = keys;
+    if (sorted) {
+        for (NSString *key in keys) {
+            [self.prefixKeys insertObject:key atIndex:[self _prefixKeyPosition:key]];
+        }
+    } else {
+        [self.prefixKeys addObjectsFromArray:keys];
+    }
+    for (NSString *trigram in [self _trigramsForContact:contact email:email]) {
+        NSMutableSet *emails = self.trigrams[trigram];
+        if (!emails) {
+            emails = [NSMutableSet set];
+            self.trigrams[trigram] = emails;
+        }
+        [emails addObject:email];
+    }
+}
+
+// Replaces the cached contact, reindexing it only when its name or address changed
+- (void)_putContact:(NSDictionary *)contact {
+    NSString *email = [contact[@"email"] lowercaseString];
+    NSDictionary *existing = self.contacts[email];
+    BOOL nameChanged = !existing || !((existing[@"name"] == nil && contact[@"name"] == nil) ||
+                                      [existing[@"name"] isEqual:contact[@"name"]]);
+    if (nameChanged) {
+        [self _unindexContactWithEmail:email];
+    }
+    self.contacts[email] = contact;
+    if (nameChanged) {
+        [self _indexContact:contact email:email sorted:YES];
+    }
+}
+
+#pragma mark - Queries
+
+- (NSUInteger)count {
+    __block NSUInteger count = 0;
+    dispatch_sync(self.queue, ^{
+      count = self.contacts.count;
+    });
+    return count;
+}
+
+- (NSDictionary *)contactWithEmail:(NSString *)email {
+    __block NSDictionary *contact = nil;
+    dispatch_sync(self.queue, ^{
+      contact = [self.contacts[email.lowercaseString] copy];
+    });
+    return contact;
+}
+
+- (NSArray *)contactsMatching:(NSString *)query limit:(NSUInteger)limit {
+    NSString *search =
+        [query stringByTrimmingCharactersInSet:[NSCharacterSet whitespaceAndNewlineCharacterSet]].lowercaseString;
+    NSMutableArray *results = [NSMutableArray array];
+    dispatch_sync(self.queue, ^{
+      if (search.length == 0) {
+          [results addObjectsFromArray:[self.contacts.allValues sortedArrayUsingComparator:^NSComparisonResult(id a, id b) {
+            return CIOCompareContacts(a, b);
+          }]];
+          return;
+      }
+      NSMutableSet *prefixMatches = [NSMutableSet set];
+      for (NSUInteger i = [self _prefixKeyPosition:search]; i < self.prefixKeys.count; i++) {
+          NSString *key = self.prefixKeys[i];
+          if (![key hasPrefix:search]) {
+              break;
+          }
+          NSRange separator = [key rangeOfString:kCIOPrefixKeySeparator options:NSLiteralSearch];
+          [prefixMatches addObject:[key substringFromIndex:NSMaxRange(separator)]];
+      }
+
+      NSMutableSet *substringMatches = [NSMutableSet set];
+      if (search.length >= 3) {
+          NSArray *lists = [CIOTrigrams(search) allObjects];
+          NSMutableArray *sets = [NSMutableArray arrayWithCapacity:lists.count];
+          for (NSString *trigram in lists) {
+              [sets addObject:self.trigrams[trigram] ?: [NSSet set]];
+          }
+          [sets sortUsingComparator:^NSComparisonResult(NSSet *a, NSSet *b) {
+            return a.count < b.count ? NSOrderedAscending : (a.count > b.count ? NSOrderedDescending : NSOrderedSame);
+          }];
+          for (NSString *email in sets.firstObject) {
+              if ([prefixMatches containsObject:email]) {
+                  continue;
+              }
+              BOOL inAll = YES;
+              for (NSSet *set in sets) {
+                  if (![set containsObject:email]) {
+                      inAll = NO;
+                      break;
+                  }
+              }
+              // Trigrams only narrow the candidates down; the query must still appear as a whole
+              NSDictionary *contact = self.contacts[email];
+              NSString *name = [contact[@"name"] isKindOfClass:[NSString class]] ? [contact[@"name"] lowercaseString] : @"";
+              if (inAll && ([email rangeOfString:search].location != NSNotFound ||
+                            [name rangeOfString:search].location != NSNotFound)) {
+                  [substringMatches addObject:email];
+              }
+          }
+      }
+
+      for (NSSet *matches in @[prefixMatches, substringMatches]) {
+          NSMutableArray *group = [NSMutableArray arrayWithCapacity:matches.count];
+          for (NSString *email in matches) {
+              [group addObject:self.contacts[email]];
+          }
+          [group sortUsingComparator:^NSComparisonResult(id a, id b) {
+            return CIOCompareContacts(a, b);
+          }];
+          [results addObjectsFromArray:group];
+      }
+    });
+    if (limit > 0 && results.count > limit) {
+        return [results subarrayWithRange:NSMakeRange(0, limit)];
+    }
+    return results;
+}
+
+#pragma mark - Updating
+
+- (void)addContacts:(NSArray *)contacts {
+    if (![contacts isKindOfClass:[NSArray class]]) {
+        return;
+    }
+    dispatch_sync(self.queue, ^{
+      [self _addContacts:contacts];
+    });
+}
+
+- (void)_addContacts:(NSArray *)contacts {
+    for (NSDictionary *contact in contacts) {
+        NSDictionary *cached = CIOCachedContact(contact);
+        if (cached) {
+            [self _putContact:cached];
+        }
+    }
+}
+
+- (void)_recordMessage:(NSDictionary *)message
+    withContactAddress:(NSDictionary *)address
+                  sent:(BOOL)sent {
+    NSString *email = [address isKindOfClass:[NSDictionary class]] ? address[@"email"] : nil;
+    if (![email isKindOfClass:[NSString class]] || email.length == 0) {
+        return;
+    }
+    NSMutableDictionary *contact = [self.contacts[email.lowercaseString] mutableCopy];
+    if (!contact) {
+        contact = [NSMutableDictionary dictionaryWithDictionary:@{@"email": email, @"count": @0, @"sent_count": @0,
+                                                                  @"received_count": @0}];
+    }
+    NSString *name = address[@"name"];
+    if ([name isKindOfClass:[NSString class]] && name.length > 0 && ![contact[@"name"] length]) {
+        contact[@"name"] = name;
+    }
+    NSString *countKey = sent ? @"sent_count" : @"received_count";
+    NSString *lastSeenKey = sent ? @"last_sent" : @"last_received";
+    contact[@"count"] = @([contact[@"count"] integerValue] + 1);
+    contact[countKey] = @([contact[countKey] integerValue] + 1);
+    NSNumber *date = message[@"date"];
+    if ([date isKindOfClass:[NSNumber class]] && date.doubleValue > [contact[lastSeenKey] doubleValue]) {
+        contact[lastSeenKey] = date;
+    }
+    [self _putContact:contact];
+}
+
+- (NSSet *)_ownerEmailSet {
+    NSMutableSet *owners = [NSMutableSet set];
+    for (NSString *address in self.ownerEmailAddresses) {
+        [owners addObject:address.lowercaseString];
+    }
+    return owners;
+}
+
+- (void)addMessages:(NSArray *)messages {
+    if (![messages isKindOfClass:[NSArray class]]) {
+        return;
+    }
+    NSSet *owners = [self _ownerEmailSet];
+    dispatch_sync(self.queue, ^{
+      [self _addMessages:messages owners:owners];
+    });
+}
+
+- (void)_addMessages:(NSArray *)messages owners:(NSSet *)owners {
+    double lastRefresh = [self.lastRefreshDate timeIntervalSince1970];
+    for (NSDictionary *message in messages) {
+        if (![message isKindOfClass:[NSDictionary class]] ||
+            ![message[@"addresses"] isKindOfClass:[NSDictionary class]]) {
+            continue;
+        }
+        NSString *messageID = message[@"message_id"];
+        NSNumber *dateIndexed = message[@"date_indexed"];
+        if (![messageID isKindOfClass:[NSString class]] || self.countedMessages[messageID] ||
+            (self.lastRefreshDate && dateIndexed.doubleValue <= lastRefresh)) {
+            continue;
+        }
+        self.countedMessages[messageID] = @(dateIndexed.doubleValue);
+
+        NSDictionary *addresses = message[@"addresses"];
+        id from = addresses[@"from"];
+        if ([from isKindOfClass:[NSArray class]]) {
+            from = [from firstObject];
+        }
+        NSString *fromEmail = [from isKindOfClass:[NSDictionary class]] ? [from[@"email"] lowercaseString] : nil;
+        if (fromEmail && [owners containsObject:fromEmail]) {
+            for (NSString *field in @[@"to", @"cc", @"bcc"]) {
+                id recipients = addresses[field];
+                if ([recipients isKindOfClass:[NSDictionary class]]) {
+                    recipients = @[recipients];
+                }
+                if (![recipients isKindOfClass:[NSArray class]]) {
+                    continue;
+                }
+                for (NSDictionary *recipient in recipients) {
+                    NSString *email = [recipient isKindOfClass:[NSDictionary class]] ? recipient[@"email"] : nil;
+                    if ([email isKindOfClass:[NSString class]] && ![owners containsObject:email.lowercaseString]) {
+                        [self _recordMessage:message withContactAddress:recipient sent:YES];
+                    }
+                }
+            }
+        } else if (fromEmail) {
+            [self _recordMessage:message withContactAddress:from sent:NO];
+        }
+    }
+}
+
+#pragma mark - Refreshing
+
+- (void)refreshWithCompletion:(void (^)(NSUInteger, NSError *))completion {
+    if (![NSThread isMainThread]) {
+        dispatch_async(dispatch_get_main_queue(), ^{
+          [self refreshWithCompletion:completion];
+        });
+        return;
+    }
+    if (completion) {
+        [self.completions addObject:[completion copy]];
+    }
+    if (self.refreshing) {
+        return;
+    }
+    self.refreshing = YES;
+    [self _fetchPageAtOffset:0 activeAfter:self.lastRefreshDate startDate:[NSDate date] fetchedCount:0];
+}
+
+- (void)_fetchPageAtOffset:(NSInteger)offset
+               activeAfter:(NSDate *)activeAfter
+                 startDate:(NSDate *)startDate
+              fetchedCount:(NSUInteger)fetchedCount {
+    CIOContactsRequest *request = [self.client getContacts];
+    request.active_after = activeAfter;
+    request.limit = kCIOContactCachePageSize;
+    request.offset = offset;
+    [request executeWithSuccess:^(NSDictionary *response) {
+      // The response has already been added through `clientDidReceiveResponse:`
+      NSArray *matches = [response[@"matches"] isKindOfClass:[NSArray class]] ? response[@"matches"] : @[];
+      if ((NSInteger)matches.count >= kCIOContactCachePageSize) {
+          [self _fetchPageAtOffset:offset + (NSInteger)matches.count
+                       activeAfter:activeAfter
+                         startDate:startDate
+                      fetchedCount:fetchedCount + matches.count];
+          return;
+      }
+      dispatch_sync(self.queue, ^{
+        self.lastRefreshDate = startDate;
+        // Messages indexed before the refresh started are in the fetched counts and will be skipped from now on
+        double refreshed = [startDate timeIntervalSince1970];
+        for (NSString *messageID in self.countedMessages.allKeys) {
+            if ([self.countedMessages[messageID] doubleValue] <= refreshed) {
+                [self.countedMessages removeObjectForKey:messageID];
+            }
+        }
+      });
+      NSError *error = nil;
+      [self save:&error];
+      [self _finishWithFetchedCount:fetchedCount + matches.count error:error];
+    } failure:^(NSError *error) {
+      [self _finishWithFetchedCount:fetchedCount error:error];
+    }];
+}
+
+- (void)_finishWithFetchedCount:(NSUInteger)fetchedCount error:(NSError *)error {
+    NSArray *completions = self.completions;
+    self.completions = [NSMutableArray array];
+    self.refreshing = NO;
+    for (void (^completion)(NSUInteger, NSError *) in completions) {
+        completion(fetchedCount, error);
+    }
+}
+
+#pragma mark - Persistence
+
+- (void)_load {
+    if (!self.fileURL) {
+        return;
+    }
+    NSData *data = [NSData dataWithContentsOfURL:self.fileURL];
+    NSDictionary *archive =
+        data ? [NSPropertyListSerialization propertyListWithData:data options:0 format:NULL error:nil] : nil;
+    if (![archive isKindOfClass:[NSDictionary class]]) {
+        return;
+    }
+    NSArray *contacts = [archive[@"contacts"] isKindOfClass:[NSArray class]] ? archive[@"contacts"] : @[];
+    dispatch_sync(self.queue, ^{
+      // Sorting the keys once is O(n log n), where inserting each in place would be O(n^2)
+      for (NSDictionary *contact in contacts) {
+          NSDictionary *cached = CIOCachedContact(contact);
+          NSString *email = [cached[@"email"] lowercaseString];
+          if (!cached || self.contacts[email]) {
+              continue;
+          }
+          self.contacts[email] = cached;
+          [self _indexContact:cached email:email sorted:NO];
+      }
+      [self.prefixKeys sortUsingComparator:^NSComparisonResult(NSString *a, NSString *b) {
+        return CIOComparePrefixKeys(a, b);
+      }];
+      self.lastRefreshDate = archive[@"last_refresh"];
+      if ([archive[@"counted_messages"] isKindOfClass:[NSDictionary class]]) {
+          [self.countedMessages addEntriesFromDictionary:archive[@"counted_messages"]];
+      }
+    });
+}
+
+- (BOOL)save:(NSError **)error {
+    if (!self.fileURL) {
+        return YES;
+    }
+    __block NSMutableDictionary *archive = [NSMutableDictionary dictionary];
+    dispatch_sync(self.queue, ^{
+      archive[@"contacts"] = self.contacts.allValues;
+      archive[@"counted_messages"] = [self.countedMessages copy];
+      if (self.lastRefreshDate) {
+          archive[@"last_refresh"] = self.lastRefreshDate;
+      }
+    });
+    NSData *data = [NSPropertyListSerialization dataWithPropertyList:archive
+                                                              format:NSPropertyListBinaryFormat_v1_0
+                                                             options:0
+                                                               error:error];
+    return data && [data writeToURL:self.fileURL options:NSDataWritingAtomic error:error];
+}
+
+@end
@@ -0,0 +1,85 @@
+//
+//  CIOCredentialStore.h
+//  CIOAPIClient
+//
+//  Copyright © 2015 Context.io. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+
+NS_ASSUME_NONNULL_BEGIN
+
+@class CIOCredentials;
+
+/**
+ *  Persistent storage for the credentials of `CIOAPIClient`s, one set per service name. Stores may be called from any
+ * thread.
+ */
+@protocol CIOCredentialStore <NSObject>
+
+/**
+ *  The saved credentials for a service, or `nil` if there are none.
+ */
+- (nullable CIOCredentials *)credentialsForService:(NSString *)service;
+
+/**
+ *  Saves the account id, token and token secret of `credentials`.
+ *
+ *  @return whether the credentials were saved
+ */
+- (BOOL)saveCredentials:(CIOCredentials *)credentials forService:(NSString *)service;
+
+- (void)removeCredentialsForService:(NSString *)service;
+
+@end
+
+#if __has_include(<Security/Security.h>)
+
+/**
+ `CIOKeychainCredentialStore` keeps each service's credentials in a single keychain item, so loading or saving them
+ is one keychain call instead of one per value. Credentials saved by earlier versions as three separate items are still
+ read, and moved to the single item.
+ */
+@interface CIOKeychainCredentialStore : NSObject <CIOCredentialStore>
+
+@end
+
+#endif
+
+/**
+ `CIOFileCredentialStore` keeps each service's credentials in a file readable only by the current user, for platforms
+ without a keychain such as Linux.
+ */
+@interface CIOFileCredentialStore : NSObject <CIOCredentialStore>
+
+/**
+ *  @param directoryURL directory the credential files are kept in, created when first needed
+ */
+- (instancetype)initWithDirectoryURL:(NSURL *)directoryURL NS_DESIGNATED_INITIALIZER;
+
+- (instancetype)init NS_UNAVAILABLE;
+
+@property (readonly, nonatomic) NSURL *directoryURL;
+
+@end
+
+/**
+ `CIOCachingCredentialStore` keeps the credentials of another store in memory, so each service is read from it at most
+ once, including services without credentials. Writes go through to the other store.
+ */
+@interface CIOCachingCredentialStore : NSObject <CIOCredentialStore>
+
+- (instancetype)initWithStore:(id<CIOCredentialStore>)store NS_DESIGNATED_INITIALIZER;
+
+- (instancetype)init NS_UNAVAILABLE;
+
+@property (readonly, nonatomic) id<CIOCredentialStore> store;
+
+/**
+ *  Forgets the cached credentials, e.g. after another process changed the underlying store.
+ */
+- (void)removeAllCachedCredentials;
+
+@end
+
+NS_ASSUME_NONNULL_END
@@ -0,0 +1,200 @@
+//
+//  CIOCredentialStore.m
+//  CIOAPIClient
+//
+//  Copyright © 2015 Context.io. All rights reserved.
+//
+
+#import "CIOCredentialStore.h"
+#import "CIOCredentials.h"
+
+#if __has_include(<Security/Security.h>)
+#import <SSKeychain/SSKeychain.h>
+#endif
+
+// Serialized form of an account id, token and token secret
+static NSData *CIOCredentialsData(CIOCredentials *credentials) {
+    if (!credentials.accountID || !credentials.token || !credentials.tokenSecret) {
+        return nil;
+    }
+    NSDictionary *values = @{
+        @"account_id": credentials.accountID,
+        @"token": credentials.token,
+        @"token_secret": credentials.tokenSecret,
+    };
+    return [NSJSONSerialization dataWithJSONObject:values options:0 error:NULL];
+}
+
+static CIOCredentials *CIOCredentialsFromData(NSData *data) {
+    NSDictionary *values = data ? [NSJSONSerialization JSONObjectWithData:data options:0 error:NULL] : nil;
+    if (![values isKindOfClass:[NSDictionary class]]) {
+        return nil;
+    }
+    NSString *accountID = values[@"account_id"];
+    NSString *token = values[@"token"];
+    NSString *tokenSecret = values[@"token_secret"];
+    if (![accountID isKindOfClass:[NSString class]] || ![token isKindOfClass:[NSString class]] ||
+        ![tokenSecret isKindOfClass:[NSString class]]) {
+        return nil;
+    }
+    return [CIOCredentials credentialsWithAccountID:accountID token:token tokenSecret:tokenSecret];
+}
+
+#pragma mark -
+
+#if __has_include(<Security/Security.h>)
+
+static NSString *const kCIOCredentialsKeyChainKey = @"kCIOCredentials";
+// Items written before credentials were saved as a single item
+static NSString *const kCIOAccountIDKeyChainKey = @"kCIOAccountID";
+static NSString *const kCIOTokenKeyChainKey = @"kCIOToken";
+static NSString *const kCIOTokenSecretKeyChainKey = @"kCIOTokenSecret";
+
+@implementation CIOKeychainCredentialStore
+
+- (CIOCredentials *)credentialsForService:(NSString *)service {
+    NSData *data = [SSKeychain passwordDataForService:service account:kCIOCredentialsKeyChainKey];
+    if (data) {
+        return CIOCredentialsFromData(data);
+    }
+    NSString *accountID = [SSKeychain passwordForService:service account:kCIOAccountIDKeyChainKey];
+    NSString *token = [SSKeychain passwordForService:service account:kCIOTokenKeyChainKey];
+    NSString *tokenSecret = [SSKeychain passwordForService:service account:kCIOTokenSecretKeyChainKey];
+    if (!accountID || !token || !tokenSecret) {
+        return nil;
+    }
+    CIOCredentials *credentials = [CIOCredentials credentialsWithAccountID:accountID token:token tokenSecret:tokenSecret];
+    if ([self saveCredentials:credentials forService:service]) {
+        [self _removeSeparateItemsForService:service];
+    }
+    return credentials;
+}
+
+- (BOOL)saveCredentials:(CIOCredentials *)credentials forService:(NSString *)service {
+    NSData *data = CIOCredentialsData(credentials);
+    return data && [SSKeychain setPasswordData:data forService:service account:kCIOCredentialsKeyChainKey];
+}
+
+- (void)removeCredentialsForService:(NSString *)service {
+    [SSKeychain deletePasswordForService:service account:kCIOCredentialsKeyChainKey];
+    [self _removeSeparateItemsForService:service];
+}
+
+- (void)_removeSeparateItemsForService:(NSString *)service {
+    [SSKeychain deletePasswordForService:service account:kCIOAccountIDKeyChainKey];
+    [SSKeychain deletePasswordForService:service account:kCIOTokenKeyChainKey];
+    [SSKeychain deletePasswordForService:service account:kCIOTokenSecretKeyChainKey];
+}
+
+@end
+
+#endif
+
+#pragma mark -
+
+@implementation CIOFileCredentialStore
+
+- (instancetype)initWithDirectoryURL:(NSURL *)directoryURL {
+    if ((self = [super init])) {
+        _directoryURL = directoryURL;
+    }
+    return self;
+}
+
+- (NSURL *)_fileURLForService:(NSString *)service {
+    NSString *name =
+        [service stringByAddingPercentEncodingWithAllowedCharacters:[NSCharacterSet alphanumericCharacterSet]];
+    return [self.directoryURL URLByAppendingPathComponent:[name stringByAppendingPathExtension:@"json"]];
+}
+
+- (CIOCredentials *)credentialsForService:(NSString *)service {
+    return CIOCredentialsFromData([NSData dataWithContentsOfURL:[self _fileURLForService:service]]);
+}
+
+- (BOOL)saveCredentials:(CIOCredentials *)credentials forService:(NSString *)service {
+    NSData *data = CIOCredentialsData(credentials);
+    if (!data) {
+        return NO;
+    }
+    NSFileManager *fileManager = [NSFileManager defaultManager];
+    if (![fileManager createDirectoryAtURL:self.directoryURL
+               withIntermediateDirectories:YES
+                                attributes:@{NSFilePosixPermissions: @0700}
+                                     error:NULL]) {
+        return NO;
+    }
+    NSURL *fileURL = [self _fileURLForService:service];
+    if (![data writeToURL:fileURL options:NSDataWritingAtomic error:NULL]) {
+        return NO;
+    }
+    return [fileManager setAttributes:@{NSFilePosixPermissions: @0600} ofItemAtPath:fileURL.path error:NULL];
+}
+
+- (void)removeCredentialsForService:(NSString *)service {
+    [[NSFileManager defaultManager] removeItemAtURL:[self _fileURLForService:service] error:NULL];
+}
+
+@end
+
+#pragma mark -
+
+@interface CIOCachingCredentialStore ()
+
+@property (nonatomic) dispatch_queue_t queue;
+// service -> CIOCredentials, or NSNull when the store has none. Must only be accessed on `queue`.
+@property (nonatomic) NSMutableDictionary *cache;
+
+@end
+
+@implementation CIOCachingCredentialStore
+
+- (instancetype)initWithStore:(id<CIOCredentialStore>)store {
+    if ((self = [super init])) {
+        _store = store;
+        _queue = dispatch_queue_create("io.context.credentialcache", DISPATCH_QUEUE_SERIAL);
+        _cache = [NSMutableDictionary dictionary];
+    }
+    return self;
+}
+
+- (CIOCredentials *)credentialsForService:(NSString *)service {
+    __block id credentials = nil;
+    dispatch_sync(self.queue, ^{
+      credentials = self.cache[service];
+      if (!credentials) {
+          credentials = [self.store credentialsForService:service] ?: [NSNull null];
+          self.cache[service] = credentials;
+      }
+    });
+    return credentials == [NSNull null] ? nil : credentials;
+}
+
+- (BOOL)saveCredentials:(CIOCredentials *)credentials forService:(NSString *)service {
+    __block BOOL saved = NO;
+    dispatch_sync(self.queue, ^{
+      saved = [self.store saveCredentials:credentials forService:service];
+      if (saved) {
+          self.cache[service] = [CIOCredentials credentialsWithAccountID:credentials.accountID
+                                                                   token:credentials.token
+                                                             tokenSecret:credentials.tokenSecret];
+      } else {
+          [self.cache removeObjectForKey:service];
+      }
+    });
+    return saved;
+}
+
+- (void)removeCredentialsForService:(NSString *)service {
+    dispatch_sync(self.queue, ^{
+      [self.store removeCredentialsForService:service];
+      self.cache[service] = [NSNull null];
+    });
+}
+
+- (void)removeAllCachedCredentials {
+    dispatch_sync(self.queue, ^{
+      [self.cache removeAllObjects];
+    });
+}
+
+@end
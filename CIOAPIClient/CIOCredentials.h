@@ -0,0 +1,49 @@
+//
+//  CIOCredentials.h
+//  CIOAPIClient
+//
+//  Copyright © 2015 Context.io. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+
+NS_ASSUME_NONNULL_BEGIN
+
+/**
+ `CIOCredentials` is an immutable snapshot of the OAuth credentials of a `CIOAPIClient`. The client replaces its
+ snapshot as a whole when credentials change, so a request is always signed with a token and secret which belong
+ together, whatever other threads do meanwhile.
+ */
+@interface CIOCredentials : NSObject <NSCopying>
+
+/**
+ *  Credentials of an authorized account.
+ */
++ (instancetype)credentialsWithAccountID:(NSString *)accountID token:(NSString *)token tokenSecret:(NSString *)tokenSecret;
+
+/**
+ *  @param temporaryToken       token received while connecting an account, used to fetch the connect token
+ *  @param temporaryTokenSecret secret of `temporaryToken`
+ */
+- (instancetype)initWithAccountID:(nullable NSString *)accountID
+                            token:(nullable NSString *)token
+                      tokenSecret:(nullable NSString *)tokenSecret
+                       authorized:(BOOL)authorized
+                   temporaryToken:(nullable NSString *)temporaryToken
+             temporaryTokenSecret:(nullable NSString *)temporaryTokenSecret NS_DESIGNATED_INITIALIZER;
+
+/**
+ *  Credentials of a client which is not authorized.
+ */
+- (instancetype)init;
+
+@property (nullable, readonly, nonatomic, copy) NSString *accountID;
+@property (nullable, readonly, nonatomic, copy) NSString *token;
+@property (nullable, readonly, nonatomic, copy) NSString *tokenSecret;
+@property (readonly, nonatomic, getter=isAuthorized) BOOL authorized;
+@property (nullable, readonly, nonatomic, copy) NSString *temporaryToken;
+@property (nullable, readonly, nonatomic, copy) NSString *temporaryTokenSecret;
+
+@end
+
+NS_ASSUME_NONNULL_END
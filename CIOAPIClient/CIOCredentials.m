@@ -0,0 +1,70 @@
+//
+//  CIOCredentials.m
+//  CIOAPIClient
+//
+//  Copyright © 2015 Context.io. All rights reserved.
+//
+
+#import "CIOCredentials.h"
+
+@implementation CIOCredentials
+
++ (instancetype)credentialsWithAccountID:(NSString *)accountID token:(NSString *)token tokenSecret:(NSString *)tokenSecret {
+    return [[self alloc] initWithAccountID:accountID
+                                     token:token
+                               tokenSecret:tokenSecret
+                                authorized:YES
+                            temporaryToken:nil
+                      temporaryTokenSecret:nil];
+}
+
+- (instancetype)init {
+    return [self initWithAccountID:nil token:nil tokenSecret:nil authorized:NO temporaryToken:nil temporaryTokenSecret:nil];
+}
+
+- (instancetype)initWithAccountID:(NSString *)accountID
+                            token:(NSString *)token
+                      tokenSecret:(NSString *)tokenSecret
+                       authorized:(BOOL)authorized
+                   temporaryToken:(NSString *)temporaryToken
+             temporaryTokenSecret:(NSString *)temporaryTokenSecret {
+    if ((self = [super init])) {
+        _accountID = [accountID copy];
+        _token = [token copy];
+        _tokenSecret = [tokenSecret copy];
+        _authorized = authorized;
+        _temporaryToken = [temporaryToken copy];
+        _temporaryTokenSecret = [temporaryTokenSecret copy];
+    }
+    return self;
+}
+
+- (id)copyWithZone:(NSZone *)zone {
+    return self;
+}
+
+- (BOOL)isEqual:(id)object {
+    if (![object isKindOfClass:[CIOCredentials class]]) {
+        return NO;
+    }
+    CIOCredentials *other = object;
+    return (self.accountID == other.accountID || [self.accountID isEqualToString:other.accountID]) &&
+           (self.token == other.token || [self.token isEqualToString:other.token]) &&
+           (self.tokenSecret == other.tokenSecret || [self.tokenSecret isEqualToString:other.tokenSecret]) &&
+           self.authorized == other.authorized &&
+           (self.temporaryToken == other.temporaryToken || [self.temporaryToken isEqualToString:other.temporaryToken]) &&
+           (self.temporaryTokenSecret == other.temporaryTokenSecret ||
+            [self.temporaryTokenSecret isEqualToString:other.temporaryTokenSecret]);
+}
+
+- (NSUInteger)hash {
+    return self.accountID.hash ^ self.token.hash;
+}
+
+- (NSString *)description {
+    // Secrets stay out of logs
+    return [NSString stringWithFormat:@"<%@: %p accountID=%@ authorized=%@>", NSStringFromClass([self class]), self,
+                                      self.accountID, self.authorized ? @"YES" : @"NO"];
+}
+
+@end
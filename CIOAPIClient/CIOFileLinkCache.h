@@ -0,0 +1,91 @@
+//
+//  CIOFileLinkCache.h
+//  CIOAPIClient
+//
+//  Copyright © 2015 Context.io. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+#import "CIOAPISession.h"
+
+NS_ASSUME_NONNULL_BEGIN
+
+@class CIOV2Client;
+
+/**
+ `CIOFileLinkCache` remembers the temporary download links returned by `-[CIOV2Client getContentsURLForFileWithID:]`
+ until they expire, and downloads files straight from them with plain, unsigned requests.
+
+ A link's expiry is read from its `Expires` or `X-Amz-Date`/`X-Amz-Expires` query parameters when it has them, and
+ otherwise assumed to be `defaultLinkLifetime` after it was fetched. Expired links are replaced transparently, and
+ concurrent requests for the same file share a single link fetch.
+
+ Use the `fileLinkCache` of a `CIOV2Client` rather than creating one.
+ */
+@interface CIOFileLinkCache : NSObject
+
+- (instancetype)initWithClient:(CIOV2Client *)client NS_DESIGNATED_INITIALIZER;
+
+- (instancetype)init NS_UNAVAILABLE;
+
+@property (nullable, readonly, weak, nonatomic) CIOV2Client *client;
+
+/**
+ *  How long links without expiry information are assumed to stay valid. Defaults to 2 minutes.
+ */
+@property (nonatomic) NSTimeInterval defaultLinkLifetime;
+
+/**
+ *  Links are treated as expired this long before their actual expiry, to leave time for a download to start. Defaults
+ * to 10 seconds.
+ */
+@property (nonatomic) NSTimeInterval expiryMargin;
+
+/**
+ *  The cached, unexpired link for a file, if there is one.
+ */
+- (nullable NSURL *)cachedLinkForFileWithID:(NSString *)fileID;
+
+/**
+ *  Caches `link` for a file. A `nil` `expirationDate` is derived from the link itself, see above.
+ */
+- (void)setLink:(NSURL *)link forFileWithID:(NSString *)fileID expirationDate:(nullable NSDate *)expirationDate;
+
+- (void)removeLinkForFileWithID:(NSString *)fileID;
+
+- (void)removeAllLinks;
+
+/**
+ *  Calls `success` with an unexpired link for a file, fetching one from the API only when none is cached. Callbacks
+ * are made on the main queue.
+ */
+- (void)getLinkForFileWithID:(NSString *)fileID
+                     success:(void (^)(NSURL *link))success
+                     failure:(nullable void (^)(NSError *error))failure;
+
+/**
+ *  Downloads a file from its temporary link without OAuth signing or going through the API host. If the link turns
+ * out to have expired early, a fresh link is fetched and the download retried once. Files already in the client's
+ * `attachmentStore` are served from it without fetching a link.
+ *
+ *  @param fileID        id of the file to download
+ *  @param fileURL       `URL` on disk to save the file to. An error will be returned if a file already exists at this
+ * path.
+ *  @param successBlock  block to be called when the file download completes
+ *  @param failureBlock  block to be called in the event of an error. No file will be written.
+ *  @param progressBlock block to receive periodic progress updates during the file download
+ */
+- (void)downloadFileWithID:(NSString *)fileID
+                 toFileURL:(NSURL *)fileURL
+                   success:(nullable void (^)())successBlock
+                   failure:(nullable void (^)(NSError *error))failureBlock
+                  progress:(nullable CIOSessionDownloadProgressBlock)progressBlock;
+
+/**
+ *  Expiry encoded in a signed link's query parameters, or `nil` if it has none.
+ */
++ (nullable NSDate *)expirationDateForLink:(NSURL *)link;
+
+@end
+
+NS_ASSUME_NONNULL_END
@@ -0,0 +1,261 @@
+//
+//  CIOFileLinkCache.m
+//  CIOAPIClient
+//
+//  Copyright © 2015 Context.io. All rights reserved.
+//
+
+#import "CIOFileLinkCache.h"
+#import "CIOV2Client.h"
+
+static const NSTimeInterval kCIOFileLinkDefaultLifetime = 120;
+static const NSTimeInterval kCIOFileLinkDefaultExpiryMargin = 10;
+
+@interface CIOFileLink : NSObject
+
+@property (nonatomic) NSURL *URL;
+@property (nonatomic) NSDate *expirationDate;
+
+@end
+
+@implementation CIOFileLink
+
+@end
+
+#pragma mark -
+
+@interface CIOFileLinkCache ()
+
+// File ID -> CIOFileLink
+@property (nonatomic) NSMutableDictionary *links;
+// File ID -> array of @[success, failure] blocks waiting on a link fetch. Only used on the main queue.
+@property (nonatomic) NSMutableDictionary *pendingFetches;
+
+@end
+
+@implementation CIOFileLinkCache
+
+- (instancetype)initWithClient:(CIOV2Client *)client {
+    if ((self = [super init])) {
+        _client = client;
+        _defaultLinkLifetime = kCIOFileLinkDefaultLifetime;
+        _expiryMargin = kCIOFileLinkDefaultExpiryMargin;
+        _links = [NSMutableDictionary dictionary];
+        _pendingFetches = [NSMutableDictionary dictionary];
+    }
+    return self;
+}
+
+// Splits a URL query in to a dictionary of percent-decoded values
+static NSDictionary *CIOQueryParameters(NSURL *link) {
+    NSMutableDictionary *parameters = [NSMutableDictionary dictionary];
+    for (NSString *pair in [link.query componentsSeparatedByString:@"&"]) {
+        NSRange equals = [pair rangeOfString:@"="];
+        if (equals.location == NSNotFound) {
+            continue;
+        }
+        NSString *name = [[pair substringToIndex:equals.location] stringByRemovingPercentEncoding];
+        NSString *value = [[pair substringFromIndex:NSMaxRange(equals)] stringByRemovingPercentEncoding];
+        if (name && value) {
+            parameters[name] = value;
+        }
+    }
+    return parameters;
+}
+
++ (NSDate *)expirationDateForLink:(NSURL *)link {
+    NSDictionary *parameters = CIOQueryParameters(link);
+    // S3 query string authentication, version 2: absolute expiry in seconds since the epoch
+    NSString *expires = parameters[@"Expires"];
+    if (expires.longLongValue > 0) {
+        return [NSDate dateWithTimeIntervalSince1970:expires.longLongValue];
+    }
+    // Version 4: signing time plus a lifetime in seconds
+    NSString *signedAt = parameters[@"X-Amz-Date"];
+    NSString *lifetime = parameters[@"X-Amz-Expires"];
+    if (signedAt && lifetime.longLongValue > 0) {
+        static NSDateFormatter *formatter;
+        static dispatch_once_t onceToken;
+        dispatch_once(&onceToken, ^{
+          formatter = [NSDateFormatter new];
+          formatter.locale = [[NSLocale alloc] initWithLocaleIdentifier:@"en_US_POSIX"];
+          formatter.timeZone = [NSTimeZone timeZoneForSecondsFromGMT:0];
+          formatter.dateFormat = @"yyyyMMdd'T'HHmmss'Z'";
+        });
+        NSDate *date = [formatter dateFromString:signedAt];
+        return [date dateByAddingTimeInterval:lifetime.longLongValue];
+    }
+    return nil;
+}
+
+#pragma mark - Cache
+
+- (NSURL *)cachedLinkForFileWithID:(NSString *)fileID {
+    @synchronized(self) {
+        CIOFileLink *link = self.links[fileID];
+        if (!link) {
+            return nil;
+        }
+        if ([link.expirationDate timeIntervalSinceNow] <= self.expiryMargin) {
+            [self.links removeObjectForKey:fileID];
+            return nil;
+        }
+        return link.URL;
+    }
+}
+
+- (void)setLink:(NSURL *)URL forFileWithID:(NSString *)fileID expirationDate:(NSDate *)expirationDate {
+    CIOFileLink *link = [CIOFileLink new];
+    link.URL = URL;
+    link.expirationDate = expirationDate ?: [self.class expirationDateForLink:URL]
+                                               ?: [NSDate dateWithTimeIntervalSinceNow:self.defaultLinkLifetime];
+    @synchronized(self) {
+        self.links[fileID] = link;
+    }
+}
+
+- (void)removeLinkForFileWithID:(NSString *)fileID {
+    @synchronized(self) {
+        [self.links removeObjectForKey:fileID];
+    }
+}
+
+- (void)removeAllLinks {
+    @synchronized(self) {
+        [self.links removeAllObjects];
+    }
+}
+
+#pragma mark - Fetching
+
+- (void)getLinkForFileWithID:(NSString *)fileID
+                     success:(void (^)(NSURL *))success
+                     failure:(void (^)(NSError *))failure {
+    if (![NSThread isMainThread]) {
+        dispatch_async(dispatch_get_main_queue(), ^{
+          [self getLinkForFileWithID:fileID success:success failure:failure];
+        });
+        return;
+    }
+    NSURL *cached = [self cachedLinkForFileWithID:fileID];
+    if (cached) {
+        success(cached);
+        return;
+    }
+    NSArray *callbacks = @[[success copy], failure ? [failure copy] : [NSNull null]];
+    NSMutableArray *waiting = self.pendingFetches[fileID];
+    if (waiting) {
+        [waiting addObject:callbacks];
+        return;
+    }
+    CIOV2Client *client = self.client;
+    if (!client) {
+        if (failure) {
+            failure([NSError errorWithDomain:@"io.context.error.client"
+                                        code:NSURLErrorCancelled
+                                    userInfo:@{NSLocalizedDescriptionKey: @"The client of the link cache is gone"}]);
+        }
+        return;
+    }
+    self.pendingFetches[fileID] = [NSMutableArray arrayWithObject:callbacks];
+
+    [[client getContentsURLForFileWithID:fileID] executeWithSuccess:^(NSString *response) {
+      NSString *linkString =
+          [response stringByTrimmingCharactersInSet:[NSCharacterSet whitespaceAndNewlineCharacterSet]];
+      NSURL *link = [NSURL URLWithString:linkString];
+      if (!link.scheme) {
+          NSString *description = [NSString stringWithFormat:@"Invalid file link: %@", linkString];
+          [self _finishFetchForFileWithID:fileID
+                                     link:nil
+                                    error:[NSError errorWithDomain:@"io.context.error.response.object"
+                                                              code:NSURLErrorBadServerResponse
+                                                          userInfo:@{NSLocalizedDescriptionKey: description}]];
+          return;
+      }
+      [self setLink:link forFileWithID:fileID expirationDate:nil];
+      [self _finishFetchForFileWithID:fileID link:link error:nil];
+    } failure:^(NSError *error) {
+      [self _finishFetchForFileWithID:fileID link:nil error:error];
+    }];
+}
+
+- (void)_finishFetchForFileWithID:(NSString *)fileID link:(NSURL *)link error:(NSError *)error {
+    NSArray *waiting = self.pendingFetches[fileID];
+    [self.pendingFetches removeObjectForKey:fileID];
+    for (NSArray *callbacks in waiting) {
+        if (link) {
+            void (^success)(NSURL *) = callbacks[0];
+            success(link);
+        } else if (callbacks[1] != [NSNull null]) {
+            void (^failure)(NSError *) = callbacks[1];
+            failure(error);
+        }
+    }
+}
+
+#pragma mark - Downloading
+
+// Responses which mean the link itself is no longer good
+static BOOL CIOIsExpiredLinkError(NSError *error) {
+    NSHTTPURLResponse *response = error.userInfo[CIOAPISessionURLResponseErrorKey];
+    NSInteger status = response.statusCode;
+    return status == 400 || status == 403 || status == 404 || status == 410;
+}
+
+- (void)downloadFileWithID:(NSString *)fileID
+                 toFileURL:(NSURL *)fileURL
+                   success:(void (^)())successBlock
+                   failure:(void (^)(NSError *))failureBlock
+                  progress:(CIOSessionDownloadProgressBlock)progressBlock {
+    [self _downloadFileWithID:fileID
+                    toFileURL:fileURL
+                   allowRetry:YES
+                      success:successBlock
+                      failure:failureBlock
+                     progress:progressBlock];
+}
+
+- (void)_downloadFileWithID:(NSString *)fileID
+                  toFileURL:(NSURL *)fileURL
+                 allowRetry:(BOOL)allowRetry
+                    success:(void (^)())successBlock
+                    failure:(void (^)(NSError *))failureBlock
+                   progress:(CIOSessionDownloadProgressBlock)progressBlock {
+    CIOV2Client *client = self.client;
+    CIORequest *signedRequest = [client downloadContentsOfFileWithID:fileID];
+    NSString *contentKey = signedRequest.contentKey;
+    if (contentKey && [client.attachmentStore containsContentForKey:contentKey]) {
+        [client downloadRequest:signedRequest
+                      toFileURL:fileURL
+                        success:successBlock
+                        failure:failureBlock
+                       progress:progressBlock];
+        return;
+    }
+    [self getLinkForFileWithID:fileID
+        success:^(NSURL *link) {
+          NSMutableURLRequest *request = [NSMutableURLRequest requestWithURL:link];
+          request.timeoutInterval = client.timeoutInterval;
+          [client downloadURLRequest:request
+              contentKey:contentKey
+              toFileURL:fileURL
+              success:successBlock
+              failure:^(NSError *error) {
+                if (allowRetry && CIOIsExpiredLinkError(error)) {
+                    [self removeLinkForFileWithID:fileID];
+                    [self _downloadFileWithID:fileID
+                                    toFileURL:fileURL
+                                   allowRetry:NO
+                                      success:successBlock
+                                      failure:failureBlock
+                                     progress:progressBlock];
+                } else if (failureBlock) {
+                    failureBlock(error);
+                }
+              }
+              progress:progressBlock];
+        }
+        failure:failureBlock];
+}
+
+@end
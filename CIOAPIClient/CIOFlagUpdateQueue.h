@@ -0,0 +1,105 @@
+//
+//  CIOFlagUpdateQueue.h
+//  CIOAPIClient
+//
+//  Copyright © 2015 Context.io. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+
+NS_ASSUME_NONNULL_BEGIN
+
+@class CIOV2Client;
+@class CIOMessageFlags;
+@class CIODictionaryRequest;
+
+/**
+ *  Makes the request sending `flags` for a message. Returning `nil` fails the update of the message.
+ */
+typedef CIODictionaryRequest *__nullable (^CIOFlagUpdateRequestFactory)(NSString *messageID, CIOMessageFlags *flags);
+
+/**
+ `CIOFlagUpdateQueue` collects flag changes and writes them behind, so bulk actions and quickly repeated toggles cost
+ one request per message instead of one per change.
+
+ Changes to the same message are merged flag by flag, the latest value of each flag winning, until the queue is flushed
+ `debounceInterval` after the last change, or at most `maximumDelay` after the first. At most
+ `maximumConcurrentRequests` requests run at once, and never two for the same message: changes made while a message's
+ update is in flight are sent after it.
+
+ The queue must be used from the main thread, and calls completions on the main queue.
+ */
+@interface CIOFlagUpdateQueue : NSObject
+
+/**
+ *  A queue sending `updateFlagsForMessageWithID:flags:` requests. Updates fail once `client` is deallocated; the queue
+ * doesn't retain it.
+ */
+- (instancetype)initWithClient:(CIOV2Client *)client;
+
+/**
+ *  A queue sending the requests made by `requestFactory`, e.g. `markRead` and `markUnread` of a `CIOLiteClient` message.
+ */
+- (instancetype)initWithRequestFactory:(CIOFlagUpdateRequestFactory)requestFactory NS_DESIGNATED_INITIALIZER;
+
+- (instancetype)init NS_UNAVAILABLE;
+
+@property (readonly, nonatomic) CIOFlagUpdateRequestFactory requestFactory;
+
+/**
+ *  Defaults to 0.25 seconds.
+ */
+@property (nonatomic) NSTimeInterval debounceInterval;
+
+/**
+ *  Defaults to 1 second.
+ */
+@property (nonatomic) NSTimeInterval maximumDelay;
+
+/**
+ *  Defaults to `4`.
+ */
+@property (nonatomic) NSUInteger maximumConcurrentRequests;
+
+/**
+ *  Number of messages with changes not yet sent.
+ */
+@property (readonly, nonatomic) NSUInteger pendingCount;
+
+/**
+ *  Number of messages whose update is in flight.
+ */
+@property (readonly, nonatomic) NSUInteger inFlightCount;
+
+/**
+ *  Queues a change of the flags set on `flags`; flags left `nil` keep any queued value.
+ *
+ *  @param completion called with `nil` once the update including this change succeeded, or with its error
+ */
+- (void)updateFlags:(CIOMessageFlags *)flags
+    forMessageWithID:(NSString *)messageID
+          completion:(nullable void (^)(NSError *__nullable error))completion;
+
+/**
+ *  Queues the same change for several messages.
+ *
+ *  @param completion called once every message was updated, with the errors of the messages which failed keyed by
+ * message id. The dictionary is empty when all succeeded.
+ */
+- (void)updateFlags:(CIOMessageFlags *)flags
+    forMessagesWithIDs:(NSArray *)messageIDs
+            completion:(nullable void (^)(NSDictionary *errors))completion;
+
+/**
+ *  The merged changes queued for a message and not yet sent.
+ */
+- (nullable CIOMessageFlags *)pendingFlagsForMessageWithID:(NSString *)messageID;
+
+/**
+ *  Sends queued changes now, without waiting for the debounce.
+ */
+- (void)flush;
+
+@end
+
+NS_ASSUME_NONNULL_END
@@ -0,0 +1,195 @@
+//
+//  CIOFlagUpdateQueue.m
+//  CIOAPIClient
+//
+//  Copyright © 2015 Context.io. All rights reserved.
+//
+
+#import "CIOFlagUpdateQueue.h"
+#import "CIOV2Client.h"
+#import "CIOBoundedRunner.h"
+
+static NSString *const CIOFlagUpdateErrorDomain = @"io.context.error.flags";
+
+@interface CIOFlagUpdateQueue ()
+
+// message_id -> NSMutableDictionary of the flag values not yet sent
+@property (nonatomic) NSMutableDictionary *pendingFlags;
+// message_id -> NSMutableArray of completions waiting for the pending flags to be sent
+@property (nonatomic) NSMutableDictionary *pendingCompletions;
+// Ids of messages with changes still being debounced, and of those ready to be sent, oldest first
+@property (nonatomic) NSMutableOrderedSet *debouncing;
+@property (nonatomic) NSMutableOrderedSet *ready;
+@property (nonatomic) NSMutableSet *inFlight;
+@property (nonatomic) CIOBoundedRunner *runner;
+@property (nullable, nonatomic) NSDate *firstChangeDate;
+// Incremented to cancel a scheduled flush
+@property (nonatomic) NSUInteger flushGeneration;
+
+@end
+
+@implementation CIOFlagUpdateQueue
+
+- (instancetype)initWithClient:(CIOV2Client *)client {
+    __weak CIOV2Client *weakClient = client;
+    return [self initWithRequestFactory:^CIODictionaryRequest *(NSString *messageID, CIOMessageFlags *flags) {
+      return [weakClient updateFlagsForMessageWithID:messageID flags:flags];
+    }];
+}
+
+- (instancetype)initWithRequestFactory:(CIOFlagUpdateRequestFactory)requestFactory {
+    if ((self = [super init])) {
+        _requestFactory = [requestFactory copy];
+        _debounceInterval = 0.25;
+        _maximumDelay = 1;
+        _maximumConcurrentRequests = 4;
+        _pendingFlags = [NSMutableDictionary dictionary];
+        _pendingCompletions = [NSMutableDictionary dictionary];
+        _debouncing = [NSMutableOrderedSet orderedSet];
+        _ready = [NSMutableOrderedSet orderedSet];
+        _inFlight = [NSMutableSet set];
+        __weak typeof(self) weakSelf = self;
+        _runner = [[CIOBoundedRunner alloc] initWithStartBlock:^BOOL(void (^finish)(void)) {
+          return [weakSelf _startNextRequestWithFinish:finish];
+        }];
+    }
+    return self;
+}
+
+- (NSUInteger)pendingCount {
+    return self.pendingFlags.count;
+}
+
+- (NSUInteger)inFlightCount {
+    return self.inFlight.count;
+}
+
+- (CIOMessageFlags *)pendingFlagsForMessageWithID:(NSString *)messageID {
+    NSDictionary *values = self.pendingFlags[messageID];
+    if (!values) {
+        return nil;
+    }
+    CIOMessageFlags *flags = [CIOMessageFlags new];
+    [flags setValuesForKeysWithDictionary:values];
+    return flags;
+}
+
+#pragma mark - Queueing
+
+- (void)updateFlags:(CIOMessageFlags *)flags
+    forMessageWithID:(NSString *)messageID
+          completion:(void (^)(NSError *))completion {
+    NSParameterAssert([NSThread isMainThread]);
+    NSMutableDictionary *values = self.pendingFlags[messageID];
+    if (!values) {
+        values = [NSMutableDictionary dictionary];
+        self.pendingFlags[messageID] = values;
+        self.pendingCompletions[messageID] = [NSMutableArray array];
+    }
+    [values addEntriesFromDictionary:[flags asDictionary]];
+    if (completion) {
+        [self.pendingCompletions[messageID] addObject:[completion copy]];
+    }
+    // Changes to a message already waiting for a free slot go out with it
+    if (![self.ready containsObject:messageID]) {
+        [self.debouncing addObject:messageID];
+        if (!self.firstChangeDate) {
+            self.firstChangeDate = [NSDate date];
+        }
+        [self _scheduleFlush];
+    }
+}
+
+- (void)updateFlags:(CIOMessageFlags *)flags
+    forMessagesWithIDs:(NSArray *)messageIDs
+            completion:(void (^)(NSDictionary *))completion {
+    NSOrderedSet *uniqueIDs = [NSOrderedSet orderedSetWithArray:messageIDs];
+    NSMutableDictionary *errors = [NSMutableDictionary dictionary];
+    __block NSUInteger remaining = uniqueIDs.count;
+    if (remaining == 0 && completion) {
+        dispatch_async(dispatch_get_main_queue(), ^{
+          completion(errors);
+        });
+    }
+    for (NSString *messageID in uniqueIDs) {
+        [self updateFlags:flags forMessageWithID:messageID completion:^(NSError *error) {
+          if (error) {
+              errors[messageID] = error;
+          }
+          if (--remaining == 0 && completion) {
+              completion(errors);
+          }
+        }];
+    }
+}
+
+- (void)_scheduleFlush {
+    NSTimeInterval delay = MIN(self.debounceInterval, MAX(0, self.maximumDelay + self.firstChangeDate.timeIntervalSinceNow));
+    NSUInteger generation = ++self.flushGeneration;
+    dispatch_after(dispatch_time(DISPATCH_TIME_NOW, (int64_t)(delay * NSEC_PER_SEC)), dispatch_get_main_queue(), ^{
+      if (generation == self.flushGeneration) {
+          [self flush];
+      }
+    });
+}
+
+#pragma mark - Sending
+
+- (void)flush {
+    NSParameterAssert([NSThread isMainThread]);
+    self.flushGeneration++;
+    self.firstChangeDate = nil;
+    [self.ready unionOrderedSet:self.debouncing];
+    [self.debouncing removeAllObjects];
+    [self _startRequests];
+}
+
+- (void)_startRequests {
+    self.runner.maximumConcurrentOperations = self.maximumConcurrentRequests;
+    [self.runner run];
+}
+
+- (BOOL)_startNextRequestWithFinish:(void (^)(void))finish {
+    NSUInteger index = 0;
+    // Messages with an update in flight are sent once it is done, so the two can't land out of order
+    while (index < self.ready.count && [self.inFlight containsObject:self.ready[index]]) {
+        index++;
+    }
+    if (index == self.ready.count) {
+        return NO;
+    }
+    NSString *messageID = self.ready[index];
+    [self.ready removeObjectAtIndex:index];
+    CIOMessageFlags *flags = [self pendingFlagsForMessageWithID:messageID];
+    NSArray *completions = self.pendingCompletions[messageID];
+    [self.pendingFlags removeObjectForKey:messageID];
+    [self.pendingCompletions removeObjectForKey:messageID];
+    [self.inFlight addObject:messageID];
+
+    void (^done)(NSError *) = ^(NSError *error) {
+      [self.inFlight removeObject:messageID];
+      for (void (^completion)(NSError *) in completions) {
+          completion(error);
+      }
+      finish();
+    };
+    CIODictionaryRequest *request = self.requestFactory(messageID, flags);
+    if (!request) {
+        // E.g. the client of `initWithClient:` is gone
+        NSError *error = [NSError errorWithDomain:CIOFlagUpdateErrorDomain
+                                             code:NSURLErrorCancelled
+                                         userInfo:@{NSLocalizedDescriptionKey: @"No request to update the flags"}];
+        dispatch_async(dispatch_get_main_queue(), ^{
+          done(error);
+        });
+        return YES;
+    }
+    [request executeWithSuccess:^(NSDictionary *response) {
+      done(nil);
+    } failure:^(NSError *error) {
+      done(error);
+    }];
+    return YES;
+}
+
+@end
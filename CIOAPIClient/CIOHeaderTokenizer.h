@@ -0,0 +1,148 @@
+//
+//  CIOHeaderTokenizer.h
+//  CIOAPIClient
+//
+//  Copyright © 2015 Context.io. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+
+NS_ASSUME_NONNULL_BEGIN
+
+/**
+ A single header found by `CIOHeaderTokenizer`. A field only records where its name and value live in the tokenizer's
+ buffer; strings are created, and encoded-words decoded, the first time they are asked for.
+ */
+@interface CIOHeaderField : NSObject
+
+/**
+ *  Location of the header name in the tokenizer's `data`, without the colon or any whitespace before it.
+ */
+@property (readonly, nonatomic) NSRange nameRange;
+
+/**
+ *  Location of the still-folded header value in the tokenizer's `data`, from the first non-whitespace character after
+ * the colon to the end of the last continuation line, excluding its line break.
+ */
+@property (readonly, nonatomic) NSRange valueRange;
+
+@property (readonly, nonatomic) NSString *name;
+
+/**
+ *  The unfolded value, with RFC 2047 encoded-words left as they are. Use this for structured headers such as
+ * `Content-Type` or `Message-ID`.
+ */
+@property (readonly, nonatomic) NSString *rawValue;
+
+/**
+ *  The unfolded value with RFC 2047 encoded-words (`=?utf-8?Q?Caf=C3=A9?=`) decoded, for display headers such as
+ * `Subject` or `From`.
+ */
+@property (readonly, nonatomic) NSString *value;
+
+@end
+
+/**
+ `CIOHeaderTokenizer` splits a raw RFC 5322 header block, such as the string returned by
+ `-[CIOV2Client getRawHeadersForMessageWithID:]` or `-[CIOLiteMessageRequest getRawHeaders]`, in to its fields.
+
+ Tokenizing only records name and value ranges in to the original buffer, handling folded values and duplicate
+ headers, and stops at the blank line which ends the header block. The headers needed for threading (`Message-ID`,
+ `In-Reply-To`, `References` and `Date`) are picked out during that single pass, so reading them needs no search.
+ */
+@interface CIOHeaderTokenizer : NSObject
+
+/**
+ *  Tokenizes the header block at the start of `data`.
+ */
+- (instancetype)initWithData:(NSData *)data;
+
+/**
+ *  Tokenizes the header block at the start of `range` within `data`, for instance the headers of one part of a larger
+ * message. Ranges of the resulting fields are relative to the whole of `data`.
+ */
+- (instancetype)initWithData:(NSData *)data range:(NSRange)range NS_DESIGNATED_INITIALIZER;
+
+/**
+ *  Tokenizes a header block returned as a string by the API.
+ */
+- (instancetype)initWithString:(NSString *)string;
+
+- (instancetype)init NS_UNAVAILABLE;
+
+@property (readonly, nonatomic) NSData *data;
+
+/**
+ *  Offset in `data` just past the blank line ending the header block, which is where a message body starts. If there
+ * is no blank line this is the end of the tokenized range.
+ */
+@property (readonly, nonatomic) NSUInteger endLocation;
+
+/**
+ *  All fields in the order they appear, including duplicates.
+ */
+@property (readonly, nonatomic) NSArray *fields;
+
+@property (readonly, nonatomic) NSUInteger count;
+
+- (CIOHeaderField *)fieldAtIndex:(NSUInteger)index;
+
+/**
+ *  The first field named `name`, compared case-insensitively.
+ */
+- (nullable CIOHeaderField *)fieldNamed:(NSString *)name;
+
+/**
+ *  Every field named `name` in order, e.g. all `Received` headers.
+ */
+- (NSArray *)fieldsNamed:(NSString *)name;
+
+/**
+ *  The decoded value of the first field named `name`.
+ */
+- (nullable NSString *)valueForHeader:(NSString *)name;
+
+#pragma mark - Threading Headers
+
+/**
+ *  `Message-ID` of the message, without angle brackets.
+ */
+@property (nullable, readonly, nonatomic) NSString *messageID;
+
+/**
+ *  First message id in `In-Reply-To`, without angle brackets.
+ */
+@property (nullable, readonly, nonatomic) NSString *inReplyTo;
+
+/**
+ *  Message ids listed in `References`, oldest first and without angle brackets. Empty if there is no such header.
+ */
+@property (readonly, nonatomic) NSArray *references;
+
+/**
+ *  The `Date` header, or `nil` if it is missing or can't be parsed.
+ */
+@property (nullable, readonly, nonatomic) NSDate *date;
+
+#pragma mark - Value Decoding
+
+/**
+ *  Decodes RFC 2047 encoded-words in `value`. Whitespace between adjacent encoded-words is dropped and malformed
+ * encoded-words are left as they are.
+ */
++ (NSString *)decodeEncodedWords:(NSString *)value;
+
+/**
+ *  Extracts the `<id>` tokens of a `Message-ID`, `In-Reply-To` or `References` value, without angle brackets. Values
+ * without any angle brackets are split on whitespace instead.
+ */
++ (NSArray *)messageIDsInString:(NSString *)value;
+
+/**
+ *  Parses an RFC 5322 date such as `Tue, 14 Jul 2015 10:00:00 -0700 (PDT)`, with or without the day name or seconds.
+ */
++ (nullable NSDate *)dateFromString:(NSString *)value;
+
+@end
+
+NS_ASSUME_NONNULL_END
@@ -0,0 +1,465 @@
+//
+//  CIOHeaderTokenizer.m
+//  CIOAPIClient
+//
+//  Copyright © 2015 Context.io. All rights reserved.
+//
+
+#import "CIOHeaderTokenizer.h"
+#import "CIOTransferDecoder.h"
+
+#include <strings.h>
+
+typedef struct {
+    NSRange name;
+    NSRange value;
+} CIOHeaderSlice;
+
+// Headers picked out while tokenizing, indexing `kCIOCommonHeaderNames`
+typedef NS_ENUM(NSUInteger, CIOCommonHeader) {
+    CIOCommonHeaderMessageID,
+    CIOCommonHeaderInReplyTo,
+    CIOCommonHeaderReferences,
+    CIOCommonHeaderDate,
+    CIOCommonHeaderCount
+};
+
+static const char *const kCIOCommonHeaderNames[CIOCommonHeaderCount] = {"message-id", "in-reply-to", "references",
+                                                                        "date"};
+
+static NSString *CIOHeaderStringFromBytes(const uint8_t *bytes, NSUInteger length) {
+    NSString *string = [[NSString alloc] initWithBytes:bytes length:length encoding:NSUTF8StringEncoding];
+    if (!string) {
+        // Raw 8-bit headers which aren't UTF-8 are most often Latin-1, which can represent any byte sequence
+        string = [[NSString alloc] initWithBytes:bytes length:length encoding:NSISOLatin1StringEncoding];
+    }
+    return string ?: @"";
+}
+
+// Unfolds a value by removing the line breaks, but not the leading whitespace, of continuation lines (RFC 5322 2.2.3)
+static NSString *CIOHeaderUnfold(const uint8_t *bytes, NSUInteger length) {
+    if (!memchr(bytes, '\n', length)) {
+        return CIOHeaderStringFromBytes(bytes, length);
+    }
+    NSMutableData *unfolded = [NSMutableData dataWithLength:length];
+    uint8_t *out = unfolded.mutableBytes;
+    NSUInteger written = 0;
+    for (NSUInteger i = 0; i < length; i++) {
+        if (bytes[i] == '\n' || (bytes[i] == '\r' && i + 1 < length && bytes[i + 1] == '\n')) {
+            continue;
+        }
+        out[written++] = bytes[i];
+    }
+    return CIOHeaderStringFromBytes(out, written);
+}
+
+// Decodes the encoded-word starting at `location` (`=?charset?B?text?=`). Returns NO if it is malformed.
+static BOOL CIODecodeEncodedWord(NSString *value, NSUInteger location, NSStringEncoding *outEncoding,
+                                 NSData **outBytes, NSUInteger *outEnd) {
+    NSUInteger length = value.length;
+    NSUInteger charsetStart = location + 2;
+    NSRange charsetEnd = [value rangeOfString:@"?" options:NSLiteralSearch
+                                        range:NSMakeRange(charsetStart, length - charsetStart)];
+    if (charsetEnd.location == NSNotFound || charsetEnd.location == charsetStart ||
+        charsetEnd.location + 3 > length || [value characterAtIndex:charsetEnd.location + 2] != '?') {
+        return NO;
+    }
+    unichar method = [value characterAtIndex:charsetEnd.location + 1];
+    NSUInteger textStart = charsetEnd.location + 3;
+    NSRange textEnd = [value rangeOfString:@"?=" options:NSLiteralSearch range:NSMakeRange(textStart, length - textStart)];
+    if (textEnd.location == NSNotFound) {
+        return NO;
+    }
+    NSString *charset = [value substringWithRange:NSMakeRange(charsetStart, charsetEnd.location - charsetStart)];
+    NSString *text = [value substringWithRange:NSMakeRange(textStart, textEnd.location - textStart)];
+    if ([text rangeOfCharacterFromSet:[NSCharacterSet whitespaceAndNewlineCharacterSet]].location != NSNotFound) {
+        return NO;
+    }
+    // RFC 2231 allows a language suffix, as in `utf-8*en`
+    charset = [charset componentsSeparatedByString:@"*"][0];
+    CFStringEncoding cfEncoding = CFStringConvertIANACharSetNameToEncoding((__bridge CFStringRef)charset);
+    if (cfEncoding == kCFStringEncodingInvalidId) {
+        return NO;
+    }
+
+    NSData *encoded = [text dataUsingEncoding:NSASCIIStringEncoding];
+    if (!encoded) {
+        return NO;
+    }
+    if (method == 'B' || method == 'b') {
+        *outBytes = [CIOTransferDecoder decodeData:encoded encoding:CIOTransferEncodingBase64];
+    } else if (method == 'Q' || method == 'q') {
+        // "_" always stands for a space; a literal underscore is escaped as =5F
+        NSMutableData *spaced = [encoded mutableCopy];
+        uint8_t *bytes = spaced.mutableBytes;
+        for (NSUInteger i = 0; i < spaced.length; i++) {
+            if (bytes[i] == '_') {
+                bytes[i] = ' ';
+            }
+        }
+        *outBytes = [CIOTransferDecoder decodeData:spaced encoding:CIOTransferEncodingQuotedPrintable];
+    } else {
+        return NO;
+    }
+    *outEncoding = CFStringConvertEncodingToNSStringEncoding(cfEncoding);
+    *outEnd = NSMaxRange(textEnd);
+    return YES;
+}
+
+@interface CIOHeaderField ()
+
+@property (nonatomic) NSData *data;
+@property (readwrite, nonatomic) NSRange nameRange;
+@property (readwrite, nonatomic) NSRange valueRange;
+
+@end
+
+@implementation CIOHeaderField {
+    NSString *_name;
+    NSString *_rawValue;
+    NSString *_value;
+}
+
+- (NSString *)name {
+    if (!_name) {
+        _name = CIOHeaderStringFromBytes((const uint8_t *)self.data.bytes + self.nameRange.location,
+                                         self.nameRange.length);
+    }
+    return _name;
+}
+
+- (NSString *)rawValue {
+    if (!_rawValue) {
+        _rawValue =
+            CIOHeaderUnfold((const uint8_t *)self.data.bytes + self.valueRange.location, self.valueRange.length);
+    }
+    return _rawValue;
+}
+
+- (NSString *)value {
+    if (!_value) {
+        _value = [CIOHeaderTokenizer decodeEncodedWords:self.rawValue];
+    }
+    return _value;
+}
+
+- (NSString *)description {
+    return [NSString stringWithFormat:@"<%@: %@: %@>", NSStringFromClass([self class]), self.name, self.rawValue];
+}
+
+@end
+
+#pragma mark -
+
+@interface CIOHeaderTokenizer () {
+    NSMutableData *_slices;
+    NSUInteger _count;
+    NSUInteger _commonIndexes[CIOCommonHeaderCount];
+    NSMutableArray *_fields;
+}
+
+@end
+
+@implementation CIOHeaderTokenizer
+
+- (instancetype)initWithData:(NSData *)data {
+    return [self initWithData:data range:NSMakeRange(0, data.length)];
+}
+
+- (instancetype)initWithString:(NSString *)string {
+    return [self initWithData:[string dataUsingEncoding:NSUTF8StringEncoding] ?: [NSData data]];
+}
+
+- (instancetype)initWithData:(NSData *)data range:(NSRange)range {
+    if ((self = [super init])) {
+        _data = data;
+        _slices = [NSMutableData data];
+        for (NSUInteger i = 0; i < CIOCommonHeaderCount; i++) {
+            _commonIndexes[i] = NSNotFound;
+        }
+        [self _tokenizeFrom:range.location end:NSMaxRange(range)];
+    }
+    return self;
+}
+
+- (void)_addSlice:(CIOHeaderSlice)slice {
+    const char *name = (const char *)self.data.bytes + slice.name.location;
+    for (NSUInteger i = 0; i < CIOCommonHeaderCount; i++) {
+        if (_commonIndexes[i] == NSNotFound && strlen(kCIOCommonHeaderNames[i]) == slice.name.length &&
+            strncasecmp(name, kCIOCommonHeaderNames[i], slice.name.length) == 0) {
+            _commonIndexes[i] = _count;
+        }
+    }
+    [_slices appendBytes:&slice length:sizeof(slice)];
+    _count++;
+}
+
+- (void)_tokenizeFrom:(NSUInteger)start end:(NSUInteger)end {
+    const uint8_t *bytes = self.data.bytes;
+    CIOHeaderSlice current = {{0, 0}, {0, 0}};
+    BOOL hasCurrent = NO;
+
+    NSUInteger cursor = start;
+    while (cursor < end) {
+        const uint8_t *newline = memchr(bytes + cursor, '\n', end - cursor);
+        NSUInteger lineEnd = newline ? (NSUInteger)(newline - bytes) : end;
+        NSUInteger nextLine = newline ? lineEnd + 1 : end;
+        NSUInteger contentEnd = lineEnd;
+        if (contentEnd > cursor && bytes[contentEnd - 1] == '\r') {
+            contentEnd--;
+        }
+        if (contentEnd == cursor) {
+            cursor = nextLine;
+            break;
+        }
+        uint8_t first = bytes[cursor];
+        if ((first == ' ' || first == '\t') && hasCurrent) {
+            current.value.length = contentEnd - current.value.location;
+        } else {
+            if (hasCurrent) {
+                [self _addSlice:current];
+                hasCurrent = NO;
+            }
+            const uint8_t *colon = memchr(bytes + cursor, ':', contentEnd - cursor);
+            // Lines without a colon, such as an mbox "From " line, are skipped
+            if (colon) {
+                NSUInteger nameEnd = (NSUInteger)(colon - bytes);
+                NSUInteger trimmedNameEnd = nameEnd;
+                while (trimmedNameEnd > cursor &&
+                       (bytes[trimmedNameEnd - 1] == ' ' || bytes[trimmedNameEnd - 1] == '\t')) {
+                    trimmedNameEnd--;
+                }
+                NSUInteger valueStart = nameEnd + 1;
+                while (valueStart < contentEnd && (bytes[valueStart] == ' ' || bytes[valueStart] == '\t')) {
+                    valueStart++;
+                }
+                current.name = NSMakeRange(cursor, trimmedNameEnd - cursor);
+                current.value = NSMakeRange(valueStart, contentEnd - valueStart);
+                hasCurrent = YES;
+            }
+        }
+        cursor = nextLine;
+    }
+    if (hasCurrent) {
+        [self _addSlice:current];
+    }
+    _endLocation = MIN(cursor, end);
+}
+
+#pragma mark - Fields
+
+- (NSUInteger)count {
+    return _count;
+}
+
+- (CIOHeaderField *)fieldAtIndex:(NSUInteger)index {
+    if (index >= _count) {
+        [NSException raise:NSRangeException format:@"Header index %lu beyond count %lu", (unsigned long)index,
+                                                   (unsigned long)_count];
+    }
+    if (!_fields) {
+        _fields = [NSMutableArray arrayWithCapacity:_count];
+        for (NSUInteger i = 0; i < _count; i++) {
+            [_fields addObject:[NSNull null]];
+        }
+    }
+    CIOHeaderField *field = _fields[index];
+    if ((id)field == [NSNull null]) {
+        CIOHeaderSlice slice = ((const CIOHeaderSlice *)_slices.bytes)[index];
+        field = [CIOHeaderField new];
+        field.data = self.data;
+        field.nameRange = slice.name;
+        field.valueRange = slice.value;
+        _fields[index] = field;
+    }
+    return field;
+}
+
+- (NSArray *)fields {
+    NSMutableArray *fields = [NSMutableArray arrayWithCapacity:_count];
+    for (NSUInteger i = 0; i < _count; i++) {
+        [fields addObject:[self fieldAtIndex:i]];
+    }
+    return fields;
+}
+
+// Indexes of fields named `name`, compared against the buffer without creating any strings
+- (NSIndexSet *)_indexesOfFieldsNamed:(NSString *)name firstOnly:(BOOL)firstOnly {
+    NSMutableIndexSet *indexes = [NSMutableIndexSet indexSet];
+    const char *needle = name.UTF8String;
+    size_t needleLength = strlen(needle);
+    const char *bytes = self.data.bytes;
+    const CIOHeaderSlice *slices = _slices.bytes;
+    for (NSUInteger i = 0; i < _count; i++) {
+        if (slices[i].name.length == needleLength &&
+            strncasecmp(bytes + slices[i].name.location, needle, needleLength) == 0) {
+            [indexes addIndex:i];
+            if (firstOnly) {
+                break;
+            }
+        }
+    }
+    return indexes;
+}
+
+- (CIOHeaderField *)fieldNamed:(NSString *)name {
+    NSUInteger index = [[self _indexesOfFieldsNamed:name firstOnly:YES] firstIndex];
+    return index == NSNotFound ? nil : [self fieldAtIndex:index];
+}
+
+- (NSArray *)fieldsNamed:(NSString *)name {
+    NSMutableArray *fields = [NSMutableArray array];
+    [[self _indexesOfFieldsNamed:name firstOnly:NO] enumerateIndexesUsingBlock:^(NSUInteger index, BOOL *stop) {
+      [fields addObject:[self fieldAtIndex:index]];
+    }];
+    return fields;
+}
+
+- (NSString *)valueForHeader:(NSString *)name {
+    return [self fieldNamed:name].value;
+}
+
+#pragma mark - Threading Headers
+
+- (CIOHeaderField *)_commonField:(CIOCommonHeader)header {
+    NSUInteger index = _commonIndexes[header];
+    return index == NSNotFound ? nil : [self fieldAtIndex:index];
+}
+
+- (NSString *)messageID {
+    return [[self.class messageIDsInString:[self _commonField:CIOCommonHeaderMessageID].rawValue ?: @""] firstObject];
+}
+
+- (NSString *)inReplyTo {
+    return [[self.class messageIDsInString:[self _commonField:CIOCommonHeaderInReplyTo].rawValue ?: @""] firstObject];
+}
+
+- (NSArray *)references {
+    return [self.class messageIDsInString:[self _commonField:CIOCommonHeaderReferences].rawValue ?: @""];
+}
+
+- (NSDate *)date {
+    NSString *value = [self _commonField:CIOCommonHeaderDate].rawValue;
+    return value ? [self.class dateFromString:value] : nil;
+}
+
+#pragma mark - Value Decoding
+
++ (NSString *)decodeEncodedWords:(NSString *)value {
+    if ([value rangeOfString:@"=?" options:NSLiteralSearch].location == NSNotFound) {
+        return value;
+    }
+    NSCharacterSet *whitespace = [NSCharacterSet whitespaceAndNewlineCharacterSet];
+    NSMutableString *result = [NSMutableString string];
+    // Bytes of consecutive encoded-words in the same charset are joined before decoding, as a multi-byte character
+    // may be split across two words
+    __block NSMutableData *pending = nil;
+    __block NSStringEncoding pendingEncoding = 0;
+    void (^flushPending)(void) = ^{
+        if (pending) {
+            NSString *decoded = [[NSString alloc] initWithData:pending encoding:pendingEncoding];
+            [result appendString:decoded ?: CIOHeaderStringFromBytes(pending.bytes, pending.length)];
+            pending = nil;
+        }
+    };
+
+    NSUInteger length = value.length;
+    NSUInteger cursor = 0;
+    while (cursor < length) {
+        NSRange start = [value rangeOfString:@"=?" options:NSLiteralSearch range:NSMakeRange(cursor, length - cursor)];
+        if (start.location == NSNotFound) {
+            flushPending();
+            [result appendString:[value substringFromIndex:cursor]];
+            break;
+        }
+        NSStringEncoding encoding = 0;
+        NSData *bytes = nil;
+        NSUInteger wordEnd = 0;
+        NSString *between = [value substringWithRange:NSMakeRange(cursor, start.location - cursor)];
+        if (!CIODecodeEncodedWord(value, start.location, &encoding, &bytes, &wordEnd)) {
+            flushPending();
+            [result appendString:between];
+            [result appendString:@"=?"];
+            cursor = NSMaxRange(start);
+            continue;
+        }
+        BOOL adjacent = pending && [between stringByTrimmingCharactersInSet:whitespace].length == 0;
+        if (!adjacent || encoding != pendingEncoding) {
+            flushPending();
+        }
+        if (!adjacent) {
+            [result appendString:between];
+        }
+        if (!pending) {
+            pending = [NSMutableData data];
+            pendingEncoding = encoding;
+        }
+        [pending appendData:bytes];
+        cursor = wordEnd;
+    }
+    flushPending();
+    return result;
+}
+
++ (NSArray *)messageIDsInString:(NSString *)value {
+    NSMutableArray *messageIDs = [NSMutableArray array];
+    NSUInteger length = value.length;
+    NSUInteger cursor = 0;
+    while (cursor < length) {
+        NSRange open = [value rangeOfString:@"<" options:NSLiteralSearch range:NSMakeRange(cursor, length - cursor)];
+        if (open.location == NSNotFound) {
+            break;
+        }
+        NSRange close = [value rangeOfString:@">" options:NSLiteralSearch
+                                       range:NSMakeRange(NSMaxRange(open), length - NSMaxRange(open))];
+        if (close.location == NSNotFound) {
+            break;
+        }
+        NSString *messageID = [value substringWithRange:NSMakeRange(NSMaxRange(open), close.location - NSMaxRange(open))];
+        if (messageID.length > 0) {
+            [messageIDs addObject:messageID];
+        }
+        cursor = NSMaxRange(close);
+    }
+    if (messageIDs.count == 0 && [value rangeOfString:@"<"].location == NSNotFound) {
+        for (NSString *token in [value componentsSeparatedByCharactersInSet:[NSCharacterSet whitespaceAndNewlineCharacterSet]]) {
+            if (token.length > 0) {
+                [messageIDs addObject:token];
+            }
+        }
+    }
+    return messageIDs;
+}
+
++ (NSDate *)dateFromString:(NSString *)value {
+    static NSArray *formatters;
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+      NSMutableArray *dateFormatters = [NSMutableArray array];
+      NSLocale *locale = [[NSLocale alloc] initWithLocaleIdentifier:@"en_US_POSIX"];
+      for (NSString *format in @[@"EEE, d MMM yyyy HH:mm:ss Z", @"d MMM yyyy HH:mm:ss Z", @"EEE, d MMM yyyy HH:mm Z",
+                                 @"d MMM yyyy HH:mm Z", @"EEE, d MMM yyyy HH:mm:ss zzz", @"d MMM yyyy HH:mm:ss zzz"]) {
+          NSDateFormatter *formatter = [NSDateFormatter new];
+          formatter.locale = locale;
+          formatter.dateFormat = format;
+          [dateFormatters addObject:formatter];
+      }
+      formatters = dateFormatters;
+    });
+
+    // Drop a trailing comment such as "(PDT)", which date formatters reject
+    NSRange comment = [value rangeOfString:@"("];
+    if (comment.location != NSNotFound) {
+        value = [value substringToIndex:comment.location];
+    }
+    value = [value stringByTrimmingCharactersInSet:[NSCharacterSet whitespaceAndNewlineCharacterSet]];
+    for (NSDateFormatter *formatter in formatters) {
+        NSDate *date = [formatter dateFromString:value];
+        if (date) {
+            return date;
+        }
+    }
+    return nil;
+}
+
+@end
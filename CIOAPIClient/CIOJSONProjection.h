@@ -0,0 +1,45 @@
+//
+//  CIOJSONProjection.h
+//  CIOAPIClient
+//
+//  Copyright © 2015 Context.io. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+
+NS_ASSUME_NONNULL_BEGIN
+
+/**
+ `CIOJSONProjection` decodes JSON keeping only the values at a set of key paths, such as `subject` or
+ `addresses.from.email`. Other subtrees are stepped over while tokenizing, so large fields nobody reads, like `files`,
+ `person_info` or `headers` of a page of messages, are never turned in to objects.
+
+ Key paths are dot-separated object keys. Arrays are looked through at any depth, so `addresses.to.email` applies to
+ every message of a page and to every recipient of a message. A key path keeps the whole value it points to. Kept
+ values are decoded straight from the bytes, leaving only strings with escapes to `NSJSONSerialization`; skipped
+ subtrees are only checked for balanced brackets and strings.
+
+ A projection is immutable and may be used from any thread.
+ */
+@interface CIOJSONProjection : NSObject
+
+/**
+ *  @param keyPaths `NSString` key paths of the values to keep
+ */
+- (instancetype)initWithKeyPaths:(NSSet *)keyPaths NS_DESIGNATED_INITIALIZER;
+
+- (instancetype)init NS_UNAVAILABLE;
+
+@property (readonly, nonatomic) NSSet *keyPaths;
+
+/**
+ *  Decodes `data`, an object or array in UTF-8, keeping only the projected values. Objects keep the projected keys
+ * they have, and may end up empty. Scalars are returned as they are.
+ *
+ *  @param error set to an `NSCocoaErrorDomain` error if `data` is not valid JSON
+ */
+- (nullable id)objectWithData:(NSData *)data error:(NSError **)error;
+
+@end
+
+NS_ASSUME_NONNULL_END
@@ -0,0 +1,339 @@
+//
+//  CIOJSONProjection.m
+//  CIOAPIClient
+//
+//  Copyright © 2015 Context.io. All rights reserved.
+//
+
+#import "CIOJSONProjection.h"
+#import <xlocale.h>
+
+typedef struct {
+    __unsafe_unretained NSData *data;
+    const uint8_t *bytes;
+    NSUInteger length;
+    NSUInteger location;
+} CIOJSONScanner;
+
+static void CIOJSONSkipWhitespace(CIOJSONScanner *scanner) {
+    while (scanner->location < scanner->length) {
+        uint8_t c = scanner->bytes[scanner->location];
+        if (c != ' ' && c != '\n' && c != '\r' && c != '\t') {
+            return;
+        }
+        scanner->location++;
+    }
+}
+
+// Moves past the string starting at the current location. Sets `hasEscapes` if it contains a backslash.
+static BOOL CIOJSONSkipString(CIOJSONScanner *scanner, BOOL *hasEscapes) {
+    for (NSUInteger i = scanner->location + 1; i < scanner->length; i++) {
+        uint8_t c = scanner->bytes[i];
+        if (c == '\\') {
+            if (hasEscapes) {
+                *hasEscapes = YES;
+            }
+            i++;
+        } else if (c == '"') {
+            scanner->location = i + 1;
+            return YES;
+        }
+    }
+    return NO;
+}
+
+// Moves past the value starting at the current location without decoding it
+static BOOL CIOJSONSkipValue(CIOJSONScanner *scanner) {
+    if (scanner->location >= scanner->length) {
+        return NO;
+    }
+    uint8_t c = scanner->bytes[scanner->location];
+    if (c == '"') {
+        return CIOJSONSkipString(scanner, NULL);
+    }
+    if (c != '{' && c != '[') {
+        NSUInteger start = scanner->location;
+        while (scanner->location < scanner->length) {
+            c = scanner->bytes[scanner->location];
+            if (c == ',' || c == ']' || c == '}' || c == ' ' || c == '\n' || c == '\r' || c == '\t') {
+                break;
+            }
+            scanner->location++;
+        }
+        return scanner->location > start;
+    }
+    NSUInteger depth = 0;
+    while (scanner->location < scanner->length) {
+        c = scanner->bytes[scanner->location];
+        if (c == '"') {
+            if (!CIOJSONSkipString(scanner, NULL)) {
+                return NO;
+            }
+            continue;
+        }
+        if (c == '{' || c == '[') {
+            depth++;
+        } else if (c == '}' || c == ']') {
+            if (--depth == 0) {
+                scanner->location++;
+                return YES;
+            }
+        }
+        scanner->location++;
+    }
+    return NO;
+}
+
+// Decodes the bytes of a single value with NSJSONSerialization, for the values not decoded directly
+static id CIOJSONDecodeRange(CIOJSONScanner *scanner, NSRange range) {
+    return [NSJSONSerialization JSONObjectWithData:[scanner->data subdataWithRange:range]
+                                           options:NSJSONReadingAllowFragments
+                                             error:NULL];
+}
+
+static BOOL CIOJSONRangeIsLiteral(CIOJSONScanner *scanner, NSRange range, const char *literal) {
+    size_t length = strlen(literal);
+    return range.length == length && memcmp(scanner->bytes + range.location, literal, length) == 0;
+}
+
+// Decodes a number in JSON syntax, or returns nil
+static NSNumber *CIOJSONDecodeNumber(CIOJSONScanner *scanner, NSRange range) {
+    const uint8_t *bytes = scanner->bytes + range.location;
+    NSUInteger end = range.length;
+    NSUInteger i = 0;
+    BOOL negative = i < end && bytes[i] == '-';
+    if (negative) {
+        i++;
+    }
+    NSUInteger integerStart = i;
+    unsigned long long magnitude = 0;
+    BOOL overflow = NO;
+    while (i < end && bytes[i] >= '0' && bytes[i] <= '9') {
+        unsigned digit = bytes[i] - '0';
+        overflow = overflow || magnitude > (ULLONG_MAX - digit) / 10;
+        magnitude = magnitude * 10 + digit;
+        i++;
+    }
+    NSUInteger integerLength = i - integerStart;
+    if (integerLength == 0 || (integerLength > 1 && bytes[integerStart] == '0')) {
+        return nil;
+    }
+    BOOL integral = YES;
+    if (i < end && bytes[i] == '.') {
+        integral = NO;
+        NSUInteger fractionStart = ++i;
+        while (i < end && bytes[i] >= '0' && bytes[i] <= '9') {
+            i++;
+        }
+        if (i == fractionStart) {
+            return nil;
+        }
+    }
+    if (i < end && (bytes[i] == 'e' || bytes[i] == 'E')) {
+        integral = NO;
+        i++;
+        if (i < end && (bytes[i] == '+' || bytes[i] == '-')) {
+            i++;
+        }
+        NSUInteger exponentStart = i;
+        while (i < end && bytes[i] >= '0' && bytes[i] <= '9') {
+            i++;
+        }
+        if (i == exponentStart) {
+            return nil;
+        }
+    }
+    if (i != end) {
+        return nil;
+    }
+    if (integral && !overflow && magnitude <= (unsigned long long)LLONG_MAX) {
+        return @(negative ? -(long long)magnitude : (long long)magnitude);
+    }
+    char buffer[64];
+    if (integral || range.length >= sizeof(buffer)) {
+        // Integers beyond long long, and unusually long numbers, are rare enough to leave to NSJSONSerialization
+        return CIOJSONDecodeRange(scanner, range);
+    }
+    memcpy(buffer, bytes, range.length);
+    buffer[range.length] = '\0';
+    // The C locale, whose decimal point is JSON's whatever the process locale
+    return @(strtod_l(buffer, NULL, NULL));
+}
+
+// Decodes the number, `true`, `false` or `null` in `range` straight from the bytes
+static id CIOJSONDecodeScalar(CIOJSONScanner *scanner, NSRange range) {
+    if (CIOJSONRangeIsLiteral(scanner, range, "true")) {
+        return @YES;
+    }
+    if (CIOJSONRangeIsLiteral(scanner, range, "false")) {
+        return @NO;
+    }
+    if (CIOJSONRangeIsLiteral(scanner, range, "null")) {
+        return [NSNull null];
+    }
+    return CIOJSONDecodeNumber(scanner, range);
+}
+
+// Decodes the string at the current location. Only strings with escapes are handed to NSJSONSerialization.
+static NSString *CIOJSONScanString(CIOJSONScanner *scanner) {
+    if (scanner->location >= scanner->length || scanner->bytes[scanner->location] != '"') {
+        return nil;
+    }
+    NSUInteger start = scanner->location;
+    BOOL hasEscapes = NO;
+    if (!CIOJSONSkipString(scanner, &hasEscapes)) {
+        return nil;
+    }
+    if (hasEscapes) {
+        return CIOJSONDecodeRange(scanner, NSMakeRange(start, scanner->location - start));
+    }
+    return [[NSString alloc] initWithBytes:scanner->bytes + start + 1
+                                    length:scanner->location - start - 2
+                                  encoding:NSUTF8StringEncoding];
+}
+
+// Decodes the value at the current location. `node` maps the keys to keep to their own node, or is NSNull to keep the
+// whole value.
+static id CIOJSONScanValue(CIOJSONScanner *scanner, id node) {
+    CIOJSONSkipWhitespace(scanner);
+    if (scanner->location >= scanner->length) {
+        return nil;
+    }
+    uint8_t c = scanner->bytes[scanner->location];
+    if (c == '"') {
+        return CIOJSONScanString(scanner);
+    }
+    if (c != '{' && c != '[') {
+        NSUInteger start = scanner->location;
+        if (!CIOJSONSkipValue(scanner)) {
+            return nil;
+        }
+        return CIOJSONDecodeScalar(scanner, NSMakeRange(start, scanner->location - start));
+    }
+    scanner->location++;
+    CIOJSONSkipWhitespace(scanner);
+    if (c == '[') {
+        NSMutableArray *array = [NSMutableArray array];
+        if (scanner->location < scanner->length && scanner->bytes[scanner->location] == ']') {
+            scanner->location++;
+            return array;
+        }
+        while (YES) {
+            id element = CIOJSONScanValue(scanner, node);
+            if (!element) {
+                return nil;
+            }
+            [array addObject:element];
+            CIOJSONSkipWhitespace(scanner);
+            if (scanner->location >= scanner->length) {
+                return nil;
+            }
+            c = scanner->bytes[scanner->location++];
+            if (c == ']') {
+                return array;
+            }
+            if (c != ',') {
+                return nil;
+            }
+        }
+    }
+    NSMutableDictionary *object = [NSMutableDictionary dictionary];
+    if (scanner->location < scanner->length && scanner->bytes[scanner->location] == '}') {
+        scanner->location++;
+        return object;
+    }
+    while (YES) {
+        NSString *key = CIOJSONScanString(scanner);
+        if (!key) {
+            return nil;
+        }
+        CIOJSONSkipWhitespace(scanner);
+        if (scanner->location >= scanner->length || scanner->bytes[scanner->location] != ':') {
+            return nil;
+        }
+        scanner->location++;
+        // Everything below a kept value is kept
+        id child = node == [NSNull null] ? node : ((NSDictionary *)node)[key];
+        if (child) {
+            id value = CIOJSONScanValue(scanner, child);
+            if (!value) {
+                return nil;
+            }
+            object[key] = value;
+        } else {
+            CIOJSONSkipWhitespace(scanner);
+            if (!CIOJSONSkipValue(scanner)) {
+                return nil;
+            }
+        }
+        CIOJSONSkipWhitespace(scanner);
+        if (scanner->location >= scanner->length) {
+            return nil;
+        }
+        c = scanner->bytes[scanner->location++];
+        if (c == '}') {
+            return object;
+        }
+        if (c != ',') {
+            return nil;
+        }
+        CIOJSONSkipWhitespace(scanner);
+    }
+}
+
+@interface CIOJSONProjection ()
+
+// Key -> nested tree of the keys to keep below it, or NSNull to keep the whole value
+@property (nonatomic) NSDictionary *tree;
+
+@end
+
+@implementation CIOJSONProjection
+
+- (instancetype)initWithKeyPaths:(NSSet *)keyPaths {
+    if ((self = [super init])) {
+        _keyPaths = [keyPaths copy];
+        NSMutableDictionary *tree = [NSMutableDictionary dictionary];
+        for (NSString *keyPath in keyPaths) {
+            NSArray *keys = [keyPath componentsSeparatedByString:@"."];
+            NSMutableDictionary *node = tree;
+            for (NSUInteger i = 0; i < keys.count; i++) {
+                id child = node[keys[i]];
+                if (child == [NSNull null]) {
+                    // A shorter key path already keeps all of it
+                    break;
+                }
+                if (i == keys.count - 1) {
+                    node[keys[i]] = [NSNull null];
+                    break;
+                }
+                if (!child) {
+                    child = [NSMutableDictionary dictionary];
+                    node[keys[i]] = child;
+                }
+                node = child;
+            }
+        }
+        _tree = tree;
+    }
+    return self;
+}
+
+- (id)objectWithData:(NSData *)data error:(NSError **)error {
+    CIOJSONScanner scanner = {data, data.bytes, data.length, 0};
+    id object = CIOJSONScanValue(&scanner, self.tree);
+    CIOJSONSkipWhitespace(&scanner);
+    if (!object || scanner.location != scanner.length) {
+        if (error) {
+            NSString *description =
+                [NSString stringWithFormat:@"Invalid JSON around character %lu.", (unsigned long)scanner.location];
+            *error = [NSError errorWithDomain:NSCocoaErrorDomain
+                                         code:NSPropertyListReadCorruptError
+                                     userInfo:@{NSLocalizedDescriptionKey: description}];
+        }
+        return nil;
+    }
+    return object;
+}
+
+@end
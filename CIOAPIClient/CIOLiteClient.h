@@ -258,6 +258,22 @@ Create a folder on an email account
  */
 - (CIODictionaryRequest *)getSettingsForSourceType:(NSString *)sourceType email:(NSString *)email;
 
+#pragma mark - Request Templates
+
+/**
+ A template for `getFolderNamed:forAccountWithLabel:delimiter:`, for callers fetching many folders. Its slots are
+ `label` and `folder`; pass a `delimiter` in the parameters if needed. The path uses the current user's id, so make a
+ new template after switching users.
+ */
+- (CIORequestTemplate *)folderRequestTemplate;
+
+/**
+ A template for `-[CIOLiteMessageRequest getFlags]`, for callers refreshing the flags of many messages. Its slots are
+ `label`, `folder` and `message_id`; pass a `delimiter` in the parameters if needed. The path uses the current user's
+ id, so make a new template after switching users.
+ */
+- (CIORequestTemplate *)messageFlagsRequestTemplate;
+
 @end
 
 NS_ASSUME_NONNULL_END
\ No newline at end of file
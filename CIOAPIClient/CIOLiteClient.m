@@ -228,4 +228,30 @@ NSString *const CIOLiteAPIBaseURLString = @"https://api.context.io/lite/";
     return [self dictionaryRequestForPath:@"discovery" method:@"GET" params:params];
 }
 
+#pragma mark - Request Templates
+
+- (CIORequestTemplate *)folderRequestTemplate {
+    NSString *pathPattern = [self accountPath:@[@"email_accounts", @"{label}", @"folders", @"{folder}"]];
+    return [[CIORequestTemplate alloc] initWithClient:self
+                                               method:@"GET"
+                                          pathPattern:pathPattern
+                                           parameters:nil
+                                         requestClass:[CIODictionaryRequest class]];
+}
+
+- (CIORequestTemplate *)messageFlagsRequestTemplate {
+    NSString *pathPattern = [self accountPath:@[@"email_accounts",
+                                                @"{label}",
+                                                @"folders",
+                                                @"{folder}",
+                                                @"messages",
+                                                @"{message_id}",
+                                                @"flags"]];
+    return [[CIORequestTemplate alloc] initWithClient:self
+                                               method:@"GET"
+                                          pathPattern:pathPattern
+                                           parameters:nil
+                                         requestClass:[CIODictionaryRequest class]];
+}
+
 @end
@@ -68,6 +68,7 @@ NS_ASSUME_NONNULL_BEGIN
 
 /**
  Get complete headers of a given email message as a raw string, rather than parsed in to a dictionary.
+ Use `CIOHeaderTokenizer` to split the result in to fields.
  */
 - (CIORequest *)getRawHeaders;
 
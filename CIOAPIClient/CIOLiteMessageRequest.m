@@ -35,10 +35,12 @@
     NSString *path = [NSString pathWithComponents:@[self.path,
                                                     @"attachments",
                                                     attachmentID]];
-    return [CIORequest requestWithPath:path
-                                method:@"GET" 
-                            parameters:[self defaultParams] 
-                                client:self.client];
+    CIORequest *request = [CIORequest requestWithPath:path
+                                               method:@"GET"
+                                           parameters:[self defaultParams]
+                                               client:self.client];
+    request.contentKey = path;
+    return request;
 }
 
 #pragma mark - Body
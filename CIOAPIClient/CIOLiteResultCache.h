@@ -0,0 +1,101 @@
+//
+//  CIOLiteResultCache.h
+//  CIOAPIClient
+//
+//  Copyright © 2015 Context.io. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+
+NS_ASSUME_NONNULL_BEGIN
+
+@class CIOLiteClient;
+@class CIOArrayRequest;
+@class CIORequest;
+@class CIOWebhookEvent;
+
+/**
+ `CIOLiteResultCache` keeps the responses of `getFoldersForAccountWithLabel:includeNamesOnly:` and
+ `getMessagesForFolderWithPath:accountLabel:` warm and correct from webhook callbacks, instead of refetching them
+ periodically.
+
+ Every such response received by the client is cached, keyed by its path and parameters (see
+ `CIOAPIClientDidReceiveResponseNotification`). A webhook callback for a message then updates the cache in place where
+ it can, and drops only the responses it can no longer vouch for:
+
+ - Cached messages with the same id are updated in every listing, keeping only the fields they already had, so new
+   flags show up without a refetch.
+ - A message new to a folder is inserted in to the first page of that folder's listings, by date. Later pages of the
+   folder are dropped, as their offsets have shifted.
+ - The listings of a folder a cached message is no longer in are dropped, as it has moved out of that folder.
+ - Folder listings with message counts are dropped when one of their folders gets a message. Listings of folder names
+   are only dropped when the message is in a folder they don't have.
+
+ A webhook failure callback drops everything, as changes may have been missed. All methods are thread safe.
+ */
+@interface CIOLiteResultCache : NSObject
+
+- (instancetype)initWithClient:(CIOLiteClient *)client NS_DESIGNATED_INITIALIZER;
+
+- (instancetype)init NS_UNAVAILABLE;
+
+@property (readonly, nonatomic, weak) CIOLiteClient *client;
+
+/**
+ *  Maximum number of cached responses; the least recently used are dropped first. Defaults to `256`.
+ */
+@property (nonatomic) NSUInteger countLimit;
+
+/**
+ *  Responses older than this are not served, as a safety net for missed callbacks. Defaults to `0`, which keeps
+ * responses until they are invalidated.
+ */
+@property (nonatomic) NSTimeInterval maximumAge;
+
+/**
+ *  Number of cached responses.
+ */
+@property (readonly) NSUInteger count;
+
+/**
+ *  Whether the responses of a request are cached: folder listings and folder message listings of a Lite client, unless
+ * they have a `projection`.
+ */
++ (BOOL)canCacheRequest:(CIORequest *)request;
+
+- (nullable NSArray *)cachedResponseForRequest:(CIOArrayRequest *)request;
+
+- (void)setResponse:(NSArray *)response forRequest:(CIOArrayRequest *)request;
+
+/**
+ *  Calls `success` with the cached response of a request, or executes it.
+ *
+ *  @param success called on the main queue
+ *  @param failure called on the main queue if the request had to be executed and failed
+ */
+- (void)executeRequest:(CIOArrayRequest *)request
+               success:(void (^)(NSArray *response))success
+               failure:(nullable void (^)(NSError *error))failure;
+
+/**
+ *  Applies a webhook callback received by a `CIOWebhookReceiver`.
+ */
+- (void)applyWebhookEvent:(CIOWebhookEvent *)event;
+
+/**
+ *  Applies a webhook callback body, e.g. one received by your own servers and relayed to the app.
+ */
+- (void)applyWebhookPayload:(NSDictionary *)payload;
+
+/**
+ *  Drops the cached message listings of a folder, and the folder listings of its account.
+ *
+ *  @param accountLabel label of the folder's email account, or `nil` for any account
+ */
+- (void)invalidateFolder:(NSString *)folderPath accountLabel:(nullable NSString *)accountLabel;
+
+- (void)removeAllResponses;
+
+@end
+
+NS_ASSUME_NONNULL_END
@@ -0,0 +1,428 @@
+//
+//  CIOLiteResultCache.m
+//  CIOAPIClient
+//
+//  Copyright © 2015 Context.io. All rights reserved.
+//
+
+#import "CIOLiteResultCache.h"
+#import "CIOLiteClient.h"
+#import "CIOWebhookReceiver.h"
+
+// A cached folder listing or folder message listing
+@interface CIOLiteCachedResponse : NSObject
+
+@property (nonatomic, copy) NSString *accountLabel;
+// nil for folder listings
+@property (nullable, nonatomic, copy) NSString *folderPath;
+@property (nonatomic) BOOL namesOnly;
+@property (nonatomic) NSInteger offset;
+@property (nonatomic) NSInteger limit;
+@property (nonatomic) NSMutableArray *response;
+@property (nonatomic) NSDate *date;
+
+@end
+
+@implementation CIOLiteCachedResponse
+
+@end
+
+#pragma mark -
+
+// The account label and folder of a cacheable request's path, or nil. The folder is missing for folder listings.
+static NSArray *CIOLiteListingComponents(CIORequest *request) {
+    if (![request isKindOfClass:[CIOArrayRequest class]] || ![request.method isEqualToString:@"GET"] ||
+        ![request.client isKindOfClass:[CIOLiteClient class]] || request.projection) {
+        return nil;
+    }
+    NSArray *components = request.path.pathComponents;
+    NSUInteger accounts = [components indexOfObject:@"email_accounts"];
+    if (accounts == NSNotFound || components.count < accounts + 3 || ![components[accounts + 2] isEqualToString:@"folders"]) {
+        return nil;
+    }
+    NSString *accountLabel = components[accounts + 1];
+    if (components.count == accounts + 3) {
+        return @[accountLabel];
+    }
+    if (components.count > accounts + 4 && [components.lastObject isEqualToString:@"messages"]) {
+        NSRange folder = NSMakeRange(accounts + 3, components.count - accounts - 4);
+        NSString *folderPath = [[components subarrayWithRange:folder] componentsJoinedByString:@"/"];
+        NSString *delimiter = request.parameters[@"delimiter"];
+        if ([delimiter isKindOfClass:[NSString class]] && delimiter.length > 0 && ![delimiter isEqualToString:@"/"]) {
+            folderPath = [folderPath stringByReplacingOccurrencesOfString:delimiter withString:@"/"];
+        }
+        return @[accountLabel, folderPath];
+    }
+    return nil;
+}
+
+static NSString *CIOLiteCacheKey(CIORequest *request) {
+    NSDictionary *parameters = request.parameters;
+    NSMutableArray *pairs = [NSMutableArray arrayWithCapacity:parameters.count];
+    for (NSString *name in [parameters.allKeys sortedArrayUsingSelector:@selector(compare:)]) {
+        [pairs addObject:[NSString stringWithFormat:@"%@=%@", name, parameters[name]]];
+    }
+    return [NSString stringWithFormat:@"%@?%@", request.path, [pairs componentsJoinedByString:@"&"]];
+}
+
+static BOOL CIOLiteFolderEqual(NSString *a, NSString *b) {
+    if ([a caseInsensitiveCompare:@"INBOX"] == NSOrderedSame) {
+        return [b caseInsensitiveCompare:@"INBOX"] == NSOrderedSame;
+    }
+    return [a isEqualToString:b];
+}
+
+// "0" is an alias for the first account, so it can't be told apart from any other label
+static BOOL CIOLiteAccountMatches(NSString *cachedLabel, NSString *label) {
+    return !label || [cachedLabel isEqualToString:@"0"] || [cachedLabel isEqualToString:label];
+}
+
+static NSSet *CIOLiteMessageIDs(NSDictionary *message) {
+    NSMutableSet *messageIDs = [NSMutableSet set];
+    for (NSString *key in @[@"message_id", @"email_message_id"]) {
+        if ([message[key] isKindOfClass:[NSString class]]) {
+            [messageIDs addObject:message[key]];
+        }
+    }
+    return messageIDs;
+}
+
+static double CIOLiteMessageDate(NSDictionary *message) {
+    for (NSString *key in @[@"date", @"sent_at", @"date_received"]) {
+        if ([message[key] isKindOfClass:[NSNumber class]]) {
+            return [message[key] doubleValue];
+        }
+    }
+    return 0;
+}
+
+static NSString *CIOLiteFolderName(id folder) {
+    if ([folder isKindOfClass:[NSString class]]) {
+        return folder;
+    }
+    if ([folder isKindOfClass:[NSDictionary class]]) {
+        return [folder[@"path"] isKindOfClass:[NSString class]] ? folder[@"path"] : folder[@"name"];
+    }
+    return nil;
+}
+
+@interface CIOLiteResultCache ()
+
+@property (nonatomic) dispatch_queue_t queue;
+// Cache key -> CIOLiteCachedResponse
+@property (nonatomic) NSMutableDictionary *responses;
+// Cache keys, least recently used first
+@property (nonatomic) NSMutableOrderedSet *usage;
+
+@end
+
+@implementation CIOLiteResultCache
+
+- (instancetype)initWithClient:(CIOLiteClient *)client {
+    if ((self = [super init])) {
+        _client = client;
+        _countLimit = 256;
+        _queue = dispatch_queue_create("io.context.literesultcache", DISPATCH_QUEUE_SERIAL);
+        _responses = [NSMutableDictionary dictionary];
+        _usage = [NSMutableOrderedSet orderedSet];
+        [[NSNotificationCenter defaultCenter] addObserver:self
+                                                 selector:@selector(clientDidReceiveResponse:)
+                                                     name:CIOAPIClientDidReceiveResponseNotification
+                                                   object:client];
+    }
+    return self;
+}
+
+- (void)dealloc {
+    [[NSNotificationCenter defaultCenter] removeObserver:self];
+}
+
+- (void)clientDidReceiveResponse:(NSNotification *)notification {
+    CIORequest *request = notification.userInfo[CIOAPIClientRequestKey];
+    NSArray *response = notification.userInfo[CIOAPIClientResponseObjectKey];
+    if ([response isKindOfClass:[NSArray class]] && [self.class canCacheRequest:request]) {
+        [self setResponse:response forRequest:(CIOArrayRequest *)request];
+    }
+}
+
++ (BOOL)canCacheRequest:(CIORequest *)request {
+    return CIOLiteListingComponents(request) != nil;
+}
+
+- (NSUInteger)count {
+    __block NSUInteger count = 0;
+    dispatch_sync(self.queue, ^{
+      count = self.responses.count;
+    });
+    return count;
+}
+
+#pragma mark - Reading and writing
+
+- (NSArray *)cachedResponseForRequest:(CIOArrayRequest *)request {
+    if (![self.class canCacheRequest:request]) {
+        return nil;
+    }
+    NSString *key = CIOLiteCacheKey(request);
+    __block NSArray *response = nil;
+    dispatch_sync(self.queue, ^{
+      CIOLiteCachedResponse *cached = self.responses[key];
+      if (!cached) {
+          return;
+      }
+      if (self.maximumAge > 0 && -cached.date.timeIntervalSinceNow > self.maximumAge) {
+          [self _removeResponseForKey:key];
+          return;
+      }
+      [self.usage removeObject:key];
+      [self.usage addObject:key];
+      response = [cached.response copy];
+    });
+    return response;
+}
+
+- (void)setResponse:(NSArray *)response forRequest:(CIOArrayRequest *)request {
+    NSArray *components = CIOLiteListingComponents(request);
+    if (!components) {
+        return;
+    }
+    CIOLiteCachedResponse *cached = [CIOLiteCachedResponse new];
+    cached.accountLabel = components[0];
+    cached.folderPath = components.count > 1 ? components[1] : nil;
+    cached.namesOnly = [request.parameters[@"include_names_only"] boolValue];
+    cached.offset = request.offset;
+    cached.limit = request.limit;
+    cached.response = [response mutableCopy];
+    cached.date = [NSDate date];
+    NSString *key = CIOLiteCacheKey(request);
+    dispatch_sync(self.queue, ^{
+      self.responses[key] = cached;
+      [self.usage removeObject:key];
+      [self.usage addObject:key];
+      while (self.usage.count > MAX(self.countLimit, 1u)) {
+          [self _removeResponseForKey:self.usage.firstObject];
+      }
+    });
+}
+
+- (void)executeRequest:(CIOArrayRequest *)request
+               success:(void (^)(NSArray *))success
+               failure:(void (^)(NSError *))failure {
+    NSArray *cached = [self cachedResponseForRequest:request];
+    if (cached) {
+        dispatch_async(dispatch_get_main_queue(), ^{
+          success(cached);
+        });
+        return;
+    }
+    [request executeWithSuccess:^(NSArray *response) {
+      // Requests of other clients are not seen through the notification
+      [self setResponse:response forRequest:request];
+      success(response);
+    } failure:^(NSError *error) {
+      if (failure) {
+          failure(error);
+      }
+    }];
+}
+
+- (void)_removeResponseForKey:(NSString *)key {
+    [self.responses removeObjectForKey:key];
+    [self.usage removeObject:key];
+}
+
+- (void)_removeResponsesPassingTest:(BOOL (^)(CIOLiteCachedResponse *cached))test {
+    NSArray *keys = [self.responses keysOfEntriesPassingTest:^BOOL(NSString *key, CIOLiteCachedResponse *cached, BOOL *stop) {
+      return test(cached);
+    }].allObjects;
+    for (NSString *key in keys) {
+        [self _removeResponseForKey:key];
+    }
+}
+
+- (void)invalidateFolder:(NSString *)folderPath accountLabel:(NSString *)accountLabel {
+    dispatch_sync(self.queue, ^{
+      [self _removeResponsesPassingTest:^BOOL(CIOLiteCachedResponse *cached) {
+        return CIOLiteAccountMatches(cached.accountLabel, accountLabel) &&
+               (!cached.folderPath || CIOLiteFolderEqual(cached.folderPath, folderPath));
+      }];
+    });
+}
+
+- (void)removeAllResponses {
+    dispatch_sync(self.queue, ^{
+      [self.responses removeAllObjects];
+      [self.usage removeAllObjects];
+    });
+}
+
+#pragma mark - Webhooks
+
+- (void)applyWebhookEvent:(CIOWebhookEvent *)event {
+    [self applyWebhookPayload:event.payload];
+}
+
+- (void)applyWebhookPayload:(NSDictionary *)payload {
+    NSDictionary *message = payload[@"message_data"];
+    if (![message isKindOfClass:[NSDictionary class]]) {
+        // The webhook failed, so changes since may have been missed
+        [self removeAllResponses];
+        return;
+    }
+    NSString *accountLabel = nil;
+    NSMutableArray *folders = [NSMutableArray array];
+    for (id folder in [message[@"folders"] isKindOfClass:[NSArray class]] ? message[@"folders"] : @[]) {
+        if (CIOLiteFolderName(folder)) {
+            [folders addObject:CIOLiteFolderName(folder)];
+        }
+    }
+    for (NSDictionary *account in [message[@"email_accounts"] isKindOfClass:[NSArray class]] ? message[@"email_accounts"] : @[]) {
+        if (![account isKindOfClass:[NSDictionary class]]) {
+            continue;
+        }
+        if ([account[@"label"] isKindOfClass:[NSString class]]) {
+            accountLabel = account[@"label"];
+        }
+        for (id folder in [account[@"folders"] isKindOfClass:[NSArray class]] ? account[@"folders"] : @[]) {
+            if (CIOLiteFolderName(folder)) {
+                [folders addObject:CIOLiteFolderName(folder)];
+            }
+        }
+    }
+    NSSet *messageIDs = CIOLiteMessageIDs(message);
+    if (messageIDs.count == 0) {
+        return;
+    }
+
+    dispatch_sync(self.queue, ^{
+      // Update the message wherever it is cached, noting the folders it was found in
+      NSMutableArray *knownFolders = [NSMutableArray array];
+      for (CIOLiteCachedResponse *cached in self.responses.allValues) {
+          if (!cached.folderPath || !CIOLiteAccountMatches(cached.accountLabel, accountLabel)) {
+              continue;
+          }
+          for (NSUInteger i = 0; i < cached.response.count; i++) {
+              NSDictionary *entry = cached.response[i];
+              if (![entry isKindOfClass:[NSDictionary class]] || ![CIOLiteMessageIDs(entry) intersectsSet:messageIDs]) {
+                  continue;
+              }
+              NSMutableDictionary *updated = [entry mutableCopy];
+              for (NSString *key in entry) {
+                  if (message[key]) {
+                      updated[key] = message[key];
+                  }
+              }
+              cached.response[i] = updated;
+              [knownFolders addObject:cached.folderPath];
+          }
+      }
+
+      if (folders.count == 0) {
+          // Without its folders the message can't be placed, so drop the listings it may be missing from
+          [self _removeResponsesPassingTest:^BOOL(CIOLiteCachedResponse *cached) {
+            return cached.folderPath && CIOLiteAccountMatches(cached.accountLabel, accountLabel) &&
+                   ![knownFolders containsObject:cached.folderPath];
+          }];
+          return;
+      }
+      // A message cached in a folder it is no longer in has moved out of it. Dropping the entry would shift the pages
+      // after it, so the folder's listings are dropped instead.
+      NSMutableArray *leftFolders = [NSMutableArray array];
+      for (NSString *knownFolder in knownFolders) {
+          BOOL remains = NO;
+          for (NSString *folder in folders) {
+              remains = remains || CIOLiteFolderEqual(knownFolder, folder);
+          }
+          if (!remains) {
+              [leftFolders addObject:knownFolder];
+          }
+      }
+      [self _removeResponsesPassingTest:^BOOL(CIOLiteCachedResponse *cached) {
+        if (!cached.folderPath || !CIOLiteAccountMatches(cached.accountLabel, accountLabel)) {
+            return NO;
+        }
+        for (NSString *leftFolder in leftFolders) {
+            if (CIOLiteFolderEqual(cached.folderPath, leftFolder)) {
+                return YES;
+            }
+        }
+        return NO;
+      }];
+      for (NSString *folder in folders) {
+          BOOL known = NO;
+          for (NSString *knownFolder in knownFolders) {
+              known = known || CIOLiteFolderEqual(knownFolder, folder);
+          }
+          if (!known) {
+              [self _insertMessage:message inFolder:folder accountLabel:accountLabel];
+          }
+      }
+      [self _removeResponsesPassingTest:^BOOL(CIOLiteCachedResponse *cached) {
+        if (cached.folderPath || !CIOLiteAccountMatches(cached.accountLabel, accountLabel)) {
+            return NO;
+        }
+        if (!cached.namesOnly) {
+            return YES;
+        }
+        for (NSString *folder in folders) {
+            BOOL listed = NO;
+            for (id entry in cached.response) {
+                NSString *name = CIOLiteFolderName(entry);
+                listed = listed || (name && CIOLiteFolderEqual(name, folder));
+            }
+            if (!listed) {
+                return YES;
+            }
+        }
+        return NO;
+      }];
+    });
+}
+
+// Inserts a message new to a folder in to the first pages of its listings, and drops the later pages. Must be called
+// on `queue`.
+- (void)_insertMessage:(NSDictionary *)message inFolder:(NSString *)folder accountLabel:(NSString *)accountLabel {
+    double date = CIOLiteMessageDate(message);
+    NSMutableArray *stale = [NSMutableArray array];
+    [self.responses enumerateKeysAndObjectsUsingBlock:^(NSString *key, CIOLiteCachedResponse *cached, BOOL *stop) {
+      if (!cached.folderPath || !CIOLiteFolderEqual(cached.folderPath, folder) ||
+          !CIOLiteAccountMatches(cached.accountLabel, accountLabel)) {
+          return;
+      }
+      NSMutableArray *entries = cached.response;
+      BOOL newestFirst = entries.count < 2 || CIOLiteMessageDate(entries.firstObject) >= CIOLiteMessageDate(entries.lastObject);
+      if (cached.offset > 0 || date == 0 || !newestFirst) {
+          [stale addObject:key];
+          return;
+      }
+      NSUInteger position = 0;
+      while (position < entries.count && CIOLiteMessageDate(entries[position]) >= date) {
+          position++;
+      }
+      if (cached.limit > 0 && position >= (NSUInteger)cached.limit) {
+          // Belongs on a later page
+          return;
+      }
+      NSDictionary *inserted = message;
+      NSDictionary *sample = entries.firstObject;
+      if ([sample isKindOfClass:[NSDictionary class]]) {
+          // Only the fields this listing was fetched with
+          NSMutableDictionary *projected = [NSMutableDictionary dictionary];
+          for (NSString *field in sample) {
+              if (message[field]) {
+                  projected[field] = message[field];
+              }
+          }
+          inserted = projected;
+      }
+      [entries insertObject:inserted atIndex:position];
+      if (cached.limit > 0 && entries.count > (NSUInteger)cached.limit) {
+          [entries removeLastObject];
+      }
+    }];
+    for (NSString *key in stale) {
+        [self _removeResponseForKey:key];
+    }
+}
+
+@end
@@ -0,0 +1,196 @@
+//
+//  CIOMIMEParser.h
+//  CIOAPIClient
+//
+//  Copyright © 2015 Context.io. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+#import "CIOTransferDecoder.h"
+
+NS_ASSUME_NONNULL_BEGIN
+
+@class CIOMIMEParser;
+
+/**
+ A single MIME entity found by `CIOMIMEParser`: the message itself, a multipart container, or a leaf body part such as
+ a text body or an attachment.
+
+ Parts only describe where their headers and body live in the parser's buffer; no body content is copied or decoded
+ until it is asked for.
+ */
+@interface CIOMIMEPart : NSObject
+
+/**
+ *  Depth-first position of this part within the message. The message itself is part `0`.
+ */
+@property (readonly, nonatomic) NSUInteger index;
+
+/**
+ *  Nesting depth of this part, `0` for the message itself.
+ */
+@property (readonly, nonatomic) NSUInteger depth;
+
+/**
+ *  Index of the enclosing multipart, or `NSNotFound` for the message itself.
+ */
+@property (readonly, nonatomic) NSUInteger parentIndex;
+
+/**
+ *  Unfolded headers in the order they appear, each an array of `@[name, value]`.
+ */
+@property (readonly, nonatomic) NSArray *headers;
+
+/**
+ *  Lower-cased MIME type of this part, e.g. `text/plain` or `multipart/mixed`.
+ */
+@property (readonly, nonatomic) NSString *contentType;
+
+/**
+ *  `Content-Type` parameters such as `charset`, `boundary` and `name`, keyed by lower-cased parameter name.
+ */
+@property (readonly, nonatomic) NSDictionary *contentTypeParameters;
+
+@property (readonly, nonatomic) CIOTransferEncoding transferEncoding;
+
+/**
+ *  Lower-cased `Content-Disposition` type, usually `inline` or `attachment`.
+ */
+@property (nullable, readonly, nonatomic) NSString *disposition;
+
+/**
+ *  File name from the `Content-Disposition` `filename` parameter, or the `Content-Type` `name` parameter.
+ */
+@property (nullable, readonly, nonatomic) NSString *fileName;
+
+@property (nullable, readonly, nonatomic) NSString *contentID;
+
+@property (readonly, nonatomic, getter=isMultipart) BOOL multipart;
+
+/**
+ *  `YES` for parts with an `attachment` disposition, or leaf parts which carry a file name.
+ */
+@property (readonly, nonatomic, getter=isAttachment) BOOL attachment;
+
+/**
+ *  Location of this part's header block in the parser's `data`.
+ */
+@property (readonly, nonatomic) NSRange headerRange;
+
+/**
+ *  Location of this part's still-encoded body in the parser's `data`. For multiparts this spans the preamble, all
+ * children and the epilogue.
+ */
+@property (readonly, nonatomic) NSRange bodyRange;
+
+/**
+ *  Value of the first header named `name`, compared case-insensitively.
+ */
+- (nullable NSString *)valueForHeader:(NSString *)name;
+
+@end
+
+/**
+ Callbacks made by `-[CIOMIMEParser parse]` as it walks a message. Every `parser:didStartPart:` is matched by a
+ `parser:didEndPart:`; children of a multipart are reported between its start and end.
+ */
+@protocol CIOMIMEParserDelegate <NSObject>
+
+@optional
+
+/**
+ *  A part's headers have been read. The part's `headers` and the properties derived from them are populated.
+ */
+- (void)parser:(CIOMIMEParser *)parser didStartPart:(CIOMIMEPart *)part;
+
+/**
+ *  A slice of a leaf part's decoded body. Slices of `7bit`/`8bit`/`binary` bodies point directly in to the parser's
+ * buffer, and slices of base64/quoted-printable bodies point in to a reused decode buffer, so neither is copied: the
+ * `data` is only valid for the duration of this call. Copy it to keep it.
+ */
+- (void)parser:(CIOMIMEParser *)parser part:(CIOMIMEPart *)part foundBodyData:(NSData *)data;
+
+- (void)parser:(CIOMIMEParser *)parser didEndPart:(CIOMIMEPart *)part;
+
+@end
+
+/**
+ `CIOMIMEParser` is a streaming RFC 822/MIME parser for raw message sources, such as those returned by
+ `-[CIOV2Client getSourceForMessageWithID:]` or `-[CIOLiteMessageRequest getRawMessage]` and saved to disk with
+ `downloadRequest:toFileURL:success:failure:progress:`.
+
+ Messages are parsed in place from a single buffer, which is memory mapped when read from a file, so only the pages
+ which are actually visited are read from disk. Bodies are decoded in bounded chunks and handed out as slices, and a
+ single part can be decoded by index without decoding, or even visiting the bodies of, any other part.
+ */
+@interface CIOMIMEParser : NSObject
+
+/**
+ *  Creates a parser over an in-memory or memory mapped message source.
+ */
+- (instancetype)initWithData:(NSData *)data NS_DESIGNATED_INITIALIZER;
+
+/**
+ *  Creates a parser over a message source on disk. The file is memory mapped rather than read.
+ *
+ *  @return a new parser, or `nil` if the file could not be mapped
+ */
+- (nullable instancetype)initWithContentsOfURL:(NSURL *)fileURL error:(NSError **)error;
+
+- (instancetype)init NS_UNAVAILABLE;
+
+/**
+ *  The raw message source being parsed.
+ */
+@property (readonly, nonatomic) NSData *data;
+
+@property (nullable, weak, nonatomic) id<CIOMIMEParserDelegate> delegate;
+
+/**
+ *  Number of encoded bytes decoded per `parser:part:foundBodyData:` slice. Defaults to 64KB.
+ */
+@property (nonatomic) NSUInteger decodeChunkSize;
+
+/**
+ *  Walks the whole message, reporting parts and decoded body slices to `delegate`.
+ *
+ *  @return `NO` if parsing was stopped early by `abortParsing`
+ */
+- (BOOL)parse;
+
+/**
+ *  Stops a `parse` in progress. Only valid when called from a delegate callback.
+ */
+- (void)abortParsing;
+
+/**
+ *  All parts of the message in depth-first order, found without decoding any body.
+ */
+@property (readonly, nonatomic) NSArray *parts;
+
+/**
+ *  Finds the part at `index`, scanning no further in to the message than necessary.
+ */
+- (nullable CIOMIMEPart *)partAtIndex:(NSUInteger)index;
+
+/**
+ *  Decodes the body of the part at `index` in to memory. The body of a multipart is returned as-is.
+ *
+ *  @return the decoded body, or `nil` if the message has no part at `index`
+ */
+- (nullable NSData *)decodedDataForPartAtIndex:(NSUInteger)index error:(NSError **)error;
+
+/**
+ *  Decodes the body of the part at `index` straight to a file, through a bounded buffer. Typically used to extract a
+ * single attachment from a large message source.
+ *
+ *  @param fileURL `URL` on disk to write the decoded part to. An error will be returned if a file already exists at
+ * this path.
+ *
+ *  @return `YES` on success
+ */
+- (BOOL)writeDecodedPartAtIndex:(NSUInteger)index toFileURL:(NSURL *)fileURL error:(NSError **)error;
+
+@end
+
+NS_ASSUME_NONNULL_END
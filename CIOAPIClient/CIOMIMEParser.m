@@ -0,0 +1,496 @@
+//
+//  CIOMIMEParser.m
+//  CIOAPIClient
+//
+//  Copyright © 2015 Context.io. All rights reserved.
+//
+
+#import "CIOMIMEParser.h"
+#import "CIOHeaderTokenizer.h"
+
+#include <string.h>
+
+static NSString *const CIOMIMEParserErrorDomain = @"io.context.error.mime";
+
+static const NSUInteger kCIOMIMEDefaultDecodeChunkSize = 64 * 1024;
+
+// Parts nested deeper than this are treated as opaque leaves rather than recursed in to
+static const NSUInteger kCIOMIMEMaximumDepth = 64;
+
+// Splits a structured header value such as `multipart/mixed; boundary="abc"` in to its lower-cased leading value and
+// its parameters, keyed by lower-cased name. RFC 2231 extended parameters (`filename*=utf-8''a%20b`) are decoded.
+static NSString *CIOMIMEParseParameterizedValue(NSString *value, NSDictionary **outParameters) {
+    NSCharacterSet *whitespace = [NSCharacterSet whitespaceAndNewlineCharacterSet];
+    NSMutableDictionary *parameters = [NSMutableDictionary dictionary];
+    NSString *leadingValue = nil;
+    NSMutableString *segment = [NSMutableString string];
+    BOOL quoted = NO;
+    NSUInteger length = value.length;
+    for (NSUInteger i = 0; i <= length; i++) {
+        unichar c = (i < length) ? [value characterAtIndex:i] : ';';
+        if (quoted) {
+            if (c == '\\' && i + 1 < length) {
+                c = [value characterAtIndex:++i];
+            } else if (c == '"') {
+                quoted = NO;
+                continue;
+            }
+            CFStringAppendCharacters((__bridge CFMutableStringRef)segment, &c, 1);
+            continue;
+        }
+        if (c == '"') {
+            quoted = YES;
+            continue;
+        }
+        if (c != ';') {
+            CFStringAppendCharacters((__bridge CFMutableStringRef)segment, &c, 1);
+            continue;
+        }
+        NSString *trimmed = [segment stringByTrimmingCharactersInSet:whitespace];
+        if (!leadingValue) {
+            leadingValue = [trimmed lowercaseString];
+        } else {
+            NSRange equals = [trimmed rangeOfString:@"="];
+            if (equals.location != NSNotFound) {
+                NSString *name = [[[trimmed substringToIndex:equals.location] stringByTrimmingCharactersInSet:whitespace]
+                    lowercaseString];
+                NSString *parameterValue =
+                    [[trimmed substringFromIndex:NSMaxRange(equals)] stringByTrimmingCharactersInSet:whitespace];
+                if ([name hasSuffix:@"*"]) {
+                    name = [name substringToIndex:name.length - 1];
+                    NSArray *pieces = [parameterValue componentsSeparatedByString:@"'"];
+                    if (pieces.count == 3) {
+                        parameterValue = [pieces[2] stringByRemovingPercentEncoding] ?: pieces[2];
+                    }
+                }
+                if (name.length > 0 && parameters[name] == nil) {
+                    parameters[name] = parameterValue;
+                }
+            }
+        }
+        segment = [NSMutableString string];
+    }
+    if (outParameters) {
+        *outParameters = parameters;
+    }
+    return leadingValue ?: @"";
+}
+
+#pragma mark -
+
+@interface CIOMIMEPart ()
+
+@property (nonatomic) NSUInteger index;
+@property (nonatomic) NSUInteger depth;
+@property (nonatomic) NSUInteger parentIndex;
+@property (nonatomic) NSArray *headers;
+@property (nonatomic) NSString *contentType;
+@property (nonatomic) NSDictionary *contentTypeParameters;
+@property (nonatomic) CIOTransferEncoding transferEncoding;
+@property (nullable, nonatomic) NSString *disposition;
+@property (nullable, nonatomic) NSString *fileName;
+@property (nullable, nonatomic) NSString *contentID;
+@property (nonatomic, getter=isMultipart) BOOL multipart;
+@property (nonatomic, getter=isAttachment) BOOL attachment;
+@property (nonatomic) NSRange headerRange;
+@property (nonatomic) NSRange bodyRange;
+
+- (void)applyHeaders:(NSArray *)headers defaultContentType:(NSString *)defaultContentType;
+
+@end
+
+@implementation CIOMIMEPart
+
+- (NSString *)valueForHeader:(NSString *)name {
+    for (NSArray *header in self.headers) {
+        if ([header[0] caseInsensitiveCompare:name] == NSOrderedSame) {
+            return header[1];
+        }
+    }
+    return nil;
+}
+
+- (void)applyHeaders:(NSArray *)headers defaultContentType:(NSString *)defaultContentType {
+    self.headers = headers;
+
+    NSDictionary *typeParameters = nil;
+    NSString *contentType = nil;
+    NSString *typeHeader = [self valueForHeader:@"Content-Type"];
+    if (typeHeader) {
+        contentType = CIOMIMEParseParameterizedValue(typeHeader, &typeParameters);
+    }
+    if (contentType.length == 0 || [contentType rangeOfString:@"/"].location == NSNotFound) {
+        contentType = defaultContentType;
+    }
+    self.contentType = contentType;
+    self.contentTypeParameters = typeParameters ?: @{};
+    self.transferEncoding = [CIOTransferDecoder encodingForName:[self valueForHeader:@"Content-Transfer-Encoding"]];
+
+    NSDictionary *dispositionParameters = nil;
+    NSString *dispositionHeader = [self valueForHeader:@"Content-Disposition"];
+    if (dispositionHeader) {
+        self.disposition = CIOMIMEParseParameterizedValue(dispositionHeader, &dispositionParameters);
+    }
+    NSString *fileName = dispositionParameters[@"filename"] ?: self.contentTypeParameters[@"name"];
+    // Many mailers send non-ASCII file names as RFC 2047 encoded-words rather than RFC 2231 parameters
+    self.fileName = fileName ? [CIOHeaderTokenizer decodeEncodedWords:fileName] : nil;
+
+    NSString *contentID = [self valueForHeader:@"Content-ID"];
+    NSCharacterSet *angleBrackets = [NSCharacterSet characterSetWithCharactersInString:@"<> \t"];
+    self.contentID = [contentID stringByTrimmingCharactersInSet:angleBrackets];
+
+    self.multipart = [contentType hasPrefix:@"multipart/"] && [self.contentTypeParameters[@"boundary"] length] > 0;
+    self.attachment =
+        !self.multipart && ([self.disposition isEqualToString:@"attachment"] || self.fileName.length > 0);
+}
+
+- (NSString *)description {
+    return [NSString stringWithFormat:@"<%@: %p index=%lu depth=%lu type=%@ body=%@>", NSStringFromClass(self.class),
+                                      self, (unsigned long)self.index, (unsigned long)self.depth, self.contentType,
+                                      NSStringFromRange(self.bodyRange)];
+}
+
+@end
+
+#pragma mark -
+
+@interface CIOMIMEParser () {
+    const uint8_t *_bytes;
+
+    // State for a single pass over the message
+    NSUInteger _nextIndex;
+    BOOL _aborted;
+    BOOL _emitting;
+    NSUInteger _stopIndex;
+    NSMutableArray *_collectedParts;
+    CIOMIMEPart *_foundPart;
+}
+
+@property (nonatomic) NSData *data;
+@property (nullable, nonatomic) NSArray *cachedParts;
+
+@end
+
+@implementation CIOMIMEParser
+
+- (instancetype)initWithData:(NSData *)data {
+    if ((self = [super init])) {
+        _data = data;
+        _bytes = data.bytes;
+        _decodeChunkSize = kCIOMIMEDefaultDecodeChunkSize;
+        _stopIndex = NSNotFound;
+    }
+    return self;
+}
+
+- (instancetype)initWithContentsOfURL:(NSURL *)fileURL error:(NSError **)error {
+    NSData *data = [NSData dataWithContentsOfURL:fileURL options:NSDataReadingMappedAlways error:error];
+    if (!data) {
+        return nil;
+    }
+    return [self initWithData:data];
+}
+
+#pragma mark - Public
+
+- (BOOL)parse {
+    [self _beginPass];
+    _emitting = YES;
+    [self _parseEntityInRange:NSMakeRange(0, self.data.length) depth:0 parent:nil defaultContentType:@"text/plain"];
+    _emitting = NO;
+    return !_aborted;
+}
+
+- (void)abortParsing {
+    _aborted = YES;
+}
+
+- (NSArray *)parts {
+    if (!self.cachedParts) {
+        // Scan in a separate parser so this is safe to call from delegate callbacks during `parse`
+        CIOMIMEParser *scanner = [[CIOMIMEParser alloc] initWithData:self.data];
+        [scanner _beginPass];
+        scanner->_collectedParts = [NSMutableArray array];
+        [scanner _parseEntityInRange:NSMakeRange(0, self.data.length)
+                               depth:0
+                              parent:nil
+                  defaultContentType:@"text/plain"];
+        self.cachedParts = [scanner->_collectedParts copy];
+    }
+    return self.cachedParts;
+}
+
+- (CIOMIMEPart *)partAtIndex:(NSUInteger)index {
+    if (self.cachedParts) {
+        return index < self.cachedParts.count ? self.cachedParts[index] : nil;
+    }
+    CIOMIMEParser *scanner = [[CIOMIMEParser alloc] initWithData:self.data];
+    [scanner _beginPass];
+    scanner->_stopIndex = index;
+    [scanner _parseEntityInRange:NSMakeRange(0, self.data.length) depth:0 parent:nil defaultContentType:@"text/plain"];
+    return scanner->_foundPart;
+}
+
+- (NSData *)decodedDataForPartAtIndex:(NSUInteger)index error:(NSError **)error {
+    CIOMIMEPart *part = [self partAtIndex:index];
+    if (!part) {
+        if (error) {
+            *error = [self _errorForMissingPartAtIndex:index];
+        }
+        return nil;
+    }
+    NSMutableData *result =
+        [NSMutableData dataWithCapacity:[CIOTransferDecoder maximumDecodedLengthForLength:part.bodyRange.length]];
+    [self _decodeBodyOfPart:part usingBlock:^BOOL(NSData *slice) {
+        [result appendData:slice];
+        return YES;
+    }];
+    return result;
+}
+
+- (BOOL)writeDecodedPartAtIndex:(NSUInteger)index toFileURL:(NSURL *)fileURL error:(NSError **)error {
+    CIOMIMEPart *part = [self partAtIndex:index];
+    if (!part) {
+        if (error) {
+            *error = [self _errorForMissingPartAtIndex:index];
+        }
+        return NO;
+    }
+    if ([[NSFileManager defaultManager] fileExistsAtPath:fileURL.path]) {
+        if (error) {
+            *error = [NSError errorWithDomain:NSCocoaErrorDomain
+                                         code:NSFileWriteFileExistsError
+                                     userInfo:@{NSURLErrorKey: fileURL}];
+        }
+        return NO;
+    }
+    NSOutputStream *stream = [NSOutputStream outputStreamWithURL:fileURL append:NO];
+    [stream open];
+    BOOL completed = [self _decodeBodyOfPart:part usingBlock:^BOOL(NSData *slice) {
+        const uint8_t *bytes = slice.bytes;
+        NSUInteger remaining = slice.length;
+        while (remaining > 0) {
+            NSInteger written = [stream write:bytes maxLength:remaining];
+            if (written <= 0) {
+                return NO;
+            }
+            bytes += written;
+            remaining -= (NSUInteger)written;
+        }
+        return YES;
+    }];
+    NSError *streamError = stream.streamError;
+    [stream close];
+    if (!completed || streamError) {
+        [[NSFileManager defaultManager] removeItemAtURL:fileURL error:nil];
+        if (error) {
+            *error = streamError ?: [NSError errorWithDomain:NSCocoaErrorDomain
+                                                        code:NSFileWriteUnknownError
+                                                    userInfo:@{NSURLErrorKey: fileURL}];
+        }
+        return NO;
+    }
+    return YES;
+}
+
+#pragma mark - Parsing
+
+- (void)_beginPass {
+    _nextIndex = 0;
+    _aborted = NO;
+    _foundPart = nil;
+}
+
+- (NSError *)_errorForMissingPartAtIndex:(NSUInteger)index {
+    NSString *description = [NSString stringWithFormat:@"Message has no MIME part at index %lu", (unsigned long)index];
+    return [NSError errorWithDomain:CIOMIMEParserErrorDomain
+                               code:NSURLErrorResourceUnavailable
+                           userInfo:@{NSLocalizedDescriptionKey: description}];
+}
+
+// Reads a header block starting at `start`, unfolding continuation lines. Returns the location just past the blank
+// line which ends the block, or `end` if there is none.
+- (NSUInteger)_readHeadersFrom:(NSUInteger)start end:(NSUInteger)end into:(NSMutableArray *)headers {
+    CIOHeaderTokenizer *tokenizer = [[CIOHeaderTokenizer alloc] initWithData:_data range:NSMakeRange(start, end - start)];
+    for (NSUInteger i = 0; i < tokenizer.count; i++) {
+        CIOHeaderField *field = [tokenizer fieldAtIndex:i];
+        [headers addObject:@[field.name, field.rawValue]];
+    }
+    return tokenizer.endLocation;
+}
+
+// Finds the next `--boundary` delimiter line at or after `from`, which must be the start of a line. Returns its
+// location, or `NSNotFound`. `isClose` is set for the closing `--boundary--` delimiter, and `nextLine` to the start of
+// the line following the delimiter.
+- (NSUInteger)_findDelimiter:(NSData *)delimiter
+                        from:(NSUInteger)from
+                         end:(NSUInteger)end
+                     isClose:(BOOL *)isClose
+                    nextLine:(NSUInteger *)nextLine {
+    const uint8_t *bytes = _bytes;
+    NSUInteger delimiterLength = delimiter.length;
+    NSUInteger cursor = from;
+    while (cursor + delimiterLength <= end) {
+        const uint8_t *match = memmem(bytes + cursor, end - cursor, delimiter.bytes, delimiterLength);
+        if (!match) {
+            return NSNotFound;
+        }
+        NSUInteger location = (NSUInteger)(match - bytes);
+        cursor = location + 1;
+        if (location > from && bytes[location - 1] != '\n') {
+            continue;
+        }
+        NSUInteger after = location + delimiterLength;
+        BOOL close = after + 2 <= end && bytes[after] == '-' && bytes[after + 1] == '-';
+        NSUInteger lineCursor = close ? after + 2 : after;
+        while (lineCursor < end && (bytes[lineCursor] == ' ' || bytes[lineCursor] == '\t')) {
+            lineCursor++;
+        }
+        if (lineCursor < end && bytes[lineCursor] == '\r') {
+            lineCursor++;
+        }
+        if (lineCursor < end && bytes[lineCursor] != '\n') {
+            if (!close) {
+                // The start of a longer boundary which merely shares this one as a prefix
+                continue;
+            }
+            const uint8_t *newline = memchr(bytes + lineCursor, '\n', end - lineCursor);
+            lineCursor = newline ? (NSUInteger)(newline - bytes) : end;
+        }
+        *isClose = close;
+        *nextLine = (lineCursor < end) ? lineCursor + 1 : end;
+        return location;
+    }
+    return NSNotFound;
+}
+
+- (void)_parseEntityInRange:(NSRange)range
+                      depth:(NSUInteger)depth
+                     parent:(CIOMIMEPart *)parent
+         defaultContentType:(NSString *)defaultContentType {
+    if (_aborted) {
+        return;
+    }
+    id<CIOMIMEParserDelegate> delegate = _emitting ? self.delegate : nil;
+
+    CIOMIMEPart *part = [[CIOMIMEPart alloc] init];
+    part.index = _nextIndex++;
+    part.depth = depth;
+    part.parentIndex = parent ? parent.index : NSNotFound;
+    NSMutableArray *headers = [NSMutableArray array];
+    NSUInteger bodyStart = [self _readHeadersFrom:range.location end:NSMaxRange(range) into:headers];
+    part.headerRange = NSMakeRange(range.location, bodyStart - range.location);
+    part.bodyRange = NSMakeRange(bodyStart, NSMaxRange(range) - bodyStart);
+    [part applyHeaders:headers defaultContentType:defaultContentType];
+
+    [_collectedParts addObject:part];
+    if (part.index == _stopIndex) {
+        _foundPart = part;
+        _aborted = YES;
+        return;
+    }
+    if ([delegate respondsToSelector:@selector(parser:didStartPart:)]) {
+        [delegate parser:self didStartPart:part];
+        if (_aborted) {
+            return;
+        }
+    }
+
+    BOOL canNest = depth < kCIOMIMEMaximumDepth;
+    if (part.multipart && canNest) {
+        NSString *childDefault =
+            [part.contentType isEqualToString:@"multipart/digest"] ? @"message/rfc822" : @"text/plain";
+        [self _parseChildrenOfPart:part defaultContentType:childDefault];
+    } else if ([part.contentType isEqualToString:@"message/rfc822"] &&
+               part.transferEncoding == CIOTransferEncodingIdentity && canNest) {
+        [self _parseEntityInRange:part.bodyRange depth:depth + 1 parent:part defaultContentType:@"text/plain"];
+    } else if ([delegate respondsToSelector:@selector(parser:part:foundBodyData:)]) {
+        [self _decodeBodyOfPart:part usingBlock:^BOOL(NSData *slice) {
+            [delegate parser:self part:part foundBodyData:slice];
+            return !_aborted;
+        }];
+    }
+
+    if (!_aborted && [delegate respondsToSelector:@selector(parser:didEndPart:)]) {
+        [delegate parser:self didEndPart:part];
+    }
+}
+
+- (void)_parseChildrenOfPart:(CIOMIMEPart *)part defaultContentType:(NSString *)defaultContentType {
+    NSString *boundary = part.contentTypeParameters[@"boundary"];
+    NSData *delimiter = [[@"--" stringByAppendingString:boundary] dataUsingEncoding:NSUTF8StringEncoding];
+    NSUInteger end = NSMaxRange(part.bodyRange);
+    NSUInteger cursor = part.bodyRange.location;
+    NSUInteger childStart = NSNotFound;
+    while (!_aborted) {
+        BOOL isClose = NO;
+        NSUInteger nextLine = end;
+        NSUInteger location = [self _findDelimiter:delimiter from:cursor end:end isClose:&isClose nextLine:&nextLine];
+        if (location == NSNotFound) {
+            break;
+        }
+        if (childStart != NSNotFound) {
+            // The line break before a delimiter belongs to the delimiter, not to the part
+            NSUInteger childEnd = location;
+            if (childEnd > childStart && _bytes[childEnd - 1] == '\n') {
+                childEnd--;
+            }
+            if (childEnd > childStart && _bytes[childEnd - 1] == '\r') {
+                childEnd--;
+            }
+            [self _parseEntityInRange:NSMakeRange(childStart, childEnd - childStart)
+                                depth:part.depth + 1
+                               parent:part
+                   defaultContentType:defaultContentType];
+        }
+        if (isClose) {
+            return;
+        }
+        childStart = nextLine;
+        cursor = nextLine;
+    }
+    // A multipart cut short without its closing delimiter: the last part runs to the end of the body
+    if (!_aborted && childStart != NSNotFound && childStart < end) {
+        [self _parseEntityInRange:NSMakeRange(childStart, end - childStart)
+                            depth:part.depth + 1
+                           parent:part
+               defaultContentType:defaultContentType];
+    }
+}
+
+#pragma mark - Decoding
+
+// Hands the decoded body of `part` to `block` one bounded slice at a time. Returns `NO` if `block` returned `NO`.
+- (BOOL)_decodeBodyOfPart:(CIOMIMEPart *)part usingBlock:(BOOL (^)(NSData *slice))block {
+    NSRange body = part.bodyRange;
+    const uint8_t *bytes = _bytes + body.location;
+    NSUInteger chunkSize = MAX(self.decodeChunkSize, (NSUInteger)1);
+
+    if (part.transferEncoding == CIOTransferEncodingIdentity) {
+        for (NSUInteger offset = 0; offset < body.length; offset += chunkSize) {
+            NSUInteger length = MIN(chunkSize, body.length - offset);
+            NSData *slice = [NSData dataWithBytesNoCopy:(void *)(bytes + offset) length:length freeWhenDone:NO];
+            if (!block(slice)) {
+                return NO;
+            }
+        }
+        return YES;
+    }
+
+    CIOTransferDecoder *decoder = [[CIOTransferDecoder alloc] initWithEncoding:part.transferEncoding];
+    NSMutableData *buffer = [NSMutableData dataWithLength:[CIOTransferDecoder maximumDecodedLengthForLength:chunkSize]];
+    uint8_t *output = buffer.mutableBytes;
+    for (NSUInteger offset = 0; offset < body.length; offset += chunkSize) {
+        NSUInteger length = MIN(chunkSize, body.length - offset);
+        NSUInteger decoded = [decoder decodeBytes:bytes + offset length:length intoBuffer:output];
+        if (offset + length == body.length) {
+            decoded += [decoder finishIntoBuffer:output + decoded];
+        }
+        if (decoded > 0 && !block([NSData dataWithBytesNoCopy:output length:decoded freeWhenDone:NO])) {
+            return NO;
+        }
+    }
+    return YES;
+}
+
+@end
@@ -0,0 +1,99 @@
+//
+//  CIOMessageFacetPlanner.h
+//  CIOAPIClient
+//
+//  Copyright © 2015 Context.io. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+
+NS_ASSUME_NONNULL_BEGIN
+
+@class CIOV2Client;
+@class CIOArrayRequest;
+
+/**
+ Details of a message which list requests only return on demand.
+ */
+typedef NS_OPTIONS(NSUInteger, CIOMessageFacets) {
+    CIOMessageFacetBody = 1 << 0,
+    CIOMessageFacetFlags = 1 << 1,
+    CIOMessageFacetHeaders = 1 << 2
+};
+
+typedef NS_ENUM(NSInteger, CIOMessageFacetStrategy) {
+    /**
+     *  Fetch the page again with `include_body`, `include_flags` or `include_headers` set.
+     */
+    CIOMessageFacetStrategyRefetchPage,
+    /**
+     *  Call `getBodyForMessageWithID:type:`, `getFlagsForMessageWithID:` or `getHeadersForMessageWithID:` for each
+     * message, a few at a time.
+     */
+    CIOMessageFacetStrategyPerMessage
+};
+
+/**
+ `CIOMessageFacetPlanner` loads the bodies, flags or headers of a page of listed messages without one round trip per
+ message and facet when that would be slower.
+
+ It either fetches the page again with the matching `include_` parameters, or runs per-message requests
+ `maximumConcurrentRequests` at a time, whichever it estimates to finish first. Estimates use the latency of a request
+ and the extra time a page takes per message when details are included, both measured as the planner is used.
+
+ The planner must be used from the main thread, and calls completions on the main queue.
+ */
+@interface CIOMessageFacetPlanner : NSObject
+
+- (instancetype)initWithClient:(CIOV2Client *)client NS_DESIGNATED_INITIALIZER;
+
+- (instancetype)init NS_UNAVAILABLE;
+
+@property (readonly, nonatomic) CIOV2Client *client;
+
+/**
+ *  Defaults to `4`.
+ */
+@property (nonatomic) NSUInteger maximumConcurrentRequests;
+
+/**
+ *  Average duration of a request, updated with each per-message request. Starts at 0.3 seconds.
+ */
+@property (nonatomic) NSTimeInterval requestLatency;
+
+/**
+ *  Average time a page takes per message when details are included, on top of `requestLatency`, updated with each
+ * refetch. Starts at 0.05 seconds.
+ */
+@property (nonatomic) NSTimeInterval includeLatencyPerMessage;
+
+/**
+ *  The faster way to load `facets` for `count` messages, given the current latency estimates.
+ */
+- (CIOMessageFacetStrategy)strategyForMessageCount:(NSUInteger)count facets:(CIOMessageFacets)facets;
+
+/**
+ *  The request fetching the page of `listRequest` again, with `facets` included.
+ *
+ *  @param listRequest a `CIOMessagesRequest` or `CIOFolderMessagesRequest`
+ */
+- (CIOArrayRequest *)refetchRequestForListRequest:(CIOArrayRequest *)listRequest facets:(CIOMessageFacets)facets;
+
+/**
+ *  Adds `facets` to listed messages. Bodies are added under `body`, flags under `flags` and headers under `headers`,
+ * as the list calls name them. Flags are always a dictionary as returned by `getFlagsForMessageWithID:`, such as
+ * `{"seen": true, "answered": false, ...}`, including flags a page listed as an array of IMAP flags.
+ *
+ *  @param messages    messages returned by `listRequest`
+ *  @param listRequest the request which listed the messages, or `nil` to use per-message requests
+ *  @param completion  called with copies of `messages` including the facets which could be loaded, in the same order,
+ * and the errors of the messages which could not be loaded completely, keyed by `message_id`
+ */
+- (void)loadFacets:(CIOMessageFacets)facets
+       forMessages:(NSArray *)messages
+       listRequest:(nullable CIOArrayRequest *)listRequest
+        completion:(void (^)(NSArray *messages, NSDictionary *errors))completion;
+
+@end
+
+NS_ASSUME_NONNULL_END
@@ -0,0 +1,225 @@
+//
+//  CIOMessageFacetPlanner.m
+//  CIOAPIClient
+//
+//  Copyright © 2015 Context.io. All rights reserved.
+//
+
+#import "CIOMessageFacetPlanner.h"
+#import "CIOV2Client.h"
+#import "CIOBoundedRunner.h"
+#import "CIOMessageUtilities.h"
+
+// Weight of the newest sample in the latency averages
+static const double kCIOLatencySmoothing = 0.2;
+
+static NSTimeInterval CIOSmoothedLatency(NSTimeInterval latency, NSTimeInterval sample) {
+    return latency * (1 - kCIOLatencySmoothing) + sample * kCIOLatencySmoothing;
+}
+
+static const CIOMessageFacets kCIOAllFacets[] = {CIOMessageFacetBody, CIOMessageFacetFlags, CIOMessageFacetHeaders};
+
+// Key of a facet in a message, as named by the list calls
+static NSString *CIOFacetKey(CIOMessageFacets facet) {
+    switch (facet) {
+        case CIOMessageFacetBody:
+            return @"body";
+        case CIOMessageFacetFlags:
+            return @"flags";
+        case CIOMessageFacetHeaders:
+            return @"headers";
+    }
+    return nil;
+}
+
+// The progress of one `loadFacets:forMessages:listRequest:completion:` call
+@interface CIOFacetLoad : NSObject
+
+@property (nonatomic) CIOMessageFacets facets;
+// Mutable copies of the messages, filled in as facets arrive
+@property (nonatomic) NSArray *messages;
+@property (nonatomic) NSMutableDictionary *errors;
+@property (nonatomic, copy) void (^completion)(NSArray *messages, NSDictionary *errors);
+// Per-message requests to make, as @[message index, facet]
+@property (nonatomic) NSArray *tasks;
+@property (nonatomic) NSUInteger nextTask;
+
+@end
+
+@implementation CIOFacetLoad
+
+@end
+
+@implementation CIOMessageFacetPlanner
+
+- (instancetype)initWithClient:(CIOV2Client *)client {
+    if ((self = [super init])) {
+        _client = client;
+        _maximumConcurrentRequests = 4;
+        _requestLatency = 0.3;
+        _includeLatencyPerMessage = 0.05;
+    }
+    return self;
+}
+
+#pragma mark - Planning
+
+- (CIOMessageFacetStrategy)strategyForMessageCount:(NSUInteger)count facets:(CIOMessageFacets)facets {
+    NSUInteger requestCount = 0;
+    for (size_t i = 0; i < sizeof(kCIOAllFacets) / sizeof(kCIOAllFacets[0]); i++) {
+        if (facets & kCIOAllFacets[i]) {
+            requestCount += count;
+        }
+    }
+    NSUInteger concurrency = MAX(self.maximumConcurrentRequests, 1u);
+    NSTimeInterval perMessage = ((requestCount + concurrency - 1) / concurrency) * self.requestLatency;
+    NSTimeInterval refetch = self.requestLatency + count * self.includeLatencyPerMessage;
+    return requestCount > 0 && refetch < perMessage ? CIOMessageFacetStrategyRefetchPage
+                                                    : CIOMessageFacetStrategyPerMessage;
+}
+
+- (CIOArrayRequest *)refetchRequestForListRequest:(CIOArrayRequest *)listRequest facets:(CIOMessageFacets)facets {
+    NSMutableDictionary *params = [listRequest.parameters mutableCopy];
+    if (facets & CIOMessageFacetBody) {
+        params[@"include_body"] = @YES;
+    }
+    if (facets & CIOMessageFacetFlags) {
+        params[@"include_flags"] = @YES;
+    }
+    if (facets & CIOMessageFacetHeaders) {
+        params[@"include_headers"] = @"1";
+    }
+    return [CIOArrayRequest requestWithPath:listRequest.path
+                                     method:listRequest.method
+                                 parameters:params
+                                     client:listRequest.client];
+}
+
+#pragma mark - Loading
+
+- (void)loadFacets:(CIOMessageFacets)facets
+       forMessages:(NSArray *)messages
+       listRequest:(CIOArrayRequest *)listRequest
+        completion:(void (^)(NSArray *, NSDictionary *))completion {
+    NSParameterAssert([NSThread isMainThread]);
+    CIOFacetLoad *load = [CIOFacetLoad new];
+    load.facets = facets;
+    NSMutableArray *copies = [NSMutableArray arrayWithCapacity:messages.count];
+    for (NSDictionary *message in messages) {
+        NSMutableDictionary *copy = [message mutableCopy];
+        if (copy[@"flags"]) {
+            copy[@"flags"] = CIONormalizedFlags(copy[@"flags"]);
+        }
+        [copies addObject:copy];
+    }
+    load.messages = copies;
+    load.errors = [NSMutableDictionary dictionary];
+    load.completion = completion;
+    NSIndexSet *allIndexes = [NSIndexSet indexSetWithIndexesInRange:NSMakeRange(0, messages.count)];
+
+    if (!listRequest ||
+        [self strategyForMessageCount:messages.count facets:facets] != CIOMessageFacetStrategyRefetchPage) {
+        [self _loadFacets:load perMessageAtIndexes:allIndexes];
+        return;
+    }
+    NSDate *start = [NSDate date];
+    NSTimeInterval requestLatency = self.requestLatency;
+    [[self refetchRequestForListRequest:listRequest facets:facets] executeWithSuccess:^(NSArray *response) {
+      NSTimeInterval extra = MAX(0, -start.timeIntervalSinceNow - requestLatency);
+      NSTimeInterval perMessage = extra / MAX(messages.count, 1u);
+      self.includeLatencyPerMessage = CIOSmoothedLatency(self.includeLatencyPerMessage, perMessage);
+
+      NSMutableDictionary *refetched = [NSMutableDictionary dictionary];
+      for (NSDictionary *message in response) {
+          if ([message isKindOfClass:[NSDictionary class]] && message[@"message_id"]) {
+              refetched[message[@"message_id"]] = message;
+          }
+      }
+      // Messages which moved out of the page since it was listed are loaded one by one
+      NSMutableIndexSet *missing = [NSMutableIndexSet indexSet];
+      [load.messages enumerateObjectsUsingBlock:^(NSMutableDictionary *message, NSUInteger idx, BOOL *stop) {
+        NSDictionary *fresh = message[@"message_id"] ? refetched[message[@"message_id"]] : nil;
+        for (size_t i = 0; i < sizeof(kCIOAllFacets) / sizeof(kCIOAllFacets[0]); i++) {
+            NSString *key = CIOFacetKey(kCIOAllFacets[i]);
+            if (!(facets & kCIOAllFacets[i])) {
+                continue;
+            }
+            if (fresh[key]) {
+                message[key] = kCIOAllFacets[i] == CIOMessageFacetFlags ? CIONormalizedFlags(fresh[key]) : fresh[key];
+            } else {
+                [missing addIndex:idx];
+            }
+        }
+      }];
+      [self _loadFacets:load perMessageAtIndexes:missing];
+    } failure:^(NSError *error) {
+      [self _loadFacets:load perMessageAtIndexes:allIndexes];
+    }];
+}
+
+- (void)_loadFacets:(CIOFacetLoad *)load perMessageAtIndexes:(NSIndexSet *)indexes {
+    NSMutableArray *tasks = [NSMutableArray array];
+    [indexes enumerateIndexesUsingBlock:^(NSUInteger idx, BOOL *stop) {
+      NSDictionary *message = load.messages[idx];
+      if (![message[@"message_id"] isKindOfClass:[NSString class]]) {
+          return;
+      }
+      for (size_t i = 0; i < sizeof(kCIOAllFacets) / sizeof(kCIOAllFacets[0]); i++) {
+          if ((load.facets & kCIOAllFacets[i]) && !message[CIOFacetKey(kCIOAllFacets[i])]) {
+              [tasks addObject:@[@(idx), @(kCIOAllFacets[i])]];
+          }
+      }
+    }];
+    load.tasks = tasks;
+    if (tasks.count == 0) {
+        dispatch_async(dispatch_get_main_queue(), ^{
+          load.completion(load.messages, load.errors);
+        });
+        return;
+    }
+    CIOBoundedRunner *runner = [[CIOBoundedRunner alloc] initWithStartBlock:^BOOL(void (^finish)(void)) {
+      return [self _startNextTaskOfLoad:load finish:finish];
+    }];
+    runner.maximumConcurrentOperations = self.maximumConcurrentRequests;
+    runner.idleBlock = ^{
+      load.completion(load.messages, load.errors);
+    };
+    [runner run];
+}
+
+- (BOOL)_startNextTaskOfLoad:(CIOFacetLoad *)load finish:(void (^)(void))finish {
+    if (load.nextTask == load.tasks.count) {
+        return NO;
+    }
+    NSArray *task = load.tasks[load.nextTask++];
+    NSMutableDictionary *message = load.messages[[task[0] unsignedIntegerValue]];
+    CIOMessageFacets facet = [task[1] unsignedIntegerValue];
+    NSString *messageID = message[@"message_id"];
+    NSDate *start = [NSDate date];
+
+    void (^done)(id, NSError *) = ^(id result, NSError *error) {
+      self.requestLatency = CIOSmoothedLatency(self.requestLatency, -start.timeIntervalSinceNow);
+      if (result) {
+          message[CIOFacetKey(facet)] = result;
+      } else if (messageID && !load.errors[messageID]) {
+          load.errors[messageID] = error;
+      }
+      finish();
+    };
+    void (^success)(id) = ^(id result) {
+      done(result, nil);
+    };
+    void (^failure)(NSError *) = ^(NSError *error) {
+      done(nil, error);
+    };
+    if (facet == CIOMessageFacetBody) {
+        [[self.client getBodyForMessageWithID:messageID type:nil] executeWithSuccess:success failure:failure];
+    } else if (facet == CIOMessageFacetFlags) {
+        [[self.client getFlagsForMessageWithID:messageID] executeWithSuccess:success failure:failure];
+    } else {
+        [[self.client getHeadersForMessageWithID:messageID] executeWithSuccess:success failure:failure];
+    }
+    return YES;
+}
+
+@end
@@ -0,0 +1,80 @@
+//
+//  CIOMessageIndex.h
+//  CIOAPIClient
+//
+//  Copyright © 2015 Context.io. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+
+NS_ASSUME_NONNULL_BEGIN
+
+@class CIOMessageStore;
+@class CIOMessagesRequest;
+
+/**
+ `CIOMessageIndex` is an in-memory inverted index over the messages of a `CIOMessageStore`, which evaluates
+ `CIOMessagesRequest` searches locally instead of asking the server to search the mailbox over IMAP.
+
+ Messages are indexed by account, `from`/`to`/`cc`/`bcc` address and domain, folder, source label, attachment file name
+ and subject words as they are added to the store. A search intersects the posting lists of its filters, smallest
+ first, and prunes `date_before`/`date_after` ranges with a date ordered index, so the cost of a search follows the
+ number of matching messages rather than the size of the mailbox.
+
+ Filters are matched the way the API documents them: addresses within one filter are an `OR` combination, filters are
+ an `AND` combination, `subject` is a case-insensitive substring or a `/regular expression/`, and `file_name` accepts
+ shell wildcards or a `/regular expression/` and is matched case-insensitively.
+
+ The index stays up to date by observing `CIOMessageStoreDidChangeNotification`. All methods are thread safe.
+ */
+@interface CIOMessageIndex : NSObject
+
+/**
+ *  Indexes the messages of `store` and keeps following its changes.
+ */
+- (instancetype)initWithStore:(CIOMessageStore *)store NS_DESIGNATED_INITIALIZER;
+
+- (instancetype)init NS_UNAVAILABLE;
+
+@property (readonly, nonatomic) CIOMessageStore *store;
+
+/**
+ *  Number of indexed messages.
+ */
+@property (readonly, nonatomic) NSUInteger count;
+
+/**
+ *  Whether `request` can be answered from message metadata. Requests asking for bodies, headers, sources, flags or
+ * thread sizes need the server, as do regular expressions which fail to compile.
+ */
+- (BOOL)canEvaluateRequest:(CIOMessagesRequest *)request;
+
+/**
+ *  Evaluates `request` against the indexed messages of its client's account only, applying its `sort_order`, `offset`
+ * and `limit`. A `limit` of `0` returns every match.
+ *
+ *  @return matching messages, newest first unless `sort_order` is ascending, or `nil` if the request can not be
+ * evaluated locally
+ */
+- (nullable NSArray *)messagesMatchingRequest:(CIOMessagesRequest *)request;
+
+/**
+ *  Answers `request` from the index, and asks the API only for messages indexed by Context.IO since the store's
+ * high-water mark for the account, i.e. messages the last `CIOMessageSync` has not seen yet. The two are merged, with
+ * the API's copy of a message winning, before `offset` and `limit` are applied.
+ *
+ *  Recent messages are paged through until there are enough of them to fill the requested page, or all of them when
+ * `limit` is `0`. Requests which can not be evaluated locally, accounts which have never completed a sync, and accounts
+ * with more than 1000 messages indexed since the last sync are sent to the API unchanged.
+ *
+ *  @param request a request created by a `CIOV2Client`
+ *  @param success called on the main queue with the matching messages
+ *  @param failure called on the main queue if the API request fails
+ */
+- (void)executeRequest:(CIOMessagesRequest *)request
+               success:(void (^)(NSArray *messages))success
+               failure:(nullable void (^)(NSError *error))failure;
+
+@end
+
+NS_ASSUME_NONNULL_END
@@ -0,0 +1,689 @@
+//
+//  CIOMessageIndex.m
+//  CIOAPIClient
+//
+//  Copyright © 2015 Context.io. All rights reserved.
+//
+
+#import "CIOMessageIndex.h"
+#import <fnmatch.h>
+#import "CIOMessageStore.h"
+#import "CIOMessageRequests.h"
+#import "CIOAPIClientHeader.h"
+#import "CIOMessageUtilities.h"
+
+// Posting list fields; each maps a normalized value to the IDs of the documents holding it
+static NSString *const kCIOFieldAccount = @"account";
+static NSString *const kCIOFieldDomain = @"domain";
+static NSString *const kCIOFieldFolder = @"folder";
+static NSString *const kCIOFieldSource = @"source";
+static NSString *const kCIOFieldFile = @"file";
+static NSString *const kCIOFieldSubject = @"subject";
+
+// Removed documents leave an NSNull in `documents` until there are this many, and more than live ones
+static const NSUInteger kCIOMessageIndexCompactionThreshold = 1024;
+// Pages of messages indexed since the last sync fetched to answer a request before it is sent to the API unchanged
+static const NSInteger kCIOMessageIndexMaximumRecentPages = 10;
+static const NSInteger kCIOMessageIndexRecentPageSize = 100;
+
+static NSArray *CIOAddressFields() {
+    return @[@"from", @"to", @"cc", @"bcc"];
+}
+
+// A message along with the ID of its entry in the posting lists
+@interface CIOIndexedMessage : NSObject
+
+@property (nonatomic) NSUInteger documentID;
+@property (nonatomic) double date;
+@property (nonatomic) NSDictionary *message;
+// Field -> array of normalized values, kept so the document can be removed from its posting lists
+@property (nonatomic) NSDictionary *terms;
+
+@end
+
+@implementation CIOIndexedMessage
+
+@end
+
+#pragma mark - Normalization
+
+static NSComparisonResult CIOCompareIndexedMessages(CIOIndexedMessage *a, CIOIndexedMessage *b) {
+    if (a.date != b.date) {
+        return a.date > b.date ? NSOrderedAscending : NSOrderedDescending;
+    }
+    if (a.documentID != b.documentID) {
+        return a.documentID < b.documentID ? NSOrderedAscending : NSOrderedDescending;
+    }
+    return NSOrderedSame;
+}
+
+static NSArray *CIOSubjectTokens(NSString *subject) {
+    NSCharacterSet *separators = [[NSCharacterSet alphanumericCharacterSet] invertedSet];
+    NSMutableArray *tokens = [NSMutableArray array];
+    for (NSString *token in [subject.lowercaseString componentsSeparatedByCharactersInSet:separators]) {
+        if (token.length > 0) {
+            [tokens addObject:token];
+        }
+    }
+    return tokens;
+}
+
+// Address filters take a comma-separated string or an array of addresses
+static NSArray *CIOAddressList(id value) {
+    if ([value isKindOfClass:[NSArray class]]) {
+        value = [value componentsJoinedByString:@","];
+    }
+    if (![value isKindOfClass:[NSString class]]) {
+        return nil;
+    }
+    NSMutableArray *addresses = [NSMutableArray array];
+    for (NSString *address in [value componentsSeparatedByString:@","]) {
+        NSString *trimmed = [address stringByTrimmingCharactersInSet:[NSCharacterSet whitespaceCharacterSet]];
+        if (trimmed.length > 0) {
+            [addresses addObject:trimmed.lowercaseString];
+        }
+    }
+    return addresses.count > 0 ? addresses : nil;
+}
+
+static BOOL CIOIsRegularExpression(NSString *value) {
+    return value.length > 2 && [value hasPrefix:@"/"] && [value hasSuffix:@"/"];
+}
+
+static NSRegularExpression *CIORegularExpression(NSString *value, NSRegularExpressionOptions options) {
+    NSString *pattern = [value substringWithRange:NSMakeRange(1, value.length - 2)];
+    return [NSRegularExpression regularExpressionWithPattern:pattern options:options error:nil];
+}
+
+static BOOL CIOHasWildcards(NSString *value) {
+    return [value rangeOfCharacterFromSet:[NSCharacterSet characterSetWithCharactersInString:@"*?["]].location !=
+           NSNotFound;
+}
+
+// Index of the first entry dated before `date`, or at or before it when `inclusive`, in an array ordered newest first
+static NSUInteger CIOFirstEntryBefore(NSArray *entries, double date, BOOL inclusive) {
+    NSUInteger low = 0;
+    NSUInteger high = entries.count;
+    while (low < high) {
+        NSUInteger middle = low + (high - low) / 2;
+        double entryDate = [(CIOIndexedMessage *)entries[middle] date];
+        if (entryDate < date || (inclusive && entryDate == date)) {
+            high = middle;
+        } else {
+            low = middle + 1;
+        }
+    }
+    return low;
+}
+
+#pragma mark -
+
+@interface CIOMessageIndex ()
+
+@property (nonatomic) dispatch_queue_t queue;
+// Document ID -> CIOIndexedMessage or NSNull once removed
+@property (nonatomic) NSMutableArray *documents;
+// Number of NSNull entries in `documents`
+@property (nonatomic) NSUInteger removedDocumentCount;
+// Message ID -> CIOIndexedMessage
+@property (nonatomic) NSMutableDictionary *messages;
+// Field -> value -> NSMutableIndexSet of document IDs
+@property (nonatomic) NSMutableDictionary *postings;
+// Every CIOIndexedMessage ordered by `CIOCompareIndexedMessages`
+@property (nonatomic) NSMutableArray *entriesByDate;
+
+@end
+
+@implementation CIOMessageIndex
+
+- (instancetype)initWithStore:(CIOMessageStore *)store {
+    if ((self = [super init])) {
+        _store = store;
+        _queue = dispatch_queue_create("io.context.messageindex", DISPATCH_QUEUE_SERIAL);
+        _documents = [NSMutableArray array];
+        _messages = [NSMutableDictionary dictionary];
+        _postings = [NSMutableDictionary dictionary];
+        _entriesByDate = [NSMutableArray array];
+        // Changes are applied on `queue` from the store's current contents, so changes made while the store is first
+        // read wait for it and are applied after, rather than being overwritten by what was read
+        [[NSNotificationCenter defaultCenter] addObserver:self
+                                                 selector:@selector(storeDidChange:)
+                                                     name:CIOMessageStoreDidChangeNotification
+                                                   object:store];
+        dispatch_sync(_queue, ^{
+          [store enumerateMessagesUsingBlock:^(NSDictionary *message, BOOL *stop) {
+            [self _indexMessage:message];
+          }];
+        });
+    }
+    return self;
+}
+
+- (void)dealloc {
+    [[NSNotificationCenter defaultCenter] removeObserver:self];
+}
+
+- (void)storeDidChange:(NSNotification *)notification {
+    NSArray *messageIDs = notification.userInfo[CIOMessageStoreMessageIDsKey];
+    dispatch_sync(self.queue, ^{
+      for (NSString *messageID in messageIDs) {
+          [self _removeMessageWithID:messageID];
+          NSDictionary *message = [self.store messageWithID:messageID];
+          if (message) {
+              [self _indexMessage:message];
+          }
+      }
+      [self _compactIfNeeded];
+    });
+}
+
+- (NSUInteger)count {
+    __block NSUInteger count = 0;
+    dispatch_sync(self.queue, ^{
+      count = self.messages.count;
+    });
+    return count;
+}
+
+#pragma mark - Indexing
+
+- (NSDictionary *)_termsForMessage:(NSDictionary *)message {
+    NSMutableDictionary *terms = [NSMutableDictionary dictionary];
+    void (^addTerm)(NSString *, NSString *) = ^(NSString *field, NSString *value) {
+      if (![value isKindOfClass:[NSString class]] || value.length == 0) {
+          return;
+      }
+      NSMutableArray *values = terms[field];
+      if (!values) {
+          values = [NSMutableArray array];
+          terms[field] = values;
+      }
+      if (![values containsObject:value]) {
+          [values addObject:value];
+      }
+    };
+
+    addTerm(kCIOFieldAccount, message[@"account_id"]);
+    NSDictionary *addresses = message[@"addresses"];
+    if ([addresses isKindOfClass:[NSDictionary class]]) {
+        for (NSString *field in CIOAddressFields()) {
+            id contacts = addresses[field];
+            if ([contacts isKindOfClass:[NSDictionary class]]) {
+                contacts = @[contacts];
+            }
+            if (![contacts isKindOfClass:[NSArray class]]) {
+                continue;
+            }
+            for (NSDictionary *contact in contacts) {
+                NSString *email = [contact isKindOfClass:[NSDictionary class]] ? contact[@"email"] : nil;
+                if (![email isKindOfClass:[NSString class]]) {
+                    continue;
+                }
+                email = email.lowercaseString;
+                addTerm(field, email);
+                NSRange at = [email rangeOfString:@"@" options:NSBackwardsSearch];
+                if (at.location != NSNotFound) {
+                    addTerm(kCIOFieldDomain, [email substringFromIndex:NSMaxRange(at)]);
+                }
+            }
+        }
+    }
+    NSArray *folders = message[@"folders"];
+    if ([folders isKindOfClass:[NSArray class]]) {
+        for (NSString *folder in folders) {
+            if ([folder isKindOfClass:[NSString class]]) {
+                addTerm(kCIOFieldFolder, CIONormalizedFolder(folder));
+            }
+        }
+    }
+    NSArray *sources = message[@"sources"];
+    if ([sources isKindOfClass:[NSArray class]]) {
+        for (NSDictionary *source in sources) {
+            if ([source isKindOfClass:[NSDictionary class]]) {
+                addTerm(kCIOFieldSource, source[@"label"]);
+            }
+        }
+    }
+    NSArray *files = message[@"files"];
+    if ([files isKindOfClass:[NSArray class]]) {
+        for (NSDictionary *file in files) {
+            NSString *fileName = [file isKindOfClass:[NSDictionary class]] ? file[@"file_name"] : nil;
+            if ([fileName isKindOfClass:[NSString class]]) {
+                addTerm(kCIOFieldFile, fileName.lowercaseString);
+            }
+        }
+    }
+    NSString *subject = message[@"subject"];
+    if ([subject isKindOfClass:[NSString class]]) {
+        for (NSString *token in CIOSubjectTokens(subject)) {
+            addTerm(kCIOFieldSubject, token);
+        }
+    }
+    return terms;
+}
+
+- (void)_indexMessage:(NSDictionary *)message {
+    NSString *messageID = message[@"message_id"];
+    if (![messageID isKindOfClass:[NSString class]]) {
+        return;
+    }
+    CIOIndexedMessage *entry = [CIOIndexedMessage new];
+    entry.documentID = self.documents.count;
+    entry.date = [message[@"date"] doubleValue];
+    entry.message = message;
+    entry.terms = [self _termsForMessage:message];
+    [self.documents addObject:entry];
+    self.messages[messageID] = entry;
+
+    [entry.terms enumerateKeysAndObjectsUsingBlock:^(NSString *field, NSArray *values, BOOL *stop) {
+      NSMutableDictionary *fieldPostings = self.postings[field];
+      if (!fieldPostings) {
+          fieldPostings = [NSMutableDictionary dictionary];
+          self.postings[field] = fieldPostings;
+      }
+      for (NSString *value in values) {
+          NSMutableIndexSet *documentIDs = fieldPostings[value];
+          if (!documentIDs) {
+              documentIDs = [NSMutableIndexSet indexSet];
+              fieldPostings[value] = documentIDs;
+          }
+          [documentIDs addIndex:entry.documentID];
+      }
+    }];
+
+    NSUInteger position = [self.entriesByDate indexOfObject:entry
+                                              inSortedRange:NSMakeRange(0, self.entriesByDate.count)
+                                                    options:NSBinarySearchingInsertionIndex
+                                            usingComparator:^NSComparisonResult(id a, id b) {
+                                              return CIOCompareIndexedMessages(a, b);
+                                            }];
+    [self.entriesByDate insertObject:entry atIndex:position];
+}
+
+- (void)_removeMessageWithID:(NSString *)messageID {
+    CIOIndexedMessage *entry = self.messages[messageID];
+    if (!entry) {
+        return;
+    }
+    [entry.terms enumerateKeysAndObjectsUsingBlock:^(NSString *field, NSArray *values, BOOL *stop) {
+      NSMutableDictionary *fieldPostings = self.postings[field];
+      for (NSString *value in values) {
+          NSMutableIndexSet *documentIDs = fieldPostings[value];
+          [documentIDs removeIndex:entry.documentID];
+          if (documentIDs.count == 0) {
+              [fieldPostings removeObjectForKey:value];
+          }
+      }
+    }];
+    NSUInteger position = [self.entriesByDate indexOfObject:entry
+                                              inSortedRange:NSMakeRange(0, self.entriesByDate.count)
+                                                    options:NSBinarySearchingFirstEqual
+                                            usingComparator:^NSComparisonResult(id a, id b) {
+                                              return CIOCompareIndexedMessages(a, b);
+                                            }];
+    if (position != NSNotFound) {
+        [self.entriesByDate removeObjectAtIndex:position];
+    }
+    self.documents[entry.documentID] = [NSNull null];
+    self.removedDocumentCount++;
+    [self.messages removeObjectForKey:messageID];
+}
+
+// Renumbers the documents once removed ones outnumber live ones, rebuilding the posting lists. Numbering follows the
+// old order, so ties in `entriesByDate` stay sorted.
+- (void)_compactIfNeeded {
+    if (self.removedDocumentCount < kCIOMessageIndexCompactionThreshold ||
+        self.removedDocumentCount <= self.messages.count) {
+        return;
+    }
+    NSMutableArray *documents = [NSMutableArray arrayWithCapacity:self.messages.count];
+    for (CIOIndexedMessage *entry in self.documents) {
+        if ((id)entry != [NSNull null]) {
+            entry.documentID = documents.count;
+            [documents addObject:entry];
+        }
+    }
+    self.documents = documents;
+    self.removedDocumentCount = 0;
+    [self.postings enumerateKeysAndObjectsUsingBlock:^(NSString *field, NSMutableDictionary *fieldPostings, BOOL *stop) {
+      [fieldPostings removeAllObjects];
+    }];
+    for (CIOIndexedMessage *entry in documents) {
+        [entry.terms enumerateKeysAndObjectsUsingBlock:^(NSString *field, NSArray *values, BOOL *stop) {
+          NSMutableDictionary *fieldPostings = self.postings[field];
+          for (NSString *value in values) {
+              NSMutableIndexSet *documentIDs = fieldPostings[value];
+              if (!documentIDs) {
+                  documentIDs = [NSMutableIndexSet indexSet];
+                  fieldPostings[value] = documentIDs;
+              }
+              [documentIDs addIndex:entry.documentID];
+          }
+        }];
+    }
+}
+
+#pragma mark - Posting Lists
+
+- (NSIndexSet *)_postingsForField:(NSString *)field value:(NSString *)value {
+    return self.postings[field][value] ?: [NSIndexSet indexSet];
+}
+
+// Union of the posting lists of every value of `field` accepted by `matches`
+- (NSIndexSet *)_postingsForField:(NSString *)field matching:(BOOL (^)(NSString *value))matches {
+    NSMutableIndexSet *combined = [NSMutableIndexSet indexSet];
+    [self.postings[field] enumerateKeysAndObjectsUsingBlock:^(NSString *value, NSIndexSet *documentIDs, BOOL *stop) {
+      if (matches(value)) {
+          [combined addIndexes:documentIDs];
+      }
+    }];
+    return combined;
+}
+
+- (NSIndexSet *)_postingsForAddresses:(NSArray *)addresses fields:(NSArray *)fields {
+    NSMutableIndexSet *combined = [NSMutableIndexSet indexSet];
+    for (NSString *address in addresses) {
+        if ([address rangeOfString:@"@"].location == NSNotFound) {
+            // `email` also accepts a top level domain
+            [combined addIndexes:[self _postingsForField:kCIOFieldDomain value:address]];
+            continue;
+        }
+        for (NSString *field in fields) {
+            [combined addIndexes:[self _postingsForField:field value:address]];
+        }
+    }
+    return combined;
+}
+
+- (NSIndexSet *)_postingsForFileName:(NSString *)fileName {
+    if (CIOIsRegularExpression(fileName)) {
+        NSRegularExpression *expression = CIORegularExpression(fileName, NSRegularExpressionCaseInsensitive);
+        return [self _postingsForField:kCIOFieldFile
+                              matching:^BOOL(NSString *value) {
+                                return [expression firstMatchInString:value options:0 range:NSMakeRange(0, value.length)] != nil;
+                              }];
+    }
+    NSString *pattern = fileName.lowercaseString;
+    if (!CIOHasWildcards(pattern)) {
+        return [self _postingsForField:kCIOFieldFile value:pattern];
+    }
+    return [self _postingsForField:kCIOFieldFile
+                          matching:^BOOL(NSString *value) {
+                            return fnmatch(pattern.UTF8String, value.UTF8String, 0) == 0;
+                          }];
+}
+
+// One posting list per word of a subject substring search. Words at the ends of the search may be cut short, so they
+// match any indexed word ending, or starting, with them; candidates are checked against the full subject afterwards.
+- (NSArray *)_postingsForSubject:(NSString *)subject {
+    NSArray *tokens = CIOSubjectTokens(subject);
+    NSMutableArray *lists = [NSMutableArray arrayWithCapacity:tokens.count];
+    [tokens enumerateObjectsUsingBlock:^(NSString *token, NSUInteger idx, BOOL *stop) {
+      BOOL first = idx == 0;
+      BOOL last = idx == tokens.count - 1;
+      if (!first && !last) {
+          [lists addObject:[self _postingsForField:kCIOFieldSubject value:token]];
+          return;
+      }
+      [lists addObject:[self _postingsForField:kCIOFieldSubject
+                                      matching:^BOOL(NSString *value) {
+                                        if (first && last) {
+                                            return [value rangeOfString:token].location != NSNotFound;
+                                        }
+                                        return first ? [value hasSuffix:token] : [value hasPrefix:token];
+                                      }]];
+    }];
+    return lists;
+}
+
+#pragma mark - Evaluation
+
+- (BOOL)canEvaluateRequest:(CIOMessagesRequest *)request {
+    if (request.include_body || request.include_source || request.include_flags || request.include_thread_size) {
+        return NO;
+    }
+    if (request.include_headers.length > 0 && ![request.include_headers isEqualToString:@"0"]) {
+        return NO;
+    }
+    for (NSString *value in @[request.subject ?: @"", request.file_name ?: @""]) {
+        if (CIOIsRegularExpression(value) && !CIORegularExpression(value, 0)) {
+            return NO;
+        }
+    }
+    return request.client.accountID != nil;
+}
+
+// Every match for `request`, in the requested order. Must be called on `queue`.
+- (NSArray *)_matchesForRequest:(CIOMessagesRequest *)request {
+    NSMutableArray *lists = [NSMutableArray array];
+    [lists addObject:[self _postingsForField:kCIOFieldAccount value:request.client.accountID]];
+    for (NSString *field in CIOAddressFields()) {
+        NSArray *addresses = CIOAddressList([request valueForKey:field]);
+        if (addresses) {
+            [lists addObject:[self _postingsForAddresses:addresses fields:@[field]]];
+        }
+    }
+    NSArray *contacts = CIOAddressList(request.email);
+    if (contacts) {
+        [lists addObject:[self _postingsForAddresses:contacts fields:CIOAddressFields()]];
+    }
+    if (request.folder) {
+        [lists addObject:[self _postingsForField:kCIOFieldFolder value:CIONormalizedFolder(request.folder)]];
+    }
+    if (request.source) {
+        [lists addObject:[self _postingsForField:kCIOFieldSource value:request.source]];
+    }
+    if (request.file_name) {
+        [lists addObject:[self _postingsForFileName:request.file_name]];
+    }
+    BOOL subjectIsExpression = CIOIsRegularExpression(request.subject);
+    if (request.subject && !subjectIsExpression) {
+        [lists addObjectsFromArray:[self _postingsForSubject:request.subject]];
+    }
+
+    // The date window of the request as a range of `entriesByDate`
+    NSUInteger start = 0;
+    NSUInteger end = self.entriesByDate.count;
+    if (request.date_before) {
+        start = CIOFirstEntryBefore(self.entriesByDate, request.date_before.timeIntervalSince1970, NO);
+    }
+    if (request.date_after) {
+        end = MAX(start, CIOFirstEntryBefore(self.entriesByDate, request.date_after.timeIntervalSince1970, YES));
+    }
+
+    [lists sortUsingComparator:^NSComparisonResult(NSIndexSet *a, NSIndexSet *b) {
+      return a.count < b.count ? NSOrderedAscending : (a.count > b.count ? NSOrderedDescending : NSOrderedSame);
+    }];
+    // Walk whichever is smaller, the date window or the shortest posting list, probing the others
+    NSIndexSet *smallest = lists.firstObject;
+    BOOL windowIsSmallest = end - start < smallest.count;
+    NSMutableIndexSet *candidates = [NSMutableIndexSet indexSet];
+    if (windowIsSmallest) {
+        for (NSUInteger i = start; i < end; i++) {
+            [candidates addIndex:[(CIOIndexedMessage *)self.entriesByDate[i] documentID]];
+        }
+    } else {
+        [candidates addIndexes:smallest];
+        [lists removeObjectAtIndex:0];
+    }
+    NSMutableIndexSet *matches = [NSMutableIndexSet indexSet];
+    [candidates enumerateIndexesUsingBlock:^(NSUInteger documentID, BOOL *stop) {
+      for (NSIndexSet *list in lists) {
+          if (![list containsIndex:documentID]) {
+              return;
+          }
+      }
+      [matches addIndex:documentID];
+    }];
+
+    NSRegularExpression *subjectExpression = subjectIsExpression ? CIORegularExpression(request.subject, 0) : nil;
+    double dateBefore = request.date_before.timeIntervalSince1970;
+    double dateAfter = request.date_after.timeIntervalSince1970;
+    NSMutableArray *results = [NSMutableArray arrayWithCapacity:matches.count];
+    [matches enumerateIndexesUsingBlock:^(NSUInteger documentID, BOOL *stop) {
+      CIOIndexedMessage *entry = self.documents[documentID];
+      NSDictionary *message = entry.message;
+      if (!windowIsSmallest && ((request.date_before && entry.date >= dateBefore) ||
+                                (request.date_after && entry.date <= dateAfter))) {
+          return;
+      }
+      double dateIndexed = [message[@"date_indexed"] doubleValue];
+      if ((request.indexed_before && dateIndexed >= request.indexed_before.timeIntervalSince1970) ||
+          (request.indexed_after && dateIndexed <= request.indexed_after.timeIntervalSince1970)) {
+          return;
+      }
+      if (request.subject) {
+          NSString *subject = [message[@"subject"] isKindOfClass:[NSString class]] ? message[@"subject"] : @"";
+          BOOL subjectMatches =
+              subjectExpression
+                  ? [subjectExpression firstMatchInString:subject options:0 range:NSMakeRange(0, subject.length)] != nil
+                  : [subject rangeOfString:request.subject options:NSCaseInsensitiveSearch].location != NSNotFound;
+          if (!subjectMatches) {
+              return;
+          }
+      }
+      if ((request.file_size_min || request.file_size_max) && ![self _message:message hasFileSizedFor:request]) {
+          return;
+      }
+      [results addObject:message];
+    }];
+
+    [results sortUsingComparator:^NSComparisonResult(NSDictionary *a, NSDictionary *b) {
+      NSComparisonResult result = CIOCompareMessages(a, b);
+      return request.sort_order == CIOSortOrderAscending ? (NSComparisonResult)-result : result;
+    }];
+    return results;
+}
+
+- (BOOL)_message:(NSDictionary *)message hasFileSizedFor:(CIOMessagesRequest *)request {
+    NSArray *files = message[@"files"];
+    if (![files isKindOfClass:[NSArray class]]) {
+        return NO;
+    }
+    for (NSDictionary *file in files) {
+        if (![file isKindOfClass:[NSDictionary class]]) {
+            continue;
+        }
+        long long size = [file[@"size"] longLongValue];
+        if ((!request.file_size_min || size >= request.file_size_min.longLongValue) &&
+            (!request.file_size_max || size <= request.file_size_max.longLongValue)) {
+            return YES;
+        }
+    }
+    return NO;
+}
+
+static NSArray *CIOPageOfMessages(NSArray *messages, NSInteger offset, NSInteger limit) {
+    NSUInteger location = MIN((NSUInteger)MAX(offset, 0), messages.count);
+    NSUInteger length = messages.count - location;
+    if (limit > 0) {
+        length = MIN(length, (NSUInteger)limit);
+    }
+    return [messages subarrayWithRange:NSMakeRange(location, length)];
+}
+
+- (NSArray *)messagesMatchingRequest:(CIOMessagesRequest *)request {
+    if (![self canEvaluateRequest:request]) {
+        return nil;
+    }
+    __block NSArray *matches = nil;
+    dispatch_sync(self.queue, ^{
+      matches = [self _matchesForRequest:request];
+    });
+    return CIOPageOfMessages(matches, request.offset, request.limit);
+}
+
+#pragma mark - Execution
+
+- (void)executeRequest:(CIOMessagesRequest *)request
+               success:(void (^)(NSArray *))success
+               failure:(void (^)(NSError *))failure {
+    NSDate *highWaterMark = request.client.accountID ? [self.store highWaterMarkForAccountID:request.client.accountID] : nil;
+    if (!highWaterMark || ![self canEvaluateRequest:request]) {
+        [request executeWithSuccess:success failure:failure];
+        return;
+    }
+    __block NSArray *localMatches = nil;
+    dispatch_sync(self.queue, ^{
+      localMatches = [self _matchesForRequest:request];
+    });
+
+    // Only messages Context.IO indexed since the last complete sync can be missing locally
+    NSDate *indexedAfter = highWaterMark;
+    if (request.indexed_after && [request.indexed_after compare:highWaterMark] == NSOrderedDescending) {
+        indexedAfter = request.indexed_after;
+    }
+    if (request.indexed_before && [request.indexed_before compare:indexedAfter] != NSOrderedDescending) {
+        NSArray *page = CIOPageOfMessages(localMatches, request.offset, request.limit);
+        dispatch_async(dispatch_get_main_queue(), ^{
+          success(page);
+        });
+        return;
+    }
+    NSMutableDictionary *parameters = [request.parameters mutableCopy];
+    parameters[@"indexed_after"] = @([indexedAfter timeIntervalSince1970]);
+    // Sorted like the request, the first offset + limit recent messages are enough to fill its page once merged
+    NSInteger neededCount = request.limit > 0 ? request.limit + MAX(request.offset, 0) : NSIntegerMax;
+    void (^merge)(NSArray *) = ^(NSArray *recentMessages) {
+      if (!recentMessages) {
+          // Too many messages were indexed since the last sync to cover them page by page
+          [request executeWithSuccess:success failure:failure];
+          return;
+      }
+      NSMutableDictionary *merged = [NSMutableDictionary dictionary];
+      for (NSDictionary *message in localMatches) {
+          merged[message[@"message_id"]] = message;
+      }
+      for (NSDictionary *message in recentMessages) {
+          if ([message isKindOfClass:[NSDictionary class]] && [message[@"message_id"] isKindOfClass:[NSString class]]) {
+              merged[message[@"message_id"]] = message;
+          }
+      }
+      NSArray *messages = [merged.allValues sortedArrayUsingComparator:^NSComparisonResult(id a, id b) {
+        NSComparisonResult result = CIOCompareMessages(a, b);
+        return request.sort_order == CIOSortOrderAscending ? (NSComparisonResult)-result : result;
+      }];
+      success(CIOPageOfMessages(messages, request.offset, request.limit));
+    };
+    [self _fetchRecentMessagesWithParameters:parameters
+                                  forRequest:request
+                                 neededCount:neededCount
+                                    messages:[NSMutableArray array]
+                                     success:merge
+                                     failure:failure];
+}
+
+// Pages through the messages indexed since the last sync until `neededCount` are fetched or a page comes back short.
+// Completes with `nil` once `kCIOMessageIndexMaximumRecentPages` pages did not cover them.
+- (void)_fetchRecentMessagesWithParameters:(NSMutableDictionary *)parameters
+                                forRequest:(CIOMessagesRequest *)request
+                               neededCount:(NSInteger)neededCount
+                                  messages:(NSMutableArray *)messages
+                                   success:(void (^)(NSArray *))success
+                                   failure:(void (^)(NSError *))failure {
+    if ((NSInteger)messages.count >= kCIOMessageIndexMaximumRecentPages * kCIOMessageIndexRecentPageSize) {
+        success(nil);
+        return;
+    }
+    parameters[@"offset"] = @(messages.count);
+    parameters[@"limit"] = @(kCIOMessageIndexRecentPageSize);
+    CIOMessagesRequest *recentRequest = [CIOMessagesRequest requestWithPath:request.path
+                                                                     method:request.method
+                                                                 parameters:[parameters copy]
+                                                                     client:request.client];
+    [recentRequest executeWithSuccess:^(NSArray *page) {
+      [messages addObjectsFromArray:page];
+      if ((NSInteger)page.count < kCIOMessageIndexRecentPageSize || (NSInteger)messages.count >= neededCount) {
+          success(messages);
+          return;
+      }
+      [self _fetchRecentMessagesWithParameters:parameters
+                                    forRequest:request
+                                   neededCount:neededCount
+                                      messages:messages
+                                       success:success
+                                       failure:failure];
+    } failure:failure];
+}
+
+@end
@@ -0,0 +1,128 @@
+//
+//  CIOMessageMetadataFile.h
+//  CIOAPIClient
+//
+//  Copyright © 2015 Context.io. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+
+@class CIOMessageFlags;
+
+NS_ASSUME_NONNULL_BEGIN
+
+/**
+ String fields of a message record. Fields with several values (addresses and folders) are stored as one string with
+ a value per line.
+ */
+typedef NS_ENUM(NSInteger, CIOMessageMetadataField) {
+    CIOMessageMetadataFieldMessageID = 0,
+    CIOMessageMetadataFieldEmailMessageID,
+    CIOMessageMetadataFieldGmailThreadID,
+    CIOMessageMetadataFieldSubject,
+    CIOMessageMetadataFieldFrom,
+    CIOMessageMetadataFieldTo,
+    CIOMessageMetadataFieldCc,
+    CIOMessageMetadataFieldFolders
+};
+
+/**
+ IMAP flags of a message record, one bit per `CIOMessageFlags` property.
+ */
+typedef NS_OPTIONS(uint8_t, CIOMessageFlagBits) {
+    CIOMessageFlagBitSeen = 1 << 0,
+    CIOMessageFlagBitAnswered = 1 << 1,
+    CIOMessageFlagBitFlagged = 1 << 2,
+    CIOMessageFlagBitDeleted = 1 << 3,
+    CIOMessageFlagBitDraft = 1 << 4
+};
+
+/**
+ `CIOMessageMetadataFile` is a compact binary cache of message metadata which is read through a memory mapping, so
+ opening a file with a million messages costs a couple of system calls and reading a message only touches the pages
+ it lives on.
+
+ A file is a directory holding two version-tagged files:
+
+ - `records`: a header followed by a fixed size record per message with its dates as integer seconds, flag bitsets and
+   references in to the string table.
+ - `strings`: the string table, NUL-terminated UTF-8 strings referenced by byte offset. Repeated strings, such as
+   addresses and folder names, are stored once.
+
+ Messages are appended in place; the string table is written before the records that reference it, and each file's
+ header is updated last, so an interrupted append leaves the previous contents intact. Values are stored in the byte
+ order of the host.
+
+ Reading is thread safe and lock-free. Appends are serialized, and readers see them once they complete.
+ */
+@interface CIOMessageMetadataFile : NSObject
+
+/**
+ *  Opens, or creates, the file at `directoryURL`.
+ *
+ *  @return the file, or `nil` if it could not be created or was written by an incompatible version
+ */
+- (nullable instancetype)initWithDirectoryURL:(NSURL *)directoryURL error:(NSError **)error NS_DESIGNATED_INITIALIZER;
+
+- (instancetype)init NS_UNAVAILABLE;
+
+@property (readonly, nonatomic) NSURL *directoryURL;
+
+/**
+ *  Number of message records.
+ */
+@property (readonly) NSUInteger count;
+
+/**
+ *  Appends records for messages as returned by the API, e.g. from `-[CIOV2Client getMessages]` or
+ * `-[CIOMessageStore enumerateMessagesUsingBlock:]`. Flags are read from a `flags` dictionary or array of IMAP flags
+ * when present.
+ *
+ *  The first append after opening reads the string table once to find strings which can be shared.
+ *
+ *  @return `YES` on success
+ */
+- (BOOL)appendMessages:(NSArray *)messages error:(NSError **)error;
+
+#pragma mark - Reading
+
+/**
+ *  The `date` of the message at `index`, in seconds since 1970.
+ */
+- (int64_t)dateAtIndex:(NSUInteger)index;
+
+/**
+ *  The `date_indexed` of the message at `index`, in seconds since 1970.
+ */
+- (int64_t)dateIndexedAtIndex:(NSUInteger)index;
+
+/**
+ *  A string field of the message at `index`, or `nil` if the message did not have it.
+ */
+- (nullable NSString *)stringForField:(CIOMessageMetadataField)field atIndex:(NSUInteger)index;
+
+/**
+ *  Number of attachments of the message at `index`.
+ */
+- (NSUInteger)fileCountAtIndex:(NSUInteger)index;
+
+/**
+ *  The flags set on the message at `index`.
+ *
+ *  @param knownFlags if not `NULL`, set to the flags whose state was known when the message was appended
+ */
+- (CIOMessageFlagBits)flagsAtIndex:(NSUInteger)index knownFlags:(nullable CIOMessageFlagBits *)knownFlags;
+
+/**
+ *  The flags of the message at `index` as `CIOMessageFlags`, leaving unknown flags `nil`.
+ */
+- (CIOMessageFlags *)messageFlagsAtIndex:(NSUInteger)index;
+
+/**
+ *  The message at `index` in the shape of an API message listing, for code which works with message dictionaries.
+ */
+- (NSDictionary *)messageAtIndex:(NSUInteger)index;
+
+@end
+
+NS_ASSUME_NONNULL_END
@@ -0,0 +1,415 @@
+//
+//  CIOMessageMetadataFile.m
+//  CIOAPIClient
+//
+//  Copyright © 2015 Context.io. All rights reserved.
+//
+
+#import "CIOMessageMetadataFile.h"
+#import "CIOMessageFlags.h"
+#import "CIOMessageUtilities.h"
+
+static NSString *const CIOMessageMetadataErrorDomain = @"io.context.error.metadata";
+
+static const uint16_t kCIOMetadataVersion = 1;
+static const char kCIORecordsMagic[4] = {'C', 'I', 'O', 'M'};
+static const char kCIOStringsMagic[4] = {'C', 'I', 'O', 'S'};
+
+typedef struct {
+    char magic[4];
+    uint16_t version;
+    // Size of each record in the records file, unused in the strings file
+    uint16_t recordSize;
+    // Records: number of committed records. Strings: committed length of the string table.
+    uint64_t length;
+} CIOMetadataHeader;
+
+#define CIOMetadataStringFieldCount 8
+
+typedef struct {
+    int64_t date;
+    int64_t dateIndexed;
+    // Offsets in to the string table by `CIOMessageMetadataField`, 0 for none
+    uint32_t strings[CIOMetadataStringFieldCount];
+    uint16_t fileCount;
+    uint8_t flags;
+    uint8_t knownFlags;
+    uint32_t reserved;
+} CIOMessageRecord;
+
+_Static_assert(sizeof(CIOMetadataHeader) == 16, "Header layout is part of the file format");
+_Static_assert(sizeof(CIOMessageRecord) == 56, "Record layout is part of the file format");
+
+static NSError *CIOMetadataError(NSInteger code, NSString *description) {
+    return [NSError errorWithDomain:CIOMessageMetadataErrorDomain
+                               code:code
+                           userInfo:@{NSLocalizedDescriptionKey: description}];
+}
+
+// The mapped contents of both files as of the last completed append
+@interface CIOMessageMetadataSnapshot : NSObject
+
+@property (nonatomic) NSData *records;
+@property (nonatomic) NSData *strings;
+@property (nonatomic) NSUInteger count;
+@property (nonatomic) uint64_t stringsLength;
+
+@end
+
+@implementation CIOMessageMetadataSnapshot
+
+@end
+
+#pragma mark -
+
+@interface CIOMessageMetadataFile ()
+
+@property (atomic) CIOMessageMetadataSnapshot *snapshot;
+// String -> offset in the string table, built on the first append
+@property (nonatomic) NSMutableDictionary *stringOffsets;
+
+@end
+
+@implementation CIOMessageMetadataFile
+
+- (instancetype)initWithDirectoryURL:(NSURL *)directoryURL error:(NSError **)error {
+    if ((self = [super init])) {
+        _directoryURL = directoryURL;
+        if (![self _createFilesIfNeeded:error]) {
+            return nil;
+        }
+        _snapshot = [self _mapFiles:error];
+        if (!_snapshot) {
+            return nil;
+        }
+    }
+    return self;
+}
+
+- (NSURL *)_recordsURL {
+    return [self.directoryURL URLByAppendingPathComponent:@"records"];
+}
+
+- (NSURL *)_stringsURL {
+    return [self.directoryURL URLByAppendingPathComponent:@"strings"];
+}
+
+- (BOOL)_createFilesIfNeeded:(NSError **)error {
+    NSFileManager *fileManager = [NSFileManager defaultManager];
+    if ([fileManager fileExistsAtPath:[self _recordsURL].path]) {
+        return YES;
+    }
+    if (![fileManager createDirectoryAtURL:self.directoryURL withIntermediateDirectories:YES attributes:nil error:error]) {
+        return NO;
+    }
+    CIOMetadataHeader header = {{0}, kCIOMetadataVersion, 0, 0};
+    // Offset 0 of the string table is an empty string standing for "no value"
+    memcpy(header.magic, kCIOStringsMagic, sizeof(header.magic));
+    header.length = 1;
+    NSMutableData *strings = [NSMutableData dataWithBytes:&header length:sizeof(header)];
+    [strings increaseLengthBy:1];
+    memcpy(header.magic, kCIORecordsMagic, sizeof(header.magic));
+    header.recordSize = sizeof(CIOMessageRecord);
+    header.length = 0;
+    NSData *records = [NSData dataWithBytes:&header length:sizeof(header)];
+    // The records file is written last, so its presence means both files are complete
+    return [strings writeToURL:[self _stringsURL] options:NSDataWritingAtomic error:error] &&
+           [records writeToURL:[self _recordsURL] options:NSDataWritingAtomic error:error];
+}
+
+- (CIOMessageMetadataSnapshot *)_mapFiles:(NSError **)error {
+    CIOMessageMetadataSnapshot *snapshot = [CIOMessageMetadataSnapshot new];
+    snapshot.records = [NSData dataWithContentsOfURL:[self _recordsURL] options:NSDataReadingMappedAlways error:error];
+    snapshot.strings = [NSData dataWithContentsOfURL:[self _stringsURL] options:NSDataReadingMappedAlways error:error];
+    if (!snapshot.records || !snapshot.strings) {
+        return nil;
+    }
+    if (snapshot.records.length < sizeof(CIOMetadataHeader) || snapshot.strings.length < sizeof(CIOMetadataHeader)) {
+        if (error) {
+            *error = CIOMetadataError(NSFileReadCorruptFileError, @"Message metadata file is truncated");
+        }
+        return nil;
+    }
+    const CIOMetadataHeader *records = snapshot.records.bytes;
+    const CIOMetadataHeader *strings = snapshot.strings.bytes;
+    if (memcmp(records->magic, kCIORecordsMagic, 4) != 0 || memcmp(strings->magic, kCIOStringsMagic, 4) != 0) {
+        if (error) {
+            *error = CIOMetadataError(NSFileReadCorruptFileError, @"Not a message metadata file");
+        }
+        return nil;
+    }
+    if (records->version != kCIOMetadataVersion || strings->version != kCIOMetadataVersion ||
+        records->recordSize != sizeof(CIOMessageRecord)) {
+        if (error) {
+            NSString *description =
+                [NSString stringWithFormat:@"Unsupported message metadata file version %d", records->version];
+            *error = CIOMetadataError(NSFileReadCorruptFileError, description);
+        }
+        return nil;
+    }
+    // Divided rather than multiplied, as a corrupt length could overflow
+    if (records->length > (snapshot.records.length - sizeof(CIOMetadataHeader)) / sizeof(CIOMessageRecord) ||
+        snapshot.strings.length - sizeof(CIOMetadataHeader) < strings->length || strings->length == 0) {
+        if (error) {
+            *error = CIOMetadataError(NSFileReadCorruptFileError, @"Message metadata file is truncated");
+        }
+        return nil;
+    }
+    snapshot.count = (NSUInteger)records->length;
+    snapshot.stringsLength = strings->length;
+    return snapshot;
+}
+
+- (NSUInteger)count {
+    return self.snapshot.count;
+}
+
+#pragma mark - Appending
+
+- (void)_buildStringOffsets:(CIOMessageMetadataSnapshot *)snapshot {
+    self.stringOffsets = [NSMutableDictionary dictionary];
+    const char *table = (const char *)snapshot.strings.bytes + sizeof(CIOMetadataHeader);
+    uint64_t offset = 1;
+    while (offset < snapshot.stringsLength) {
+        const char *end = memchr(table + offset, '\0', (size_t)(snapshot.stringsLength - offset));
+        if (!end) {
+            break;
+        }
+        NSString *string = [[NSString alloc] initWithBytes:table + offset
+                                                    length:(NSUInteger)(end - (table + offset))
+                                                  encoding:NSUTF8StringEncoding];
+        if (string && !self.stringOffsets[string]) {
+            self.stringOffsets[string] = @(offset);
+        }
+        offset = (uint64_t)(end - table) + 1;
+    }
+}
+
+static NSString *CIOEmailList(id contacts) {
+    if ([contacts isKindOfClass:[NSDictionary class]]) {
+        contacts = @[contacts];
+    }
+    if (![contacts isKindOfClass:[NSArray class]]) {
+        return nil;
+    }
+    NSMutableArray *emails = [NSMutableArray array];
+    for (NSDictionary *contact in contacts) {
+        NSString *email = [contact isKindOfClass:[NSDictionary class]] ? contact[@"email"] : nil;
+        if ([email isKindOfClass:[NSString class]]) {
+            [emails addObject:email];
+        }
+    }
+    return emails.count > 0 ? [emails componentsJoinedByString:@"\n"] : nil;
+}
+
+static void CIOReadFlags(id flags, uint8_t *bits, uint8_t *known) {
+    NSDictionary *values = CIONormalizedFlags(flags);
+    if (![values isKindOfClass:[NSDictionary class]]) {
+        return;
+    }
+    [CIOMessageFlagNames() enumerateObjectsUsingBlock:^(NSString *name, NSUInteger idx, BOOL *stop) {
+      NSNumber *value = values[name];
+      if ([value isKindOfClass:[NSNumber class]]) {
+          *known |= 1 << idx;
+          if (value.boolValue) {
+              *bits |= 1 << idx;
+          }
+      }
+    }];
+}
+
+- (BOOL)appendMessages:(NSArray *)messages error:(NSError **)error {
+    @synchronized(self) {
+        CIOMessageMetadataSnapshot *snapshot = self.snapshot;
+        if (!self.stringOffsets) {
+            [self _buildStringOffsets:snapshot];
+        }
+        NSMutableDictionary *newOffsets = [NSMutableDictionary dictionary];
+        NSMutableData *table = [NSMutableData data];
+        __block BOOL tableFull = NO;
+        uint32_t (^intern)(id) = ^uint32_t(id string) {
+          if (![string isKindOfClass:[NSString class]] || [string length] == 0) {
+              return 0;
+          }
+          NSNumber *existing = self.stringOffsets[string] ?: newOffsets[string];
+          if (existing) {
+              return existing.unsignedIntValue;
+          }
+          NSData *bytes = [string dataUsingEncoding:NSUTF8StringEncoding];
+          uint64_t offset = snapshot.stringsLength + table.length;
+          if (offset + bytes.length + 1 > UINT32_MAX) {
+              tableFull = YES;
+              return 0;
+          }
+          [table appendData:bytes];
+          [table increaseLengthBy:1];
+          newOffsets[string] = @(offset);
+          return (uint32_t)offset;
+        };
+
+        NSMutableData *records = [NSMutableData data];
+        for (NSDictionary *message in messages) {
+            if (![message isKindOfClass:[NSDictionary class]]) {
+                continue;
+            }
+            CIOMessageRecord record;
+            memset(&record, 0, sizeof(record));
+            record.date = [message[@"date"] longLongValue];
+            record.dateIndexed = [message[@"date_indexed"] longLongValue];
+            NSDictionary *addresses = [message[@"addresses"] isKindOfClass:[NSDictionary class]] ? message[@"addresses"] : nil;
+            NSArray *folders = [message[@"folders"] isKindOfClass:[NSArray class]] ? message[@"folders"] : nil;
+            record.strings[CIOMessageMetadataFieldMessageID] = intern(message[@"message_id"]);
+            record.strings[CIOMessageMetadataFieldEmailMessageID] = intern(message[@"email_message_id"]);
+            record.strings[CIOMessageMetadataFieldGmailThreadID] = intern(message[@"gmail_thread_id"]);
+            record.strings[CIOMessageMetadataFieldSubject] = intern(message[@"subject"]);
+            record.strings[CIOMessageMetadataFieldFrom] = intern(CIOEmailList(addresses[@"from"]));
+            record.strings[CIOMessageMetadataFieldTo] = intern(CIOEmailList(addresses[@"to"]));
+            record.strings[CIOMessageMetadataFieldCc] = intern(CIOEmailList(addresses[@"cc"]));
+            record.strings[CIOMessageMetadataFieldFolders] = intern([folders componentsJoinedByString:@"\n"]);
+            NSArray *files = message[@"files"];
+            record.fileCount = [files isKindOfClass:[NSArray class]] ? (uint16_t)MIN(files.count, UINT16_MAX) : 0;
+            CIOReadFlags(message[@"flags"], &record.flags, &record.knownFlags);
+            [records appendBytes:&record length:sizeof(record)];
+        }
+        if (tableFull) {
+            if (error) {
+                *error = CIOMetadataError(NSFileWriteOutOfSpaceError, @"Message metadata string table is full");
+            }
+            return NO;
+        }
+        if (records.length == 0) {
+            return YES;
+        }
+
+        NSUInteger count = snapshot.count + records.length / sizeof(CIOMessageRecord);
+        uint64_t stringsLength = snapshot.stringsLength + table.length;
+        NSFileHandle *stringsHandle = [NSFileHandle fileHandleForWritingToURL:[self _stringsURL] error:error];
+        NSFileHandle *recordsHandle = [NSFileHandle fileHandleForWritingToURL:[self _recordsURL] error:error];
+        if (!stringsHandle || !recordsHandle) {
+            return NO;
+        }
+        @try {
+            // Strings before the records which reference them, and each header after its contents
+            [stringsHandle seekToFileOffset:sizeof(CIOMetadataHeader) + snapshot.stringsLength];
+            [stringsHandle writeData:table];
+            [stringsHandle seekToFileOffset:offsetof(CIOMetadataHeader, length)];
+            [stringsHandle writeData:[NSData dataWithBytes:&stringsLength length:sizeof(stringsLength)]];
+            [recordsHandle seekToFileOffset:sizeof(CIOMetadataHeader) + snapshot.count * sizeof(CIOMessageRecord)];
+            [recordsHandle writeData:records];
+            uint64_t recordCount = count;
+            [recordsHandle seekToFileOffset:offsetof(CIOMetadataHeader, length)];
+            [recordsHandle writeData:[NSData dataWithBytes:&recordCount length:sizeof(recordCount)]];
+        } @catch (NSException *exception) {
+            if (error) {
+                *error = CIOMetadataError(NSFileWriteUnknownError, exception.reason ?: @"Could not write message metadata");
+            }
+            return NO;
+        } @finally {
+            [stringsHandle closeFile];
+            [recordsHandle closeFile];
+        }
+        [self.stringOffsets addEntriesFromDictionary:newOffsets];
+
+        CIOMessageMetadataSnapshot *appended = [self _mapFiles:error];
+        if (!appended) {
+            return NO;
+        }
+        self.snapshot = appended;
+        return YES;
+    }
+}
+
+#pragma mark - Reading
+
+static const CIOMessageRecord *CIORecordAtIndex(CIOMessageMetadataSnapshot *snapshot, NSUInteger index) {
+    if (index >= snapshot.count) {
+        [NSException raise:NSRangeException format:@"Index %lu beyond bounds [0 .. %lu)", (unsigned long)index,
+                                                    (unsigned long)snapshot.count];
+    }
+    const uint8_t *base = (const uint8_t *)snapshot.records.bytes + sizeof(CIOMetadataHeader);
+    return (const CIOMessageRecord *)(base + index * sizeof(CIOMessageRecord));
+}
+
+- (int64_t)dateAtIndex:(NSUInteger)index {
+    return CIORecordAtIndex(self.snapshot, index)->date;
+}
+
+- (int64_t)dateIndexedAtIndex:(NSUInteger)index {
+    return CIORecordAtIndex(self.snapshot, index)->dateIndexed;
+}
+
+- (NSString *)stringForField:(CIOMessageMetadataField)field atIndex:(NSUInteger)index {
+    NSParameterAssert(field >= 0 && field < CIOMetadataStringFieldCount);
+    CIOMessageMetadataSnapshot *snapshot = self.snapshot;
+    uint32_t offset = CIORecordAtIndex(snapshot, index)->strings[field];
+    if (offset == 0 || offset >= snapshot.stringsLength) {
+        return nil;
+    }
+    const char *string = (const char *)snapshot.strings.bytes + sizeof(CIOMetadataHeader) + offset;
+    const char *end = memchr(string, '\0', (size_t)(snapshot.stringsLength - offset));
+    if (!end) {
+        return nil;
+    }
+    return [[NSString alloc] initWithBytes:string length:(NSUInteger)(end - string) encoding:NSUTF8StringEncoding];
+}
+
+- (NSUInteger)fileCountAtIndex:(NSUInteger)index {
+    return CIORecordAtIndex(self.snapshot, index)->fileCount;
+}
+
+- (CIOMessageFlagBits)flagsAtIndex:(NSUInteger)index knownFlags:(CIOMessageFlagBits *)knownFlags {
+    const CIOMessageRecord *record = CIORecordAtIndex(self.snapshot, index);
+    if (knownFlags) {
+        *knownFlags = record->knownFlags;
+    }
+    return record->flags;
+}
+
+- (CIOMessageFlags *)messageFlagsAtIndex:(NSUInteger)index {
+    CIOMessageFlagBits known = 0;
+    CIOMessageFlagBits flags = [self flagsAtIndex:index knownFlags:&known];
+    CIOMessageFlags *messageFlags = [CIOMessageFlags new];
+    [CIOMessageFlagNames() enumerateObjectsUsingBlock:^(NSString *name, NSUInteger idx, BOOL *stop) {
+      if (known & (1 << idx)) {
+          [messageFlags setValue:@((flags & (1 << idx)) != 0) forKey:name];
+      }
+    }];
+    return messageFlags;
+}
+
+- (NSDictionary *)messageAtIndex:(NSUInteger)index {
+    NSMutableDictionary *message = [NSMutableDictionary dictionary];
+    message[@"date"] = @([self dateAtIndex:index]);
+    message[@"date_indexed"] = @([self dateIndexedAtIndex:index]);
+    message[@"message_id"] = [self stringForField:CIOMessageMetadataFieldMessageID atIndex:index];
+    message[@"email_message_id"] = [self stringForField:CIOMessageMetadataFieldEmailMessageID atIndex:index];
+    message[@"gmail_thread_id"] = [self stringForField:CIOMessageMetadataFieldGmailThreadID atIndex:index];
+    message[@"subject"] = [self stringForField:CIOMessageMetadataFieldSubject atIndex:index];
+    message[@"folders"] = [[self stringForField:CIOMessageMetadataFieldFolders atIndex:index]
+                              componentsSeparatedByString:@"\n"] ?: @[];
+
+    NSMutableDictionary *addresses = [NSMutableDictionary dictionary];
+    NSDictionary *fields = @{@"from": @(CIOMessageMetadataFieldFrom), @"to": @(CIOMessageMetadataFieldTo),
+                             @"cc": @(CIOMessageMetadataFieldCc)};
+    [fields enumerateKeysAndObjectsUsingBlock:^(NSString *key, NSNumber *field, BOOL *stop) {
+      NSString *emails = [self stringForField:field.integerValue atIndex:index];
+      if (!emails) {
+          return;
+      }
+      NSMutableArray *contacts = [NSMutableArray array];
+      for (NSString *email in [emails componentsSeparatedByString:@"\n"]) {
+          [contacts addObject:@{@"email": email}];
+      }
+      // A message has a single sender
+      addresses[key] = [key isEqualToString:@"from"] ? contacts.firstObject : contacts;
+    }];
+    message[@"addresses"] = addresses;
+
+    NSDictionary *flags = [[self messageFlagsAtIndex:index] asDictionary];
+    if (flags.count > 0) {
+        message[@"flags"] = flags;
+    }
+    return message;
+}
+
+@end
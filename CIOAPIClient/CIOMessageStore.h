@@ -0,0 +1,111 @@
+//
+//  CIOMessageStore.h
+//  CIOAPIClient
+//
+//  Copyright © 2015 Context.io. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+
+NS_ASSUME_NONNULL_BEGIN
+
+/**
+ *  Posted by a `CIOMessageStore` after messages are added or removed. The `userInfo` holds the affected message ids
+ * under `CIOMessageStoreMessageIDsKey`.
+ */
+extern NSString *const CIOMessageStoreDidChangeNotification;
+
+extern NSString *const CIOMessageStoreMessageIDsKey;
+
+/**
+ `CIOMessageStore` is a persistent local store of message metadata, as returned by `-[CIOV2Client getMessages]`,
+ keyed by `message_id` and tagged with the account, sources and folders of each message.
+
+ The store is an append-only log on disk which is replayed in to memory when opened, so writes are cheap and a crash
+ loses at most the last partial record. Messages are kept indexed by folder and date, so listings such as "the latest
+ 50 messages in the Inbox" are answered from memory without touching the network or the disk. Call `compact` now and
+ then to drop superseded records from the log.
+
+ Message bodies, sources and headers are not stored, except for the `References` and `In-Reply-To` headers which are
+ kept under `references` for `CIOMessageThreader`. Use `CIOMessageSync` to keep the store up to date.
+
+ All methods are thread safe.
+ */
+@interface CIOMessageStore : NSObject
+
+/**
+ *  Opens, or creates, the store at `fileURL`.
+ *
+ *  @return a store, or `nil` if the file could not be read or created
+ */
+- (nullable instancetype)initWithFileURL:(NSURL *)fileURL error:(NSError **)error NS_DESIGNATED_INITIALIZER;
+
+- (instancetype)init NS_UNAVAILABLE;
+
+@property (readonly, nonatomic) NSURL *fileURL;
+
+/**
+ *  Number of messages in the store.
+ */
+@property (readonly, nonatomic) NSUInteger count;
+
+/**
+ *  Adds or replaces messages from an API listing.
+ *
+ *  @param messages  message dictionaries as returned by the API
+ *  @param accountID account the messages belong to
+ */
+- (void)addMessages:(NSArray *)messages accountID:(NSString *)accountID;
+
+- (void)removeMessagesWithIDs:(NSArray *)messageIDs;
+
+/**
+ *  The stored metadata for a message, with its account under `account_id`.
+ */
+- (nullable NSDictionary *)messageWithID:(NSString *)messageID;
+
+/**
+ *  The most recent messages in a folder, newest first by `date`. `INBOX` is matched case-insensitively, other folder
+ * names exactly.
+ *
+ *  @param limit  maximum number of messages to return
+ *  @param folder folder or Gmail label name
+ */
+- (NSArray *)latestMessages:(NSUInteger)limit inFolder:(NSString *)folder accountID:(NSString *)accountID;
+
+/**
+ *  The most recent messages of an account across all folders, newest first.
+ */
+- (NSArray *)latestMessages:(NSUInteger)limit accountID:(NSString *)accountID;
+
+/**
+ *  Calls `block` with every stored message, in no particular order.
+ */
+- (void)enumerateMessagesUsingBlock:(void (^)(NSDictionary *message, BOOL *stop))block;
+
+#pragma mark - Sync State
+
+/**
+ *  Latest `date_indexed` seen for the account, which `CIOMessageSync` uses as the `indexed_after` of its next sync.
+ */
+- (nullable NSDate *)highWaterMarkForAccountID:(NSString *)accountID;
+
+- (void)setHighWaterMark:(nullable NSDate *)date forAccountID:(NSString *)accountID;
+
+#pragma mark - Maintenance
+
+/**
+ *  Rewrites the log with only the current state of each message.
+ *
+ *  @return `YES` on success
+ */
+- (BOOL)compact:(NSError **)error;
+
+/**
+ *  Removes every message and high-water mark.
+ */
+- (void)removeAllMessages;
+
+@end
+
+NS_ASSUME_NONNULL_END
@@ -0,0 +1,351 @@
+//
+//  CIOMessageStore.m
+//  CIOAPIClient
+//
+//  Copyright © 2015 Context.io. All rights reserved.
+//
+
+#import "CIOMessageStore.h"
+#import "CIOMessageThreader.h"
+#import "CIOMessageUtilities.h"
+
+NSString *const CIOMessageStoreDidChangeNotification = @"CIOMessageStoreDidChangeNotification";
+NSString *const CIOMessageStoreMessageIDsKey = @"messageIDs";
+
+// Log record types, each the single key of a JSON object on its own line
+static NSString *const kCIOLogPutKey = @"put";
+static NSString *const kCIOLogDeleteKey = @"delete";
+static NSString *const kCIOLogMarkKey = @"mark";
+static NSString *const kCIOLogClearKey = @"clear";
+
+static NSString *const kCIOAccountIDKey = @"account_id";
+
+static NSString *CIOFolderIndexKey(NSString *accountID, NSString *folder) {
+    if (!folder) {
+        return accountID;
+    }
+    return [NSString stringWithFormat:@"%@/%@", accountID, CIONormalizedFolder(folder)];
+}
+
+@interface CIOMessageStore ()
+
+@property (nonatomic) dispatch_queue_t queue;
+@property (nonatomic) NSFileHandle *logHandle;
+
+// Message ID -> stored message
+@property (nonatomic) NSMutableDictionary *messages;
+// Folder index key -> mutable array of messages ordered by `CIOCompareMessages`
+@property (nonatomic) NSMutableDictionary *folderIndexes;
+// Account ID -> NSDate
+@property (nonatomic) NSMutableDictionary *highWaterMarks;
+
+@end
+
+@implementation CIOMessageStore
+
+- (instancetype)initWithFileURL:(NSURL *)fileURL error:(NSError **)error {
+    if ((self = [super init])) {
+        _fileURL = fileURL;
+        _queue = dispatch_queue_create("io.context.messagestore", DISPATCH_QUEUE_SERIAL);
+        _messages = [NSMutableDictionary dictionary];
+        _folderIndexes = [NSMutableDictionary dictionary];
+        _highWaterMarks = [NSMutableDictionary dictionary];
+        if (![self _replayLog:error] || ![self _openLog:error]) {
+            return nil;
+        }
+    }
+    return self;
+}
+
+- (void)dealloc {
+    [_logHandle closeFile];
+}
+
+#pragma mark - Log
+
+- (BOOL)_openLog:(NSError **)error {
+    NSFileManager *fileManager = [NSFileManager defaultManager];
+    if (![fileManager fileExistsAtPath:self.fileURL.path] &&
+        ![[NSData data] writeToURL:self.fileURL options:NSDataWritingAtomic error:error]) {
+        return NO;
+    }
+    self.logHandle = [NSFileHandle fileHandleForWritingToURL:self.fileURL error:error];
+    [self.logHandle seekToEndOfFile];
+    return self.logHandle != nil;
+}
+
+- (BOOL)_replayLog:(NSError **)error {
+    if (![[NSFileManager defaultManager] fileExistsAtPath:self.fileURL.path]) {
+        return YES;
+    }
+    NSData *log = [NSData dataWithContentsOfURL:self.fileURL options:NSDataReadingMappedIfSafe error:error];
+    if (!log) {
+        return NO;
+    }
+    const char *bytes = log.bytes;
+    NSUInteger length = log.length;
+    NSUInteger lineStart = 0;
+    while (lineStart < length) {
+        const char *newline = memchr(bytes + lineStart, '\n', length - lineStart);
+        if (!newline) {
+            break;
+        }
+        NSUInteger lineEnd = (NSUInteger)(newline - bytes);
+        NSData *line = [log subdataWithRange:NSMakeRange(lineStart, lineEnd - lineStart)];
+        NSDictionary *record = [NSJSONSerialization JSONObjectWithData:line options:0 error:nil];
+        if ([record isKindOfClass:[NSDictionary class]]) {
+            [self _applyRecord:record];
+        }
+        lineStart = lineEnd + 1;
+    }
+    if (lineStart < length) {
+        // A record cut short by a crash; drop it so the next append starts on a fresh line
+        NSFileHandle *handle = [NSFileHandle fileHandleForWritingToURL:self.fileURL error:error];
+        [handle truncateFileAtOffset:lineStart];
+        [handle closeFile];
+    }
+    return YES;
+}
+
+- (void)_appendRecord:(NSDictionary *)record {
+    NSMutableData *line = [[NSJSONSerialization dataWithJSONObject:record options:0 error:nil] mutableCopy];
+    [line appendBytes:"\n" length:1];
+    [self.logHandle writeData:line];
+}
+
+- (void)_applyRecord:(NSDictionary *)record {
+    NSDictionary *message = record[kCIOLogPutKey];
+    NSString *deletedID = record[kCIOLogDeleteKey];
+    NSDictionary *mark = record[kCIOLogMarkKey];
+    if ([message isKindOfClass:[NSDictionary class]]) {
+        [self _putMessage:message];
+    } else if ([deletedID isKindOfClass:[NSString class]]) {
+        [self _removeMessageWithID:deletedID];
+    } else if ([mark isKindOfClass:[NSDictionary class]]) {
+        NSNumber *date = mark[@"date"];
+        if ([date isKindOfClass:[NSNumber class]]) {
+            self.highWaterMarks[mark[kCIOAccountIDKey]] = [NSDate dateWithTimeIntervalSince1970:date.doubleValue];
+        } else {
+            [self.highWaterMarks removeObjectForKey:mark[kCIOAccountIDKey]];
+        }
+    } else if (record[kCIOLogClearKey]) {
+        [self.messages removeAllObjects];
+        [self.folderIndexes removeAllObjects];
+        [self.highWaterMarks removeAllObjects];
+    }
+}
+
+#pragma mark - Indexes
+
+- (NSArray *)_indexKeysForMessage:(NSDictionary *)message {
+    NSString *accountID = message[kCIOAccountIDKey];
+    NSMutableArray *keys = [NSMutableArray arrayWithObject:CIOFolderIndexKey(accountID, nil)];
+    NSArray *folders = message[@"folders"];
+    if ([folders isKindOfClass:[NSArray class]]) {
+        for (NSString *folder in folders) {
+            if ([folder isKindOfClass:[NSString class]]) {
+                [keys addObject:CIOFolderIndexKey(accountID, folder)];
+            }
+        }
+    }
+    return keys;
+}
+
+- (void)_putMessage:(NSDictionary *)message {
+    NSString *messageID = message[@"message_id"];
+    if (![messageID isKindOfClass:[NSString class]]) {
+        return;
+    }
+    [self _removeMessageWithID:messageID];
+    self.messages[messageID] = message;
+    for (NSString *key in [self _indexKeysForMessage:message]) {
+        NSMutableArray *index = self.folderIndexes[key];
+        if (!index) {
+            index = [NSMutableArray array];
+            self.folderIndexes[key] = index;
+        }
+        NSUInteger position = [index indexOfObject:message
+                                     inSortedRange:NSMakeRange(0, index.count)
+                                           options:NSBinarySearchingInsertionIndex
+                                   usingComparator:^NSComparisonResult(id a, id b) {
+                                     return CIOCompareMessages(a, b);
+                                   }];
+        [index insertObject:message atIndex:position];
+    }
+}
+
+- (void)_removeMessageWithID:(NSString *)messageID {
+    NSDictionary *existing = self.messages[messageID];
+    if (!existing) {
+        return;
+    }
+    for (NSString *key in [self _indexKeysForMessage:existing]) {
+        NSMutableArray *index = self.folderIndexes[key];
+        NSUInteger position = [index indexOfObject:existing
+                                     inSortedRange:NSMakeRange(0, index.count)
+                                           options:NSBinarySearchingFirstEqual
+                                   usingComparator:^NSComparisonResult(id a, id b) {
+                                     return CIOCompareMessages(a, b);
+                                   }];
+        if (position != NSNotFound) {
+            [index removeObjectAtIndex:position];
+        }
+    }
+    [self.messages removeObjectForKey:messageID];
+}
+
+- (void)_postChangeForMessageIDs:(NSArray *)messageIDs {
+    if (messageIDs.count == 0) {
+        return;
+    }
+    [[NSNotificationCenter defaultCenter] postNotificationName:CIOMessageStoreDidChangeNotification
+                                                        object:self
+                                                      userInfo:@{CIOMessageStoreMessageIDsKey: messageIDs}];
+}
+
+#pragma mark - Messages
+
+- (NSUInteger)count {
+    __block NSUInteger count = 0;
+    dispatch_sync(self.queue, ^{
+      count = self.messages.count;
+    });
+    return count;
+}
+
+- (void)addMessages:(NSArray *)messages accountID:(NSString *)accountID {
+    NSMutableArray *messageIDs = [NSMutableArray array];
+    dispatch_sync(self.queue, ^{
+      for (NSDictionary *message in messages) {
+          if (![message isKindOfClass:[NSDictionary class]] || ![message[@"message_id"] isKindOfClass:[NSString class]]) {
+              continue;
+          }
+          // Only metadata is kept; bodies, sources and headers can be fetched again on demand. The threading
+          // headers are small and needed to thread messages locally.
+          NSMutableDictionary *stored = [message mutableCopy];
+          if (message[@"headers"] && !message[@"references"] && !message[@"in_reply_to"]) {
+              NSArray *references = [CIOMessageThreader referencesForMessage:message];
+              if (references.count > 0) {
+                  stored[@"references"] = references;
+              }
+          }
+          [stored removeObjectsForKeys:@[@"body", @"source", @"headers"]];
+          stored[kCIOAccountIDKey] = accountID;
+          [self _appendRecord:@{kCIOLogPutKey: stored}];
+          [self _putMessage:[stored copy]];
+          [messageIDs addObject:stored[@"message_id"]];
+      }
+    });
+    [self _postChangeForMessageIDs:messageIDs];
+}
+
+- (void)removeMessagesWithIDs:(NSArray *)messageIDs {
+    NSMutableArray *removedIDs = [NSMutableArray array];
+    dispatch_sync(self.queue, ^{
+      for (NSString *messageID in messageIDs) {
+          if (self.messages[messageID]) {
+              [self _appendRecord:@{kCIOLogDeleteKey: messageID}];
+              [self _removeMessageWithID:messageID];
+              [removedIDs addObject:messageID];
+          }
+      }
+    });
+    [self _postChangeForMessageIDs:removedIDs];
+}
+
+- (NSDictionary *)messageWithID:(NSString *)messageID {
+    __block NSDictionary *message = nil;
+    dispatch_sync(self.queue, ^{
+      message = self.messages[messageID];
+    });
+    return message;
+}
+
+- (NSArray *)_latestMessages:(NSUInteger)limit indexKey:(NSString *)key {
+    __block NSArray *messages = nil;
+    dispatch_sync(self.queue, ^{
+      NSArray *index = self.folderIndexes[key];
+      messages = [index subarrayWithRange:NSMakeRange(0, MIN(limit, index.count))];
+    });
+    return messages ?: @[];
+}
+
+- (NSArray *)latestMessages:(NSUInteger)limit inFolder:(NSString *)folder accountID:(NSString *)accountID {
+    return [self _latestMessages:limit indexKey:CIOFolderIndexKey(accountID, folder)];
+}
+
+- (NSArray *)latestMessages:(NSUInteger)limit accountID:(NSString *)accountID {
+    return [self _latestMessages:limit indexKey:CIOFolderIndexKey(accountID, nil)];
+}
+
+- (void)enumerateMessagesUsingBlock:(void (^)(NSDictionary *, BOOL *))block {
+    __block NSArray *messages = nil;
+    dispatch_sync(self.queue, ^{
+      messages = self.messages.allValues;
+    });
+    BOOL stop = NO;
+    for (NSDictionary *message in messages) {
+        block(message, &stop);
+        if (stop) {
+            break;
+        }
+    }
+}
+
+#pragma mark - Sync State
+
+- (NSDate *)highWaterMarkForAccountID:(NSString *)accountID {
+    __block NSDate *date = nil;
+    dispatch_sync(self.queue, ^{
+      date = self.highWaterMarks[accountID];
+    });
+    return date;
+}
+
+- (void)setHighWaterMark:(NSDate *)date forAccountID:(NSString *)accountID {
+    dispatch_sync(self.queue, ^{
+      NSDictionary *mark = @{kCIOAccountIDKey: accountID, @"date": date ? @([date timeIntervalSince1970]) : [NSNull null]};
+      [self _appendRecord:@{kCIOLogMarkKey: mark}];
+      [self _applyRecord:@{kCIOLogMarkKey: mark}];
+    });
+}
+
+#pragma mark - Maintenance
+
+- (BOOL)compact:(NSError **)error {
+    __block BOOL success = NO;
+    __block NSError *compactError = nil;
+    dispatch_sync(self.queue, ^{
+      NSMutableData *log = [NSMutableData data];
+      void (^appendLine)(NSDictionary *) = ^(NSDictionary *record) {
+        [log appendData:[NSJSONSerialization dataWithJSONObject:record options:0 error:nil]];
+        [log appendBytes:"\n" length:1];
+      };
+      for (NSDictionary *message in self.messages.allValues) {
+          appendLine(@{kCIOLogPutKey: message});
+      }
+      [self.highWaterMarks enumerateKeysAndObjectsUsingBlock:^(NSString *accountID, NSDate *date, BOOL *stop) {
+        appendLine(@{kCIOLogMarkKey: @{kCIOAccountIDKey: accountID, @"date": @([date timeIntervalSince1970])}});
+      }];
+      [self.logHandle closeFile];
+      success = [log writeToURL:self.fileURL options:NSDataWritingAtomic error:&compactError];
+      // The atomic write replaced the file, so the handle must be reopened either way
+      success = [self _openLog:success ? &compactError : NULL] && success;
+    });
+    if (!success && error) {
+        *error = compactError;
+    }
+    return success;
+}
+
+- (void)removeAllMessages {
+    __block NSArray *messageIDs = nil;
+    dispatch_sync(self.queue, ^{
+      messageIDs = self.messages.allKeys;
+      [self _appendRecord:@{kCIOLogClearKey: @YES}];
+      [self _applyRecord:@{kCIOLogClearKey: @YES}];
+    });
+    [self _postChangeForMessageIDs:messageIDs];
+}
+
+@end
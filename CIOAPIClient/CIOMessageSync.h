@@ -0,0 +1,75 @@
+//
+//  CIOMessageSync.h
+//  CIOAPIClient
+//
+//  Copyright © 2015 Context.io. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+
+NS_ASSUME_NONNULL_BEGIN
+
+@class CIOV2Client;
+@class CIOMessageStore;
+@class CIOMessagesRequest;
+
+/**
+ `CIOMessageSync` keeps a `CIOMessageStore` up to date with the messages of the client's account.
+
+ The first sync pages through every message. After that, each sync asks only for messages indexed since the store's
+ high-water mark (the latest `date_indexed` seen) using `indexed_after`, so a sync of an unchanged mailbox is a single
+ small request.
+
+ Every page of a sync is requested with the same `indexed_after` and paged through with `offset`. Pages are sorted by
+ `date` rather than `date_indexed`, so the high-water mark only advances, to the latest `date_indexed` of the whole
+ pass, once its last page is stored. A sync which fails part way keeps the pages it stored but leaves the mark alone,
+ so the next one fetches the same messages again.
+ */
+@interface CIOMessageSync : NSObject
+
+- (instancetype)initWithClient:(CIOV2Client *)client store:(CIOMessageStore *)store NS_DESIGNATED_INITIALIZER;
+
+- (instancetype)init NS_UNAVAILABLE;
+
+@property (readonly, nonatomic) CIOV2Client *client;
+
+@property (readonly, nonatomic) CIOMessageStore *store;
+
+/**
+ *  Messages requested per page. Defaults to, and is capped at, the API maximum of `100`.
+ */
+@property (nonatomic) NSInteger pageSize;
+
+/**
+ *  Syncs ask for messages indexed this long before the high-water mark, so messages indexed within the same second as
+ * the last one seen are not missed. Defaults to 1 second.
+ */
+@property (nonatomic) NSTimeInterval overlap;
+
+@property (readonly, nonatomic, getter=isSyncing) BOOL syncing;
+
+/**
+ *  The request for a page of messages. Exposed for customizing what is fetched, e.g. to add `include_flags`, via
+ * `requestConfigurationBlock`.
+ *
+ *  @param offset       offset of the page within the sync
+ *  @param indexedAfter `indexed_after` of every page of the sync, `nil` for a first sync
+ */
+- (CIOMessagesRequest *)requestForPageAtOffset:(NSInteger)offset indexedAfter:(nullable NSDate *)indexedAfter;
+
+/**
+ *  Called with every page request before it is sent.
+ */
+@property (nullable, nonatomic, copy) void (^requestConfigurationBlock)(CIOMessagesRequest *request);
+
+/**
+ *  Fetches messages indexed since the last sync in to the store. Only one sync runs at a time; calls made while a sync
+ * is running are completed when it finishes.
+ *
+ *  @param completion called on the main queue with the number of messages fetched, or an error
+ */
+- (void)syncWithCompletion:(nullable void (^)(NSUInteger fetchedCount, NSError *__nullable error))completion;
+
+@end
+
+NS_ASSUME_NONNULL_END
@@ -0,0 +1,121 @@
+//
+//  CIOMessageSync.m
+//  CIOAPIClient
+//
+//  Copyright © 2015 Context.io. All rights reserved.
+//
+
+#import "CIOMessageSync.h"
+#import "CIOV2Client.h"
+#import "CIOMessageStore.h"
+
+static const NSInteger kCIOMessageSyncMaximumPageSize = 100;
+
+@interface CIOMessageSync ()
+
+@property (readwrite, nonatomic, getter=isSyncing) BOOL syncing;
+@property (nonatomic) NSMutableArray *completions;
+@property (nonatomic) NSUInteger fetchedCount;
+
+@end
+
+@implementation CIOMessageSync
+
+- (instancetype)initWithClient:(CIOV2Client *)client store:(CIOMessageStore *)store {
+    if ((self = [super init])) {
+        _client = client;
+        _store = store;
+        _pageSize = kCIOMessageSyncMaximumPageSize;
+        _overlap = 1;
+        _completions = [NSMutableArray array];
+    }
+    return self;
+}
+
+- (void)setPageSize:(NSInteger)pageSize {
+    _pageSize = MAX(1, MIN(pageSize, kCIOMessageSyncMaximumPageSize));
+}
+
+- (CIOMessagesRequest *)requestForPageAtOffset:(NSInteger)offset indexedAfter:(NSDate *)indexedAfter {
+    CIOMessagesRequest *request = [self.client getMessages];
+    request.indexed_after = indexedAfter;
+    request.sort_order = CIOSortOrderAscending;
+    request.limit = self.pageSize;
+    if (offset > 0) {
+        request.offset = offset;
+    }
+    if (self.requestConfigurationBlock) {
+        self.requestConfigurationBlock(request);
+    }
+    return request;
+}
+
+- (void)syncWithCompletion:(void (^)(NSUInteger, NSError *))completion {
+    if (![NSThread isMainThread]) {
+        dispatch_async(dispatch_get_main_queue(), ^{
+          [self syncWithCompletion:completion];
+        });
+        return;
+    }
+    if (completion) {
+        [self.completions addObject:[completion copy]];
+    }
+    if (self.syncing) {
+        return;
+    }
+    self.syncing = YES;
+    NSString *accountID = self.client.accountID;
+    NSDate *highWaterMark = [self.store highWaterMarkForAccountID:accountID];
+    self.fetchedCount = 0;
+    [self _fetchPageAtOffset:0
+                indexedAfter:[highWaterMark dateByAddingTimeInterval:-self.overlap]
+               highWaterMark:highWaterMark
+                   accountID:accountID];
+}
+
+- (void)_fetchPageAtOffset:(NSInteger)offset
+              indexedAfter:(NSDate *)indexedAfter
+             highWaterMark:(NSDate *)highWaterMark
+                 accountID:(NSString *)accountID {
+    [[self requestForPageAtOffset:offset indexedAfter:indexedAfter] executeWithSuccess:^(NSArray *messages) {
+      [self.store addMessages:messages accountID:accountID];
+      self.fetchedCount += messages.count;
+      // Pages are sorted by date, not date_indexed, so the latest date_indexed may be on any page
+      NSDate *latestIndexed = highWaterMark;
+      for (NSDictionary *message in messages) {
+          NSNumber *dateIndexed = [message isKindOfClass:[NSDictionary class]] ? message[@"date_indexed"] : nil;
+          if ([dateIndexed isKindOfClass:[NSNumber class]]) {
+              NSDate *date = [NSDate dateWithTimeIntervalSince1970:dateIndexed.doubleValue];
+              if (!latestIndexed || [date compare:latestIndexed] == NSOrderedDescending) {
+                  latestIndexed = date;
+              }
+          }
+      }
+      if ((NSInteger)messages.count >= self.pageSize) {
+          [self _fetchPageAtOffset:offset + messages.count
+                      indexedAfter:indexedAfter
+                     highWaterMark:latestIndexed
+                         accountID:accountID];
+          return;
+      }
+      // Every page of the pass is stored, so the next sync can start after it
+      if (latestIndexed && ![latestIndexed isEqualToDate:highWaterMark]) {
+          [self.store setHighWaterMark:latestIndexed forAccountID:accountID];
+      }
+      [self _finishWithError:nil];
+    } failure:^(NSError *error) {
+      [self _finishWithError:error];
+    }];
+}
+
+- (void)_finishWithError:(NSError *)error {
+    NSArray *completions = self.completions;
+    NSUInteger fetchedCount = self.fetchedCount;
+    self.completions = [NSMutableArray array];
+    self.syncing = NO;
+    for (void (^completion)(NSUInteger, NSError *) in completions) {
+        completion(fetchedCount, error);
+    }
+}
+
+@end
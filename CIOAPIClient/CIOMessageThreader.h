@@ -0,0 +1,83 @@
+//
+//  CIOMessageThreader.h
+//  CIOAPIClient
+//
+//  Copyright © 2015 Context.io. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+
+NS_ASSUME_NONNULL_BEGIN
+
+@class CIOV2Client;
+@class CIOMessageStore;
+
+/**
+ `CIOMessageThreader` groups messages in to conversations locally, so conversation views can be built from message
+ listings instead of a `getThreadForMessageWithID:` round trip per message.
+
+ Messages are threaded with Jamie Zawinski's algorithm (https://www.jwz.org/doc/threading.html): each message is linked
+ under the last message id in its `References`, or else `In-Reply-To`, and the ids before it are linked in order,
+ without ever creating a loop. Messages without either header are joined to the thread whose first message has the
+ same subject, when their subject marks them as a reply. Messages sharing a `gmail_thread_id` are always in the same
+ thread.
+
+ Threading headers are read from the `references` and `in_reply_to` fields of a message, or from its `headers` when the
+ listing was made with `include_headers`. `CIOMessageStore` keeps these fields when it drops the rest of the headers.
+
+ Threads are updated incrementally as messages are added and removed; when created with a store the threader follows
+ its changes. All methods are thread safe.
+ */
+@interface CIOMessageThreader : NSObject
+
+/**
+ *  @param client used to fetch threads which are incomplete locally
+ *  @param store  optional store whose messages are threaded, and which threads fetched from the API are added to
+ */
+- (instancetype)initWithClient:(CIOV2Client *)client
+                         store:(nullable CIOMessageStore *)store NS_DESIGNATED_INITIALIZER;
+
+- (instancetype)init NS_UNAVAILABLE;
+
+@property (readonly, nonatomic, weak) CIOV2Client *client;
+
+@property (nullable, readonly, nonatomic) CIOMessageStore *store;
+
+/**
+ *  Threads messages as returned by the API, without a store.
+ */
+- (void)addMessages:(NSArray *)messages accountID:(NSString *)accountID;
+
+- (void)removeMessagesWithIDs:(NSArray *)messageIDs;
+
+/**
+ *  The messages of the thread containing a message, oldest first, or `nil` if the message is unknown.
+ */
+- (nullable NSArray *)messagesInThreadOfMessageWithID:(NSString *)messageID;
+
+/**
+ *  Whether the thread of a message is known completely: every message id it references is a known message, or its
+ * messages were all returned by `getThreadForMessageWithID:`.
+ */
+- (BOOL)isThreadCompleteForMessageWithID:(NSString *)messageID;
+
+/**
+ *  Returns the thread of a message from local data when it is complete, and otherwise fetches it with
+ * `getThreadForMessageWithID:` and threads the result.
+ *
+ *  @param success called on the main queue with the messages of the thread, oldest first
+ *  @param failure called on the main queue if the thread had to be fetched and the request failed
+ */
+- (void)getThreadForMessageWithID:(NSString *)messageID
+                          success:(void (^)(NSArray *messages))success
+                          failure:(nullable void (^)(NSError *error))failure;
+
+/**
+ *  The message ids a message refers to, oldest first: its `References` followed by its `In-Reply-To` if that is not
+ * already the last reference. Ids are returned without angle brackets.
+ */
++ (NSArray *)referencesForMessage:(NSDictionary *)message;
+
+@end
+
+NS_ASSUME_NONNULL_END
@@ -0,0 +1,473 @@
+//
+//  CIOMessageThreader.m
+//  CIOAPIClient
+//
+//  Copyright © 2015 Context.io. All rights reserved.
+//
+
+#import "CIOMessageThreader.h"
+#import "CIOV2Client.h"
+#import "CIOMessageStore.h"
+#import "CIOHeaderTokenizer.h"
+
+// A node of the thread tree for one Message-ID, which is empty when the id is only known from references
+@interface CIOThreadContainer : NSObject
+
+@property (nonatomic, copy) NSString *key;
+@property (nullable, nonatomic) NSDictionary *message;
+@property (nullable, nonatomic, weak) CIOThreadContainer *parent;
+@property (nonatomic) NSMutableArray *children;
+
+- (BOOL)hasAncestor:(CIOThreadContainer *)container;
+
+// Moves the container under `parent`, or makes it a root when `parent` is nil
+- (void)setParentContainer:(nullable CIOThreadContainer *)parent;
+
+- (CIOThreadContainer *)root;
+
+@end
+
+@implementation CIOThreadContainer
+
+- (instancetype)init {
+    if ((self = [super init])) {
+        _children = [NSMutableArray array];
+    }
+    return self;
+}
+
+- (BOOL)hasAncestor:(CIOThreadContainer *)container {
+    for (CIOThreadContainer *ancestor = self.parent; ancestor; ancestor = ancestor.parent) {
+        if (ancestor == container) {
+            return YES;
+        }
+    }
+    return NO;
+}
+
+- (void)setParentContainer:(CIOThreadContainer *)parent {
+    [self.parent.children removeObjectIdenticalTo:self];
+    self.parent = parent;
+    [parent.children addObject:self];
+}
+
+- (CIOThreadContainer *)root {
+    CIOThreadContainer *root = self;
+    while (root.parent) {
+        root = root.parent;
+    }
+    return root;
+}
+
+@end
+
+#pragma mark -
+
+static NSArray *CIOMessageIDs(id value) {
+    if ([value isKindOfClass:[NSString class]]) {
+        return [CIOHeaderTokenizer messageIDsInString:value];
+    }
+    NSMutableArray *messageIDs = [NSMutableArray array];
+    if ([value isKindOfClass:[NSArray class]]) {
+        for (NSString *item in value) {
+            if ([item isKindOfClass:[NSString class]]) {
+                [messageIDs addObjectsFromArray:[CIOHeaderTokenizer messageIDsInString:item]];
+            }
+        }
+    }
+    return messageIDs;
+}
+
+// Keys are scoped by account, as the same message can be synced in to several accounts
+static NSString *CIOScopedKey(NSString *accountID, NSString *key) {
+    return [NSString stringWithFormat:@"%@\n%@", accountID, key];
+}
+
+// The subject without reply prefixes, and whether it had any. Forward prefixes are kept, as a forward starts a new
+// conversation.
+static NSString *CIOBaseSubject(NSString *subject, BOOL *isReply) {
+    static NSRegularExpression *prefix;
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+      prefix = [NSRegularExpression regularExpressionWithPattern:@"^\\s*(re|aw)(\\[\\d+\\])?\\s*:\\s*"
+                                                         options:NSRegularExpressionCaseInsensitive
+                                                           error:nil];
+    });
+    *isReply = NO;
+    NSString *base = subject;
+    NSTextCheckingResult *match;
+    while ((match = [prefix firstMatchInString:base options:0 range:NSMakeRange(0, base.length)])) {
+        *isReply = YES;
+        base = [base substringFromIndex:NSMaxRange(match.range)];
+    }
+    base = [base stringByTrimmingCharactersInSet:[NSCharacterSet whitespaceAndNewlineCharacterSet]];
+    return base.lowercaseString;
+}
+
+static void CIOAddToSetInDictionary(NSMutableDictionary *dictionary, NSString *key, NSString *value) {
+    NSMutableSet *set = dictionary[key];
+    if (!set) {
+        set = [NSMutableSet set];
+        dictionary[key] = set;
+    }
+    [set addObject:value];
+}
+
+static void CIORemoveFromSetInDictionary(NSMutableDictionary *dictionary, NSString *key, NSString *value) {
+    NSMutableSet *set = dictionary[key];
+    [set removeObject:value];
+    if (set.count == 0) {
+        [dictionary removeObjectForKey:key];
+    }
+}
+
+@interface CIOMessageThreader ()
+
+@property (nonatomic) dispatch_queue_t queue;
+// Scoped Message-ID -> CIOThreadContainer
+@property (nonatomic) NSMutableDictionary *containers;
+// message_id -> CIOThreadContainer holding it
+@property (nonatomic) NSMutableDictionary *messageContainers;
+// message_id -> scoped thread key, from `gmail_thread_id` or a thread fetched from the API
+@property (nonatomic) NSMutableDictionary *threadKeys;
+// Scoped thread key -> NSMutableSet of message_id
+@property (nonatomic) NSMutableDictionary *threadMembers;
+// Scoped base subject -> NSMutableSet of message_id, for messages without threading headers
+@property (nonatomic) NSMutableDictionary *subjectOrigins;
+@property (nonatomic) NSMutableDictionary *subjectReplies;
+// message_id of messages returned by `getThreadForMessageWithID:`
+@property (nonatomic) NSMutableSet *confirmedMessageIDs;
+
+@end
+
+@implementation CIOMessageThreader
+
+- (instancetype)initWithClient:(CIOV2Client *)client store:(CIOMessageStore *)store {
+    if ((self = [super init])) {
+        _client = client;
+        _store = store;
+        _queue = dispatch_queue_create("io.context.messagethreader", DISPATCH_QUEUE_SERIAL);
+        _containers = [NSMutableDictionary dictionary];
+        _messageContainers = [NSMutableDictionary dictionary];
+        _threadKeys = [NSMutableDictionary dictionary];
+        _threadMembers = [NSMutableDictionary dictionary];
+        _subjectOrigins = [NSMutableDictionary dictionary];
+        _subjectReplies = [NSMutableDictionary dictionary];
+        _confirmedMessageIDs = [NSMutableSet set];
+        if (store) {
+            [[NSNotificationCenter defaultCenter] addObserver:self
+                                                     selector:@selector(storeDidChange:)
+                                                         name:CIOMessageStoreDidChangeNotification
+                                                       object:store];
+            dispatch_sync(_queue, ^{
+              [store enumerateMessagesUsingBlock:^(NSDictionary *message, BOOL *stop) {
+                [self _addMessage:message];
+              }];
+            });
+        }
+    }
+    return self;
+}
+
+- (void)dealloc {
+    [[NSNotificationCenter defaultCenter] removeObserver:self];
+}
+
+- (void)storeDidChange:(NSNotification *)notification {
+    NSArray *messageIDs = notification.userInfo[CIOMessageStoreMessageIDsKey];
+    NSMutableArray *messages = [NSMutableArray arrayWithCapacity:messageIDs.count];
+    for (NSString *messageID in messageIDs) {
+        [messages addObject:[self.store messageWithID:messageID] ?: [NSNull null]];
+    }
+    dispatch_sync(self.queue, ^{
+      [messageIDs enumerateObjectsUsingBlock:^(NSString *messageID, NSUInteger idx, BOOL *stop) {
+        if (messages[idx] == [NSNull null]) {
+            [self _removeMessageWithID:messageID];
+        } else {
+            [self _addMessage:messages[idx]];
+        }
+      }];
+    });
+}
+
++ (NSArray *)referencesForMessage:(NSDictionary *)message {
+    id references = message[@"references"];
+    id inReplyTo = message[@"in_reply_to"];
+    id headers = message[@"headers"];
+    if (!references && !inReplyTo) {
+        if ([headers isKindOfClass:[NSString class]]) {
+            CIOHeaderTokenizer *tokenizer = [[CIOHeaderTokenizer alloc] initWithString:headers];
+            references = tokenizer.references;
+            inReplyTo = tokenizer.inReplyTo;
+        } else if ([headers isKindOfClass:[NSDictionary class]]) {
+            for (NSString *name in headers) {
+                if ([name caseInsensitiveCompare:@"References"] == NSOrderedSame) {
+                    references = headers[name];
+                } else if ([name caseInsensitiveCompare:@"In-Reply-To"] == NSOrderedSame) {
+                    inReplyTo = headers[name];
+                }
+            }
+        }
+    }
+    NSMutableArray *messageIDs = [CIOMessageIDs(references) mutableCopy];
+    NSString *parentID = CIOMessageIDs(inReplyTo).firstObject;
+    if (parentID && ![messageIDs.lastObject isEqualToString:parentID]) {
+        [messageIDs removeObject:parentID];
+        [messageIDs addObject:parentID];
+    }
+    return messageIDs;
+}
+
+#pragma mark - Threading
+
+- (CIOThreadContainer *)_containerForKey:(NSString *)key {
+    CIOThreadContainer *container = self.containers[key];
+    if (!container) {
+        container = [CIOThreadContainer new];
+        container.key = key;
+        self.containers[key] = container;
+    }
+    return container;
+}
+
+- (void)_addMessage:(NSDictionary *)message {
+    NSString *messageID = message[@"message_id"];
+    if (![messageID isKindOfClass:[NSString class]]) {
+        return;
+    }
+    [self _removeMessageWithID:messageID];
+    NSString *accountID = [message[@"account_id"] isKindOfClass:[NSString class]] ? message[@"account_id"] : @"";
+
+    // Messages without a Message-ID, or whose Message-ID is taken by another message, get a container of their own
+    NSString *emailMessageID = CIOMessageIDs(message[@"email_message_id"]).firstObject;
+    CIOThreadContainer *container = emailMessageID ? self.containers[CIOScopedKey(accountID, emailMessageID)] : nil;
+    if (!emailMessageID || container.message) {
+        container = [self _containerForKey:CIOScopedKey(accountID, [@"cio-" stringByAppendingString:messageID])];
+    } else {
+        container = [self _containerForKey:CIOScopedKey(accountID, emailMessageID)];
+    }
+    container.message = message;
+    self.messageContainers[messageID] = container;
+
+    // Link the references in order, keeping existing links and never creating a loop
+    NSArray *references = [self.class referencesForMessage:message];
+    CIOThreadContainer *previous = nil;
+    for (NSString *reference in references) {
+        CIOThreadContainer *referenced = [self _containerForKey:CIOScopedKey(accountID, reference)];
+        if (previous && referenced != previous && !referenced.parent && ![previous hasAncestor:referenced]) {
+            [referenced setParentContainer:previous];
+        }
+        previous = referenced;
+    }
+    // The message's own references decide its parent
+    if (previous && previous != container && ![previous hasAncestor:container]) {
+        [container setParentContainer:previous];
+    }
+
+    NSString *gmailThreadID = message[@"gmail_thread_id"];
+    if ([gmailThreadID isKindOfClass:[NSString class]] && gmailThreadID.length > 0) {
+        NSString *threadKey = CIOScopedKey(accountID, [@"gm-" stringByAppendingString:gmailThreadID]);
+        self.threadKeys[messageID] = threadKey;
+        CIOAddToSetInDictionary(self.threadMembers, threadKey, messageID);
+    }
+    NSString *subject = message[@"subject"];
+    if (references.count == 0 && [subject isKindOfClass:[NSString class]]) {
+        BOOL isReply = NO;
+        NSString *subjectKey = CIOScopedKey(accountID, CIOBaseSubject(subject, &isReply));
+        CIOAddToSetInDictionary(isReply ? self.subjectReplies : self.subjectOrigins, subjectKey, messageID);
+    }
+}
+
+- (void)_removeMessageWithID:(NSString *)messageID {
+    CIOThreadContainer *container = self.messageContainers[messageID];
+    if (!container) {
+        return;
+    }
+    NSDictionary *message = container.message;
+    NSString *accountID = [message[@"account_id"] isKindOfClass:[NSString class]] ? message[@"account_id"] : @"";
+    [self.messageContainers removeObjectForKey:messageID];
+    container.message = nil;
+
+    NSString *threadKey = self.threadKeys[messageID];
+    if (threadKey) {
+        CIORemoveFromSetInDictionary(self.threadMembers, threadKey, messageID);
+        [self.threadKeys removeObjectForKey:messageID];
+    }
+    NSString *subject = message[@"subject"];
+    if ([subject isKindOfClass:[NSString class]]) {
+        BOOL isReply = NO;
+        NSString *subjectKey = CIOScopedKey(accountID, CIOBaseSubject(subject, &isReply));
+        CIORemoveFromSetInDictionary(self.subjectOrigins, subjectKey, messageID);
+        CIORemoveFromSetInDictionary(self.subjectReplies, subjectKey, messageID);
+    }
+    [self.confirmedMessageIDs removeObject:messageID];
+
+    // Drop containers which no longer hold a message nor lead to one
+    while (container && !container.message && container.children.count == 0) {
+        CIOThreadContainer *parent = container.parent;
+        [container setParentContainer:nil];
+        [self.containers removeObjectForKey:container.key];
+        container = parent;
+    }
+}
+
+// The message ids of the thread of `messageID`, and whether it references any unknown message. Must be called on
+// `queue`.
+- (NSSet *)_threadOfMessageWithID:(NSString *)messageID hasGaps:(BOOL *)hasGaps {
+    *hasGaps = NO;
+    CIOThreadContainer *start = self.messageContainers[messageID];
+    if (!start) {
+        return nil;
+    }
+    NSMutableSet *messageIDs = [NSMutableSet set];
+    NSMutableSet *visitedRoots = [NSMutableSet set];
+    NSMutableArray *pending = [NSMutableArray arrayWithObject:start];
+    while (pending.count > 0) {
+        CIOThreadContainer *root = [pending.lastObject root];
+        [pending removeLastObject];
+        if ([visitedRoots containsObject:root.key]) {
+            continue;
+        }
+        [visitedRoots addObject:root.key];
+
+        NSMutableArray *tree = [NSMutableArray arrayWithObject:root];
+        while (tree.count > 0) {
+            CIOThreadContainer *container = tree.lastObject;
+            [tree removeLastObject];
+            [tree addObjectsFromArray:container.children];
+            NSDictionary *message = container.message;
+            if (!message) {
+                *hasGaps = YES;
+                continue;
+            }
+            NSString *memberID = message[@"message_id"];
+            [messageIDs addObject:memberID];
+            if (!message[@"email_message_id"] && !self.threadKeys[memberID]) {
+                *hasGaps = YES;
+            }
+
+            // Other trees joined to this one by thread id or subject
+            NSMutableSet *related = [NSMutableSet set];
+            NSString *threadKey = self.threadKeys[memberID];
+            if (threadKey) {
+                [related unionSet:self.threadMembers[threadKey]];
+            }
+            NSString *subject = message[@"subject"];
+            if ([subject isKindOfClass:[NSString class]]) {
+                BOOL isReply = NO;
+                NSString *accountID = [message[@"account_id"] isKindOfClass:[NSString class]] ? message[@"account_id"] : @"";
+                NSString *subjectKey = CIOScopedKey(accountID, CIOBaseSubject(subject, &isReply));
+                // A reply without threading headers joins the message which started its subject
+                if ([self.subjectOrigins[subjectKey] containsObject:memberID]) {
+                    [related unionSet:self.subjectReplies[subjectKey]];
+                } else if ([self.subjectReplies[subjectKey] containsObject:memberID]) {
+                    [related unionSet:self.subjectOrigins[subjectKey]];
+                }
+            }
+            for (NSString *relatedID in related) {
+                CIOThreadContainer *relatedContainer = self.messageContainers[relatedID];
+                if (relatedContainer && ![messageIDs containsObject:relatedID]) {
+                    [pending addObject:relatedContainer];
+                }
+            }
+        }
+    }
+    return messageIDs;
+}
+
+- (NSArray *)_sortedMessagesWithIDs:(NSSet *)messageIDs {
+    NSMutableArray *messages = [NSMutableArray arrayWithCapacity:messageIDs.count];
+    for (NSString *messageID in messageIDs) {
+        [messages addObject:[self.messageContainers[messageID] message]];
+    }
+    return [messages sortedArrayUsingComparator:^NSComparisonResult(NSDictionary *a, NSDictionary *b) {
+      double dateA = [a[@"date"] doubleValue];
+      double dateB = [b[@"date"] doubleValue];
+      if (dateA != dateB) {
+          return dateA < dateB ? NSOrderedAscending : NSOrderedDescending;
+      }
+      return [a[@"message_id"] compare:b[@"message_id"]];
+    }];
+}
+
+#pragma mark - Public
+
+- (void)addMessages:(NSArray *)messages accountID:(NSString *)accountID {
+    dispatch_sync(self.queue, ^{
+      for (NSDictionary *message in messages) {
+          if ([message isKindOfClass:[NSDictionary class]]) {
+              NSMutableDictionary *scoped = [message mutableCopy];
+              scoped[@"account_id"] = accountID;
+              [self _addMessage:scoped];
+          }
+      }
+    });
+}
+
+- (void)removeMessagesWithIDs:(NSArray *)messageIDs {
+    dispatch_sync(self.queue, ^{
+      for (NSString *messageID in messageIDs) {
+          [self _removeMessageWithID:messageID];
+      }
+    });
+}
+
+- (NSArray *)messagesInThreadOfMessageWithID:(NSString *)messageID {
+    __block NSArray *messages = nil;
+    dispatch_sync(self.queue, ^{
+      BOOL hasGaps = NO;
+      NSSet *messageIDs = [self _threadOfMessageWithID:messageID hasGaps:&hasGaps];
+      messages = messageIDs ? [self _sortedMessagesWithIDs:messageIDs] : nil;
+    });
+    return messages;
+}
+
+- (BOOL)isThreadCompleteForMessageWithID:(NSString *)messageID {
+    __block BOOL complete = NO;
+    dispatch_sync(self.queue, ^{
+      BOOL hasGaps = NO;
+      NSSet *messageIDs = [self _threadOfMessageWithID:messageID hasGaps:&hasGaps];
+      complete = messageIDs && (!hasGaps || [messageIDs isSubsetOfSet:self.confirmedMessageIDs]);
+    });
+    return complete;
+}
+
+- (void)getThreadForMessageWithID:(NSString *)messageID
+                          success:(void (^)(NSArray *))success
+                          failure:(void (^)(NSError *))failure {
+    if ([self isThreadCompleteForMessageWithID:messageID]) {
+        NSArray *messages = [self messagesInThreadOfMessageWithID:messageID];
+        dispatch_async(dispatch_get_main_queue(), ^{
+          success(messages);
+        });
+        return;
+    }
+    CIOV2Client *client = self.client;
+    NSString *accountID = client.accountID ?: @"";
+    [[client getThreadForMessageWithID:messageID] executeWithSuccess:^(NSDictionary *response) {
+      NSArray *messages = [response[@"messages"] isKindOfClass:[NSArray class]] ? response[@"messages"] : @[];
+      if (self.store) {
+          [self.store addMessages:messages accountID:accountID];
+      } else {
+          [self addMessages:messages accountID:accountID];
+      }
+      dispatch_sync(self.queue, ^{
+        // The API vouches for these messages being one thread, whatever their headers say
+        NSString *threadKey = CIOScopedKey(accountID, [@"cio-thread-" stringByAppendingString:messageID]);
+        for (NSDictionary *message in messages) {
+            NSString *memberID = [message isKindOfClass:[NSDictionary class]] ? message[@"message_id"] : nil;
+            if (![memberID isKindOfClass:[NSString class]] || !self.messageContainers[memberID]) {
+                continue;
+            }
+            [self.confirmedMessageIDs addObject:memberID];
+            if (!self.threadKeys[memberID]) {
+                self.threadKeys[memberID] = threadKey;
+                CIOAddToSetInDictionary(self.threadMembers, threadKey, memberID);
+            }
+        }
+      });
+      success([self messagesInThreadOfMessageWithID:messageID] ?: messages);
+    } failure:failure];
+}
+
+@end
@@ -0,0 +1,37 @@
+//
+//  CIOMessageUtilities.h
+//  CIOAPIClient
+//
+//  Copyright © 2015 Context.io. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+
+NS_ASSUME_NONNULL_BEGIN
+
+// Internal to the library: normalizations of message values shared by the local stores and indexes
+
+/**
+ *  Orders messages newest first by `date`, breaking ties by `message_id` so every message has exactly one position.
+ */
+NSComparisonResult CIOCompareMessages(NSDictionary *a, NSDictionary *b);
+
+/**
+ *  `folder`, with any spelling of `INBOX` replaced by `INBOX`. Other folder names are case sensitive on IMAP servers
+ * (RFC 3501 5.1).
+ */
+NSString *CIONormalizedFolder(NSString *folder);
+
+/**
+ *  Keys of the flags in `getFlagsForMessageWithID:` responses, which are also the names of the IMAP system flags, in
+ * bit order of `CIOMessageFlagBits`.
+ */
+NSArray *CIOMessageFlagNames(void);
+
+/**
+ *  Flags as `getFlagsForMessageWithID:` returns them, e.g. `{"seen": true, "answered": false, ...}`, from either that
+ * shape or the array of IMAP system flags such as `\Seen` which `include_flags` lists. Other values are returned as is.
+ */
+id CIONormalizedFlags(id flags);
+
+NS_ASSUME_NONNULL_END
@@ -0,0 +1,45 @@
+//
+//  CIOMessageUtilities.m
+//  CIOAPIClient
+//
+//  Copyright © 2015 Context.io. All rights reserved.
+//
+
+#import "CIOMessageUtilities.h"
+
+NSComparisonResult CIOCompareMessages(NSDictionary *a, NSDictionary *b) {
+    double dateA = [a[@"date"] doubleValue];
+    double dateB = [b[@"date"] doubleValue];
+    if (dateA != dateB) {
+        return dateA > dateB ? NSOrderedAscending : NSOrderedDescending;
+    }
+    return [a[@"message_id"] compare:b[@"message_id"]];
+}
+
+NSString *CIONormalizedFolder(NSString *folder) {
+    if ([folder caseInsensitiveCompare:@"INBOX"] == NSOrderedSame) {
+        return @"INBOX";
+    }
+    return folder;
+}
+
+NSArray *CIOMessageFlagNames(void) {
+    return @[@"seen", @"answered", @"flagged", @"deleted", @"draft"];
+}
+
+id CIONormalizedFlags(id flags) {
+    if (![flags isKindOfClass:[NSArray class]]) {
+        return flags;
+    }
+    // Any flag missing from the list is unset
+    NSMutableDictionary *normalized = [NSMutableDictionary dictionary];
+    for (NSString *name in CIOMessageFlagNames()) {
+        BOOL set = NO;
+        for (NSString *flag in flags) {
+            set = set || ([flag isKindOfClass:[NSString class]] &&
+                          [flag caseInsensitiveCompare:[@"\\" stringByAppendingString:name]] == NSOrderedSame);
+        }
+        normalized[name] = @(set);
+    }
+    return normalized;
+}
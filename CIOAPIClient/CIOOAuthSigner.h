@@ -0,0 +1,46 @@
+//
+//  CIOOAuthSigner.h
+//  CIOAPIClient
+//
+//  Copyright © 2015 Context.io. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+
+NS_ASSUME_NONNULL_BEGIN
+
+@class CIOCredentials;
+
+/**
+ `CIOOAuthSigner` builds HMAC-SHA1 signed requests from a path and parameters which are already percent-encoded. They
+ are the requests `+[TDOAuth URLRequestForPath:parameters:host:...]` builds with `TDOAuthContentTypeUrlEncodedForm`,
+ stamped with the same clock offset, so callers can encode the constant parts of requests they send often only once.
+
+ Internal to the library, see `CIORequestTemplate`.
+ */
+@interface CIOOAuthSigner : NSObject
+
+/**
+ *  Percent-encodes the description of a parameter name or value the way TDOAuth sends and signs it.
+ */
++ (NSString *)percentEncode:(id)value;
+
+/**
+ *  @param encodedPath       path without the query, percent-encoded with `stringByAddingPercentEscapesUsingEncoding:`
+ *  @param encodedParameters parameter names and values, each encoded with `percentEncode:`
+ *  @param credentials       snapshot of the token and secret to sign with, whether or not it is authorized, or `nil`
+ * to sign with the consumer key only
+ */
++ (NSMutableURLRequest *)requestWithMethod:(NSString *)method
+                                    scheme:(NSString *)scheme
+                                      host:(NSString *)host
+                               encodedPath:(NSString *)encodedPath
+                         encodedParameters:(NSDictionary *)encodedParameters
+                               consumerKey:(NSString *)consumerKey
+                            consumerSecret:(NSString *)consumerSecret
+                               credentials:(nullable CIOCredentials *)credentials
+                              headerValues:(nullable NSDictionary *)headerValues;
+
+@end
+
+NS_ASSUME_NONNULL_END
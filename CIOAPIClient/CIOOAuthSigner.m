@@ -0,0 +1,120 @@
+//
+//  CIOOAuthSigner.m
+//  CIOAPIClient
+//
+//  Copyright © 2015 Context.io. All rights reserved.
+//
+
+#import "CIOOAuthSigner.h"
+#import <CommonCrypto/CommonHMAC.h>
+#import "CIOCredentials.h"
+#import "OMGUserAgent.h"
+#import "TDOAuth.h"
+
+// As TDOAuth's, which `CIOAPIClient` overrides per request anyway
+static const NSTimeInterval kCIOOAuthRequestTimeout = 30;
+
+// The characters TDOAuth escapes in parameters on top of those never allowed in URLs
+static NSString *CIOPercentEncode(NSString *string) {
+    return (__bridge_transfer NSString *)CFURLCreateStringByAddingPercentEscapes(
+        NULL, (__bridge CFStringRef)string, NULL, CFSTR("!*'();:@&=+$,/?%#[]"), kCFStringEncodingUTF8);
+}
+
+// TDOAuth's nonce and timestamp, including the fixed values its tests are built with
+static NSString *CIOOAuthNonce() {
+#ifdef TDOAUTH_USE_STATIC_VALUES_FOR_AUTOMATIC_TESTING
+    return @"static-nonce-for-testing";
+#else
+    return [[NSUUID UUID] UUIDString];
+#endif
+}
+
+static NSString *CIOOAuthTimestamp() {
+#ifdef TDOAUTH_USE_STATIC_VALUES_FOR_AUTOMATIC_TESTING
+    time_t t = 1456789012;
+#else
+    time_t t = time(NULL);
+#endif
+    return [NSString stringWithFormat:@"%ld", (long)(t + [TDOAuth utcTimeOffset])];
+}
+
+static NSString *CIOJoinedParameters(NSDictionary *parameters, NSArray *names) {
+    NSMutableArray *pairs = [NSMutableArray arrayWithCapacity:names.count];
+    for (NSString *name in names) {
+        [pairs addObject:[NSString stringWithFormat:@"%@=%@", name, parameters[name]]];
+    }
+    return [pairs componentsJoinedByString:@"&"];
+}
+
+@implementation CIOOAuthSigner
+
++ (NSString *)percentEncode:(id)value {
+    return CIOPercentEncode([value description]);
+}
+
++ (NSMutableURLRequest *)requestWithMethod:(NSString *)method
+                                    scheme:(NSString *)scheme
+                                      host:(NSString *)host
+                               encodedPath:(NSString *)encodedPath
+                         encodedParameters:(NSDictionary *)encodedParameters
+                               consumerKey:(NSString *)consumerKey
+                            consumerSecret:(NSString *)consumerSecret
+                               credentials:(CIOCredentials *)credentials
+                              headerValues:(NSDictionary *)headerValues {
+    NSMutableDictionary *oauthParameters = [@{
+        @"oauth_consumer_key": consumerKey,
+        @"oauth_nonce": CIOOAuthNonce(),
+        @"oauth_timestamp": CIOOAuthTimestamp(),
+        @"oauth_version": @"1.0",
+        @"oauth_signature_method": @"HMAC-SHA1"
+    } mutableCopy];
+    if (credentials.token) {
+        oauthParameters[@"oauth_token"] = credentials.token;
+    }
+
+    NSMutableDictionary *signedParameters = [encodedParameters mutableCopy];
+    [signedParameters addEntriesFromDictionary:oauthParameters];
+    NSString *base = [NSString
+        stringWithFormat:@"%@&%@%%3A%%2F%%2F%@&%@", method, scheme.lowercaseString,
+                         CIOPercentEncode([host.lowercaseString stringByAppendingString:encodedPath]),
+                         CIOPercentEncode(CIOJoinedParameters(
+                             signedParameters, [signedParameters.allKeys sortedArrayUsingSelector:@selector(compare:)]))];
+    NSData *baseData = [base dataUsingEncoding:NSUTF8StringEncoding];
+    NSData *secret = [[NSString stringWithFormat:@"%@&%@", consumerSecret, credentials.tokenSecret ?: @""]
+        dataUsingEncoding:NSUTF8StringEncoding];
+    NSMutableData *digest = [NSMutableData dataWithLength:CC_SHA1_DIGEST_LENGTH];
+    CCHmac(kCCHmacAlgSHA1, secret.bytes, secret.length, baseData.bytes, baseData.length, digest.mutableBytes);
+
+    NSMutableString *authorization = [NSMutableString stringWithString:@"OAuth "];
+    for (NSString *name in oauthParameters) {
+        [authorization appendFormat:@"%@=\"%@\", ", name, oauthParameters[name]];
+    }
+    [authorization appendFormat:@"oauth_signature=\"%@\"", CIOPercentEncode([digest base64EncodedStringWithOptions:0])];
+
+    // Like TDOAuth, GET requests always end their path with `?`, even without parameters
+    NSString *query = CIOJoinedParameters(encodedParameters, encodedParameters.allKeys);
+    BOOL isGET = [method isEqualToString:@"GET"];
+    NSString *URLString = [NSString stringWithFormat:@"%@://%@%@%@", scheme, host, encodedPath,
+                                                     isGET ? [@"?" stringByAppendingString:query] : @""];
+    NSMutableURLRequest *request = [NSMutableURLRequest requestWithURL:[NSURL URLWithString:URLString]
+                                                           cachePolicy:NSURLRequestReloadIgnoringLocalCacheData
+                                                       timeoutInterval:kCIOOAuthRequestTimeout];
+    [request setValue:OMGUserAgent() forHTTPHeaderField:@"User-Agent"];
+    [request setValue:authorization forHTTPHeaderField:@"Authorization"];
+    [request setValue:@"gzip" forHTTPHeaderField:@"Accept-Encoding"];
+    for (NSString *name in headerValues) {
+        if ([headerValues[name] isKindOfClass:[NSString class]]) {
+            [request setValue:headerValues[name] forHTTPHeaderField:name];
+        }
+    }
+    request.HTTPMethod = method;
+    if (!isGET && query.length > 0) {
+        request.HTTPBody = [query dataUsingEncoding:NSUTF8StringEncoding];
+        [request setValue:@"application/x-www-form-urlencoded" forHTTPHeaderField:@"Content-Type"];
+        [request setValue:[NSString stringWithFormat:@"%lu", (unsigned long)request.HTTPBody.length]
+            forHTTPHeaderField:@"Content-Length"];
+    }
+    return request;
+}
+
+@end
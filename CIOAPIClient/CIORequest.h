@@ -61,6 +61,16 @@ NS_ASSUME_NONNULL_BEGIN
  */
 @property (nonatomic) id requestBody;
 
+/**
+ Stable identifier of the file contents this request downloads, set by file and attachment download calls. When the client has an `attachmentStore`, downloads with a `contentKey` are served from and saved to it.
+ */
+@property (nullable, nonatomic, copy) NSString *contentKey;
+
+/**
+ Key paths of the response values to keep, such as `message_id`, `subject` or `addresses.from`, see `CIOJSONProjection`. When set, the rest of a JSON response is skipped while it is decoded, rather than decoded and kept in memory. A `success` key at the top of a response is always kept so that failed calls are still detected. Projected responses are not posted through `CIOAPIClientDidReceiveResponseNotification`, nor cached.
+ */
+@property (nullable, nonatomic, copy) NSSet *projection;
+
 
 /**
  *  Creates a new `CIORequest` representing a single API call against the Context.IO API.
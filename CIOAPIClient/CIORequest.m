@@ -19,11 +19,116 @@
 @property (nonatomic) NSString *path;
 @property (nonatomic) NSString *method;
 
+// Names of the properties whose setter was called. Only those, and properties whose setter can't be tracked, are
+// included in `parameters`.
+@property (nullable, nonatomic) NSMutableSet *assignedPropertyNames;
+
+- (void)_didSetPropertyNamed:(NSString *)name;
 
 @end
 
+// Set of the names of properties declared by a request class whose setters are not tracked, associated with the class
+static const char kCIOUntrackedPropertyNamesKey;
+
+#define CIO_TRACKING_SETTER(type)                                                                                      \
+    imp_implementationWithBlock(^(CIORequest *request, type value) {                                                   \
+      [request _didSetPropertyNamed:name];                                                                             \
+      ((void (*)(id, SEL, type))original)(request, setter, value);                                                     \
+    })
+
+// Replaces the setter of `property` with one recording that it was called. Returns NO if the property is readonly or of
+// a type no setter is made for.
+static BOOL CIOTrackSetter(Class cls, objc_property_t property, NSString *name) {
+    char *readonly = property_copyAttributeValue(property, "R");
+    if (readonly) {
+        free(readonly);
+        return NO;
+    }
+    SEL setter;
+    char *customSetter = property_copyAttributeValue(property, "S");
+    if (customSetter) {
+        setter = sel_registerName(customSetter);
+        free(customSetter);
+    } else {
+        setter = NSSelectorFromString([NSString stringWithFormat:@"set%@%@:", [[name substringToIndex:1] uppercaseString],
+                                                                 [name substringFromIndex:1]]);
+    }
+    Method method = class_getInstanceMethod(cls, setter);
+    char *type = property_copyAttributeValue(property, "T");
+    if (!method || !type) {
+        free(type);
+        return NO;
+    }
+    IMP original = method_getImplementation(method);
+    IMP tracking = NULL;
+    switch (type[0]) {
+        case '@':
+            tracking = CIO_TRACKING_SETTER(id);
+            break;
+        case 'c':
+            tracking = CIO_TRACKING_SETTER(char);
+            break;
+        case 'B':
+            tracking = CIO_TRACKING_SETTER(bool);
+            break;
+        case 'i':
+            tracking = CIO_TRACKING_SETTER(int);
+            break;
+        case 'I':
+            tracking = CIO_TRACKING_SETTER(unsigned int);
+            break;
+        case 'l':
+            tracking = CIO_TRACKING_SETTER(long);
+            break;
+        case 'L':
+            tracking = CIO_TRACKING_SETTER(unsigned long);
+            break;
+        case 'q':
+            tracking = CIO_TRACKING_SETTER(long long);
+            break;
+        case 'Q':
+            tracking = CIO_TRACKING_SETTER(unsigned long long);
+            break;
+        case 'd':
+            tracking = CIO_TRACKING_SETTER(double);
+            break;
+    }
+    free(type);
+    if (!tracking) {
+        return NO;
+    }
+    class_replaceMethod(cls, setter, tracking, method_getTypeEncoding(method));
+    return YES;
+}
+
+#undef CIO_TRACKING_SETTER
+
 @implementation CIORequest
 
++ (void)initialize {
+    if (self == [CIORequest class]) {
+        return;
+    }
+    // Also reached for subclasses without their own +initialize, once each
+    @synchronized([CIORequest class]) {
+        if (objc_getAssociatedObject(self, &kCIOUntrackedPropertyNamesKey)) {
+            return;
+        }
+        NSMutableSet *untrackedPropertyNames = [NSMutableSet set];
+        unsigned int count = 0;
+        objc_property_t *properties = class_copyPropertyList(self, &count);
+        for (unsigned int i = 0; i < count; i++) {
+            NSString *name = [NSString stringWithCString:property_getName(properties[i]) encoding:NSUTF8StringEncoding];
+            if (!CIOTrackSetter(self, properties[i], name)) {
+                [untrackedPropertyNames addObject:name];
+            }
+        }
+        free(properties);
+        objc_setAssociatedObject(self, &kCIOUntrackedPropertyNamesKey, untrackedPropertyNames,
+                                 OBJC_ASSOCIATION_RETAIN);
+    }
+}
+
 + (instancetype)requestWithPath:(NSString *)path method:(NSString *)method parameters:(nullable NSDictionary *)params client:(nullable CIOAPIClient *)client {
     CIORequest *request = [[self alloc] init];
     request.internalParameters = [params mutableCopy] ?: [NSMutableDictionary dictionary];
@@ -80,8 +185,38 @@
 
 #pragma mark - KVC Parameter Generation
 
+- (void)_didSetPropertyNamed:(NSString *)name {
+    if (!self.assignedPropertyNames) {
+        self.assignedPropertyNames = [NSMutableSet set];
+    }
+    [self.assignedPropertyNames addObject:name];
+}
+
+- (BOOL)_sendsPropertyNamed:(NSString *)name {
+    if ([self.assignedPropertyNames containsObject:name]) {
+        return YES;
+    }
+    for (Class currentClass = self.class; currentClass != nil && currentClass != [CIORequest class];
+         currentClass = [currentClass superclass]) {
+        NSSet *untrackedPropertyNames = objc_getAssociatedObject(currentClass, &kCIOUntrackedPropertyNamesKey);
+        // A subclass overriding +initialize without calling super never had its setters tracked, so nothing it was
+        // assigned would be known. Everything is sent, as it used to be.
+        if (!untrackedPropertyNames || [untrackedPropertyNames containsObject:name]) {
+            return YES;
+        }
+    }
+    return NO;
+}
+
 - (NSDictionary *)parameters {
-    NSMutableDictionary *parameters = [[self dictionaryWithValuesForKeys:[self.class propertyNames]] mutableCopy];
+    // Properties left at their default are not sent, so they don't lengthen the URL or the signature base string
+    NSMutableArray *keys = [NSMutableArray array];
+    for (NSString *name in [self.class propertyNames]) {
+        if ([self _sendsPropertyNamed:name]) {
+            [keys addObject:name];
+        }
+    }
+    NSMutableDictionary *parameters = [[self dictionaryWithValuesForKeys:keys] mutableCopy];
     [parameters addEntriesFromDictionary:self.internalParameters];
     for (NSString *key in [parameters copy]) {
         if (parameters[key] == [NSNull null]) {
@@ -0,0 +1,72 @@
+//
+//  CIORequestTemplate.h
+//  CIOAPIClient
+//
+//  Copyright © 2015 Context.io. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+
+NS_ASSUME_NONNULL_BEGIN
+
+@class CIOAPIClient;
+
+/**
+ `CIORequestTemplate` signs requests of one shape sent over and over, such as the flags of a message, where only a few
+ path segments or parameters change from one request to the next.
+
+ The path pattern names its variable segments in braces, e.g. `users/<id>/email_accounts/{label}/folders/{folder}`.
+ The constant segments and parameters are percent-encoded once when the template is made, so each request only
+ encodes its slot values and extra parameters before it is signed. Requests are the same as those of the matching
+ `CIORequest`, with parameter values sent as their `description`: use strings and numbers.
+
+ Make a template once and keep it; it is immutable and may be used from any thread. Responses to templated requests are
+ not posted with `CIOAPIClientDidReceiveResponseNotification`.
+ */
+@interface CIORequestTemplate : NSObject
+
+/**
+ *  @param pathPattern  API path with `{name}` slots, e.g. `accounts/<id>/messages/{message_id}/flags`
+ *  @param parameters   parameters sent with every request
+ *  @param requestClass the `CIORequest` subclass whose `validateResponseObject:` checks responses, such as
+ * `CIODictionaryRequest`
+ */
+- (instancetype)initWithClient:(CIOAPIClient *)client
+                        method:(NSString *)method
+                   pathPattern:(NSString *)pathPattern
+                    parameters:(nullable NSDictionary *)parameters
+                  requestClass:(Class)requestClass NS_DESIGNATED_INITIALIZER;
+
+- (instancetype)init NS_UNAVAILABLE;
+
+@property (readonly, nonatomic) CIOAPIClient *client;
+
+@property (readonly, nonatomic) NSString *method;
+
+@property (readonly, nonatomic) NSString *pathPattern;
+
+/**
+ *  Names of the slots of `pathPattern`, in order.
+ */
+@property (readonly, nonatomic) NSArray *slotNames;
+
+/**
+ *  A request signed with the client's current credentials.
+ *
+ *  @param values     the value of every slot, keyed by slot name
+ *  @param parameters parameters added to, or replacing, the template's for this request
+ */
+- (NSURLRequest *)URLRequestWithValues:(NSDictionary *)values parameters:(nullable NSDictionary *)parameters;
+
+/**
+ *  Executes `URLRequestWithValues:parameters:` in the client's session, calling back on the main queue like
+ * `-[CIORequest executeWithSuccess:failure:]`.
+ */
+- (void)executeWithValues:(NSDictionary *)values
+               parameters:(nullable NSDictionary *)parameters
+                  success:(nullable void (^)(id responseObject))success
+                  failure:(nullable void (^)(NSError *error))failure;
+
+@end
+
+NS_ASSUME_NONNULL_END
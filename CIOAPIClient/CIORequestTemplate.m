@@ -0,0 +1,111 @@
+//
+//  CIORequestTemplate.m
+//  CIOAPIClient
+//
+//  Copyright © 2015 Context.io. All rights reserved.
+//
+
+#import "CIORequestTemplate.h"
+#import "CIOAPIClientHeader.h"
+#import "CIOOAuthSigner.h"
+
+// Path segments are encoded as TDOAuth encodes a whole path, leaving `/` alone
+static NSString *CIOEncodedPathString(NSString *string) {
+    return [string stringByAddingPercentEscapesUsingEncoding:NSUTF8StringEncoding];
+}
+
+@interface CIORequestTemplate ()
+
+// Encoded constant parts of the path, one more than there are slots: slot i goes between parts i and i + 1
+@property (nonatomic) NSArray *encodedPathParts;
+@property (nonatomic) NSDictionary *encodedParameters;
+// Instance of the request class, only used to validate responses
+@property (nonatomic) CIORequest *validator;
+
+@end
+
+@implementation CIORequestTemplate
+
+- (instancetype)initWithClient:(CIOAPIClient *)client
+                        method:(NSString *)method
+                   pathPattern:(NSString *)pathPattern
+                    parameters:(NSDictionary *)parameters
+                  requestClass:(Class)requestClass {
+    NSParameterAssert([requestClass isSubclassOfClass:[CIORequest class]]);
+    if ((self = [super init])) {
+        _client = client;
+        _method = [method copy];
+        // Normalized like the paths of other requests, which are appended as a path component
+        _pathPattern = [[@"/" stringByAppendingPathComponent:pathPattern] substringFromIndex:1];
+        _validator = [requestClass new];
+
+        NSMutableArray *parts = [NSMutableArray array];
+        NSMutableArray *slotNames = [NSMutableArray array];
+        NSScanner *scanner = [NSScanner scannerWithString:_pathPattern];
+        scanner.charactersToBeSkipped = nil;
+        while (YES) {
+            NSString *part = @"";
+            [scanner scanUpToString:@"{" intoString:&part];
+            [parts addObject:CIOEncodedPathString(part)];
+            NSString *slotName = nil;
+            if (![scanner scanString:@"{" intoString:NULL] || ![scanner scanUpToString:@"}" intoString:&slotName] ||
+                ![scanner scanString:@"}" intoString:NULL]) {
+                break;
+            }
+            [slotNames addObject:slotName];
+        }
+        _encodedPathParts = parts;
+        _slotNames = slotNames;
+
+        NSMutableDictionary *encodedParameters = [NSMutableDictionary dictionaryWithCapacity:parameters.count];
+        for (NSString *name in parameters) {
+            encodedParameters[[CIOOAuthSigner percentEncode:name]] = [CIOOAuthSigner percentEncode:parameters[name]];
+        }
+        _encodedParameters = encodedParameters;
+    }
+    return self;
+}
+
+- (NSURLRequest *)URLRequestWithValues:(NSDictionary *)values parameters:(NSDictionary *)parameters {
+    NSMutableString *path = [NSMutableString stringWithString:self.encodedPathParts[0]];
+    for (NSUInteger i = 0; i < self.slotNames.count; i++) {
+        id value = values[self.slotNames[i]];
+        NSParameterAssert(value);
+        [path appendString:CIOEncodedPathString([value description])];
+        [path appendString:self.encodedPathParts[i + 1]];
+    }
+    NSDictionary *encodedParameters = self.encodedParameters;
+    if (parameters.count > 0) {
+        NSMutableDictionary *merged = [encodedParameters mutableCopy];
+        for (NSString *name in parameters) {
+            merged[[CIOOAuthSigner percentEncode:name]] = [CIOOAuthSigner percentEncode:parameters[name]];
+        }
+        encodedParameters = merged;
+    }
+    return [self.client requestForEncodedPath:path method:self.method encodedParameters:encodedParameters];
+}
+
+- (void)executeWithValues:(NSDictionary *)values
+               parameters:(NSDictionary *)parameters
+                  success:(void (^)(id))success
+                  failure:(void (^)(NSError *))failure {
+    CIORequest *validator = self.validator;
+    [self.client.session executeRequest:[self URLRequestWithValues:values parameters:parameters]
+        success:^(id responseObject) {
+          NSError *error = [validator validateResponseObject:responseObject];
+          if (error) {
+              if (failure) {
+                  failure(error);
+              }
+          } else if (success) {
+              success(responseObject);
+          }
+        }
+        failure:^(NSError *error) {
+          if (failure) {
+              failure(error);
+          }
+        }];
+}
+
+@end
@@ -102,6 +102,10 @@
 @end
 
 
+/**
+ Request to change the settings of an existing source. Only the properties which were set are sent, so settings left
+ alone keep their current value on the server. To turn off a setting such as `sync_all_folders`, set it to `NO`.
+ */
 @interface CIOMailboxModifyRequest : CIODictionaryRequest
 
 /**
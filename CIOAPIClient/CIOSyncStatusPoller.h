@@ -0,0 +1,133 @@
+//
+//  CIOSyncStatusPoller.h
+//  CIOAPIClient
+//
+//  Copyright © 2015 Context.io. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+
+NS_ASSUME_NONNULL_BEGIN
+
+@class CIOV2Client;
+
+/**
+ *  Posted on the main queue when a poll finds the sync status of an account changed. The `userInfo` holds the
+ * account id under `CIOSyncStatusPollerAccountIDKey` and the changes, as returned by
+ * `+changesFromStatus:toStatus:`, under `CIOSyncStatusPollerChangesKey`.
+ */
+extern NSString *const CIOSyncStatusPollerDidChangeNotification;
+extern NSString *const CIOSyncStatusPollerAccountIDKey;
+extern NSString *const CIOSyncStatusPollerChangesKey;
+
+/**
+ `CIOSyncStatusPoller` polls the sync status of many accounts, each at its own pace.
+
+ An account is polled every `minimumInterval` while its status keeps changing or one of its sources is syncing. Each
+ poll that finds nothing new stretches its interval by `backoffMultiplier`, up to `maximumInterval`, so idle accounts
+ cost few requests. Every delay is randomized by `jitter`, and the first polls are spread over `minimumInterval`, so
+ accounts added together are not polled together.
+
+ Only changes are reported, through `CIOSyncStatusPollerDidChangeNotification`. When `forceSyncAfter` is set, sources
+ which have not finished a sync for that long get a `forceSyncForSourceWithLabel:`.
+
+ The poller runs on the main queue, and its methods must be called from the main thread.
+ */
+@interface CIOSyncStatusPoller : NSObject
+
+/**
+ *  Interval used while an account's status is changing. Defaults to 60 seconds.
+ */
+@property (nonatomic) NSTimeInterval minimumInterval;
+
+/**
+ *  Longest interval between polls of an account. Defaults to 1 hour.
+ */
+@property (nonatomic) NSTimeInterval maximumInterval;
+
+/**
+ *  Factor the interval grows by after each poll which found no change or failed. Defaults to `2`.
+ */
+@property (nonatomic) double backoffMultiplier;
+
+/**
+ *  Fraction by which each delay is randomly lengthened or shortened. Defaults to `0.1`.
+ */
+@property (nonatomic) double jitter;
+
+/**
+ *  Sources whose last sync finished longer ago than this get a forced sync, at most once per this interval. Defaults to
+ * `0`, which never forces a sync.
+ */
+@property (nonatomic) NSTimeInterval forceSyncAfter;
+
+/**
+ *  Maximum number of polls in flight at once. Defaults to `4`.
+ */
+@property (nonatomic) NSUInteger maximumConcurrentPolls;
+
+@property (readonly, nonatomic, getter=isRunning) BOOL running;
+
+/**
+ *  Ids of the polled accounts.
+ */
+@property (readonly, nonatomic) NSArray *accountIDs;
+
+/**
+ *  Polls all sources of the client's account.
+ */
+- (void)addClient:(CIOV2Client *)client;
+
+/**
+ *  Polls the client's account, using `getSyncStatusForSourceWithLabel:` when `sourceLabel` is given. Replaces any
+ * client previously added for the same account.
+ */
+- (void)addClient:(CIOV2Client *)client sourceLabel:(nullable NSString *)sourceLabel;
+
+- (void)removeClientForAccountID:(NSString *)accountID;
+
+/**
+ *  Starts polling. The first poll of each account happens within `minimumInterval`.
+ */
+- (void)start;
+
+- (void)stop;
+
+/**
+ *  Polls an account now, unless a poll of it is already in flight.
+ */
+- (void)pollAccountWithID:(NSString *)accountID;
+
+/**
+ *  The last status seen for an account.
+ */
+- (nullable NSDictionary *)statusForAccountWithID:(NSString *)accountID;
+
+/**
+ *  The current polling interval of an account, before jitter.
+ */
+- (NSTimeInterval)intervalForAccountWithID:(NSString *)accountID;
+
+/**
+ *  Records a status of an account, as a poll does: adapts the account's interval, posts the changes, and forces syncs
+ * of stale sources. The first status of an account is a baseline and is not posted. Useful to feed in statuses fetched
+ * elsewhere.
+ *
+ *  @return the changes from the previous status
+ */
+- (NSDictionary *)updateStatus:(NSDictionary *)status forAccountWithID:(NSString *)accountID;
+
+/**
+ *  Labels of sources in a sync status which have not finished a sync within `forceSyncAfter` and are not syncing.
+ */
+- (NSArray *)staleSourceLabelsInStatus:(NSDictionary *)status;
+
+/**
+ *  The sources of `newStatus` which differ from `oldStatus`, keyed by source label. Sources which are gone map to
+ * `NSNull`.
+ */
++ (NSDictionary *)changesFromStatus:(nullable NSDictionary *)oldStatus toStatus:(NSDictionary *)newStatus;
+
+@end
+
+NS_ASSUME_NONNULL_END
@@ -0,0 +1,303 @@
+//
+//  CIOSyncStatusPoller.m
+//  CIOAPIClient
+//
+//  Copyright © 2015 Context.io. All rights reserved.
+//
+
+#import "CIOSyncStatusPoller.h"
+#import "CIOV2Client.h"
+
+NSString *const CIOSyncStatusPollerDidChangeNotification = @"CIOSyncStatusPollerDidChangeNotification";
+NSString *const CIOSyncStatusPollerAccountIDKey = @"accountID";
+NSString *const CIOSyncStatusPollerChangesKey = @"changes";
+
+// Polling state of one account
+@interface CIOSyncPollState : NSObject
+
+@property (nonatomic) CIOV2Client *client;
+@property (nullable, nonatomic, copy) NSString *sourceLabel;
+@property (nullable, nonatomic) NSDictionary *status;
+@property (nonatomic) NSTimeInterval interval;
+@property (nonatomic) NSDate *nextPollDate;
+@property (nonatomic, getter=isPolling) BOOL polling;
+// Source label -> NSDate of the last forced sync
+@property (nonatomic) NSMutableDictionary *forcedSyncDates;
+
+@end
+
+@implementation CIOSyncPollState
+
+- (instancetype)init {
+    if ((self = [super init])) {
+        _forcedSyncDates = [NSMutableDictionary dictionary];
+    }
+    return self;
+}
+
+@end
+
+#pragma mark -
+
+static double CIORandomFraction(void) {
+    return (double)arc4random_uniform(UINT32_MAX) / (double)UINT32_MAX;
+}
+
+// The latest sync start and stop times of a source, from any provider entry nested in its status
+static void CIOSyncTimes(id status, double *start, double *stop) {
+    if (![status isKindOfClass:[NSDictionary class]]) {
+        return;
+    }
+    [status enumerateKeysAndObjectsUsingBlock:^(NSString *key, id value, BOOL *s) {
+      if ([value isKindOfClass:[NSDictionary class]]) {
+          CIOSyncTimes(value, start, stop);
+      } else if ([key isEqualToString:@"last_sync_start"] && [value respondsToSelector:@selector(doubleValue)]) {
+          *start = MAX(*start, [value doubleValue]);
+      } else if ([key isEqualToString:@"last_sync_stop"] && [value respondsToSelector:@selector(doubleValue)]) {
+          *stop = MAX(*stop, [value doubleValue]);
+      }
+    }];
+}
+
+@interface CIOSyncStatusPoller ()
+
+// Account id -> CIOSyncPollState
+@property (nonatomic) NSMutableDictionary *states;
+@property (nullable, nonatomic) dispatch_source_t timer;
+@property (readwrite, nonatomic, getter=isRunning) BOOL running;
+@property (nonatomic) NSUInteger pollsInFlight;
+
+@end
+
+@implementation CIOSyncStatusPoller
+
+- (instancetype)init {
+    if ((self = [super init])) {
+        _minimumInterval = 60;
+        _maximumInterval = 60 * 60;
+        _backoffMultiplier = 2;
+        _jitter = 0.1;
+        _maximumConcurrentPolls = 4;
+        _states = [NSMutableDictionary dictionary];
+    }
+    return self;
+}
+
+- (void)dealloc {
+    if (_timer) {
+        dispatch_source_cancel(_timer);
+    }
+}
+
+- (NSArray *)accountIDs {
+    return self.states.allKeys;
+}
+
+- (void)addClient:(CIOV2Client *)client {
+    [self addClient:client sourceLabel:nil];
+}
+
+- (void)addClient:(CIOV2Client *)client sourceLabel:(NSString *)sourceLabel {
+    NSParameterAssert(client.accountID);
+    CIOSyncPollState *state = [CIOSyncPollState new];
+    state.client = client;
+    state.sourceLabel = sourceLabel;
+    state.interval = self.minimumInterval;
+    state.nextPollDate = [NSDate dateWithTimeIntervalSinceNow:self.minimumInterval * CIORandomFraction()];
+    self.states[client.accountID] = state;
+    [self _scheduleTimer];
+}
+
+- (void)removeClientForAccountID:(NSString *)accountID {
+    [self.states removeObjectForKey:accountID];
+}
+
+- (NSDictionary *)statusForAccountWithID:(NSString *)accountID {
+    return [self.states[accountID] status];
+}
+
+- (NSTimeInterval)intervalForAccountWithID:(NSString *)accountID {
+    return [self.states[accountID] interval];
+}
+
+#pragma mark - Scheduling
+
+- (void)start {
+    if (self.running) {
+        return;
+    }
+    self.running = YES;
+    self.timer = dispatch_source_create(DISPATCH_SOURCE_TYPE_TIMER, 0, 0, dispatch_get_main_queue());
+    __weak typeof(self) weakSelf = self;
+    dispatch_source_set_event_handler(self.timer, ^{
+      [weakSelf _pollDueAccounts];
+    });
+    [self _scheduleTimer];
+    dispatch_resume(self.timer);
+}
+
+- (void)stop {
+    if (!self.running) {
+        return;
+    }
+    self.running = NO;
+    dispatch_source_cancel(self.timer);
+    self.timer = nil;
+}
+
+// Sets the timer to fire when the next account is due
+- (void)_scheduleTimer {
+    if (!self.timer) {
+        return;
+    }
+    NSDate *next = nil;
+    for (CIOSyncPollState *state in self.states.allValues) {
+        if (!state.polling && (!next || [state.nextPollDate compare:next] == NSOrderedAscending)) {
+            next = state.nextPollDate;
+        }
+    }
+    if (!next || self.pollsInFlight >= self.maximumConcurrentPolls) {
+        dispatch_source_set_timer(self.timer, DISPATCH_TIME_FOREVER, DISPATCH_TIME_FOREVER, 0);
+        return;
+    }
+    NSTimeInterval delay = MAX(0, next.timeIntervalSinceNow);
+    dispatch_source_set_timer(self.timer, dispatch_time(DISPATCH_TIME_NOW, (int64_t)(delay * NSEC_PER_SEC)),
+                              DISPATCH_TIME_FOREVER, NSEC_PER_SEC);
+}
+
+- (void)_pollDueAccounts {
+    NSDate *now = [NSDate date];
+    NSArray *due = [self.states keysOfEntriesPassingTest:^BOOL(NSString *accountID, CIOSyncPollState *state, BOOL *stop) {
+      return !state.polling && [state.nextPollDate compare:now] != NSOrderedDescending;
+    }].allObjects;
+    due = [due sortedArrayUsingComparator:^NSComparisonResult(NSString *a, NSString *b) {
+      return [[self.states[a] nextPollDate] compare:[self.states[b] nextPollDate]];
+    }];
+    for (NSString *accountID in due) {
+        if (self.pollsInFlight >= self.maximumConcurrentPolls) {
+            break;
+        }
+        [self pollAccountWithID:accountID];
+    }
+    [self _scheduleTimer];
+}
+
+- (NSTimeInterval)_jitteredInterval:(NSTimeInterval)interval {
+    return interval * (1 + self.jitter * (2 * CIORandomFraction() - 1));
+}
+
+- (void)pollAccountWithID:(NSString *)accountID {
+    CIOSyncPollState *state = self.states[accountID];
+    if (!state || state.polling) {
+        return;
+    }
+    state.polling = YES;
+    self.pollsInFlight++;
+    CIODictionaryRequest *request = state.sourceLabel ? [state.client getSyncStatusForSourceWithLabel:state.sourceLabel]
+                                                      : [state.client getSyncStatusForAllSources];
+    [request executeWithSuccess:^(NSDictionary *status) {
+      if (self.states[accountID] == state) {
+          [self updateStatus:status forAccountWithID:accountID];
+      }
+      [self _finishPollOfState:state];
+    } failure:^(NSError *error) {
+      state.interval = MIN(self.maximumInterval, state.interval * self.backoffMultiplier);
+      state.nextPollDate = [NSDate dateWithTimeIntervalSinceNow:[self _jitteredInterval:state.interval]];
+      [self _finishPollOfState:state];
+    }];
+}
+
+- (void)_finishPollOfState:(CIOSyncPollState *)state {
+    state.polling = NO;
+    self.pollsInFlight--;
+    [self _scheduleTimer];
+}
+
+#pragma mark - Status
+
++ (NSDictionary *)changesFromStatus:(NSDictionary *)oldStatus toStatus:(NSDictionary *)newStatus {
+    NSMutableDictionary *changes = [NSMutableDictionary dictionary];
+    [newStatus enumerateKeysAndObjectsUsingBlock:^(NSString *label, id sourceStatus, BOOL *stop) {
+      if (![oldStatus[label] isEqual:sourceStatus]) {
+          changes[label] = sourceStatus;
+      }
+    }];
+    for (NSString *label in oldStatus) {
+        if (!newStatus[label]) {
+            changes[label] = [NSNull null];
+        }
+    }
+    return changes;
+}
+
+- (NSArray *)staleSourceLabelsInStatus:(NSDictionary *)status {
+    if (self.forceSyncAfter <= 0) {
+        return @[];
+    }
+    double staleBefore = [[NSDate date] timeIntervalSince1970] - self.forceSyncAfter;
+    NSMutableArray *labels = [NSMutableArray array];
+    [status enumerateKeysAndObjectsUsingBlock:^(NSString *label, id sourceStatus, BOOL *stop) {
+      double start = 0;
+      double lastStop = 0;
+      CIOSyncTimes(sourceStatus, &start, &lastStop);
+      BOOL syncing = start > lastStop;
+      if (!syncing && lastStop < staleBefore) {
+          [labels addObject:label];
+      }
+    }];
+    return labels;
+}
+
+- (NSDictionary *)updateStatus:(NSDictionary *)status forAccountWithID:(NSString *)accountID {
+    CIOSyncPollState *state = self.states[accountID];
+    if (!state) {
+        return @{};
+    }
+    NSDictionary *previous = state.status;
+    NSDictionary *changes = [self.class changesFromStatus:previous toStatus:status];
+    state.status = status;
+
+    BOOL syncing = NO;
+    for (id sourceStatus in status.allValues) {
+        double start = 0;
+        double stop = 0;
+        CIOSyncTimes(sourceStatus, &start, &stop);
+        syncing = syncing || start > stop;
+    }
+    NSArray *forced = [self _forceSyncOfStaleSourcesInStatus:status state:state];
+
+    // Keep a close eye on accounts which are changing or about to, and back off from idle ones
+    if (syncing || forced.count > 0 || (previous && changes.count > 0)) {
+        state.interval = self.minimumInterval;
+    } else if (previous) {
+        state.interval = MIN(self.maximumInterval, state.interval * self.backoffMultiplier);
+    }
+    state.nextPollDate = [NSDate dateWithTimeIntervalSinceNow:[self _jitteredInterval:state.interval]];
+    [self _scheduleTimer];
+
+    if (previous && changes.count > 0) {
+        [[NSNotificationCenter defaultCenter]
+            postNotificationName:CIOSyncStatusPollerDidChangeNotification
+                          object:self
+                        userInfo:@{CIOSyncStatusPollerAccountIDKey: accountID, CIOSyncStatusPollerChangesKey: changes}];
+    }
+    return changes;
+}
+
+- (NSArray *)_forceSyncOfStaleSourcesInStatus:(NSDictionary *)status state:(CIOSyncPollState *)state {
+    NSMutableArray *forced = [NSMutableArray array];
+    for (NSString *label in [self staleSourceLabelsInStatus:status]) {
+        NSDate *lastForced = state.forcedSyncDates[label];
+        if (lastForced && -lastForced.timeIntervalSinceNow < self.forceSyncAfter) {
+            continue;
+        }
+        state.forcedSyncDates[label] = [NSDate date];
+        [forced addObject:label];
+        [[state.client forceSyncForSourceWithLabel:label] executeWithSuccess:^(NSDictionary *response) {
+        } failure:^(NSError *error) {
+        }];
+    }
+    return forced;
+}
+
+@end
@@ -0,0 +1,120 @@
+//
+//  CIOTransferDecoder.h
+//  CIOAPIClient
+//
+//  Copyright © 2015 Context.io. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+
+NS_ASSUME_NONNULL_BEGIN
+
+/**
+ Content-Transfer-Encodings understood by `CIOTransferDecoder`. See [RFC 2045](https://tools.ietf.org/html/rfc2045#section-6).
+ */
+typedef NS_ENUM(NSInteger, CIOTransferEncoding) {
+    /**
+     *  `7bit`, `8bit`, `binary`, or no `Content-Transfer-Encoding` at all. Bytes are passed through untouched.
+     */
+    CIOTransferEncodingIdentity = 0,
+    CIOTransferEncodingBase64,
+    CIOTransferEncodingQuotedPrintable
+};
+
+/**
+ Vector instruction sets `CIOTransferDecoder` can use. Long runs of base64 alphabet are classified and unpacked 16
+ (SSE2) or 32 (AVX2) characters at a time, and quoted-printable text is scanned for escapes the same way. Anything
+ else, such as line breaks, padding and escapes themselves, goes through the scalar decoder.
+ */
+typedef NS_ENUM(NSInteger, CIOTransferDecoderAcceleration) {
+    CIOTransferDecoderAccelerationNone = 0,
+    CIOTransferDecoderAccelerationSSE2,
+    CIOTransferDecoderAccelerationAVX2
+};
+
+/**
+ Incremental decoder for base64 and quoted-printable MIME bodies.
+
+ Input may be fed in chunks of any size, including chunks which split a base64 quantum or a `=XX` escape; the decoder
+ carries that state over to the next call. Output is written to a caller-provided buffer so large bodies can be
+ decoded through a single bounded, reused buffer rather than being materialized in memory.
+
+ Decoding is vectorized where the CPU allows it, see `CIOTransferDecoderAcceleration`.
+ */
+@interface CIOTransferDecoder : NSObject
+
+/**
+ *  Maps a `Content-Transfer-Encoding` header value to a `CIOTransferEncoding`. Unknown values map to
+ * `CIOTransferEncodingIdentity`.
+ */
++ (CIOTransferEncoding)encodingForName:(nullable NSString *)name;
+
+/**
+ *  Upper bound on the number of bytes a single `decodeBytes:length:intoBuffer:` call followed by `finishIntoBuffer:`
+ * can write for `length` bytes of input. Use it to size the output buffer.
+ */
++ (NSUInteger)maximumDecodedLengthForLength:(NSUInteger)length;
+
+/**
+ *  Decodes a complete buffer in one call.
+ */
++ (NSData *)decodeData:(NSData *)data encoding:(CIOTransferEncoding)encoding;
+
+/**
+ *  Decodes a file to another file through a bounded buffer, without reading either in to memory.
+ *
+ *  @param sourceURL      encoded file to read
+ *  @param destinationURL `URL` on disk to write the decoded file to. An error will be returned if a file already exists
+ * at this path.
+ *
+ *  @return `YES` on success
+ */
++ (BOOL)decodeFileAtURL:(NSURL *)sourceURL
+              toFileURL:(NSURL *)destinationURL
+               encoding:(CIOTransferEncoding)encoding
+                  error:(NSError **)error;
+
+/**
+ *  The fastest acceleration the current CPU and OS support.
+ */
++ (CIOTransferDecoderAcceleration)supportedAcceleration;
+
+- (instancetype)initWithEncoding:(CIOTransferEncoding)encoding NS_DESIGNATED_INITIALIZER;
+
+- (instancetype)init NS_UNAVAILABLE;
+
+@property (readonly, nonatomic) CIOTransferEncoding encoding;
+
+/**
+ *  Instruction set used by this decoder. Defaults to `supportedAcceleration`; values above it are clamped to it.
+ */
+@property (nonatomic) CIOTransferDecoderAcceleration acceleration;
+
+/**
+ *  Decodes the next chunk of encoded input.
+ *
+ *  @param bytes  encoded input
+ *  @param length number of bytes of input
+ *  @param buffer output buffer, at least `maximumDecodedLengthForLength:length` bytes long
+ *
+ *  @return the number of decoded bytes written to `buffer`
+ */
+- (NSUInteger)decodeBytes:(const uint8_t *)bytes length:(NSUInteger)length intoBuffer:(uint8_t *)buffer;
+
+/**
+ *  Flushes any partial quantum or escape left over from the last chunk. Call once after all input has been fed.
+ *
+ *  @param buffer output buffer, at least 4 bytes long
+ *
+ *  @return the number of decoded bytes written to `buffer`
+ */
+- (NSUInteger)finishIntoBuffer:(uint8_t *)buffer;
+
+/**
+ *  Discards any carried-over state so the decoder can be reused for a new body.
+ */
+- (void)reset;
+
+@end
+
+NS_ASSUME_NONNULL_END
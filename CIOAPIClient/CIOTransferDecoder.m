@@ -0,0 +1,564 @@
+//
+//  CIOTransferDecoder.m
+//  CIOAPIClient
+//
+//  Copyright © 2015 Context.io. All rights reserved.
+//
+
+#import "CIOTransferDecoder.h"
+
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define CIO_TRANSFER_DECODER_X86 1
+#include <cpuid.h>
+#include <emmintrin.h>
+#include <immintrin.h>
+#endif
+
+#if defined(__has_attribute)
+#if __has_attribute(target)
+#define CIO_TRANSFER_DECODER_TARGET_ATTRIBUTE 1
+#endif
+#endif
+
+#if CIO_TRANSFER_DECODER_X86 && (defined(__AVX2__) || CIO_TRANSFER_DECODER_TARGET_ATTRIBUTE)
+#define CIO_TRANSFER_DECODER_AVX2 1
+#define CIO_AVX2_FUNCTION __attribute__((target("avx2")))
+#endif
+
+static NSString *const CIOTransferDecoderErrorDomain = @"io.context.error.decode";
+
+// Encoded bytes read per pass when decoding files
+static const NSUInteger kCIOTransferDecoderFileChunkSize = 256 * 1024;
+
+// Base64 lookup values for non-alphabet bytes
+static const int8_t kCIOBase64Invalid = -1;
+static const int8_t kCIOBase64Pad = -2;
+
+static int8_t CIOBase64DecodeTable[256];
+
+static void CIOBase64InitializeTable(void) {
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        memset(CIOBase64DecodeTable, kCIOBase64Invalid, sizeof(CIOBase64DecodeTable));
+        const char *alphabet = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+        for (int8_t i = 0; i < 64; i++) {
+            CIOBase64DecodeTable[(uint8_t)alphabet[i]] = i;
+        }
+        CIOBase64DecodeTable['='] = kCIOBase64Pad;
+    });
+}
+
+static inline int CIOHexValue(uint8_t c) {
+    if (c >= '0' && c <= '9') {
+        return c - '0';
+    } else if (c >= 'A' && c <= 'F') {
+        return c - 'A' + 10;
+    } else if (c >= 'a' && c <= 'f') {
+        return c - 'a' + 10;
+    }
+    return -1;
+}
+
+#pragma mark - Vector Kernels
+
+// The base64 kernels map each 32-bit lane of 4 alphabet characters to its 3 decoded bytes in place, then store the low
+// 3 bytes of every lane. With lane x = a | b << 8 | c << 16 | d << 24 holding sextets a-d:
+//   byte 0 = a << 2 | b >> 4, byte 1 = (b & 0xF) << 4 | c >> 2, byte 2 = (c & 0x3) << 6 | d
+
+#if CIO_TRANSFER_DECODER_X86
+
+static inline __m128i CIOInRange128(__m128i c, char low, char high) {
+    return _mm_and_si128(_mm_cmpgt_epi8(c, _mm_set1_epi8((char)(low - 1))),
+                         _mm_cmpgt_epi8(_mm_set1_epi8((char)(high + 1)), c));
+}
+
+// Decodes whole 16 character blocks of base64 alphabet, stopping at the first block containing anything else. Returns
+// the number of input bytes consumed and sets `written` to the number of output bytes.
+static NSUInteger CIOBase64DecodeSSE2(const uint8_t *input, NSUInteger length, uint8_t *output, NSUInteger *written) {
+    NSUInteger consumed = 0;
+    uint8_t *out = output;
+    while (length - consumed >= 16) {
+        __m128i c = _mm_loadu_si128((const __m128i *)(input + consumed));
+        __m128i upper = CIOInRange128(c, 'A', 'Z');
+        __m128i lower = CIOInRange128(c, 'a', 'z');
+        __m128i digit = CIOInRange128(c, '0', '9');
+        __m128i plus = _mm_cmpeq_epi8(c, _mm_set1_epi8('+'));
+        __m128i slash = _mm_cmpeq_epi8(c, _mm_set1_epi8('/'));
+        __m128i valid = _mm_or_si128(_mm_or_si128(upper, lower), _mm_or_si128(digit, _mm_or_si128(plus, slash)));
+        if (_mm_movemask_epi8(valid) != 0xFFFF) {
+            break;
+        }
+        __m128i offset = _mm_or_si128(
+            _mm_or_si128(_mm_and_si128(upper, _mm_set1_epi8(-65)), _mm_and_si128(lower, _mm_set1_epi8(-71))),
+            _mm_or_si128(_mm_and_si128(digit, _mm_set1_epi8(4)),
+                         _mm_or_si128(_mm_and_si128(plus, _mm_set1_epi8(19)), _mm_and_si128(slash, _mm_set1_epi8(16)))));
+        __m128i x = _mm_add_epi8(c, offset);
+        __m128i byte0 = _mm_or_si128(_mm_slli_epi32(_mm_and_si128(x, _mm_set1_epi32(0x3F)), 2),
+                                     _mm_and_si128(_mm_srli_epi32(x, 12), _mm_set1_epi32(0x03)));
+        __m128i byte1 = _mm_or_si128(_mm_slli_epi32(_mm_and_si128(x, _mm_set1_epi32(0x0F00)), 4),
+                                     _mm_and_si128(_mm_srli_epi32(x, 10), _mm_set1_epi32(0x0F00)));
+        __m128i byte2 = _mm_or_si128(_mm_slli_epi32(_mm_and_si128(x, _mm_set1_epi32(0x030000)), 6),
+                                     _mm_and_si128(_mm_srli_epi32(x, 8), _mm_set1_epi32(0x3F0000)));
+        uint32_t lanes[4];
+        _mm_storeu_si128((__m128i *)lanes, _mm_or_si128(byte0, _mm_or_si128(byte1, byte2)));
+        for (int i = 0; i < 4; i++) {
+            memcpy(out + 3 * i, &lanes[i], 3);
+        }
+        consumed += 16;
+        out += 12;
+    }
+    *written = (NSUInteger)(out - output);
+    return consumed;
+}
+
+static NSUInteger CIOFindByteSSE2(const uint8_t *bytes, NSUInteger length, uint8_t byte) {
+    __m128i needle = _mm_set1_epi8((char)byte);
+    NSUInteger i = 0;
+    for (; i + 16 <= length; i += 16) {
+        int mask = _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(bytes + i)), needle));
+        if (mask) {
+            return i + (NSUInteger)__builtin_ctz((unsigned int)mask);
+        }
+    }
+    for (; i < length; i++) {
+        if (bytes[i] == byte) {
+            return i;
+        }
+    }
+    return length;
+}
+
+#endif
+
+#if CIO_TRANSFER_DECODER_AVX2
+
+CIO_AVX2_FUNCTION static inline __m256i CIOInRange256(__m256i c, char low, char high) {
+    return _mm256_and_si256(_mm256_cmpgt_epi8(c, _mm256_set1_epi8((char)(low - 1))),
+                            _mm256_cmpgt_epi8(_mm256_set1_epi8((char)(high + 1)), c));
+}
+
+// As `CIOBase64DecodeSSE2`, 32 characters at a time
+CIO_AVX2_FUNCTION static NSUInteger CIOBase64DecodeAVX2(const uint8_t *input, NSUInteger length, uint8_t *output,
+                                                        NSUInteger *written) {
+    NSUInteger consumed = 0;
+    uint8_t *out = output;
+    while (length - consumed >= 32) {
+        __m256i c = _mm256_loadu_si256((const __m256i *)(input + consumed));
+        __m256i upper = CIOInRange256(c, 'A', 'Z');
+        __m256i lower = CIOInRange256(c, 'a', 'z');
+        __m256i digit = CIOInRange256(c, '0', '9');
+        __m256i plus = _mm256_cmpeq_epi8(c, _mm256_set1_epi8('+'));
+        __m256i slash = _mm256_cmpeq_epi8(c, _mm256_set1_epi8('/'));
+        __m256i valid =
+            _mm256_or_si256(_mm256_or_si256(upper, lower), _mm256_or_si256(digit, _mm256_or_si256(plus, slash)));
+        if ((uint32_t)_mm256_movemask_epi8(valid) != 0xFFFFFFFFu) {
+            break;
+        }
+        __m256i offset = _mm256_or_si256(
+            _mm256_or_si256(_mm256_and_si256(upper, _mm256_set1_epi8(-65)),
+                            _mm256_and_si256(lower, _mm256_set1_epi8(-71))),
+            _mm256_or_si256(_mm256_and_si256(digit, _mm256_set1_epi8(4)),
+                            _mm256_or_si256(_mm256_and_si256(plus, _mm256_set1_epi8(19)),
+                                            _mm256_and_si256(slash, _mm256_set1_epi8(16)))));
+        __m256i x = _mm256_add_epi8(c, offset);
+        __m256i byte0 = _mm256_or_si256(_mm256_slli_epi32(_mm256_and_si256(x, _mm256_set1_epi32(0x3F)), 2),
+                                        _mm256_and_si256(_mm256_srli_epi32(x, 12), _mm256_set1_epi32(0x03)));
+        __m256i byte1 = _mm256_or_si256(_mm256_slli_epi32(_mm256_and_si256(x, _mm256_set1_epi32(0x0F00)), 4),
+                                        _mm256_and_si256(_mm256_srli_epi32(x, 10), _mm256_set1_epi32(0x0F00)));
+        __m256i byte2 = _mm256_or_si256(_mm256_slli_epi32(_mm256_and_si256(x, _mm256_set1_epi32(0x030000)), 6),
+                                        _mm256_and_si256(_mm256_srli_epi32(x, 8), _mm256_set1_epi32(0x3F0000)));
+        uint32_t lanes[8];
+        _mm256_storeu_si256((__m256i *)lanes, _mm256_or_si256(byte0, _mm256_or_si256(byte1, byte2)));
+        for (int i = 0; i < 8; i++) {
+            memcpy(out + 3 * i, &lanes[i], 3);
+        }
+        consumed += 32;
+        out += 24;
+    }
+    *written = (NSUInteger)(out - output);
+    return consumed;
+}
+
+CIO_AVX2_FUNCTION static NSUInteger CIOFindByteAVX2(const uint8_t *bytes, NSUInteger length, uint8_t byte) {
+    __m256i needle = _mm256_set1_epi8((char)byte);
+    NSUInteger i = 0;
+    for (; i + 32 <= length; i += 32) {
+        uint32_t mask = (uint32_t)_mm256_movemask_epi8(
+            _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *)(bytes + i)), needle));
+        if (mask) {
+            return i + (NSUInteger)__builtin_ctz(mask);
+        }
+    }
+    return i + CIOFindByteSSE2(bytes + i, length - i, byte);
+}
+
+#endif
+
+static CIOTransferDecoderAcceleration CIODetectAcceleration(void) {
+#if CIO_TRANSFER_DECODER_X86
+    CIOTransferDecoderAcceleration acceleration = CIOTransferDecoderAccelerationSSE2;
+#if CIO_TRANSFER_DECODER_AVX2
+    unsigned int eax = 0, ebx = 0, ecx = 0, edx = 0;
+    if (__get_cpuid(1, &eax, &ebx, &ecx, &edx)) {
+        // AVX state must be enabled by the OS (OSXSAVE + XCR0 bits 1-2) as well as supported by the CPU
+        BOOL osSavesAVX = NO;
+        if ((ecx & (1u << 27)) && (ecx & (1u << 28))) {
+            uint32_t xcr0 = 0;
+            __asm__ volatile("xgetbv" : "=a"(xcr0) : "c"(0) : "%edx");
+            osSavesAVX = (xcr0 & 0x6) == 0x6;
+        }
+        if (osSavesAVX && __get_cpuid_max(0, NULL) >= 7) {
+            __cpuid_count(7, 0, eax, ebx, ecx, edx);
+            if (ebx & (1u << 5)) {
+                acceleration = CIOTransferDecoderAccelerationAVX2;
+            }
+        }
+    }
+#endif
+    return acceleration;
+#else
+    return CIOTransferDecoderAccelerationNone;
+#endif
+}
+
+// Decodes a run of pure base64 alphabet with the widest available kernel. Returns the number of input bytes consumed.
+static NSUInteger CIOBase64DecodeVector(CIOTransferDecoderAcceleration acceleration, const uint8_t *input,
+                                        NSUInteger length, uint8_t *output, NSUInteger *written) {
+    *written = 0;
+    NSUInteger consumed = 0;
+#if CIO_TRANSFER_DECODER_AVX2
+    if (acceleration == CIOTransferDecoderAccelerationAVX2) {
+        consumed = CIOBase64DecodeAVX2(input, length, output, written);
+    }
+#endif
+#if CIO_TRANSFER_DECODER_X86
+    if (acceleration >= CIOTransferDecoderAccelerationSSE2) {
+        NSUInteger tailWritten = 0;
+        consumed += CIOBase64DecodeSSE2(input + consumed, length - consumed, output + *written, &tailWritten);
+        *written += tailWritten;
+    }
+#endif
+    return consumed;
+}
+
+// Returns the offset of the first `byte` in `bytes`, or `length` if there is none
+static NSUInteger CIOFindByte(CIOTransferDecoderAcceleration acceleration, const uint8_t *bytes, NSUInteger length,
+                              uint8_t byte) {
+#if CIO_TRANSFER_DECODER_AVX2
+    if (acceleration == CIOTransferDecoderAccelerationAVX2) {
+        return CIOFindByteAVX2(bytes, length, byte);
+    }
+#endif
+#if CIO_TRANSFER_DECODER_X86
+    if (acceleration == CIOTransferDecoderAccelerationSSE2) {
+        return CIOFindByteSSE2(bytes, length, byte);
+    }
+#endif
+    const uint8_t *found = memchr(bytes, byte, length);
+    return found ? (NSUInteger)(found - bytes) : length;
+}
+
+typedef NS_ENUM(NSInteger, CIOQuotedPrintableState) {
+    CIOQuotedPrintableStateText,
+    CIOQuotedPrintableStateEquals,
+    CIOQuotedPrintableStateHex,
+    CIOQuotedPrintableStateSoftBreakPadding,
+    CIOQuotedPrintableStateSoftBreakCR
+};
+
+@interface CIOTransferDecoder () {
+    // base64: sextets accumulated towards the current 4 character quantum
+    uint32_t _quantum;
+    NSUInteger _quantumLength;
+
+    // quoted-printable: position within an `=XX` escape or soft line break
+    CIOQuotedPrintableState _qpState;
+    uint8_t _qpHighNibble;
+}
+
+@end
+
+@implementation CIOTransferDecoder
+
++ (CIOTransferEncoding)encodingForName:(NSString *)name {
+    NSString *normalized = [[name stringByTrimmingCharactersInSet:[NSCharacterSet whitespaceAndNewlineCharacterSet]]
+        lowercaseString];
+    if ([normalized isEqualToString:@"base64"]) {
+        return CIOTransferEncodingBase64;
+    } else if ([normalized isEqualToString:@"quoted-printable"]) {
+        return CIOTransferEncodingQuotedPrintable;
+    }
+    return CIOTransferEncodingIdentity;
+}
+
++ (NSUInteger)maximumDecodedLengthForLength:(NSUInteger)length {
+    // Base64 shrinks its input. Quoted-printable only grows when an "=X" held back from the previous chunk turns out
+    // not to be an escape and is written literally, and again when one is flushed on finish: 2 bytes each time.
+    return length + 4;
+}
+
++ (CIOTransferDecoderAcceleration)supportedAcceleration {
+    static CIOTransferDecoderAcceleration supported;
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        supported = CIODetectAcceleration();
+    });
+    return supported;
+}
+
++ (NSData *)decodeData:(NSData *)data encoding:(CIOTransferEncoding)encoding {
+    CIOTransferDecoder *decoder = [[self alloc] initWithEncoding:encoding];
+    NSMutableData *output = [NSMutableData dataWithLength:[self maximumDecodedLengthForLength:data.length]];
+    uint8_t *buffer = output.mutableBytes;
+    NSUInteger length = [decoder decodeBytes:data.bytes length:data.length intoBuffer:buffer];
+    length += [decoder finishIntoBuffer:buffer + length];
+    output.length = length;
+    return output;
+}
+
++ (BOOL)decodeFileAtURL:(NSURL *)sourceURL
+              toFileURL:(NSURL *)destinationURL
+               encoding:(CIOTransferEncoding)encoding
+                  error:(NSError **)error {
+    if ([[NSFileManager defaultManager] fileExistsAtPath:destinationURL.path]) {
+        if (error) {
+            *error = [NSError errorWithDomain:NSCocoaErrorDomain
+                                         code:NSFileWriteFileExistsError
+                                     userInfo:@{NSURLErrorKey: destinationURL}];
+        }
+        return NO;
+    }
+    NSInputStream *input = [NSInputStream inputStreamWithURL:sourceURL];
+    NSOutputStream *output = [NSOutputStream outputStreamWithURL:destinationURL append:NO];
+    [input open];
+    [output open];
+    CIOTransferDecoder *decoder = [[self alloc] initWithEncoding:encoding];
+    NSMutableData *inputBuffer = [NSMutableData dataWithLength:kCIOTransferDecoderFileChunkSize];
+    NSMutableData *outputBuffer =
+        [NSMutableData dataWithLength:[self maximumDecodedLengthForLength:kCIOTransferDecoderFileChunkSize]];
+    NSError *streamError = nil;
+    BOOL finished = NO;
+    while (!streamError) {
+        NSInteger read = [input read:inputBuffer.mutableBytes maxLength:inputBuffer.length];
+        NSUInteger written = 0;
+        if (read < 0) {
+            streamError = input.streamError;
+            break;
+        } else if (read == 0) {
+            written = [decoder finishIntoBuffer:outputBuffer.mutableBytes];
+            finished = YES;
+        } else {
+            written = [decoder decodeBytes:inputBuffer.bytes length:(NSUInteger)read intoBuffer:outputBuffer.mutableBytes];
+        }
+        const uint8_t *bytes = outputBuffer.bytes;
+        while (written > 0) {
+            NSInteger result = [output write:bytes maxLength:written];
+            if (result <= 0) {
+                streamError = output.streamError;
+                break;
+            }
+            bytes += result;
+            written -= (NSUInteger)result;
+        }
+        if (finished) {
+            break;
+        }
+    }
+    [input close];
+    [output close];
+    if (streamError || !finished) {
+        [[NSFileManager defaultManager] removeItemAtURL:destinationURL error:nil];
+        if (error) {
+            *error = streamError ?: [NSError errorWithDomain:CIOTransferDecoderErrorDomain
+                                                        code:NSURLErrorCannotDecodeContentData
+                                                    userInfo:nil];
+        }
+        return NO;
+    }
+    return YES;
+}
+
+- (instancetype)initWithEncoding:(CIOTransferEncoding)encoding {
+    if ((self = [super init])) {
+        _encoding = encoding;
+        _acceleration = [[self class] supportedAcceleration];
+        CIOBase64InitializeTable();
+    }
+    return self;
+}
+
+- (void)setAcceleration:(CIOTransferDecoderAcceleration)acceleration {
+    _acceleration = MAX(CIOTransferDecoderAccelerationNone, MIN(acceleration, [[self class] supportedAcceleration]));
+}
+
+- (void)reset {
+    _quantum = 0;
+    _quantumLength = 0;
+    _qpState = CIOQuotedPrintableStateText;
+    _qpHighNibble = 0;
+}
+
+- (NSUInteger)decodeBytes:(const uint8_t *)bytes length:(NSUInteger)length intoBuffer:(uint8_t *)buffer {
+    switch (self.encoding) {
+        case CIOTransferEncodingBase64:
+            return [self _decodeBase64:bytes length:length intoBuffer:buffer];
+        case CIOTransferEncodingQuotedPrintable:
+            return [self _decodeQuotedPrintable:bytes length:length intoBuffer:buffer];
+        case CIOTransferEncodingIdentity:
+        default:
+            if (length > 0) {
+                memcpy(buffer, bytes, length);
+            }
+            return length;
+    }
+}
+
+- (NSUInteger)finishIntoBuffer:(uint8_t *)buffer {
+    NSUInteger written = 0;
+    if (self.encoding == CIOTransferEncodingBase64) {
+        written = [self _flushBase64Quantum:buffer];
+    } else if (self.encoding == CIOTransferEncodingQuotedPrintable) {
+        // A dangling escape is passed through literally, as most mail readers do
+        if (_qpState == CIOQuotedPrintableStateEquals) {
+            buffer[written++] = '=';
+        } else if (_qpState == CIOQuotedPrintableStateHex) {
+            buffer[written++] = '=';
+            buffer[written++] = "0123456789ABCDEF"[_qpHighNibble];
+        }
+    }
+    [self reset];
+    return written;
+}
+
+#pragma mark - Base64
+
+// Writes out a partial quantum cut short by padding or the end of input
+- (NSUInteger)_flushBase64Quantum:(uint8_t *)buffer {
+    NSUInteger written = 0;
+    if (_quantumLength == 2) {
+        buffer[written++] = (uint8_t)(_quantum >> 4);
+    } else if (_quantumLength == 3) {
+        buffer[written++] = (uint8_t)(_quantum >> 10);
+        buffer[written++] = (uint8_t)(_quantum >> 2);
+    }
+    _quantum = 0;
+    _quantumLength = 0;
+    return written;
+}
+
+- (NSUInteger)_decodeBase64:(const uint8_t *)bytes length:(NSUInteger)length intoBuffer:(uint8_t *)buffer {
+    uint8_t *out = buffer;
+    uint32_t quantum = _quantum;
+    NSUInteger quantumLength = _quantumLength;
+    CIOTransferDecoderAcceleration acceleration = _acceleration;
+    for (NSUInteger i = 0; i < length; i++) {
+        if (quantumLength == 0 && acceleration != CIOTransferDecoderAccelerationNone && length - i >= 16) {
+            // On a quantum boundary, hand whole lines of alphabet to the vector kernel
+            NSUInteger written = 0;
+            i += CIOBase64DecodeVector(acceleration, bytes + i, length - i, out, &written);
+            out += written;
+            if (i == length) {
+                break;
+            }
+        }
+        int8_t value = CIOBase64DecodeTable[bytes[i]];
+        if (value < 0) {
+            if (value == kCIOBase64Pad && quantumLength > 0) {
+                // Padding ends the current quantum; anything after it starts a new one
+                _quantum = quantum;
+                _quantumLength = quantumLength;
+                out += [self _flushBase64Quantum:out];
+                quantum = 0;
+                quantumLength = 0;
+            }
+            // Line breaks and any other non-alphabet characters are ignored, per RFC 2045
+            continue;
+        }
+        quantum = (quantum << 6) | (uint32_t)value;
+        if (++quantumLength == 4) {
+            *out++ = (uint8_t)(quantum >> 16);
+            *out++ = (uint8_t)(quantum >> 8);
+            *out++ = (uint8_t)quantum;
+            quantum = 0;
+            quantumLength = 0;
+        }
+    }
+    _quantum = quantum;
+    _quantumLength = quantumLength;
+    return (NSUInteger)(out - buffer);
+}
+
+#pragma mark - Quoted-Printable
+
+- (NSUInteger)_decodeQuotedPrintable:(const uint8_t *)bytes length:(NSUInteger)length intoBuffer:(uint8_t *)buffer {
+    uint8_t *out = buffer;
+    for (NSUInteger i = 0; i < length; i++) {
+        uint8_t c = bytes[i];
+        switch (_qpState) {
+            case CIOQuotedPrintableStateText: {
+                // Copy the literal run up to the next escape in one go
+                NSUInteger run = CIOFindByte(_acceleration, bytes + i, length - i, '=');
+                memcpy(out, bytes + i, run);
+                out += run;
+                i += run;
+                if (i < length) {
+                    _qpState = CIOQuotedPrintableStateEquals;
+                }
+                break;
+            }
+            case CIOQuotedPrintableStateEquals: {
+                int value = CIOHexValue(c);
+                if (value >= 0) {
+                    _qpHighNibble = (uint8_t)value;
+                    _qpState = CIOQuotedPrintableStateHex;
+                } else if (c == '\r') {
+                    _qpState = CIOQuotedPrintableStateSoftBreakCR;
+                } else if (c == '\n') {
+                    _qpState = CIOQuotedPrintableStateText;
+                } else if (c == ' ' || c == '\t') {
+                    // Transport padding between a soft break "=" and the end of the line
+                    _qpState = CIOQuotedPrintableStateSoftBreakPadding;
+                } else {
+                    // Not an escape: keep the "=" and reprocess this byte as text
+                    *out++ = '=';
+                    _qpState = CIOQuotedPrintableStateText;
+                    i--;
+                }
+                break;
+            }
+            case CIOQuotedPrintableStateHex: {
+                int value = CIOHexValue(c);
+                if (value >= 0) {
+                    *out++ = (uint8_t)((_qpHighNibble << 4) | value);
+                } else {
+                    *out++ = '=';
+                    *out++ = "0123456789ABCDEF"[_qpHighNibble];
+                    i--;
+                }
+                _qpState = CIOQuotedPrintableStateText;
+                break;
+            }
+            case CIOQuotedPrintableStateSoftBreakPadding:
+                if (c == '\r') {
+                    _qpState = CIOQuotedPrintableStateSoftBreakCR;
+                } else if (c == '\n') {
+                    _qpState = CIOQuotedPrintableStateText;
+                } else if (c != ' ' && c != '\t') {
+                    _qpState = CIOQuotedPrintableStateText;
+                    i--;
+                }
+                break;
+            case CIOQuotedPrintableStateSoftBreakCR:
+                _qpState = CIOQuotedPrintableStateText;
+                if (c != '\n') {
+                    i--;
+                }
+                break;
+        }
+    }
+    return (NSUInteger)(out - buffer);
+}
+
+@end
@@ -7,6 +7,7 @@
 //
 
 #import "CIOAPIClient.h"
+#import "CIOFileLinkCache.h"
 
 NS_ASSUME_NONNULL_BEGIN
 
@@ -191,6 +192,11 @@ NS_ASSUME_NONNULL_BEGIN
  */
 - (CIOStringRequest *)getContentsURLForFileWithID:(NSString *)fileID;
 
+/**
+ Cache of the temporary links returned by `getContentsURLForFileWithID:`. Use its `downloadFileWithID:toFileURL:success:failure:progress:` to download files straight from their links, reusing each link until it expires.
+ */
+@property (readonly, nonatomic) CIOFileLinkCache *fileLinkCache;
+
 /**
  Retrieves the contents of a particular file.
 
@@ -388,7 +394,8 @@ NS_ASSUME_NONNULL_BEGIN
 - (CIODictionaryRequest *)getHeadersForMessageWithID:(NSString *)messageID;
 
 /**
- Complete headers of a given email message as a raw string
+ Complete headers of a given email message as a raw string. Use `CIOHeaderTokenizer` to split the result in to fields,
+ which is enough for threading without the larger `getHeadersForMessageWithID:` response.
 
  @param messageID Unique id of a message. This can be the message_id or email_message_id property of the message. The gmail_message_id (prefixed with gm-) can also be used.
  */
@@ -10,7 +10,9 @@
 
 NSString *const CIOV2APIBaseURLString = @"https://api.context.io/2.0/";
 
-@implementation CIOV2Client
+@implementation CIOV2Client {
+    CIOFileLinkCache *_fileLinkCache;
+}
 
 - (instancetype)initWithConsumerKey:(NSString *)consumerKey consumerSecret:(NSString *)consumerSecret {
     self = [self initWithConsumerKey:consumerKey
@@ -137,10 +139,19 @@ NSString *const CIOV2APIBaseURLString = @"https://api.context.io/2.0/";
                                       client:self];
 }
 
+- (CIOFileLinkCache *)fileLinkCache {
+    if (_fileLinkCache == nil) {
+        _fileLinkCache = [[CIOFileLinkCache alloc] initWithClient:self];
+    }
+    return _fileLinkCache;
+}
+
 - (CIORequest *)downloadContentsOfFileWithID:(NSString *)fileID {
 
     NSString *path = [NSString pathWithComponents:@[self.accountPath, @"files", fileID, @"content"]];
-    return [CIORequest requestWithPath:path method:@"GET" parameters:nil client:self];
+    CIORequest *request = [CIORequest requestWithPath:path method:@"GET" parameters:nil client:self];
+    request.contentKey = path;
+    return request;
 }
 
 - (CIOArrayRequest *)getRelatedForFileWithID:(NSString *)fileID {
@@ -0,0 +1,136 @@
+//
+//  CIOWebhookReceiver.h
+//  CIOAPIClient
+//
+//  Copyright © 2015 Context.io. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+
+NS_ASSUME_NONNULL_BEGIN
+
+typedef NS_ENUM(NSInteger, CIOWebhookEventType) {
+    /** A message matched the webhook's filters */
+    CIOWebhookEventTypeMessage,
+    /** The webhook failed and is no longer active, see `setWebhookID:toActive:` */
+    CIOWebhookEventTypeFailure,
+};
+
+/**
+ *  A verified webhook callback.
+ */
+@interface CIOWebhookEvent : NSObject
+
+@property (readonly, nonatomic) CIOWebhookEventType type;
+
+@property (nullable, readonly, nonatomic) NSString *webhookID;
+
+@property (nullable, readonly, nonatomic) NSString *accountID;
+
+@property (readonly, nonatomic) NSDate *timestamp;
+
+/**
+ *  The `message_data` of a message callback.
+ */
+@property (nullable, readonly, nonatomic) NSDictionary *messageData;
+
+/**
+ *  The id of the message in `messageData`.
+ */
+@property (nullable, readonly, nonatomic) NSString *messageID;
+
+/**
+ *  The complete callback body.
+ */
+@property (readonly, nonatomic) NSDictionary *payload;
+
+@end
+
+/**
+ `CIOWebhookReceiver` is an embeddable HTTP server for the callbacks of webhooks created with
+ `createWebhookWithCallbackURL:failureURL:`.
+
+ Connections are served by an event loop of dispatch sources on a single serial queue. Each `POST` body is checked
+ against its `signature`, the hex SHA-256 HMAC of its `timestamp` followed by its `token` keyed with the consumer secret,
+ and turned in to a `CIOWebhookEvent`. Callbacks whose `timestamp` is more than `timestampTolerance` away from the
+ current time are rejected, so that captured callbacks can't be replayed later. Events are handed to the registered
+ handlers on a pool of at most `maximumConcurrentHandlers` workers.
+
+ When `maximumPendingEvents` events are waiting or being handled, new callbacks are answered with
+ `503 Service Unavailable` so that they are retried later, instead of piling up in memory. Callbacks which were already
+ accepted, i.e. for the same message from the same webhook, or with the same `token` for failure callbacks, are
+ acknowledged without being handled again. Connections which have not sent a complete request within `requestTimeout`
+ are answered with `408 Request Timeout` and closed.
+ */
+@interface CIOWebhookReceiver : NSObject
+
+/**
+ *  @param consumerSecret the consumer secret callbacks are signed with
+ */
+- (instancetype)initWithConsumerSecret:(NSString *)consumerSecret NS_DESIGNATED_INITIALIZER;
+
+- (instancetype)init NS_UNAVAILABLE;
+
+/**
+ *  Whether to only accept connections from the local machine, e.g. behind a reverse proxy. Defaults to `YES`. Must be
+ * set before `startOnPort:error:`.
+ */
+@property (nonatomic) BOOL localOnly;
+
+/**
+ *  Defaults to `4`.
+ */
+@property (nonatomic) NSUInteger maximumConcurrentHandlers;
+
+/**
+ *  Defaults to `64`.
+ */
+@property (nonatomic) NSUInteger maximumPendingEvents;
+
+/**
+ *  Number of recently accepted callbacks remembered to drop duplicates. Defaults to `1024`.
+ */
+@property (nonatomic) NSUInteger deduplicationCapacity;
+
+/**
+ *  Largest accepted difference between a callback's `timestamp` and the current time, in either direction. Defaults to
+ * 5 minutes. `0` accepts any timestamp.
+ */
+@property (nonatomic) NSTimeInterval timestampTolerance;
+
+/**
+ *  Time a connection has to send its complete request. Defaults to 30 seconds. Must be set before
+ * `startOnPort:error:`.
+ */
+@property (nonatomic) NSTimeInterval requestTimeout;
+
+/**
+ *  The port the receiver listens on, or `0` when it is not running.
+ */
+@property (readonly) uint16_t port;
+
+/**
+ *  Starts listening.
+ *
+ *  @param port the port to listen on, or `0` for any free port
+ */
+- (BOOL)startOnPort:(uint16_t)port error:(NSError **)error;
+
+/**
+ *  Stops listening and closes open connections. Events already accepted are still handled.
+ */
+- (void)stop;
+
+/**
+ *  Adds a handler for events of a type. Handlers are called on a background queue, possibly concurrently.
+ */
+- (void)addHandlerForEventType:(CIOWebhookEventType)type usingBlock:(void (^)(CIOWebhookEvent *event))block;
+
+/**
+ *  Parses and verifies a callback body, as done for each request.
+ */
+- (nullable CIOWebhookEvent *)eventFromBody:(NSData *)body error:(NSError **)error;
+
+@end
+
+NS_ASSUME_NONNULL_END
@@ -0,0 +1,450 @@
+//
+//  CIOWebhookReceiver.m
+//  CIOAPIClient
+//
+//  Copyright © 2015 Context.io. All rights reserved.
+//
+
+#import "CIOWebhookReceiver.h"
+#import <CommonCrypto/CommonHMAC.h>
+#import <arpa/inet.h>
+#import <fcntl.h>
+#import <netinet/in.h>
+#import <sys/socket.h>
+#import <unistd.h>
+
+static NSString *const CIOWebhookErrorDomain = @"io.context.error.webhook";
+
+static const NSUInteger kCIOWebhookMaximumHeaderLength = 16 * 1024;
+static const NSUInteger kCIOWebhookMaximumBodyLength = 4 * 1024 * 1024;
+
+static NSError *CIOWebhookError(NSInteger code, NSString *description) {
+    return [NSError errorWithDomain:CIOWebhookErrorDomain code:code userInfo:@{NSLocalizedDescriptionKey: description}];
+}
+
+static NSError *CIOPOSIXError(void) {
+    return [NSError errorWithDomain:NSPOSIXErrorDomain code:errno userInfo:nil];
+}
+
+static NSString *CIOHexHMACSHA256(NSString *key, NSString *string) {
+    NSData *keyData = [key dataUsingEncoding:NSUTF8StringEncoding];
+    NSData *data = [string dataUsingEncoding:NSUTF8StringEncoding];
+    unsigned char digest[CC_SHA256_DIGEST_LENGTH];
+    CCHmac(kCCHmacAlgSHA256, keyData.bytes, keyData.length, data.bytes, data.length, digest);
+    NSMutableString *hex = [NSMutableString stringWithCapacity:CC_SHA256_DIGEST_LENGTH * 2];
+    for (int i = 0; i < CC_SHA256_DIGEST_LENGTH; i++) {
+        [hex appendFormat:@"%02x", digest[i]];
+    }
+    return hex;
+}
+
+// Compares in time independent of where the strings differ, so signatures can't be guessed byte by byte
+static BOOL CIOConstantTimeEqual(NSString *a, NSString *b) {
+    NSData *dataA = [a.lowercaseString dataUsingEncoding:NSUTF8StringEncoding];
+    NSData *dataB = [b.lowercaseString dataUsingEncoding:NSUTF8StringEncoding];
+    if (dataA.length != dataB.length) {
+        return NO;
+    }
+    const uint8_t *bytesA = dataA.bytes;
+    const uint8_t *bytesB = dataB.bytes;
+    uint8_t difference = 0;
+    for (NSUInteger i = 0; i < dataA.length; i++) {
+        difference |= bytesA[i] ^ bytesB[i];
+    }
+    return difference == 0;
+}
+
+static NSString *CIOStringValue(id value) {
+    if ([value isKindOfClass:[NSString class]]) {
+        return value;
+    }
+    return [value isKindOfClass:[NSNumber class]] ? [value stringValue] : nil;
+}
+
+#pragma mark -
+
+@interface CIOWebhookEvent ()
+
+@property (readwrite, nonatomic) CIOWebhookEventType type;
+@property (nullable, readwrite, nonatomic) NSString *webhookID;
+@property (nullable, readwrite, nonatomic) NSString *accountID;
+@property (readwrite, nonatomic) NSDate *timestamp;
+@property (nullable, readwrite, nonatomic) NSDictionary *messageData;
+@property (nullable, readwrite, nonatomic) NSString *messageID;
+@property (readwrite, nonatomic) NSDictionary *payload;
+
+@end
+
+@implementation CIOWebhookEvent
+
+@end
+
+// Redeliveries of a message have the same key even when signed anew; other callbacks are told apart by their token
+static NSString *CIOWebhookEventKey(CIOWebhookEvent *event) {
+    if (event.messageID) {
+        return [NSString stringWithFormat:@"message\n%@\n%@", event.webhookID ?: @"", event.messageID];
+    }
+    NSString *token = CIOStringValue(event.payload[@"token"]);
+    return token ? [NSString stringWithFormat:@"token\n%@\n%@", event.webhookID ?: @"", token] : nil;
+}
+
+// A client connection and the request read from it so far
+@interface CIOWebhookConnection : NSObject
+
+@property (nonatomic) int fd;
+@property (nonatomic) dispatch_source_t readSource;
+// Fires when the request has not been read in time
+@property (nonatomic) dispatch_source_t timeoutSource;
+@property (nonatomic) NSMutableData *buffer;
+
+@end
+
+@implementation CIOWebhookConnection
+
+@end
+
+#pragma mark -
+
+@interface CIOWebhookReceiver ()
+
+@property (nonatomic, copy) NSString *consumerSecret;
+// Event loop: the listening socket, connections and the event queue are only used on this queue
+@property (nonatomic) dispatch_queue_t queue;
+@property (nonatomic) dispatch_queue_t handlerQueue;
+@property (nullable, nonatomic) dispatch_source_t listenSource;
+@property (readwrite) uint16_t port;
+@property (nonatomic) NSMutableSet *connections;
+@property (nonatomic) NSMutableArray *pendingEvents;
+@property (nonatomic) NSUInteger runningHandlers;
+// Deduplication keys of accepted events, oldest first, see `CIOWebhookEventKey`
+@property (nonatomic) NSMutableOrderedSet *acceptedEventKeys;
+// NSNumber of CIOWebhookEventType -> NSArray of handler blocks
+@property (nonatomic) NSMutableDictionary *handlers;
+
+@end
+
+@implementation CIOWebhookReceiver
+
+- (instancetype)initWithConsumerSecret:(NSString *)consumerSecret {
+    if ((self = [super init])) {
+        _consumerSecret = [consumerSecret copy];
+        _localOnly = YES;
+        _maximumConcurrentHandlers = 4;
+        _maximumPendingEvents = 64;
+        _deduplicationCapacity = 1024;
+        _timestampTolerance = 5 * 60;
+        _requestTimeout = 30;
+        _queue = dispatch_queue_create("io.context.webhookreceiver", DISPATCH_QUEUE_SERIAL);
+        _handlerQueue = dispatch_queue_create("io.context.webhookreceiver.handlers", DISPATCH_QUEUE_CONCURRENT);
+        _connections = [NSMutableSet set];
+        _pendingEvents = [NSMutableArray array];
+        _acceptedEventKeys = [NSMutableOrderedSet orderedSet];
+        _handlers = [NSMutableDictionary dictionary];
+    }
+    return self;
+}
+
+- (void)dealloc {
+    if (_listenSource) {
+        dispatch_source_cancel(_listenSource);
+    }
+    for (CIOWebhookConnection *connection in _connections) {
+        dispatch_source_cancel(connection.timeoutSource);
+        dispatch_source_cancel(connection.readSource);
+    }
+}
+
+- (void)addHandlerForEventType:(CIOWebhookEventType)type usingBlock:(void (^)(CIOWebhookEvent *))block {
+    dispatch_sync(self.queue, ^{
+      NSArray *handlers = self.handlers[@(type)] ?: @[];
+      self.handlers[@(type)] = [handlers arrayByAddingObject:[block copy]];
+    });
+}
+
+#pragma mark - Listening
+
+- (BOOL)startOnPort:(uint16_t)port error:(NSError **)error {
+    __block BOOL started = NO;
+    __block NSError *startError = nil;
+    dispatch_sync(self.queue, ^{
+      if (self.listenSource) {
+          started = YES;
+          return;
+      }
+      int fd = socket(AF_INET, SOCK_STREAM, 0);
+      if (fd < 0) {
+          startError = CIOPOSIXError();
+          return;
+      }
+      int yes = 1;
+      setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes));
+      struct sockaddr_in address;
+      memset(&address, 0, sizeof(address));
+      address.sin_len = sizeof(address);
+      address.sin_family = AF_INET;
+      address.sin_port = htons(port);
+      address.sin_addr.s_addr = htonl(self.localOnly ? INADDR_LOOPBACK : INADDR_ANY);
+      socklen_t length = sizeof(address);
+      if (bind(fd, (struct sockaddr *)&address, sizeof(address)) != 0 || listen(fd, SOMAXCONN) != 0 ||
+          getsockname(fd, (struct sockaddr *)&address, &length) != 0) {
+          startError = CIOPOSIXError();
+          close(fd);
+          return;
+      }
+      fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+      self.port = ntohs(address.sin_port);
+
+      dispatch_source_t source = dispatch_source_create(DISPATCH_SOURCE_TYPE_READ, (uintptr_t)fd, 0, self.queue);
+      __weak typeof(self) weakSelf = self;
+      dispatch_source_set_event_handler(source, ^{
+        [weakSelf _acceptConnectionsOnSocket:fd count:dispatch_source_get_data(source)];
+      });
+      dispatch_source_set_cancel_handler(source, ^{
+        close(fd);
+      });
+      self.listenSource = source;
+      dispatch_resume(source);
+      started = YES;
+    });
+    if (error) {
+        *error = startError;
+    }
+    return started;
+}
+
+- (void)stop {
+    dispatch_sync(self.queue, ^{
+      if (self.listenSource) {
+          dispatch_source_cancel(self.listenSource);
+          self.listenSource = nil;
+      }
+      for (CIOWebhookConnection *connection in self.connections) {
+          dispatch_source_cancel(connection.timeoutSource);
+          dispatch_source_cancel(connection.readSource);
+      }
+      [self.connections removeAllObjects];
+      self.port = 0;
+    });
+}
+
+- (void)_acceptConnectionsOnSocket:(int)listenFD count:(unsigned long)count {
+    for (unsigned long i = 0; i < MAX(count, 1ul); i++) {
+        int fd = accept(listenFD, NULL, NULL);
+        if (fd < 0) {
+            return;
+        }
+        int yes = 1;
+        setsockopt(fd, SOL_SOCKET, SO_NOSIGPIPE, &yes, sizeof(yes));
+        fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+
+        CIOWebhookConnection *connection = [CIOWebhookConnection new];
+        connection.fd = fd;
+        connection.buffer = [NSMutableData data];
+        connection.readSource = dispatch_source_create(DISPATCH_SOURCE_TYPE_READ, (uintptr_t)fd, 0, self.queue);
+        __weak typeof(self) weakSelf = self;
+        __weak CIOWebhookConnection *weakConnection = connection;
+        dispatch_source_set_event_handler(connection.readSource, ^{
+          [weakSelf _readFromConnection:weakConnection];
+        });
+        dispatch_source_set_cancel_handler(connection.readSource, ^{
+          close(fd);
+        });
+        connection.timeoutSource = dispatch_source_create(DISPATCH_SOURCE_TYPE_TIMER, 0, 0, self.queue);
+        dispatch_source_set_timer(connection.timeoutSource,
+                                  dispatch_time(DISPATCH_TIME_NOW, (int64_t)(self.requestTimeout * NSEC_PER_SEC)),
+                                  DISPATCH_TIME_FOREVER, NSEC_PER_SEC / 10);
+        dispatch_source_set_event_handler(connection.timeoutSource, ^{
+          [weakSelf _connectionTimedOut:weakConnection];
+        });
+        [self.connections addObject:connection];
+        dispatch_resume(connection.readSource);
+        dispatch_resume(connection.timeoutSource);
+    }
+}
+
+- (void)_readFromConnection:(CIOWebhookConnection *)connection {
+    if (!connection) {
+        return;
+    }
+    uint8_t bytes[16 * 1024];
+    ssize_t count;
+    while ((count = read(connection.fd, bytes, sizeof(bytes))) > 0) {
+        [connection.buffer appendBytes:bytes length:(NSUInteger)count];
+    }
+    BOOL closed = count == 0 || (count < 0 && errno != EAGAIN && errno != EWOULDBLOCK);
+    [self _processRequestOfConnection:connection];
+    if (closed && [self.connections containsObject:connection]) {
+        [self _closeConnection:connection response:nil];
+    }
+}
+
+- (void)_connectionTimedOut:(CIOWebhookConnection *)connection {
+    if (connection && [self.connections containsObject:connection]) {
+        [self _respondToConnection:connection status:408 reason:@"Request Timeout" headers:nil];
+    }
+}
+
+- (void)_closeConnection:(CIOWebhookConnection *)connection response:(NSData *)response {
+    if (response) {
+        // The response is written once reading has stopped, and the socket closed after it
+        int fd = connection.fd;
+        dispatch_source_set_cancel_handler(connection.readSource, ^{
+          dispatch_data_t data = dispatch_data_create(response.bytes, response.length, NULL, DISPATCH_DATA_DESTRUCTOR_DEFAULT);
+          dispatch_write(fd, data, dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^(dispatch_data_t rest, int e) {
+            close(fd);
+          });
+        });
+    }
+    dispatch_source_cancel(connection.timeoutSource);
+    dispatch_source_cancel(connection.readSource);
+    [self.connections removeObject:connection];
+}
+
+- (void)_respondToConnection:(CIOWebhookConnection *)connection
+                      status:(NSInteger)status
+                      reason:(NSString *)reason
+                     headers:(NSString *)headers {
+    NSString *response = [NSString stringWithFormat:@"HTTP/1.1 %ld %@\r\nContent-Length: 0\r\nConnection: close\r\n%@\r\n",
+                                                    (long)status, reason, headers ?: @""];
+    [self _closeConnection:connection response:[response dataUsingEncoding:NSUTF8StringEncoding]];
+}
+
+#pragma mark - Requests
+
+// Handles the request once it has been read completely
+- (void)_processRequestOfConnection:(CIOWebhookConnection *)connection {
+    NSData *separator = [@"\r\n\r\n" dataUsingEncoding:NSUTF8StringEncoding];
+    NSRange headerEnd = [connection.buffer rangeOfData:separator options:0 range:NSMakeRange(0, connection.buffer.length)];
+    if (headerEnd.location == NSNotFound) {
+        if (connection.buffer.length > kCIOWebhookMaximumHeaderLength) {
+            [self _respondToConnection:connection status:431 reason:@"Request Header Fields Too Large" headers:nil];
+        }
+        return;
+    }
+    NSString *head = [[NSString alloc] initWithData:[connection.buffer subdataWithRange:NSMakeRange(0, headerEnd.location)]
+                                           encoding:NSISOLatin1StringEncoding];
+    NSArray *lines = [head componentsSeparatedByString:@"\r\n"];
+    NSArray *requestLine = [lines.firstObject componentsSeparatedByString:@" "];
+    if (requestLine.count < 3) {
+        [self _respondToConnection:connection status:400 reason:@"Bad Request" headers:nil];
+        return;
+    }
+    if (![requestLine[0] isEqualToString:@"POST"]) {
+        [self _respondToConnection:connection status:405 reason:@"Method Not Allowed" headers:@"Allow: POST\r\n"];
+        return;
+    }
+    NSInteger contentLength = -1;
+    for (NSString *line in [lines subarrayWithRange:NSMakeRange(1, lines.count - 1)]) {
+        NSRange colon = [line rangeOfString:@":"];
+        if (colon.location != NSNotFound &&
+            [[line substringToIndex:colon.location] caseInsensitiveCompare:@"Content-Length"] == NSOrderedSame) {
+            contentLength = [[line substringFromIndex:NSMaxRange(colon)] integerValue];
+        }
+    }
+    if (contentLength < 0) {
+        [self _respondToConnection:connection status:411 reason:@"Length Required" headers:nil];
+        return;
+    }
+    if ((NSUInteger)contentLength > kCIOWebhookMaximumBodyLength) {
+        [self _respondToConnection:connection status:413 reason:@"Payload Too Large" headers:nil];
+        return;
+    }
+    NSUInteger bodyStart = NSMaxRange(headerEnd);
+    if (connection.buffer.length < bodyStart + (NSUInteger)contentLength) {
+        return;
+    }
+    NSData *body = [connection.buffer subdataWithRange:NSMakeRange(bodyStart, (NSUInteger)contentLength)];
+
+    NSError *error = nil;
+    CIOWebhookEvent *event = [self eventFromBody:body error:&error];
+    if (!event) {
+        [self _respondToConnection:connection
+                            status:error.code
+                            reason:error.code == 401 ? @"Unauthorized" : @"Bad Request"
+                           headers:nil];
+        return;
+    }
+    NSString *eventKey = CIOWebhookEventKey(event);
+    if (eventKey && [self.acceptedEventKeys containsObject:eventKey]) {
+        [self _respondToConnection:connection status:200 reason:@"OK" headers:nil];
+        return;
+    }
+    if (self.pendingEvents.count + self.runningHandlers >= self.maximumPendingEvents) {
+        [self _respondToConnection:connection status:503 reason:@"Service Unavailable" headers:@"Retry-After: 5\r\n"];
+        return;
+    }
+    if (eventKey) {
+        [self.acceptedEventKeys addObject:eventKey];
+        while (self.acceptedEventKeys.count > self.deduplicationCapacity) {
+            [self.acceptedEventKeys removeObjectAtIndex:0];
+        }
+    }
+    [self.pendingEvents addObject:event];
+    [self _startHandlers];
+    [self _respondToConnection:connection status:200 reason:@"OK" headers:nil];
+}
+
+- (CIOWebhookEvent *)eventFromBody:(NSData *)body error:(NSError **)error {
+    NSDictionary *payload = [NSJSONSerialization JSONObjectWithData:body options:0 error:nil];
+    if (![payload isKindOfClass:[NSDictionary class]]) {
+        if (error) {
+            *error = CIOWebhookError(400, @"Webhook callback is not a JSON object");
+        }
+        return nil;
+    }
+    NSString *timestamp = CIOStringValue(payload[@"timestamp"]);
+    NSString *token = CIOStringValue(payload[@"token"]);
+    NSString *signature = CIOStringValue(payload[@"signature"]);
+    if (!timestamp || !token || !signature ||
+        !CIOConstantTimeEqual(CIOHexHMACSHA256(self.consumerSecret, [timestamp stringByAppendingString:token]),
+                              signature)) {
+        if (error) {
+            *error = CIOWebhookError(401, @"Webhook callback signature is missing or invalid");
+        }
+        return nil;
+    }
+    NSDate *date = [NSDate dateWithTimeIntervalSince1970:timestamp.doubleValue];
+    if (self.timestampTolerance > 0 && fabs(date.timeIntervalSinceNow) > self.timestampTolerance) {
+        if (error) {
+            *error = CIOWebhookError(401, @"Webhook callback timestamp is too far from the current time");
+        }
+        return nil;
+    }
+
+    CIOWebhookEvent *event = [CIOWebhookEvent new];
+    event.payload = payload;
+    event.timestamp = date;
+    event.webhookID = CIOStringValue(payload[@"webhook_id"]);
+    event.accountID = CIOStringValue(payload[@"account_id"]);
+    NSDictionary *messageData = payload[@"message_data"];
+    if ([messageData isKindOfClass:[NSDictionary class]]) {
+        event.type = CIOWebhookEventTypeMessage;
+        event.messageData = messageData;
+        event.messageID = CIOStringValue(messageData[@"message_id"]) ?: CIOStringValue(messageData[@"email_message_id"]);
+    } else {
+        event.type = CIOWebhookEventTypeFailure;
+    }
+    return event;
+}
+
+#pragma mark - Handlers
+
+- (void)_startHandlers {
+    while (self.pendingEvents.count > 0 && self.runningHandlers < MAX(self.maximumConcurrentHandlers, 1u)) {
+        CIOWebhookEvent *event = self.pendingEvents.firstObject;
+        [self.pendingEvents removeObjectAtIndex:0];
+        self.runningHandlers++;
+        NSArray *handlers = self.handlers[@(event.type)];
+        dispatch_async(self.handlerQueue, ^{
+          for (void (^handler)(CIOWebhookEvent *) in handlers) {
+              handler(event);
+          }
+          dispatch_async(self.queue, ^{
+            self.runningHandlers--;
+            [self _startHandlers];
+          });
+        });
+    }
+}
+
+@end
@@ -7,6 +7,7 @@
 //
 
 #import "CIOAPISession.h"
+#import "CIOJSONProjection.h"
 #import <XCTest/XCTest.h>
 
 @interface CIOAPISessionTests : XCTestCase
@@ -47,6 +48,20 @@
     XCTAssertEqualObjects(error.localizedDescription, @"error string");
 }
 
+- (void)testProjectionOnlyAppliesToSuccessfulResponses {
+    NSData *data = [NSJSONSerialization dataWithJSONObject:@{@"type": @"error", @"value": @"error string"} options:0 error:nil];
+    NSURL *url = [NSURL URLWithString:@"https://api.context.io/2.0/account/12"];
+    NSDictionary *header = @{@"Content-Type": @"application/json"};
+    CIOJSONProjection *projection = [[CIOJSONProjection alloc] initWithKeyPaths:[NSSet setWithObject:@"type"]];
+    NSURLResponse *response = [[NSHTTPURLResponse alloc] initWithURL:url statusCode:200 HTTPVersion:@"1.1" headerFields:header];
+    NSError *error = nil;
+    XCTAssertEqualObjects([self.session parseResponse:response data:data projection:projection error:&error], @{@"type": @"error"});
+    XCTAssertNil(error);
+    response = [[NSHTTPURLResponse alloc] initWithURL:url statusCode:402 HTTPVersion:@"1.1" headerFields:header];
+    [self.session parseResponse:response data:data projection:projection error:&error];
+    XCTAssertEqualObjects(error.localizedDescription, @"error string");
+}
+
 - (void)testEmptyDataSuccess {
     NSURL *url = [NSURL URLWithString:@"https://api.context.io/2.0/account/12"];
     NSDictionary *header = @{@"Content-Type": @"application/json"};
@@ -77,5 +92,41 @@
     XCTAssertEqualObjects(error.localizedDescription, expectedError);
 }
 
+- (void)testPrewarmReportsTransportErrors {
+    XCTAssertEqual(self.session.heartbeatInterval, 0);
+    XCTAssertEqual(self.session.keepAliveDuration, 300);
+    XCTestExpectation *expectation = [self expectationWithDescription:@"prewarm"];
+    // Nothing listens on port 1
+    [self.session prewarmConnectionsToURL:[NSURL URLWithString:@"http://127.0.0.1:1/"]
+                                    count:2
+                               completion:^(NSError *error) {
+                                 XCTAssertTrue([NSThread isMainThread]);
+                                 XCTAssertNotNil(error);
+                                 [expectation fulfill];
+                               }];
+    [self waitForExpectationsWithTimeout:5 handler:nil];
+    XCTAssertEqual(self.session.requestCount, 0u);
+    XCTAssertEqual(self.session.connectionReuseRate, 0);
+    // Without heartbeats, hosts are not tracked
+    XCTAssertEqual([[self.session valueForKey:@"lastUseDates"] count], 0u);
+}
+
+- (void)testHeartbeatsStopAfterKeepAlive {
+    self.session.heartbeatInterval = 0.1;
+    [self.session executeRequest:[NSURLRequest requestWithURL:[NSURL URLWithString:@"http://127.0.0.1:1/accounts"]]
+                         success:^(id responseObject) {
+                         }
+                         failure:^(NSError *error) {
+                         }];
+    [[NSRunLoop currentRunLoop] runUntilDate:[NSDate dateWithTimeIntervalSinceNow:0.5]];
+    NSUInteger heartbeatCount = self.session.heartbeatCount;
+    XCTAssertGreaterThan(heartbeatCount, 0u);
+
+    self.session.keepAliveDuration = 0;
+    [[NSRunLoop currentRunLoop] runUntilDate:[NSDate dateWithTimeIntervalSinceNow:0.3]];
+    XCTAssertEqual(self.session.heartbeatCount, heartbeatCount);
+    XCTAssertNil([self.session valueForKey:@"heartbeatTimer"], @"the timer stops with the last host kept alive");
+    self.session.heartbeatInterval = 0;
+}
 
 @end
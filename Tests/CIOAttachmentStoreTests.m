@@ -0,0 +1,133 @@
+//
+//  CIOAttachmentStoreTests.m
+//  CIOAPIClient
+//
+//  Copyright © 2015 Context.io. All rights reserved.
+//
+
+#import <XCTest/XCTest.h>
+#import "CIOAttachmentStore.h"
+
+@interface CIOAttachmentStoreTests : XCTestCase
+
+@property (nonatomic) NSURL *directoryURL;
+@property (nonatomic) CIOAttachmentStore *store;
+
+@end
+
+@implementation CIOAttachmentStoreTests
+
+- (void)setUp {
+    [super setUp];
+    NSString *path = [NSTemporaryDirectory() stringByAppendingPathComponent:[[NSUUID UUID] UUIDString]];
+    self.directoryURL = [NSURL fileURLWithPath:path isDirectory:YES];
+    self.store = [[CIOAttachmentStore alloc] initWithDirectoryURL:self.directoryURL byteBudget:1024];
+}
+
+- (void)tearDown {
+    [[NSFileManager defaultManager] removeItemAtURL:self.directoryURL error:nil];
+    [super tearDown];
+}
+
+- (NSURL *)temporaryURL {
+    return [self.directoryURL URLByAppendingPathComponent:[[NSUUID UUID] UUIDString]];
+}
+
+// Writes `string` to a new file, as a finished download would
+- (NSURL *)downloadedFileWithString:(NSString *)string {
+    NSURL *fileURL = [self temporaryURL];
+    [[string dataUsingEncoding:NSUTF8StringEncoding] writeToURL:fileURL atomically:YES];
+    return fileURL;
+}
+
+- (NSString *)stringAtURL:(NSURL *)fileURL {
+    return [NSString stringWithContentsOfURL:fileURL encoding:NSUTF8StringEncoding error:nil];
+}
+
+- (void)testStoreAndWrite {
+    NSError *error = nil;
+    NSString *hash = [self.store storeFileAtURL:[self downloadedFileWithString:@"hello"] forKey:@"a" error:&error];
+    XCTAssertEqualObjects(hash, @"2cf24dba5fb0a30e26e83b2ac5b9e29e1b161e5c1fa7425e73043362938b9824");
+    XCTAssertTrue([self.store containsContentForKey:@"a"]);
+
+    NSURL *destination = [self temporaryURL];
+    XCTAssertTrue([self.store writeContentForKey:@"a" toFileURL:destination error:&error]);
+    XCTAssertEqualObjects([self stringAtURL:destination], @"hello");
+    XCTAssertFalse([self.store writeContentForKey:@"a" toFileURL:destination error:&error]);
+    XCTAssertFalse([self.store writeContentForKey:@"b" toFileURL:[self temporaryURL] error:&error]);
+    XCTAssertEqual(self.store.hitCount, 2u);
+    XCTAssertEqual(self.store.missCount, 1u);
+}
+
+- (void)testDeduplication {
+    [self.store storeFileAtURL:[self downloadedFileWithString:@"same"] forKey:@"a" error:nil];
+    NSURL *duplicate = [self downloadedFileWithString:@"same"];
+    [self.store storeFileAtURL:duplicate forKey:@"b" error:nil];
+    XCTAssertFalse([[NSFileManager defaultManager] fileExistsAtPath:duplicate.path]);
+    XCTAssertEqualObjects([self.store contentHashForKey:@"a"], [self.store contentHashForKey:@"b"]);
+    XCTAssertEqual(self.store.storedBytes, 4u);
+    XCTAssertEqual(self.store.bytesSaved, 4u);
+    XCTAssertEqualWithAccuracy(self.store.deduplicationRatio, 2.0, 0.001);
+
+    [self.store removeContentForKey:@"a"];
+    XCTAssertTrue([self.store containsContentForKey:@"b"]);
+    [self.store removeContentForKey:@"b"];
+    XCTAssertEqual(self.store.storedBytes, 0u);
+    XCTAssertEqualWithAccuracy(self.store.deduplicationRatio, 1.0, 0.001);
+}
+
+- (void)testLeastRecentlyUsedEviction {
+    NSString *padding = [@"" stringByPaddingToLength:600 withString:@"x" startingAtIndex:0];
+    [self.store storeFileAtURL:[self downloadedFileWithString:[padding stringByAppendingString:@"1"]]
+                        forKey:@"old"
+                         error:nil];
+    [self.store storeFileAtURL:[self downloadedFileWithString:[padding stringByAppendingString:@"2"]]
+                        forKey:@"new"
+                         error:nil];
+    XCTAssertFalse([self.store containsContentForKey:@"old"]);
+    XCTAssertTrue([self.store containsContentForKey:@"new"]);
+    XCTAssertLessThanOrEqual(self.store.storedBytes, 1024u);
+}
+
+- (void)testPersistence {
+    [self.store storeFileAtURL:[self downloadedFileWithString:@"kept"] forKey:@"a" error:nil];
+    CIOAttachmentStore *reopened = [[CIOAttachmentStore alloc] initWithDirectoryURL:self.directoryURL byteBudget:1024];
+    NSURL *destination = [self temporaryURL];
+    XCTAssertTrue([reopened writeContentForKey:@"a" toFileURL:destination error:nil]);
+    XCTAssertEqualObjects([self stringAtURL:destination], @"kept");
+}
+
+- (void)testHitsAreSavedOnDealloc {
+    @autoreleasepool {
+        [self.store storeFileAtURL:[self downloadedFileWithString:@"kept"] forKey:@"a" error:nil];
+        [self.store writeContentForKey:@"a" toFileURL:[self temporaryURL] error:nil];
+        self.store = nil;
+    }
+    CIOAttachmentStore *reopened = [[CIOAttachmentStore alloc] initWithDirectoryURL:self.directoryURL byteBudget:1024];
+    XCTAssertEqual(reopened.bytesSaved, 4u);
+}
+
+- (void)testWritingPlacedFilesLeavesTheStoreIntact {
+    [self.store storeFileAtURL:[self downloadedFileWithString:@"kept"] forKey:@"a" error:nil];
+    NSURL *destination = [self temporaryURL];
+    XCTAssertTrue([self.store writeContentForKey:@"a" toFileURL:destination error:nil]);
+    NSFileHandle *handle = [NSFileHandle fileHandleForWritingToURL:destination error:nil];
+    [handle writeData:[@"lost" dataUsingEncoding:NSUTF8StringEncoding]];
+    [handle closeFile];
+
+    NSURL *again = [self temporaryURL];
+    XCTAssertTrue([self.store writeContentForKey:@"a" toFileURL:again error:nil]);
+    XCTAssertEqualObjects([self stringAtURL:again], @"kept");
+}
+
+- (void)testCopyingInsteadOfCloning {
+    NSString *hash = [self.store storeFileAtURL:[self downloadedFileWithString:@"copy"] forKey:@"a" error:nil];
+    self.store.clonesFiles = NO;
+    NSURL *destination = [self temporaryURL];
+    XCTAssertTrue([self.store writeContentWithHash:hash toFileURL:destination error:nil]);
+    NSDictionary *attributes = [[NSFileManager defaultManager] attributesOfItemAtPath:destination.path error:nil];
+    XCTAssertEqual([attributes[NSFileReferenceCount] integerValue], 1);
+    XCTAssertEqual(self.store.hitCount, 0u);
+}
+
+@end
@@ -0,0 +1,367 @@
+//
+//  CIOBenchmarkTests.m
+//  CIOAPIClient
+//
+//  Copyright © 2015 Context.io. All rights reserved.
+//
+
+#import <XCTest/XCTest.h>
+#import "CIOV2Client.h"
+#import "CIOAPISession.h"
+#import "CIOJSONProjection.h"
+#import "CIOStubServer.h"
+#import "TDOAuth.h"
+
+// Benchmarks are slow, so they only run when CIO_BENCHMARKS is set in the environment of the test run, e.g. through
+// TEST_RUNNER_CIO_BENCHMARKS=1 with xcodebuild. Results are written as JSON to the path in CIO_BENCHMARK_OUTPUT, or to
+// `cio-benchmarks.json` in the temporary directory. When CIO_BENCHMARK_BASELINE names the results of an earlier run,
+// metrics more than CIO_BENCHMARK_TOLERANCE (default 0.2, i.e. 20%) worse fail their test.
+
+static NSTimeInterval const kCIOBenchmarkDuration = 1;
+static NSUInteger const kCIOBenchmarkRequestCount = 400;
+
+static NSString *CIOBenchmarkEnvironment(NSString *name) {
+    return [NSProcessInfo processInfo].environment[name];
+}
+
+// Runs `operation` repeatedly for at least `duration` seconds after warming up, returning how many ran per second
+static double CIOOperationsPerSecond(NSTimeInterval duration, void (^operation)(void)) {
+    for (NSUInteger i = 0; i < 100; i++) {
+        @autoreleasepool {
+            operation();
+        }
+    }
+    NSUInteger count = 0;
+    CFAbsoluteTime start = CFAbsoluteTimeGetCurrent();
+    CFAbsoluteTime elapsed;
+    do {
+        @autoreleasepool {
+            for (NSUInteger i = 0; i < 100; i++) {
+                operation();
+            }
+        }
+        count += 100;
+        elapsed = CFAbsoluteTimeGetCurrent() - start;
+    } while (elapsed < duration);
+    return count / elapsed;
+}
+
+static double CIOPercentile(NSArray *sortedValues, double percentile) {
+    NSUInteger index = MIN(sortedValues.count - 1, (NSUInteger)(percentile * sortedValues.count));
+    return [sortedValues[index] doubleValue];
+}
+
+#pragma mark -
+
+/**
+ Results of the run, shared by all benchmarks and written out after each metric, so a crash keeps earlier ones.
+ */
+@interface CIOBenchmarkReport : NSObject
+
++ (instancetype)sharedReport;
+
+@property (readonly, nonatomic) NSURL *outputURL;
+// Metric name -> value, from the baseline file if any
+@property (readonly, nonatomic) NSDictionary *baselineValues;
+@property (readonly, nonatomic) double tolerance;
+
+/**
+ *  Records a metric, returning a description of the regression if it is worse than the baseline by more than the
+ * tolerance, or `nil`.
+ */
+- (NSString *)recordMetric:(NSString *)name
+                     value:(double)value
+                      unit:(NSString *)unit
+            higherIsBetter:(BOOL)higherIsBetter;
+
+@end
+
+@interface CIOBenchmarkReport ()
+
+@property (nonatomic) NSMutableDictionary *metrics;
+
+@end
+
+@implementation CIOBenchmarkReport
+
++ (instancetype)sharedReport {
+    static CIOBenchmarkReport *report;
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+      report = [self new];
+    });
+    return report;
+}
+
+- (instancetype)init {
+    if ((self = [super init])) {
+        NSString *outputPath = CIOBenchmarkEnvironment(@"CIO_BENCHMARK_OUTPUT")
+                                   ?: [NSTemporaryDirectory() stringByAppendingPathComponent:@"cio-benchmarks.json"];
+        _outputURL = [NSURL fileURLWithPath:outputPath];
+        NSString *tolerance = CIOBenchmarkEnvironment(@"CIO_BENCHMARK_TOLERANCE");
+        _tolerance = tolerance ? tolerance.doubleValue : 0.2;
+        _metrics = [NSMutableDictionary dictionary];
+
+        NSMutableDictionary *baselineValues = [NSMutableDictionary dictionary];
+        NSString *baselinePath = CIOBenchmarkEnvironment(@"CIO_BENCHMARK_BASELINE");
+        NSData *baseline = baselinePath ? [NSData dataWithContentsOfFile:baselinePath] : nil;
+        NSDictionary *baselineMetrics =
+            baseline ? [NSJSONSerialization JSONObjectWithData:baseline options:0 error:NULL][@"metrics"] : nil;
+        for (NSString *name in baselineMetrics) {
+            baselineValues[name] = baselineMetrics[name][@"value"];
+        }
+        _baselineValues = baselineValues;
+    }
+    return self;
+}
+
+- (NSString *)recordMetric:(NSString *)name
+                     value:(double)value
+                      unit:(NSString *)unit
+            higherIsBetter:(BOOL)higherIsBetter {
+    NSMutableDictionary *metric =
+        [@{@"value": @(value), @"unit": unit, @"higher_is_better": @(higherIsBetter)} mutableCopy];
+    NSString *regression = nil;
+    NSNumber *baseline = self.baselineValues[name];
+    if (baseline.doubleValue > 0) {
+        double change = value / baseline.doubleValue - 1;
+        metric[@"baseline"] = baseline;
+        metric[@"change"] = @(change);
+        if ((higherIsBetter ? -change : change) > self.tolerance) {
+            regression = [NSString stringWithFormat:@"%@ regressed from %.4g to %.4g %@ (%+.1f%%)", name,
+                                                    baseline.doubleValue, value, unit, change * 100];
+        }
+    }
+    @synchronized(self) {
+        self.metrics[name] = metric;
+        NSProcessInfo *processInfo = [NSProcessInfo processInfo];
+        NSDictionary *results = @{
+            @"date": @([[NSDate date] timeIntervalSince1970]),
+            @"host": @{
+                @"os": processInfo.operatingSystemVersionString,
+                @"processors": @(processInfo.activeProcessorCount),
+            },
+            @"tolerance": @(self.tolerance),
+            @"metrics": self.metrics,
+        };
+        NSData *data = [NSJSONSerialization dataWithJSONObject:results options:NSJSONWritingPrettyPrinted error:NULL];
+        [data writeToURL:self.outputURL atomically:YES];
+    }
+    NSLog(@"Benchmark %@: %.4g %@", name, value, unit);
+    return regression;
+}
+
+@end
+
+#pragma mark -
+
+@interface CIOBenchmarkTests : XCTestCase
+
+@property (nonatomic) CIOStubServer *server;
+@property (nonatomic) CIOV2Client *client;
+
+@end
+
+@implementation CIOBenchmarkTests
+
++ (XCTestSuite *)defaultTestSuite {
+    if (!CIOBenchmarkEnvironment(@"CIO_BENCHMARKS")) {
+        return [XCTestSuite testSuiteWithName:NSStringFromClass(self)];
+    }
+    return [super defaultTestSuite];
+}
+
+- (void)setUp {
+    [super setUp];
+    self.server = [[CIOStubServer alloc] initWithFixturesURL:[CIOStubServer defaultFixturesURL]];
+    NSError *error = nil;
+    XCTAssertTrue([self.server startWithError:&error], @"%@", error);
+    NSString *baseURLString = [NSURL URLWithString:@"2.0/" relativeToURL:self.server.URL].absoluteString;
+    self.client = [[CIOV2Client alloc] initWithBaseURLString:baseURLString
+                                                 consumerKey:@"consumer_key"
+                                              consumerSecret:@"consumer_secret"
+                                                       token:@"token"
+                                                 tokenSecret:@"token_secret"
+                                                   accountID:@"anAccountId"];
+    self.client.URLScheme = @"http";
+}
+
+- (void)tearDown {
+    [self.server stop];
+    [super tearDown];
+}
+
+- (void)recordMetric:(NSString *)name value:(double)value unit:(NSString *)unit higherIsBetter:(BOOL)higherIsBetter {
+    NSString *regression =
+        [[CIOBenchmarkReport sharedReport] recordMetric:name value:value unit:unit higherIsBetter:higherIsBetter];
+    if (regression) {
+        XCTFail(@"%@", regression);
+    }
+}
+
+// A page of 100 messages, as returned for a folder listing
+- (NSData *)messagePageData {
+    NSURL *fixtureURL = [[CIOStubServer defaultFixturesURL] URLByAppendingPathComponent:@"2.0/messages.json"];
+    NSArray *fixtures = [NSJSONSerialization JSONObjectWithData:[NSData dataWithContentsOfURL:fixtureURL]
+                                                        options:0
+                                                          error:NULL];
+    NSMutableArray *page = [NSMutableArray array];
+    for (NSUInteger i = 0; page.count < 100; i++) {
+        NSMutableDictionary *message = [fixtures[i % fixtures.count] mutableCopy];
+        message[@"message_id"] = [NSString stringWithFormat:@"%@%lu", message[@"message_id"], (unsigned long)i];
+        [page addObject:message];
+    }
+    return [NSJSONSerialization dataWithJSONObject:page options:0 error:NULL];
+}
+
+#pragma mark - Micro benchmarks
+
+- (void)testSigning {
+    NSDictionary *parameters = @{@"limit": @100, @"include_body": @1, @"folder": @"INBOX", @"date_after": @1456789012};
+    double rate = CIOOperationsPerSecond(kCIOBenchmarkDuration, ^{
+      [TDOAuth URLRequestForPath:@"/2.0/accounts/anAccountId/messages"
+                      parameters:parameters
+                            host:@"api.context.io"
+                     consumerKey:@"consumer_key"
+                  consumerSecret:@"consumer_secret"
+                     accessToken:@"token"
+                     tokenSecret:@"token_secret"
+                          scheme:@"https"
+                   requestMethod:@"GET"
+                    dataEncoding:TDOAuthContentTypeUrlEncodedForm
+                    headerValues:@{@"Accept": @"application/json"}
+                 signatureMethod:TDOAuthSignatureMethodHmacSha1];
+    });
+    [self recordMetric:@"signing" value:rate unit:@"ops/s" higherIsBetter:YES];
+}
+
+- (void)testRequestParameters {
+    CIOMessagesRequest *request = [self.client getMessages];
+    request.folder = @"INBOX";
+    request.include_body = YES;
+    request.include_flags = YES;
+    request.date_after = [NSDate dateWithTimeIntervalSince1970:1456789012];
+    request.limit = 100;
+    double rate = CIOOperationsPerSecond(kCIOBenchmarkDuration, ^{
+      [request parameters];
+    });
+    [self recordMetric:@"request_parameters" value:rate unit:@"ops/s" higherIsBetter:YES];
+}
+
+- (void)testParseResponse {
+    NSData *data = [self messagePageData];
+    NSHTTPURLResponse *response = [[NSHTTPURLResponse alloc] initWithURL:[NSURL URLWithString:@"https://api.context.io"]
+                                                              statusCode:200
+                                                             HTTPVersion:@"HTTP/1.1"
+                                                            headerFields:@{@"Content-Type": @"application/json"}];
+    CIOAPISession *session = [[CIOAPISession alloc] init];
+    double rate = CIOOperationsPerSecond(kCIOBenchmarkDuration, ^{
+      [session parseResponse:response data:data error:NULL];
+    });
+    [self recordMetric:@"parse_response" value:rate * data.length / 1e6 unit:@"MB/s" higherIsBetter:YES];
+
+    CIOJSONProjection *projection =
+        [[CIOJSONProjection alloc] initWithKeyPaths:[NSSet setWithObjects:@"message_id", @"subject", @"date", nil]];
+    rate = CIOOperationsPerSecond(kCIOBenchmarkDuration, ^{
+      [session parseResponse:response data:data projection:projection error:NULL];
+    });
+    [self recordMetric:@"parse_response_projected" value:rate * data.length / 1e6 unit:@"MB/s" higherIsBetter:YES];
+}
+
+// The projection against a full parse of the same page, both without the session's response handling around them
+- (void)testJSONProjection {
+    NSData *data = [self messagePageData];
+    double fullRate = CIOOperationsPerSecond(kCIOBenchmarkDuration, ^{
+      [NSJSONSerialization JSONObjectWithData:data options:0 error:NULL];
+    });
+    [self recordMetric:@"json_full_parse" value:fullRate * data.length / 1e6 unit:@"MB/s" higherIsBetter:YES];
+
+    // What a message list shows
+    NSSet *keyPaths = [NSSet setWithObjects:@"message_id", @"subject", @"date", @"folders", @"addresses.from", nil];
+    CIOJSONProjection *projection = [[CIOJSONProjection alloc] initWithKeyPaths:keyPaths];
+    XCTAssertNotNil([projection objectWithData:data error:NULL]);
+    double projectedRate = CIOOperationsPerSecond(kCIOBenchmarkDuration, ^{
+      [projection objectWithData:data error:NULL];
+    });
+    [self recordMetric:@"json_projection" value:projectedRate * data.length / 1e6 unit:@"MB/s" higherIsBetter:YES];
+    [self recordMetric:@"json_projection_speedup" value:projectedRate / fullRate unit:@"x" higherIsBetter:YES];
+}
+
+#pragma mark - End to end
+
+// Sends `kCIOBenchmarkRequestCount` message listings with at most `concurrency` in flight
+- (void)measureRequestsWithConcurrency:(NSUInteger)concurrency {
+    NSURLSessionConfiguration *configuration = [NSURLSessionConfiguration ephemeralSessionConfiguration];
+    configuration.HTTPMaximumConnectionsPerHost = (NSInteger)concurrency;
+    self.client.session = [[CIOAPISession alloc] initWithConfiguration:configuration];
+
+    XCTestExpectation *expectation = [self expectationWithDescription:@"requests"];
+    NSMutableArray *latencies = [NSMutableArray arrayWithCapacity:kCIOBenchmarkRequestCount];
+    __block NSUInteger started = 0;
+    __block NSUInteger failures = 0;
+    __block void (^startNext)(void);
+    __weak typeof(self) weakSelf = self;
+    void (^next)(void) = ^{
+      if (started == kCIOBenchmarkRequestCount) {
+          return;
+      }
+      started++;
+      CFAbsoluteTime requestStart = CFAbsoluteTimeGetCurrent();
+      void (^finish)(void) = ^{
+        [latencies addObject:@(CFAbsoluteTimeGetCurrent() - requestStart)];
+        if (latencies.count == kCIOBenchmarkRequestCount) {
+            [expectation fulfill];
+        } else {
+            startNext();
+        }
+      };
+      CIOV2Client *client = weakSelf.client;
+      [client.session executeRequest:[client requestForCIORequest:[client getMessages]]
+          success:^(id responseObject) {
+            finish();
+          }
+          failure:^(NSError *error) {
+            failures++;
+            finish();
+          }];
+    };
+    startNext = next;
+
+    CFAbsoluteTime start = CFAbsoluteTimeGetCurrent();
+    for (NSUInteger i = 0; i < concurrency; i++) {
+        next();
+    }
+    [self waitForExpectationsWithTimeout:60 handler:nil];
+    CFAbsoluteTime elapsed = CFAbsoluteTimeGetCurrent() - start;
+    startNext = nil;
+    XCTAssertEqual(failures, 0u);
+
+    [latencies sortUsingSelector:@selector(compare:)];
+    NSString *prefix = [NSString stringWithFormat:@"requests_c%lu", (unsigned long)concurrency];
+    [self recordMetric:[prefix stringByAppendingString:@"_throughput"]
+                 value:kCIOBenchmarkRequestCount / elapsed
+                  unit:@"requests/s"
+        higherIsBetter:YES];
+    [self recordMetric:[prefix stringByAppendingString:@"_p50"]
+                 value:CIOPercentile(latencies, 0.5) * 1000
+                  unit:@"ms"
+        higherIsBetter:NO];
+    [self recordMetric:[prefix stringByAppendingString:@"_p99"]
+                 value:CIOPercentile(latencies, 0.99) * 1000
+                  unit:@"ms"
+        higherIsBetter:NO];
+}
+
+- (void)testRequestsSerially {
+    [self measureRequestsWithConcurrency:1];
+}
+
+- (void)testRequestsWithConcurrency4 {
+    [self measureRequestsWithConcurrency:4];
+}
+
+- (void)testRequestsWithConcurrency16 {
+    [self measureRequestsWithConcurrency:16];
+}
+
+@end
@@ -0,0 +1,150 @@
+//
+//  CIOBulkFolderUpdateTests.m
+//  CIOAPIClient
+//
+//  Copyright © 2015 Context.io. All rights reserved.
+//
+
+#import <XCTest/XCTest.h>
+#import "CIOV2Client.h"
+#import "CIOMessageThreader.h"
+#import "CIOBulkFolderUpdate.h"
+
+// Answers folder updates shortly after they are made, failing those `failsBlock` picks, and tracks how many are running
+@interface CIOFolderUpdateClient : CIOV2Client
+
+@property (nonatomic, copy) BOOL (^failsBlock)(CIODictionaryRequest *request);
+@property (nonatomic) NSUInteger requestCount;
+@property (nonatomic) NSUInteger runningCount;
+@property (nonatomic) NSUInteger maximumRunningCount;
+
+@end
+
+@implementation CIOFolderUpdateClient
+
+- (void)executeDictionaryRequest:(CIODictionaryRequest *)request
+                         success:(void (^)(NSDictionary *))success
+                         failure:(void (^)(NSError *))failure {
+    self.requestCount++;
+    self.runningCount++;
+    self.maximumRunningCount = MAX(self.maximumRunningCount, self.runningCount);
+    BOOL fails = self.failsBlock && self.failsBlock(request);
+    dispatch_after(dispatch_time(DISPATCH_TIME_NOW, (int64_t)(0.01 * NSEC_PER_SEC)), dispatch_get_main_queue(), ^{
+      self.runningCount--;
+      if (fails) {
+          failure([NSError errorWithDomain:NSURLErrorDomain code:NSURLErrorBadServerResponse userInfo:nil]);
+      } else {
+          success(@{@"success": @YES});
+      }
+    });
+}
+
+@end
+
+@interface CIOBulkFolderUpdateTests : XCTestCase
+
+@property (nonatomic) CIOFolderUpdateClient *client;
+@property (nonatomic) CIOMessageThreader *threader;
+@property (nonatomic) CIOBulkFolderUpdate *update;
+
+@end
+
+@implementation CIOBulkFolderUpdateTests
+
+- (void)setUp {
+    [super setUp];
+    self.client = [[CIOFolderUpdateClient alloc] initWithConsumerKey:@"consumer_key" consumerSecret:@"consumer_secret"];
+    [self.client setValue:@"anAccountId" forKey:@"accountID"];
+    self.threader = [[CIOMessageThreader alloc] initWithClient:self.client store:nil];
+    [self.threader addMessages:@[
+        @{@"message_id": @"a1", @"email_message_id": @"<a1@x>", @"date": @1, @"gmail_thread_id": @"t1"},
+        @{@"message_id": @"a2", @"email_message_id": @"<a2@x>", @"date": @2, @"gmail_thread_id": @"t1"},
+        @{@"message_id": @"b1", @"email_message_id": @"<b1@x>", @"date": @3, @"gmail_thread_id": @"t2"},
+        @{@"message_id": @"b2", @"email_message_id": @"<b2@x>", @"date": @4, @"gmail_thread_id": @"t2"},
+        @{@"message_id": @"c1", @"email_message_id": @"<c1@x>", @"date": @5},
+        @{@"message_id": @"d1", @"email_message_id": @"<d1@x>", @"date": @6, @"gmail_thread_id": @"t3"},
+    ] accountID:@"anAccountId"];
+    self.update = [[CIOBulkFolderUpdate alloc] initWithClient:self.client threader:self.threader];
+}
+
+- (void)tearDown {
+    [self.client clearCredentials];
+    [super tearDown];
+}
+
+- (void)testCollapsesAndDeduplicates {
+    NSArray *requests = [self.update requestsForMessagesWithIDs:@[@"a1", @"a2", @"b1", @"c1", @"c1", @"d1"]
+                                                      threadIDs:@[@"gm-t3", @"gm-t3"]
+                                                     addFolders:@[@"Archive"]
+                                                  removeFolders:@[@"INBOX"]];
+    XCTAssertEqualObjects([requests valueForKey:@"path"], (@[
+                              @"accounts/anAccountId/threads/gm-t3/folders",
+                              @"accounts/anAccountId/threads/gm-t1/folders",
+                              @"accounts/anAccountId/messages/b1/folders",
+                              @"accounts/anAccountId/messages/c1/folders",
+                          ]));
+    for (CIODictionaryRequest *request in requests) {
+        XCTAssertEqualObjects(request.parameters, (@{@"add": @"Archive", @"remove": @"INBOX"}));
+    }
+}
+
+- (void)testWithoutThreader {
+    CIOBulkFolderUpdate *update = [[CIOBulkFolderUpdate alloc] initWithClient:self.client threader:nil];
+    NSArray *requests =
+        [update requestsForMessagesWithIDs:@[@"a1", @"a2"] threadIDs:nil addFolders:@[@"Archive"] removeFolders:nil];
+    XCTAssertEqualObjects([requests valueForKey:@"path"], (@[
+                              @"accounts/anAccountId/messages/a1/folders",
+                              @"accounts/anAccountId/messages/a2/folders",
+                          ]));
+}
+
+- (void)testOneCallPerFolder {
+    NSArray *requests = [self.update requestsForMessagesWithIDs:@[@"c1"]
+                                                      threadIDs:nil
+                                                     addFolders:@[@"Archive", @"Later"]
+                                                  removeFolders:@[@"INBOX"]];
+    XCTAssertEqualObjects([requests valueForKey:@"parameters"], (@[
+                              @{@"add": @"Archive", @"remove": @"INBOX"},
+                              @{@"add": @"Later"},
+                          ]));
+    XCTAssertEqual([self.update requestsForMessagesWithIDs:@[@"c1"] threadIDs:nil addFolders:nil removeFolders:nil].count,
+                   0u);
+}
+
+- (void)testEmptyUpdateCompletes {
+    XCTestExpectation *expectation = [self expectationWithDescription:@"completion"];
+    [self.update updateMessagesWithIDs:@[] threadIDs:nil addFolders:@[@"Archive"] removeFolders:nil
+                            completion:^(NSDictionary *errors) {
+                              XCTAssertTrue([NSThread isMainThread]);
+                              XCTAssertEqual(errors.count, 0u);
+                              [expectation fulfill];
+                            }];
+    [self waitForExpectationsWithTimeout:1 handler:nil];
+}
+
+- (void)testReportsFailuresPerIDWithBoundedConcurrency {
+    // The second call for gm-t1, adding Later, fails, and so do both calls for c1
+    self.client.failsBlock = ^BOOL(CIODictionaryRequest *request) {
+      return [request.path hasSuffix:@"/c1/folders"] ||
+             ([request.path hasSuffix:@"/gm-t1/folders"] && [request.parameters[@"add"] isEqual:@"Later"]);
+    };
+    self.update.maximumConcurrentRequests = 2;
+    XCTestExpectation *expectation = [self expectationWithDescription:@"completion"];
+    [self.update updateMessagesWithIDs:@[@"a1", @"a2", @"b1", @"c1"]
+                             threadIDs:nil
+                            addFolders:@[@"Archive", @"Later"]
+                         removeFolders:nil
+                            completion:^(NSDictionary *errors) {
+                              XCTAssertTrue([NSThread isMainThread]);
+                              XCTAssertEqualObjects([errors.allKeys sortedArrayUsingSelector:@selector(compare:)],
+                                                    (@[@"a1", @"a2", @"c1"]));
+                              XCTAssertEqualObjects([errors[@"c1"] domain], NSURLErrorDomain);
+                              [expectation fulfill];
+                            }];
+    [self waitForExpectationsWithTimeout:1 handler:nil];
+    XCTAssertEqual(self.client.requestCount, 6u);
+    XCTAssertEqual(self.client.maximumRunningCount, 2u);
+    XCTAssertEqual(self.client.runningCount, 0u);
+}
+
+@end
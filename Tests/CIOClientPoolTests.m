@@ -0,0 +1,58 @@
+//
+//  CIOClientPoolTests.m
+//  CIOAPIClient
+//
+//  Copyright © 2015 Context.io. All rights reserved.
+//
+
+#import <XCTest/XCTest.h>
+#import "CIOV2Client.h"
+#import "CIOLiteClient.h"
+#import "CIOClientPool.h"
+
+@interface CIOClientPoolTests : XCTestCase
+
+@property (nonatomic) CIOClientPool *pool;
+
+@end
+
+@implementation CIOClientPoolTests
+
+- (void)setUp {
+    [super setUp];
+    self.pool = [[CIOClientPool alloc] initWithConsumerKey:@"consumer_key" consumerSecret:@"consumer_secret"];
+}
+
+- (void)testClientsShareTheSession {
+    CIOV2Client *first = [self.pool V2ClientWithAccountID:@"first" token:@"token1" tokenSecret:@"secret1"];
+    CIOV2Client *second = [self.pool V2ClientWithAccountID:@"second" token:@"token2" tokenSecret:@"secret2"];
+    XCTAssertNotEqual(first, second);
+    XCTAssertEqual(first.session, self.pool.session);
+    XCTAssertEqual(second.session, self.pool.session);
+    XCTAssertEqual(self.pool.session.configuration.HTTPMaximumConnectionsPerHost, 8);
+
+    XCTAssertTrue(first.isAuthorized);
+    XCTAssertEqualObjects([first getAccount].path, @"accounts/first");
+    XCTAssertEqualObjects([second getAccount].path, @"accounts/second");
+    NSString *authorization = [[first requestForPath:@"accounts/first" method:@"GET" params:nil]
+        valueForHTTPHeaderField:@"Authorization"];
+    XCTAssertTrue([authorization rangeOfString:@"oauth_token=\"token1\""].location != NSNotFound);
+}
+
+- (void)testClientsAreKeptPerAccount {
+    CIOV2Client *client = [self.pool V2ClientWithAccountID:@"first" token:@"token1" tokenSecret:@"secret1"];
+    XCTAssertEqual([self.pool V2ClientWithAccountID:@"first" token:@"token1" tokenSecret:@"secret1"], client);
+    XCTAssertEqual([self.pool clientForAccountID:@"first"], client);
+    XCTAssertEqual(self.pool.clientCount, 1u);
+
+    CIOLiteClient *liteClient = [self.pool liteClientWithAccountID:@"first" token:@"token1" tokenSecret:@"secret1"];
+    XCTAssertTrue([liteClient isKindOfClass:[CIOLiteClient class]]);
+    XCTAssertEqual(liteClient.session, self.pool.session);
+    XCTAssertEqual(self.pool.clientCount, 1u);
+
+    [self.pool removeClientForAccountID:@"first"];
+    XCTAssertNil([self.pool clientForAccountID:@"first"]);
+    XCTAssertEqual(self.pool.clientCount, 0u);
+}
+
+@end
@@ -0,0 +1,128 @@
+//
+//  CIOContactCacheTests.m
+//  CIOAPIClient
+//
+//  Copyright © 2015 Context.io. All rights reserved.
+//
+
+#import <XCTest/XCTest.h>
+#import "CIOV2Client.h"
+#import "CIOContactCache.h"
+
+@interface CIOContactCacheTests : XCTestCase
+
+@property (nonatomic) CIOV2Client *client;
+@property (nonatomic) CIOContactCache *cache;
+@property (nonatomic) NSURL *fileURL;
+
+@end
+
+@implementation CIOContactCacheTests
+
+- (void)setUp {
+    [super setUp];
+    self.client = [[CIOV2Client alloc] initWithConsumerKey:@"consumer_key" consumerSecret:@"consumer_secret"];
+    [self.client setValue:@"anAccountId" forKey:@"accountID"];
+    NSString *path = [NSTemporaryDirectory() stringByAppendingPathComponent:[[NSUUID UUID] UUIDString]];
+    self.fileURL = [NSURL fileURLWithPath:path];
+    self.cache = [[CIOContactCache alloc] initWithClient:self.client fileURL:self.fileURL];
+    self.cache.ownerEmailAddresses = @[@"Me@Home.org"];
+    [self.cache addContacts:@[
+        @{@"email": @"john.smith@example.com", @"name": @"John Smith", @"count": @10, @"thumbnail": [NSNull null]},
+        @{@"email": @"jo@example.com", @"name": @"Jo Bloggs", @"count": @30},
+        @{@"email": @"billing@johnson.com", @"count": @5},
+    ]];
+}
+
+- (void)tearDown {
+    [self.client clearCredentials];
+    [[NSFileManager defaultManager] removeItemAtURL:self.fileURL error:nil];
+    [super tearDown];
+}
+
+- (NSArray *)emailsMatching:(NSString *)query {
+    return [[self.cache contactsMatching:query limit:0] valueForKey:@"email"];
+}
+
+- (void)testPrefixAndSubstringMatches {
+    XCTAssertEqual(self.cache.count, 3u);
+    XCTAssertEqualObjects([self emailsMatching:@"jo"],
+                          (@[@"jo@example.com", @"john.smith@example.com", @"billing@johnson.com"]));
+    XCTAssertEqualObjects([self emailsMatching:@"SMI"], @[@"john.smith@example.com"]);
+    XCTAssertEqualObjects([self emailsMatching:@"john sm"], @[@"john.smith@example.com"]);
+    // Prefix matches first, then matches inside a word
+    XCTAssertEqualObjects([self emailsMatching:@"ohn"], (@[@"john.smith@example.com", @"billing@johnson.com"]));
+    XCTAssertEqualObjects([self emailsMatching:@"illing"], @[@"billing@johnson.com"]);
+    XCTAssertEqualObjects([self emailsMatching:@"example"], (@[@"jo@example.com", @"john.smith@example.com"]));
+    XCTAssertEqualObjects([self emailsMatching:@"zzz"], @[]);
+    XCTAssertEqual([self.cache contactsMatching:@"" limit:2].count, 2u);
+    XCTAssertNil([self.cache contactWithEmail:@"John.Smith@example.com"][@"thumbnail"]);
+}
+
+- (void)testReplacingContactReindexes {
+    [self.cache addContacts:@[@{@"email": @"jo@example.com", @"name": @"Joanna Bloggs", @"count": @31}]];
+    XCTAssertEqualObjects([self emailsMatching:@"joanna"], @[@"jo@example.com"]);
+    XCTAssertEqual(self.cache.count, 3u);
+    XCTAssertEqualObjects([self.cache contactWithEmail:@"jo@example.com"][@"count"], @31);
+}
+
+- (void)testMessagesUpdateCounts {
+    NSArray *messages = @[
+        @{@"message_id": @"m1", @"date": @100, @"date_indexed": @110,
+          @"addresses": @{@"from": @{@"email": @"billing@johnson.com"}, @"to": @[@{@"email": @"me@home.org"}]}},
+        @{@"message_id": @"m2", @"date": @200, @"date_indexed": @210,
+          @"addresses": @{@"from": @{@"email": @"me@home.org"},
+                          @"to": @[@{@"email": @"new@example.com", @"name": @"New Person"}],
+                          @"cc": @[@{@"email": @"JO@example.com"}]}},
+    ];
+    [self.cache addMessages:messages];
+    [self.cache addMessages:messages];
+
+    NSDictionary *billing = [self.cache contactWithEmail:@"billing@johnson.com"];
+    XCTAssertEqualObjects(billing[@"count"], @6);
+    XCTAssertEqualObjects(billing[@"received_count"], @1);
+    XCTAssertEqualObjects(billing[@"last_received"], @100);
+    XCTAssertEqualObjects([self.cache contactWithEmail:@"jo@example.com"][@"sent_count"], @1);
+    XCTAssertEqualObjects([self.cache contactWithEmail:@"new@example.com"][@"name"], @"New Person");
+    XCTAssertEqualObjects([self emailsMatching:@"new pe"], @[@"new@example.com"]);
+    XCTAssertNil([self.cache contactWithEmail:@"me@home.org"]);
+
+    // Messages indexed before the last refresh are already in the API's counts
+    [self.cache setValue:[NSDate dateWithTimeIntervalSince1970:500] forKey:@"lastRefreshDate"];
+    [self.cache addMessages:@[@{@"message_id": @"m3", @"date": @300, @"date_indexed": @400,
+                                @"addresses": @{@"from": @{@"email": @"billing@johnson.com"}}}]];
+    XCTAssertEqualObjects([self.cache contactWithEmail:@"billing@johnson.com"][@"count"], @6);
+}
+
+- (void)testFollowsClientResponses {
+    CIOContactsRequest *request = [self.client getContacts];
+    [[NSNotificationCenter defaultCenter]
+        postNotificationName:CIOAPIClientDidReceiveResponseNotification
+                      object:self.client
+                    userInfo:@{CIOAPIClientRequestKey: request,
+                               CIOAPIClientResponseObjectKey: @{@"matches": @[@{@"email": @"x@y.com", @"count": @1}]}}];
+    XCTAssertNotNil([self.cache contactWithEmail:@"x@y.com"]);
+
+    [[NSNotificationCenter defaultCenter]
+        postNotificationName:CIOAPIClientDidReceiveResponseNotification
+                      object:self.client
+                    userInfo:@{CIOAPIClientRequestKey: [self.client getMessages],
+                               CIOAPIClientResponseObjectKey: @[@{@"message_id": @"m", @"date_indexed": @1,
+                                                                  @"addresses": @{@"from": @{@"email": @"x@y.com"}}}]}];
+    XCTAssertEqualObjects([self.cache contactWithEmail:@"x@y.com"][@"count"], @2);
+}
+
+- (void)testPersistence {
+    [self.cache setValue:[NSDate dateWithTimeIntervalSince1970:500] forKey:@"lastRefreshDate"];
+    NSError *error = nil;
+    XCTAssertTrue([self.cache save:&error], @"%@", error);
+    CIOContactCache *reloaded = [[CIOContactCache alloc] initWithClient:self.client fileURL:self.fileURL];
+    XCTAssertEqual(reloaded.count, 3u);
+    XCTAssertEqualObjects(reloaded.lastRefreshDate, [NSDate dateWithTimeIntervalSince1970:500]);
+    // Keys sorted once on load are in the order they were inserted in one by one
+    XCTAssertEqualObjects([reloaded valueForKey:@"prefixKeys"], [self.cache valueForKey:@"prefixKeys"]);
+    XCTAssertEqualObjects([[reloaded contactsMatching:@"smith" limit:0] valueForKey:@"email"],
+                          @[@"john.smith@example.com"]);
+}
+
+@end
@@ -0,0 +1,138 @@
+//
+//  CIOCredentialStoreTests.m
+//  CIOAPIClient
+//
+//  Copyright © 2015 Context.io. All rights reserved.
+//
+
+#import <XCTest/XCTest.h>
+#import "CIOV2Client.h"
+#import "CIOCredentials.h"
+#import "CIOCredentialStore.h"
+
+// In-memory store counting how often it is read
+@interface CIOCountingCredentialStore : NSObject <CIOCredentialStore>
+
+@property (nonatomic) NSMutableDictionary *saved;
+@property (nonatomic) NSUInteger readCount;
+
+@end
+
+@implementation CIOCountingCredentialStore
+
+- (instancetype)init {
+    if ((self = [super init])) {
+        _saved = [NSMutableDictionary dictionary];
+    }
+    return self;
+}
+
+- (CIOCredentials *)credentialsForService:(NSString *)service {
+    self.readCount++;
+    return self.saved[service];
+}
+
+- (BOOL)saveCredentials:(CIOCredentials *)credentials forService:(NSString *)service {
+    self.saved[service] = credentials;
+    return YES;
+}
+
+- (void)removeCredentialsForService:(NSString *)service {
+    [self.saved removeObjectForKey:service];
+}
+
+@end
+
+@interface CIOCredentialStoreTests : XCTestCase
+
+@property (nonatomic) CIOCountingCredentialStore *store;
+@property (nonatomic) id<CIOCredentialStore> previousDefaultStore;
+@property (nonatomic) NSURL *directoryURL;
+
+@end
+
+@implementation CIOCredentialStoreTests
+
+- (void)setUp {
+    [super setUp];
+    self.store = [CIOCountingCredentialStore new];
+    self.previousDefaultStore = [CIOAPIClient defaultCredentialStore];
+    [CIOAPIClient setDefaultCredentialStore:self.store];
+    self.directoryURL = [NSURL fileURLWithPath:[NSTemporaryDirectory() stringByAppendingPathComponent:[NSUUID UUID].UUIDString]];
+}
+
+- (void)tearDown {
+    [CIOAPIClient setDefaultCredentialStore:self.previousDefaultStore];
+    [[NSFileManager defaultManager] removeItemAtURL:self.directoryURL error:NULL];
+    [super tearDown];
+}
+
+- (void)testFileStore {
+    CIOFileCredentialStore *store = [[CIOFileCredentialStore alloc] initWithDirectoryURL:self.directoryURL];
+    NSString *service = @"Context-IO--consumer/key";
+    XCTAssertNil([store credentialsForService:service]);
+
+    CIOCredentials *credentials = [CIOCredentials credentialsWithAccountID:@"anAccountId" token:@"token" tokenSecret:@"secret"];
+    XCTAssertTrue([store saveCredentials:credentials forService:service]);
+    XCTAssertEqualObjects([store credentialsForService:service], credentials);
+    XCTAssertNil([store credentialsForService:@"Context-IO--other"]);
+
+    NSArray *files = [[NSFileManager defaultManager] contentsOfDirectoryAtPath:self.directoryURL.path error:NULL];
+    XCTAssertEqual(files.count, 1u);
+    NSDictionary *attributes = [[NSFileManager defaultManager]
+        attributesOfItemAtPath:[self.directoryURL.path stringByAppendingPathComponent:files.firstObject]
+                         error:NULL];
+    XCTAssertEqual([attributes[NSFilePosixPermissions] unsignedIntegerValue], 0600u);
+
+    [store removeCredentialsForService:service];
+    XCTAssertNil([store credentialsForService:service]);
+}
+
+- (void)testCachingStoreReadsOnce {
+    CIOCachingCredentialStore *cache = [[CIOCachingCredentialStore alloc] initWithStore:self.store];
+    XCTAssertNil([cache credentialsForService:@"service"]);
+    XCTAssertNil([cache credentialsForService:@"service"]);
+    XCTAssertEqual(self.store.readCount, 1u);
+
+    CIOCredentials *credentials = [CIOCredentials credentialsWithAccountID:@"anAccountId" token:@"token" tokenSecret:@"secret"];
+    XCTAssertTrue([cache saveCredentials:credentials forService:@"service"]);
+    XCTAssertEqualObjects([cache credentialsForService:@"service"], credentials);
+    XCTAssertEqual(self.store.readCount, 1u);
+
+    [cache removeCredentialsForService:@"service"];
+    XCTAssertNil([cache credentialsForService:@"service"]);
+    XCTAssertNil(self.store.saved[@"service"]);
+    [cache removeAllCachedCredentials];
+    XCTAssertNil([cache credentialsForService:@"service"]);
+    XCTAssertEqual(self.store.readCount, 2u);
+}
+
+- (void)testClientsLoadLazily {
+    CIOV2Client *client = [[CIOV2Client alloc] initWithConsumerKey:@"consumer_key" consumerSecret:@"consumer_secret"];
+    XCTAssertEqual(client.credentialStore, self.store);
+    XCTAssertEqual(self.store.readCount, 0u);
+    XCTAssertFalse(client.isAuthorized);
+    XCTAssertEqual(self.store.readCount, 1u);
+
+    XCTAssertTrue([client completeLoginWithResponse:@{@"account": @{@"id": @"anAccountId", @"access_token": @"token",
+                                                                    @"access_token_secret": @"secret"}}
+                                    saveCredentials:YES]);
+    CIOV2Client *restored = [[CIOV2Client alloc] initWithConsumerKey:@"consumer_key" consumerSecret:@"consumer_secret"];
+    XCTAssertEqualObjects(restored.accountID, @"anAccountId");
+    XCTAssertTrue(restored.isAuthorized);
+    XCTAssertEqual(self.store.readCount, 2u);
+
+    CIOV2Client *explicit = [[CIOV2Client alloc] initWithConsumerKey:@"consumer_key"
+                                                      consumerSecret:@"consumer_secret"
+                                                               token:@"other_token"
+                                                         tokenSecret:@"other_secret"
+                                                           accountID:@"otherAccount"];
+    XCTAssertEqualObjects(explicit.accountID, @"otherAccount");
+    XCTAssertEqual(self.store.readCount, 2u);
+
+    [restored clearCredentials];
+    XCTAssertEqual(self.store.saved.count, 0u);
+    XCTAssertNil(restored.accountID);
+}
+
+@end
@@ -0,0 +1,106 @@
+//
+//  CIOCredentialsTests.m
+//  CIOAPIClient
+//
+//  Copyright © 2015 Context.io. All rights reserved.
+//
+
+#import <XCTest/XCTest.h>
+#import "CIOV2Client.h"
+#import "CIOCredentials.h"
+#import "TestUtil.h"
+
+static NSDictionary *CIOLoginResponse(NSUInteger index) {
+    return @{@"account": @{
+        @"id": [NSString stringWithFormat:@"account-%lu", (unsigned long)index],
+        @"access_token": [NSString stringWithFormat:@"token-%lu", (unsigned long)index],
+        @"access_token_secret": [NSString stringWithFormat:@"secret-%lu", (unsigned long)index],
+    }};
+}
+
+// The value of the `oauth_token` field of an OAuth header
+static NSString *CIOOAuthToken(NSString *header) {
+    for (NSString *section in [header componentsSeparatedByString:@", "]) {
+        NSRange range = [section rangeOfString:@"oauth_token=\""];
+        if (range.location != NSNotFound) {
+            return [[section substringFromIndex:NSMaxRange(range)] stringByReplacingOccurrencesOfString:@"\""
+                                                                                             withString:@""];
+        }
+    }
+    return nil;
+}
+
+@interface CIOCredentialsTests : XCTestCase
+
+@property (nonatomic) CIOV2Client *client;
+
+@end
+
+@implementation CIOCredentialsTests
+
+- (void)setUp {
+    [super setUp];
+    self.client = [[CIOV2Client alloc] initWithConsumerKey:@"consumer_key"
+                                            consumerSecret:@"consumer_secret"
+                                                     token:@"token-0"
+                                               tokenSecret:@"secret-0"
+                                                 accountID:@"account-0"];
+}
+
+- (void)testSnapshotsAreReplaced {
+    CIOCredentials *before = self.client.credentials;
+    XCTAssertEqualObjects(before, [CIOCredentials credentialsWithAccountID:@"account-0" token:@"token-0" tokenSecret:@"secret-0"]);
+    XCTAssertTrue([self.client completeLoginWithResponse:CIOLoginResponse(1) saveCredentials:NO]);
+
+    XCTAssertEqualObjects(before.token, @"token-0");
+    XCTAssertEqualObjects(self.client.credentials.token, @"token-1");
+    XCTAssertEqualObjects(self.client.accountID, @"account-1");
+
+    [self.client setValue:@NO forKey:@"isAuthorized"];
+    XCTAssertFalse(self.client.isAuthorized);
+    XCTAssertEqualObjects(self.client.credentials.tokenSecret, @"secret-1");
+    XCTAssertEqual([[self.client.credentials description] rangeOfString:@"secret"].location, NSNotFound);
+}
+
+- (void)testConcurrentSigningWhileRotating {
+    NSUInteger pairCount = 4;
+    NSString *path = @"accounts/anAccountId/messages";
+    // Nonces and timestamps are fixed in tests, so each token has exactly one valid signature for the request
+    NSMutableDictionary *signatures = [NSMutableDictionary dictionary];
+    NSMutableDictionary *secrets = [NSMutableDictionary dictionary];
+    for (NSUInteger i = 0; i < pairCount; i++) {
+        [self.client completeLoginWithResponse:CIOLoginResponse(i) saveCredentials:NO];
+        NSString *header = [[self.client requestForPath:path method:@"GET" params:nil] valueForHTTPHeaderField:@"Authorization"];
+        signatures[CIOOAuthToken(header)] = [TestUtil OAuthSignature:header];
+        secrets[self.client.credentials.token] = self.client.credentials.tokenSecret;
+    }
+    XCTAssertEqual([NSSet setWithArray:signatures.allValues].count, pairCount);
+
+    CIOV2Client *client = self.client;
+    dispatch_queue_t queue = dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0);
+    dispatch_group_t group = dispatch_group_create();
+    dispatch_group_async(group, queue, ^{
+      for (NSUInteger i = 0; i < 4000; i++) {
+          [client completeLoginWithResponse:CIOLoginResponse(i % pairCount) saveCredentials:NO];
+      }
+    });
+    NSMutableArray *mismatches = [NSMutableArray array];
+    dispatch_apply(8, queue, ^(size_t worker) {
+      for (NSUInteger i = 0; i < 500; i++) {
+          NSString *header = [[client requestForPath:path method:@"GET" params:nil] valueForHTTPHeaderField:@"Authorization"];
+          NSString *token = CIOOAuthToken(header);
+          CIOCredentials *credentials = client.credentials;
+          if (!token || ![signatures[token] isEqualToString:[TestUtil OAuthSignature:header]] ||
+              ![secrets[credentials.token] isEqualToString:credentials.tokenSecret] ||
+              ![[credentials.accountID substringFromIndex:8] isEqualToString:[credentials.token substringFromIndex:6]]) {
+              @synchronized(mismatches) {
+                  [mismatches addObject:header];
+              }
+          }
+      }
+    });
+    dispatch_group_wait(group, DISPATCH_TIME_FOREVER);
+    XCTAssertEqual(mismatches.count, 0u, @"%@", mismatches.firstObject);
+}
+
+@end
@@ -0,0 +1,98 @@
+//
+//  CIOFileLinkCacheTests.m
+//  CIOAPIClient
+//
+//  Copyright © 2015 Context.io. All rights reserved.
+//
+
+#import <XCTest/XCTest.h>
+#import "CIOV2Client.h"
+
+@interface CIOFileLinkCacheTests : XCTestCase
+
+@property (nonatomic) CIOV2Client *client;
+@property (nonatomic) CIOFileLinkCache *cache;
+
+@end
+
+@implementation CIOFileLinkCacheTests
+
+- (void)setUp {
+    [super setUp];
+    self.client = [[CIOV2Client alloc] initWithConsumerKey:@"consumer_key" consumerSecret:@"consumer_secret"];
+    [self.client setValue:@"anAccountId" forKey:@"accountID"];
+    self.cache = self.client.fileLinkCache;
+}
+
+- (void)tearDown {
+    [super tearDown];
+    [self.client clearCredentials];
+}
+
+- (void)testClientOwnsOneCache {
+    XCTAssertEqual(self.client.fileLinkCache, self.cache);
+    XCTAssertEqual(self.cache.client, self.client);
+}
+
+- (void)testExpirationFromLink {
+    NSURL *v2 = [NSURL URLWithString:@"https://s3.amazonaws.com/b/f?AWSAccessKeyId=a&Expires=1436893200&Signature=s%3D"];
+    XCTAssertEqualObjects([CIOFileLinkCache expirationDateForLink:v2], [NSDate dateWithTimeIntervalSince1970:1436893200]);
+    NSURL *v4 = [NSURL URLWithString:@"https://s3.amazonaws.com/b/f?X-Amz-Date=20150714T165000Z&X-Amz-Expires=600"];
+    XCTAssertEqualObjects([CIOFileLinkCache expirationDateForLink:v4], [NSDate dateWithTimeIntervalSince1970:1436893200]);
+    XCTAssertNil([CIOFileLinkCache expirationDateForLink:[NSURL URLWithString:@"https://example.com/f?a=b"]]);
+}
+
+- (void)testCachedLinks {
+    NSURL *link = [NSURL URLWithString:@"https://example.com/file"];
+    [self.cache setLink:link forFileWithID:@"fresh" expirationDate:[NSDate dateWithTimeIntervalSinceNow:60]];
+    [self.cache setLink:link forFileWithID:@"expiring" expirationDate:[NSDate dateWithTimeIntervalSinceNow:5]];
+    [self.cache setLink:link forFileWithID:@"default" expirationDate:nil];
+    XCTAssertEqualObjects([self.cache cachedLinkForFileWithID:@"fresh"], link);
+    XCTAssertNil([self.cache cachedLinkForFileWithID:@"expiring"]);
+    XCTAssertEqualObjects([self.cache cachedLinkForFileWithID:@"default"], link);
+    XCTAssertNil([self.cache cachedLinkForFileWithID:@"missing"]);
+
+    [self.cache removeLinkForFileWithID:@"fresh"];
+    XCTAssertNil([self.cache cachedLinkForFileWithID:@"fresh"]);
+    [self.cache removeAllLinks];
+    XCTAssertNil([self.cache cachedLinkForFileWithID:@"default"]);
+}
+
+- (void)testLinkInPast {
+    NSURL *link = [NSURL URLWithString:@"https://s3.amazonaws.com/b/f?Expires=1436893200"];
+    [self.cache setLink:link forFileWithID:@"old" expirationDate:nil];
+    XCTAssertNil([self.cache cachedLinkForFileWithID:@"old"]);
+}
+
+- (void)testGetCachedLinkWithoutFetching {
+    NSURL *link = [NSURL URLWithString:@"https://example.com/file"];
+    [self.cache setLink:link forFileWithID:@"aFileId" expirationDate:[NSDate dateWithTimeIntervalSinceNow:60]];
+    __block NSURL *result = nil;
+    [self.cache getLinkForFileWithID:@"aFileId"
+                             success:^(NSURL *cached) {
+                               result = cached;
+                             }
+                             failure:nil];
+    XCTAssertEqualObjects(result, link);
+}
+
+- (void)testFetchFailsWithoutClient {
+    CIOFileLinkCache *cache = [[CIOFileLinkCache alloc] initWithClient:self.client];
+    // As when the client is deallocated
+    [cache setValue:nil forKey:@"client"];
+    __block NSUInteger failureCount = 0;
+    for (NSUInteger i = 0; i < 2; i++) {
+        [cache getLinkForFileWithID:@"aFileId"
+            success:^(NSURL *link) {
+              XCTFail(@"no link without a client");
+            }
+            failure:^(NSError *error) {
+              XCTAssertNotNil(error);
+              failureCount++;
+            }];
+    }
+    XCTAssertEqual(failureCount, 2u);
+    XCTAssertEqual([[cache valueForKey:@"pendingFetches"] count], 0u);
+}
+
+@end
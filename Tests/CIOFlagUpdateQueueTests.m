@@ -0,0 +1,110 @@
+//
+//  CIOFlagUpdateQueueTests.m
+//  CIOAPIClient
+//
+//  Copyright © 2015 Context.io. All rights reserved.
+//
+
+#import <XCTest/XCTest.h>
+#import "CIOV2Client.h"
+#import "CIOFlagUpdateQueue.h"
+
+@interface CIOFlagUpdateQueueTests : XCTestCase
+
+@property (nonatomic) NSMutableArray *sent;
+@property (nonatomic) CIOFlagUpdateQueue *queue;
+
+@end
+
+@implementation CIOFlagUpdateQueueTests
+
+- (void)setUp {
+    [super setUp];
+    self.sent = [NSMutableArray array];
+    NSMutableArray *sent = self.sent;
+    // Requests without a client are never answered, so they stay in flight
+    self.queue = [[CIOFlagUpdateQueue alloc] initWithRequestFactory:^CIODictionaryRequest *(NSString *messageID, CIOMessageFlags *flags) {
+      [sent addObject:@[messageID, [flags asDictionary]]];
+      return [CIODictionaryRequest requestWithPath:messageID method:@"POST" parameters:[flags asDictionary] client:nil];
+    }];
+    self.queue.debounceInterval = 60;
+    self.queue.maximumDelay = 60;
+}
+
+- (CIOMessageFlags *)flagsWithSeen:(NSNumber *)seen flagged:(NSNumber *)flagged {
+    CIOMessageFlags *flags = [CIOMessageFlags new];
+    flags.seen = seen;
+    flags.flagged = flagged;
+    return flags;
+}
+
+- (void)testDefaultRequest {
+    CIOV2Client *client = [[CIOV2Client alloc] initWithConsumerKey:@"consumer_key" consumerSecret:@"consumer_secret"];
+    [client setValue:@"anAccountId" forKey:@"accountID"];
+    CIOFlagUpdateQueue *queue = [[CIOFlagUpdateQueue alloc] initWithClient:client];
+    CIODictionaryRequest *request = queue.requestFactory(@"m1", [self flagsWithSeen:@YES flagged:nil]);
+    XCTAssertEqualObjects(request.path, @"accounts/anAccountId/messages/m1/flags");
+    XCTAssertEqualObjects(request.parameters, @{@"seen": @YES});
+    [client clearCredentials];
+}
+
+- (void)testMergesChangesPerFlag {
+    [self.queue updateFlags:[self flagsWithSeen:@YES flagged:nil] forMessageWithID:@"m1" completion:nil];
+    [self.queue updateFlags:[self flagsWithSeen:nil flagged:@YES] forMessageWithID:@"m1" completion:nil];
+    [self.queue updateFlags:[self flagsWithSeen:@NO flagged:nil] forMessageWithID:@"m1" completion:nil];
+    XCTAssertEqual(self.queue.pendingCount, 1u);
+    XCTAssertEqualObjects([[self.queue pendingFlagsForMessageWithID:@"m1"] asDictionary], (@{@"seen": @NO, @"flagged": @YES}));
+    XCTAssertEqual(self.sent.count, 0u);
+
+    [self.queue flush];
+    XCTAssertEqualObjects(self.sent, (@[@[@"m1", @{@"seen": @NO, @"flagged": @YES}]]));
+    XCTAssertEqual(self.queue.pendingCount, 0u);
+    XCTAssertEqual(self.queue.inFlightCount, 1u);
+
+    // A change made while the message's update is in flight waits for it
+    [self.queue updateFlags:[self flagsWithSeen:@YES flagged:nil] forMessageWithID:@"m1" completion:nil];
+    [self.queue flush];
+    XCTAssertEqual(self.sent.count, 1u);
+    XCTAssertEqual(self.queue.pendingCount, 1u);
+}
+
+- (void)testBoundsConcurrency {
+    self.queue.maximumConcurrentRequests = 2;
+    [self.queue updateFlags:[self flagsWithSeen:@YES flagged:nil]
+         forMessagesWithIDs:@[@"m1", @"m2", @"m1", @"m3"]
+                 completion:nil];
+    XCTAssertEqual(self.queue.pendingCount, 3u);
+    [self.queue flush];
+    XCTAssertEqualObjects([self.sent valueForKey:@"firstObject"], (@[@"m1", @"m2"]));
+    XCTAssertEqual(self.queue.inFlightCount, 2u);
+    XCTAssertEqual(self.queue.pendingCount, 1u);
+}
+
+- (void)testUpdateFailsWithoutRequest {
+    CIOV2Client *client = [[CIOV2Client alloc] initWithConsumerKey:@"consumer_key" consumerSecret:@"consumer_secret"];
+    CIOFlagUpdateQueue *queue = [[CIOFlagUpdateQueue alloc] initWithClient:client];
+    [client clearCredentials];
+    client = nil;
+
+    XCTestExpectation *expectation = [self expectationWithDescription:@"update"];
+    [queue updateFlags:[self flagsWithSeen:@YES flagged:nil]
+        forMessagesWithIDs:@[@"m1", @"m2"]
+                completion:^(NSDictionary *errors) {
+                  XCTAssertEqualObjects([errors.allKeys sortedArrayUsingSelector:@selector(compare:)], (@[@"m1", @"m2"]));
+                  [expectation fulfill];
+                }];
+    [queue flush];
+    [self waitForExpectationsWithTimeout:1 handler:nil];
+    XCTAssertEqual(queue.inFlightCount, 0u);
+    XCTAssertEqual(queue.pendingCount, 0u);
+}
+
+- (void)testDebounce {
+    self.queue.debounceInterval = 0.05;
+    [self.queue updateFlags:[self flagsWithSeen:@YES flagged:nil] forMessageWithID:@"m1" completion:nil];
+    XCTAssertEqual(self.sent.count, 0u);
+    [[NSRunLoop currentRunLoop] runUntilDate:[NSDate dateWithTimeIntervalSinceNow:0.2]];
+    XCTAssertEqual(self.sent.count, 1u);
+}
+
+@end
@@ -0,0 +1,100 @@
+//
+//  CIOHeaderTokenizerTests.m
+//  CIOAPIClient
+//
+//  Copyright © 2015 Context.io. All rights reserved.
+//
+
+#import <XCTest/XCTest.h>
+#import "CIOHeaderTokenizer.h"
+
+static NSString *const kCIOTestHeaders =
+    @"Received: from a.example.com\r\n"
+    @"\tby b.example.com; Tue, 14 Jul 2015 10:00:01 -0700\r\n"
+    @"Received: from c.example.com\r\n"
+    @"Message-ID: <reply@example.com>\r\n"
+    @"In-Reply-To: <original@example.com>\r\n"
+    @"References: <root@example.com>\r\n"
+    @" <original@example.com>\r\n"
+    @"Date: Tue, 14 Jul 2015 10:00:00 -0700 (PDT)\r\n"
+    @"Subject: =?utf-8?Q?Caf=C3=A9?= =?utf-8?B?IGF0IG5vb24=?= today\r\n"
+    @"From: Joe <joe@example.com>\r\n"
+    @"\r\n"
+    @"Body text: not a header\r\n";
+
+@interface CIOHeaderTokenizerTests : XCTestCase
+
+@property (nonatomic) CIOHeaderTokenizer *tokenizer;
+
+@end
+
+@implementation CIOHeaderTokenizerTests
+
+- (void)setUp {
+    [super setUp];
+    self.tokenizer = [[CIOHeaderTokenizer alloc] initWithString:kCIOTestHeaders];
+}
+
+- (void)testFields {
+    XCTAssertEqual(self.tokenizer.count, 8u);
+    XCTAssertEqualObjects([self.tokenizer.fields valueForKey:@"name"],
+                          (@[@"Received", @"Received", @"Message-ID", @"In-Reply-To", @"References", @"Date",
+                             @"Subject", @"From"]));
+    XCTAssertNil([self.tokenizer fieldNamed:@"Body text"]);
+    NSString *headers = kCIOTestHeaders;
+    NSUInteger bodyStart = [headers rangeOfString:@"Body text"].location;
+    XCTAssertEqual(self.tokenizer.endLocation, bodyStart);
+}
+
+- (void)testSlicesPointInToBuffer {
+    CIOHeaderField *from = [self.tokenizer fieldNamed:@"from"];
+    NSData *name = [self.tokenizer.data subdataWithRange:from.nameRange];
+    NSData *value = [self.tokenizer.data subdataWithRange:from.valueRange];
+    XCTAssertEqualObjects(name, [@"From" dataUsingEncoding:NSUTF8StringEncoding]);
+    XCTAssertEqualObjects(value, [@"Joe <joe@example.com>" dataUsingEncoding:NSUTF8StringEncoding]);
+}
+
+- (void)testFoldingAndDuplicates {
+    NSArray *received = [self.tokenizer fieldsNamed:@"RECEIVED"];
+    XCTAssertEqual(received.count, 2u);
+    XCTAssertEqualObjects([received[0] rawValue],
+                          @"from a.example.com\tby b.example.com; Tue, 14 Jul 2015 10:00:01 -0700");
+    XCTAssertEqualObjects([received[1] rawValue], @"from c.example.com");
+}
+
+- (void)testEncodedWords {
+    CIOHeaderField *subject = [self.tokenizer fieldNamed:@"Subject"];
+    XCTAssertEqualObjects(subject.rawValue, @"=?utf-8?Q?Caf=C3=A9?= =?utf-8?B?IGF0IG5vb24=?= today");
+    XCTAssertEqualObjects(subject.value, @"Café at noon today");
+    XCTAssertEqualObjects([CIOHeaderTokenizer decodeEncodedWords:@"=?iso-8859-1?q?h=E9_llo?="], @"hé llo");
+    XCTAssertEqualObjects([CIOHeaderTokenizer decodeEncodedWords:@"a =?bogus?= b =?x-unknown?Q?z?="],
+                          @"a =?bogus?= b =?x-unknown?Q?z?=");
+    // A multi-byte character split across two encoded-words
+    XCTAssertEqualObjects([CIOHeaderTokenizer decodeEncodedWords:@"=?utf-8?Q?=E2=82?=\r\n =?utf-8?Q?=AC?="], @"€");
+}
+
+- (void)testThreadingHeaders {
+    XCTAssertEqualObjects(self.tokenizer.messageID, @"reply@example.com");
+    XCTAssertEqualObjects(self.tokenizer.inReplyTo, @"original@example.com");
+    XCTAssertEqualObjects(self.tokenizer.references, (@[@"root@example.com", @"original@example.com"]));
+    XCTAssertEqualObjects(self.tokenizer.date, [NSDate dateWithTimeIntervalSince1970:1436893200]);
+}
+
+- (void)testMissingHeaders {
+    CIOHeaderTokenizer *tokenizer = [[CIOHeaderTokenizer alloc] initWithString:@"Subject: hi\n"];
+    XCTAssertNil(tokenizer.messageID);
+    XCTAssertNil(tokenizer.date);
+    XCTAssertEqualObjects(tokenizer.references, @[]);
+    XCTAssertEqualObjects([tokenizer valueForHeader:@"subject"], @"hi");
+    XCTAssertEqual(tokenizer.endLocation, 12u);
+}
+
+- (void)testDates {
+    NSDate *expected = [NSDate dateWithTimeIntervalSince1970:1436893200];
+    XCTAssertEqualObjects([CIOHeaderTokenizer dateFromString:@"14 Jul 2015 17:00:00 +0000"], expected);
+    XCTAssertEqualObjects([CIOHeaderTokenizer dateFromString:@"14 Jul 2015 17:00 +0000"], expected);
+    XCTAssertEqualObjects([CIOHeaderTokenizer dateFromString:@"Tue, 14 Jul 2015 17:00:00 GMT"], expected);
+    XCTAssertNil([CIOHeaderTokenizer dateFromString:@"yesterday"]);
+}
+
+@end
@@ -0,0 +1,79 @@
+//
+//  CIOJSONProjectionTests.m
+//  CIOAPIClient
+//
+//  Copyright © 2015 Context.io. All rights reserved.
+//
+
+#import <XCTest/XCTest.h>
+#import "CIOJSONProjection.h"
+
+@interface CIOJSONProjectionTests : XCTestCase
+
+@end
+
+@implementation CIOJSONProjectionTests
+
+- (id)objectWithJSON:(NSString *)JSON keyPaths:(NSArray *)keyPaths {
+    CIOJSONProjection *projection = [[CIOJSONProjection alloc] initWithKeyPaths:[NSSet setWithArray:keyPaths]];
+    NSError *error = nil;
+    id object = [projection objectWithData:[JSON dataUsingEncoding:NSUTF8StringEncoding] error:&error];
+    XCTAssertNil(error);
+    return object;
+}
+
+- (void)testKeepsProjectedKeysOfEveryElement {
+    NSString *JSON = @"[{\"message_id\": \"m1\", \"subject\": \"Hi\", \"files\": [{\"size\": 1}],"
+                     @" \"addresses\": {\"from\": {\"email\": \"a@x\", \"name\": \"A\"}, \"to\": [{\"email\": \"b@x\"}]}},"
+                     @" {\"message_id\": \"m2\", \"person_info\": {\"a@x\": {\"thumbnail\": \"t\"}}}]";
+    id object = [self objectWithJSON:JSON keyPaths:@[@"message_id", @"subject", @"addresses.from"]];
+    XCTAssertEqualObjects(object, (@[
+                              @{@"message_id": @"m1", @"subject": @"Hi",
+                                @"addresses": @{@"from": @{@"email": @"a@x", @"name": @"A"}}},
+                              @{@"message_id": @"m2"},
+                          ]));
+}
+
+- (void)testLooksThroughNestedArrays {
+    NSString *JSON = @"{\"addresses\": {\"to\": [{\"email\": \"b@x\", \"name\": \"B\"}, {\"email\": \"c@x\"}]}}";
+    XCTAssertEqualObjects([self objectWithJSON:JSON keyPaths:@[@"addresses.to.email"]],
+                          (@{@"addresses": @{@"to": @[@{@"email": @"b@x"}, @{@"email": @"c@x"}]}}));
+    // A shorter key path keeps everything below it
+    XCTAssertEqualObjects([self objectWithJSON:JSON keyPaths:@[@"addresses.to.email", @"addresses"]],
+                          [NSJSONSerialization JSONObjectWithData:[JSON dataUsingEncoding:NSUTF8StringEncoding]
+                                                          options:0
+                                                            error:nil]);
+}
+
+- (void)testSkipsStringsAndScalars {
+    NSString *JSON = @"{\"body\": \"a } ] \\\" { [ b\", \"n\": -1.5e3, \"t\": true, \"z\": null, \"k\\u00e9y\": [1, 2],"
+                     @" \"date\": 1437000000}";
+    XCTAssertEqualObjects([self objectWithJSON:JSON keyPaths:@[@"date", @"kéy"]], (@{@"date": @1437000000, @"kéy": @[@1, @2]}));
+    XCTAssertEqualObjects([self objectWithJSON:@"\"plain\"" keyPaths:@[@"date"]], @"plain");
+    XCTAssertEqualObjects([self objectWithJSON:@" [ ] " keyPaths:@[@"date"]], @[]);
+}
+
+- (void)testDecodesScalarsLikeNSJSONSerialization {
+    NSString *JSON = @"{\"s\": \"caf\u00e9\", \"e\": \"a\\nb\\u00e9\", \"i\": -42, \"z\": 0, \"f\": 1.25,"
+                     @" \"x\": -2.5E-1, \"big\": 18446744073709551615, \"t\": true, \"n\": false,"
+                     @" \"null\": null, \"a\": [1, {\"b\": [true, \"c\"]}]}";
+    NSData *data = [JSON dataUsingEncoding:NSUTF8StringEncoding];
+    NSDictionary *expected = [NSJSONSerialization JSONObjectWithData:data options:0 error:nil];
+    NSArray *keys = @[@"s", @"e", @"i", @"z", @"f", @"x", @"big", @"t", @"n", @"null", @"a"];
+    NSDictionary *object = [self objectWithJSON:JSON keyPaths:keys];
+    XCTAssertEqualObjects(object, expected);
+    XCTAssertEqual([object[@"t"] objCType][0], [expected[@"t"] objCType][0]);
+    XCTAssertEqualObjects(object[@"e"], @"a\nbé");
+}
+
+- (void)testInvalidJSON {
+    CIOJSONProjection *projection = [[CIOJSONProjection alloc] initWithKeyPaths:[NSSet setWithObject:@"a"]];
+    for (NSString *JSON in @[@"", @"{\"a\": 1", @"{\"b\": [1, 2}", @"[1 2]", @"{\"a\": 1} x", @"{\"b\": \"open}",
+                           @"{\"a\": 01}", @"{\"a\": 1.}", @"{\"a\": -}", @"{\"a\": tru}", @"{\"a\": nulls}"]) {
+        NSError *error = nil;
+        XCTAssertNil([projection objectWithData:[JSON dataUsingEncoding:NSUTF8StringEncoding] error:&error], @"%@", JSON);
+        XCTAssertEqualObjects(error.domain, NSCocoaErrorDomain);
+    }
+}
+
+@end
@@ -180,6 +180,7 @@
                                 CIORequest,
                                 @"GET");
     XCTAssertEqualObjects(request.parameters[@"delimiter"], @"\\");
+    XCTAssertEqualObjects(request.contentKey, request.path);
 }
 
 - (void)testMessageBody {
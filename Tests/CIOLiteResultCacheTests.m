@@ -0,0 +1,180 @@
+//
+//  CIOLiteResultCacheTests.m
+//  CIOAPIClient
+//
+//  Copyright © 2015 Context.io. All rights reserved.
+//
+
+#import <XCTest/XCTest.h>
+#import "CIOLiteClient.h"
+#import "CIOLiteResultCache.h"
+#import "CIOStubServer.h"
+
+@interface CIOLiteResultCacheTests : XCTestCase
+
+@property (nonatomic) CIOLiteClient *client;
+@property (nonatomic) CIOLiteResultCache *cache;
+
+@end
+
+@implementation CIOLiteResultCacheTests
+
+- (void)setUp {
+    [super setUp];
+    self.client = [[CIOLiteClient alloc] initWithConsumerKey:@"consumer_key" consumerSecret:@"consumer_secret"];
+    [self.client setValue:@"anAccountId" forKey:@"accountID"];
+    self.cache = [[CIOLiteResultCache alloc] initWithClient:self.client];
+}
+
+- (void)tearDown {
+    [self.client clearCredentials];
+    [super tearDown];
+}
+
+- (CIOLiteFolderMessagesRequest *)inboxPageAtOffset:(NSInteger)offset {
+    CIOLiteFolderMessagesRequest *request = [self.client getMessagesForFolderWithPath:@"INBOX" accountLabel:@"main"];
+    request.include_flags = YES;
+    request.limit = 2;
+    request.offset = offset;
+    return request;
+}
+
+- (NSDictionary *)messageWithID:(NSString *)messageID date:(NSInteger)date read:(BOOL)read {
+    return @{@"message_id": messageID, @"subject": messageID, @"sent_at": @(date), @"flags": @{@"read": @(read)}};
+}
+
+- (NSDictionary *)payloadForMessage:(NSDictionary *)message folders:(NSArray *)folders {
+    NSMutableDictionary *data = [message mutableCopy];
+    data[@"email_accounts"] = @[@{@"label": @"main", @"folders": folders}];
+    data[@"bodies"] = @[@{@"content": @"not in listings"}];
+    return @{@"webhook_id": @"hook", @"timestamp": @1, @"token": @"t", @"signature": @"s", @"message_data": data};
+}
+
+- (void)cacheSampleListings {
+    [self.cache setResponse:@[[self messageWithID:@"<c>" date:300 read:NO], [self messageWithID:@"<b>" date:200 read:NO]]
+                 forRequest:[self inboxPageAtOffset:0]];
+    [self.cache setResponse:@[[self messageWithID:@"<a>" date:100 read:NO]] forRequest:[self inboxPageAtOffset:2]];
+    [self.cache setResponse:@[@{@"name": @"INBOX", @"nb_messages": @3}]
+                 forRequest:[self.client getFoldersForAccountWithLabel:@"main" includeNamesOnly:NO]];
+    [self.cache setResponse:@[@{@"name": @"INBOX"}, @{@"name": @"Work"}]
+                 forRequest:[self.client getFoldersForAccountWithLabel:@"main" includeNamesOnly:YES]];
+}
+
+- (void)testCachesListings {
+    XCTAssertTrue([CIOLiteResultCache canCacheRequest:[self inboxPageAtOffset:0]]);
+    XCTAssertTrue([CIOLiteResultCache canCacheRequest:[self.client getFoldersForAccountWithLabel:nil includeNamesOnly:NO]]);
+    XCTAssertFalse([CIOLiteResultCache canCacheRequest:[self.client listWebhooks]]);
+
+    [self cacheSampleListings];
+    XCTAssertEqual(self.cache.count, 4u);
+    XCTAssertEqualObjects([[self.cache cachedResponseForRequest:[self inboxPageAtOffset:0]] valueForKey:@"message_id"],
+                          (@[@"<c>", @"<b>"]));
+    XCTAssertNil([self.cache cachedResponseForRequest:[self inboxPageAtOffset:4]]);
+
+    CIOLiteFolderMessagesRequest *other = [self inboxPageAtOffset:0];
+    other.include_body = YES;
+    XCTAssertNil([self.cache cachedResponseForRequest:other], @"parameters are part of the key");
+
+    // Responses received by the client are cached
+    [[NSNotificationCenter defaultCenter] postNotificationName:CIOAPIClientDidReceiveResponseNotification
+                                                        object:self.client
+                                                      userInfo:@{CIOAPIClientRequestKey: other,
+                                                                 CIOAPIClientResponseObjectKey: @[]}];
+    XCTAssertEqualObjects([self.cache cachedResponseForRequest:other], @[]);
+}
+
+- (void)testFlagChangeUpdatesInPlace {
+    [self cacheSampleListings];
+    [self.cache applyWebhookPayload:[self payloadForMessage:[self messageWithID:@"<b>" date:200 read:YES] folders:@[@"INBOX"]]];
+
+    NSArray *firstPage = [self.cache cachedResponseForRequest:[self inboxPageAtOffset:0]];
+    XCTAssertEqualObjects(firstPage[1][@"flags"], @{@"read": @YES});
+    XCTAssertNil(firstPage[1][@"bodies"], @"only fields the listing has are updated");
+    XCTAssertNotNil([self.cache cachedResponseForRequest:[self inboxPageAtOffset:2]]);
+    XCTAssertNotNil([self.cache cachedResponseForRequest:[self.client getFoldersForAccountWithLabel:@"main" includeNamesOnly:YES]]);
+    XCTAssertNil([self.cache cachedResponseForRequest:[self.client getFoldersForAccountWithLabel:@"main" includeNamesOnly:NO]]);
+}
+
+- (void)testNewMessageIsInserted {
+    [self cacheSampleListings];
+    [self.cache applyWebhookPayload:[self payloadForMessage:[self messageWithID:@"<d>" date:250 read:NO] folders:@[@"INBOX"]]];
+
+    NSArray *firstPage = [self.cache cachedResponseForRequest:[self inboxPageAtOffset:0]];
+    XCTAssertEqualObjects([firstPage valueForKey:@"message_id"], (@[@"<c>", @"<d>"]));
+    XCTAssertNil(firstPage[1][@"bodies"]);
+    XCTAssertNil([self.cache cachedResponseForRequest:[self inboxPageAtOffset:2]], @"later pages have shifted");
+
+    // A message in a folder missing from a names listing drops it
+    [self.cache applyWebhookPayload:[self payloadForMessage:[self messageWithID:@"<e>" date:50 read:NO] folders:@[@"New"]]];
+    XCTAssertNil([self.cache cachedResponseForRequest:[self.client getFoldersForAccountWithLabel:@"main" includeNamesOnly:YES]]);
+    XCTAssertEqual([[self.cache cachedResponseForRequest:[self inboxPageAtOffset:0]] count], 2u);
+}
+
+- (void)testMovedMessageLeavesFolder {
+    [self cacheSampleListings];
+    CIOLiteFolderMessagesRequest *archive = [self.client getMessagesForFolderWithPath:@"Archive" accountLabel:@"main"];
+    [self.cache setResponse:@[[self messageWithID:@"<z>" date:400 read:YES]] forRequest:archive];
+    [self.cache applyWebhookPayload:[self payloadForMessage:[self messageWithID:@"<b>" date:200 read:NO] folders:@[@"Archive"]]];
+
+    XCTAssertNil([self.cache cachedResponseForRequest:[self inboxPageAtOffset:0]]);
+    XCTAssertNil([self.cache cachedResponseForRequest:[self inboxPageAtOffset:2]]);
+    XCTAssertEqualObjects([[self.cache cachedResponseForRequest:archive] valueForKey:@"message_id"], (@[@"<z>", @"<b>"]));
+}
+
+- (void)testFailureDropsEverything {
+    [self cacheSampleListings];
+    [self.cache applyWebhookPayload:@{@"webhook_id": @"hook", @"data": @"failed"}];
+    XCTAssertEqual(self.cache.count, 0u);
+}
+
+- (void)testCountLimit {
+    self.cache.countLimit = 2;
+    [self cacheSampleListings];
+    XCTAssertEqual(self.cache.count, 2u);
+    XCTAssertNil([self.cache cachedResponseForRequest:[self inboxPageAtOffset:0]]);
+}
+
+
+- (void)testProjectedResponsesAreNotCached {
+    CIOStubServer *server = [[CIOStubServer alloc] initWithFixturesURL:[CIOStubServer defaultFixturesURL]];
+    NSError *error = nil;
+    XCTAssertTrue([server startWithError:&error], @"%@", error);
+    CIOLiteClient *client = [[CIOLiteClient alloc]
+        initWithBaseURLString:[NSURL URLWithString:@"lite/" relativeToURL:server.URL].absoluteString
+                  consumerKey:@"consumer_key"
+               consumerSecret:@"consumer_secret"
+                        token:@"token"
+                  tokenSecret:@"token_secret"
+                    accountID:@"anAccountId"];
+    client.URLScheme = @"http";
+    CIOLiteResultCache *cache = [[CIOLiteResultCache alloc] initWithClient:client];
+
+    CIOLiteFolderMessagesRequest *projected = [client getMessagesForFolderWithPath:@"INBOX" accountLabel:@"main"];
+    projected.projection = [NSSet setWithObject:@"subject"];
+    XCTAssertFalse([CIOLiteResultCache canCacheRequest:projected]);
+    XCTestExpectation *projectedFetch = [self expectationWithDescription:@"projected"];
+    [projected executeWithSuccess:^(NSArray *response) {
+      XCTAssertNil([response.firstObject objectForKey:@"addresses"]);
+      [projectedFetch fulfill];
+    } failure:^(NSError *failure) {
+      XCTFail(@"%@", failure);
+      [projectedFetch fulfill];
+    }];
+    [self waitForExpectationsWithTimeout:5 handler:nil];
+    XCTAssertEqual(cache.count, 0u);
+
+    XCTestExpectation *fullFetch = [self expectationWithDescription:@"full"];
+    [cache executeRequest:[client getMessagesForFolderWithPath:@"INBOX" accountLabel:@"main"] success:^(NSArray *response) {
+      XCTAssertNotNil([response.firstObject objectForKey:@"addresses"]);
+      [fullFetch fulfill];
+    } failure:^(NSError *failure) {
+      XCTFail(@"%@", failure);
+      [fullFetch fulfill];
+    }];
+    [self waitForExpectationsWithTimeout:5 handler:nil];
+    XCTAssertEqual(server.requestCount, 2u);
+    XCTAssertEqual(cache.count, 1u);
+    [server stop];
+}
+
+@end
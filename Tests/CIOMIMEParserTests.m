@@ -0,0 +1,211 @@
+//
+//  CIOMIMEParserTests.m
+//  CIOAPIClient
+//
+//  Copyright © 2015 Context.io. All rights reserved.
+//
+
+#import <XCTest/XCTest.h>
+#import "CIOMIMEParser.h"
+
+static NSString *const kCIOTestMessage =
+    @"From: Joe <joe@example.com>\r\n"
+    @"To: bob@example.com\r\n"
+    @"Subject: A long\r\n"
+    @" folded subject\r\n"
+    @"MIME-Version: 1.0\r\n"
+    @"Content-Type: multipart/mixed; boundary=\"outer\"\r\n"
+    @"\r\n"
+    @"This is the preamble.\r\n"
+    @"--outer\r\n"
+    @"Content-Type: multipart/alternative; boundary=outer-inner\r\n"
+    @"\r\n"
+    @"--outer-inner\r\n"
+    @"Content-Type: text/plain; charset=utf-8\r\n"
+    @"Content-Transfer-Encoding: quoted-printable\r\n"
+    @"\r\n"
+    @"Caf=C3=A9 is a soft=\r\n"
+    @" break\r\n"
+    @"--outer-inner\r\n"
+    @"Content-Type: text/html\r\n"
+    @"\r\n"
+    @"<p>Hi</p>\r\n"
+    @"--outer-inner--\r\n"
+    @"--outer\r\n"
+    @"Content-Type: application/octet-stream; name=\"ignored.bin\"\r\n"
+    @"Content-Disposition: attachment; filename=\"hello.txt\"\r\n"
+    @"Content-Transfer-Encoding: base64\r\n"
+    @"Content-ID: <att1@example.com>\r\n"
+    @"\r\n"
+    @"SGVsbG8s\r\n"
+    @"IHdvcmxk\r\n"
+    @"IQ==\r\n"
+    @"--outer--\r\n"
+    @"Epilogue\r\n";
+
+@interface CIOMIMEParserTestDelegate : NSObject <CIOMIMEParserDelegate>
+
+@property (nonatomic) NSMutableArray *events;
+@property (nonatomic) NSMutableDictionary *bodies;
+@property (nonatomic) NSUInteger abortAtIndex;
+
+@end
+
+@implementation CIOMIMEParserTestDelegate
+
+- (instancetype)init {
+    if ((self = [super init])) {
+        _events = [NSMutableArray array];
+        _bodies = [NSMutableDictionary dictionary];
+        _abortAtIndex = NSNotFound;
+    }
+    return self;
+}
+
+- (void)parser:(CIOMIMEParser *)parser didStartPart:(CIOMIMEPart *)part {
+    [self.events addObject:[NSString stringWithFormat:@"start %lu", (unsigned long)part.index]];
+    if (part.index == self.abortAtIndex) {
+        [parser abortParsing];
+    }
+}
+
+- (void)parser:(CIOMIMEParser *)parser part:(CIOMIMEPart *)part foundBodyData:(NSData *)data {
+    NSMutableData *body = self.bodies[@(part.index)];
+    if (!body) {
+        body = [NSMutableData data];
+        self.bodies[@(part.index)] = body;
+    }
+    [body appendData:data];
+}
+
+- (void)parser:(CIOMIMEParser *)parser didEndPart:(CIOMIMEPart *)part {
+    [self.events addObject:[NSString stringWithFormat:@"end %lu", (unsigned long)part.index]];
+}
+
+@end
+
+@interface CIOMIMEParserTests : XCTestCase
+
+@property (nonatomic) CIOMIMEParser *parser;
+
+@end
+
+@implementation CIOMIMEParserTests
+
+- (void)setUp {
+    [super setUp];
+    self.parser = [[CIOMIMEParser alloc] initWithData:[kCIOTestMessage dataUsingEncoding:NSUTF8StringEncoding]];
+}
+
+- (NSString *)decodedStringAtIndex:(NSUInteger)index {
+    NSData *data = [self.parser decodedDataForPartAtIndex:index error:nil];
+    return [[NSString alloc] initWithData:data encoding:NSUTF8StringEncoding];
+}
+
+- (void)testStructure {
+    NSArray *parts = self.parser.parts;
+    XCTAssertEqual(parts.count, 5u);
+    NSArray *types = [parts valueForKey:@"contentType"];
+    XCTAssertEqualObjects(types, (@[@"multipart/mixed", @"multipart/alternative", @"text/plain", @"text/html",
+                                    @"application/octet-stream"]));
+    XCTAssertEqualObjects([parts valueForKey:@"depth"], (@[@0, @1, @2, @2, @1]));
+    XCTAssertEqual([parts[2] parentIndex], 1u);
+    XCTAssertEqual([parts[0] parentIndex], (NSUInteger)NSNotFound);
+    XCTAssertTrue([parts[0] isMultipart]);
+    XCTAssertFalse([parts[2] isAttachment]);
+}
+
+- (void)testHeaders {
+    CIOMIMEPart *message = [self.parser partAtIndex:0];
+    XCTAssertEqualObjects([message valueForHeader:@"subject"], @"A long folded subject");
+    XCTAssertEqualObjects([message valueForHeader:@"TO"], @"bob@example.com");
+    XCTAssertEqualObjects(message.contentTypeParameters[@"boundary"], @"outer");
+    XCTAssertEqual(message.headers.count, 5u);
+}
+
+- (void)testAttachment {
+    CIOMIMEPart *attachment = [self.parser partAtIndex:4];
+    XCTAssertTrue(attachment.isAttachment);
+    XCTAssertEqualObjects(attachment.disposition, @"attachment");
+    XCTAssertEqualObjects(attachment.fileName, @"hello.txt");
+    XCTAssertEqualObjects(attachment.contentID, @"att1@example.com");
+    XCTAssertEqual(attachment.transferEncoding, CIOTransferEncodingBase64);
+    XCTAssertEqualObjects([self decodedStringAtIndex:4], @"Hello, world!");
+}
+
+- (void)testQuotedPrintableBody {
+    XCTAssertEqualObjects([self decodedStringAtIndex:2], @"Café is a soft break");
+    XCTAssertEqualObjects([self decodedStringAtIndex:3], @"<p>Hi</p>");
+}
+
+- (void)testMissingPart {
+    NSError *error = nil;
+    XCTAssertNil([self.parser partAtIndex:5]);
+    XCTAssertNil([self.parser decodedDataForPartAtIndex:5 error:&error]);
+    XCTAssertNotNil(error);
+}
+
+- (void)testDelegateEvents {
+    CIOMIMEParserTestDelegate *delegate = [CIOMIMEParserTestDelegate new];
+    self.parser.delegate = delegate;
+    self.parser.decodeChunkSize = 3;
+    XCTAssertTrue([self.parser parse]);
+    XCTAssertEqualObjects(delegate.events, (@[@"start 0", @"start 1", @"start 2", @"end 2", @"start 3", @"end 3",
+                                              @"end 1", @"start 4", @"end 4", @"end 0"]));
+    NSString *text = [[NSString alloc] initWithData:delegate.bodies[@2] encoding:NSUTF8StringEncoding];
+    XCTAssertEqualObjects(text, @"Café is a soft break");
+    NSString *attachment = [[NSString alloc] initWithData:delegate.bodies[@4] encoding:NSUTF8StringEncoding];
+    XCTAssertEqualObjects(attachment, @"Hello, world!");
+    XCTAssertNil(delegate.bodies[@0]);
+    XCTAssertNil(delegate.bodies[@1]);
+}
+
+- (void)testAbort {
+    CIOMIMEParserTestDelegate *delegate = [CIOMIMEParserTestDelegate new];
+    delegate.abortAtIndex = 2;
+    self.parser.delegate = delegate;
+    XCTAssertFalse([self.parser parse]);
+    XCTAssertEqualObjects(delegate.events, (@[@"start 0", @"start 1", @"start 2"]));
+}
+
+- (void)testWriteAttachmentToFile {
+    NSString *path = [NSTemporaryDirectory() stringByAppendingPathComponent:[[NSUUID UUID] UUIDString]];
+    NSURL *fileURL = [NSURL fileURLWithPath:path];
+    NSError *error = nil;
+    XCTAssertTrue([self.parser writeDecodedPartAtIndex:4 toFileURL:fileURL error:&error]);
+    XCTAssertNil(error);
+    XCTAssertEqualObjects([NSData dataWithContentsOfURL:fileURL], [@"Hello, world!" dataUsingEncoding:NSUTF8StringEncoding]);
+    XCTAssertFalse([self.parser writeDecodedPartAtIndex:4 toFileURL:fileURL error:&error]);
+    XCTAssertEqual(error.code, NSFileWriteFileExistsError);
+    [[NSFileManager defaultManager] removeItemAtURL:fileURL error:nil];
+}
+
+- (void)testMappedFile {
+    NSString *path = [NSTemporaryDirectory() stringByAppendingPathComponent:[[NSUUID UUID] UUIDString]];
+    [[kCIOTestMessage dataUsingEncoding:NSUTF8StringEncoding] writeToFile:path atomically:YES];
+    CIOMIMEParser *parser = [[CIOMIMEParser alloc] initWithContentsOfURL:[NSURL fileURLWithPath:path] error:nil];
+    XCTAssertNotNil(parser);
+    XCTAssertEqual(parser.parts.count, 5u);
+    [[NSFileManager defaultManager] removeItemAtPath:path error:nil];
+}
+
+- (void)testUnterminatedMultipartAndBareLineFeeds {
+    NSString *message = @"Content-Type: multipart/mixed; boundary=b\n"
+                        @"\n"
+                        @"--b\n"
+                        @"\n"
+                        @"first\n"
+                        @"--b\n"
+                        @"Content-Type: text/plain\n"
+                        @"\n"
+                        @"second";
+    CIOMIMEParser *parser = [[CIOMIMEParser alloc] initWithData:[message dataUsingEncoding:NSUTF8StringEncoding]];
+    XCTAssertEqual(parser.parts.count, 3u);
+    XCTAssertEqualObjects([[parser partAtIndex:1] contentType], @"text/plain");
+    NSData *second = [parser decodedDataForPartAtIndex:2 error:nil];
+    XCTAssertEqualObjects([[NSString alloc] initWithData:second encoding:NSUTF8StringEncoding], @"second");
+    NSData *first = [parser decodedDataForPartAtIndex:1 error:nil];
+    XCTAssertEqualObjects([[NSString alloc] initWithData:first encoding:NSUTF8StringEncoding], @"first");
+}
+
+@end
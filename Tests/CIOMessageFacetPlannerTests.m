@@ -0,0 +1,178 @@
+//
+//  CIOMessageFacetPlannerTests.m
+//  CIOAPIClient
+//
+//  Copyright © 2015 Context.io. All rights reserved.
+//
+
+#import <XCTest/XCTest.h>
+#import "CIOV2Client.h"
+#import "CIOMessageFacetPlanner.h"
+
+// Answers list requests with `page`, or fails them when `page` is nil, and per-message flag requests with the message
+// seen, unless the message is in `failingMessageIDs`
+@interface CIOFacetClient : CIOV2Client
+
+@property (nonatomic) NSArray *page;
+@property (nonatomic) NSSet *failingMessageIDs;
+@property (nonatomic) NSMutableArray *paths;
+
+@end
+
+@implementation CIOFacetClient
+
+- (void)executeArrayRequest:(CIOArrayRequest *)request
+                    success:(void (^)(NSArray *))success
+                    failure:(void (^)(NSError *))failure {
+    [self.paths addObject:request.path];
+    NSArray *page = self.page;
+    dispatch_async(dispatch_get_main_queue(), ^{
+      if (page) {
+          success(page);
+      } else {
+          failure([NSError errorWithDomain:NSURLErrorDomain code:NSURLErrorTimedOut userInfo:nil]);
+      }
+    });
+}
+
+- (void)executeDictionaryRequest:(CIODictionaryRequest *)request
+                         success:(void (^)(NSDictionary *))success
+                         failure:(void (^)(NSError *))failure {
+    [self.paths addObject:request.path];
+    NSString *messageID = request.path.pathComponents[request.path.pathComponents.count - 2];
+    BOOL fails = [self.failingMessageIDs containsObject:messageID];
+    dispatch_async(dispatch_get_main_queue(), ^{
+      if (fails) {
+          failure([NSError errorWithDomain:NSURLErrorDomain code:NSURLErrorBadServerResponse userInfo:nil]);
+      } else {
+          success(@{@"seen": @YES});
+      }
+    });
+}
+
+@end
+
+@interface CIOMessageFacetPlannerTests : XCTestCase
+
+@property (nonatomic) CIOFacetClient *client;
+@property (nonatomic) CIOMessageFacetPlanner *planner;
+
+@end
+
+@implementation CIOMessageFacetPlannerTests
+
+- (void)setUp {
+    [super setUp];
+    self.client = [[CIOFacetClient alloc] initWithConsumerKey:@"consumer_key" consumerSecret:@"consumer_secret"];
+    [self.client setValue:@"anAccountId" forKey:@"accountID"];
+    self.client.paths = [NSMutableArray array];
+    self.planner = [[CIOMessageFacetPlanner alloc] initWithClient:self.client];
+}
+
+- (void)tearDown {
+    [self.client clearCredentials];
+    [super tearDown];
+}
+
+- (void)testStrategy {
+    XCTAssertEqual([self.planner strategyForMessageCount:1 facets:CIOMessageFacetFlags], CIOMessageFacetStrategyPerMessage);
+    XCTAssertEqual([self.planner strategyForMessageCount:20 facets:CIOMessageFacetFlags], CIOMessageFacetStrategyRefetchPage);
+    XCTAssertEqual([self.planner strategyForMessageCount:2 facets:CIOMessageFacetFlags | CIOMessageFacetHeaders],
+                   CIOMessageFacetStrategyPerMessage);
+    XCTAssertEqual([self.planner strategyForMessageCount:4 facets:CIOMessageFacetFlags | CIOMessageFacetHeaders],
+                   CIOMessageFacetStrategyRefetchPage);
+    XCTAssertEqual([self.planner strategyForMessageCount:20 facets:0], CIOMessageFacetStrategyPerMessage);
+
+    // Pages slow to include details favour per-message requests, unless those have to wait for a free slot a lot
+    self.planner.includeLatencyPerMessage = 1;
+    XCTAssertEqual([self.planner strategyForMessageCount:20 facets:CIOMessageFacetBody], CIOMessageFacetStrategyPerMessage);
+    self.planner.maximumConcurrentRequests = 1;
+    self.planner.requestLatency = 2;
+    XCTAssertEqual([self.planner strategyForMessageCount:20 facets:CIOMessageFacetBody], CIOMessageFacetStrategyRefetchPage);
+}
+
+- (void)testRefetchRequest {
+    CIOFolderMessagesRequest *listRequest = [self.client getMessagesForFolderWithPath:@"INBOX" sourceLabel:@"0"];
+    listRequest.include_thread_size = YES;
+    listRequest.flag_seen = @NO;
+    CIOArrayRequest *request =
+        [self.planner refetchRequestForListRequest:listRequest facets:CIOMessageFacetBody | CIOMessageFacetHeaders];
+    XCTAssertEqualObjects(request.path, @"accounts/anAccountId/sources/0/folders/INBOX/messages");
+    XCTAssertEqualObjects(request.method, @"GET");
+    XCTAssertEqualObjects(request.parameters[@"include_body"], @YES);
+    XCTAssertEqualObjects(request.parameters[@"include_headers"], @"1");
+    XCTAssertNil(request.parameters[@"include_flags"]);
+    XCTAssertEqualObjects(request.parameters[@"include_thread_size"], @YES);
+    XCTAssertEqualObjects(request.parameters[@"flag_seen"], @NO);
+}
+
+- (void)testLoadedFacetsAreNotFetchedAgain {
+    NSArray *messages = @[@{@"message_id": @"m1", @"flags": @[@"\\Seen"]}];
+    XCTestExpectation *expectation = [self expectationWithDescription:@"completion"];
+    [self.planner loadFacets:CIOMessageFacetFlags
+                 forMessages:messages
+                 listRequest:nil
+                  completion:^(NSArray *loaded, NSDictionary *errors) {
+                    NSDictionary *flags =
+                        @{@"seen": @YES, @"answered": @NO, @"flagged": @NO, @"deleted": @NO, @"draft": @NO};
+                    XCTAssertEqualObjects(loaded, (@[@{@"message_id": @"m1", @"flags": flags}]));
+                    XCTAssertEqual(errors.count, 0u);
+                    [expectation fulfill];
+                  }];
+    [self waitForExpectationsWithTimeout:1 handler:nil];
+}
+
+- (NSDictionary *)loadFlagsOfMessagesWithIDs:(NSArray *)messageIDs {
+    // One request at a time makes refetching the page the faster strategy
+    self.planner.maximumConcurrentRequests = 1;
+    NSMutableArray *messages = [NSMutableArray array];
+    for (NSString *messageID in messageIDs) {
+        [messages addObject:@{@"message_id": messageID}];
+    }
+    __block NSDictionary *result = nil;
+    XCTestExpectation *expectation = [self expectationWithDescription:@"completion"];
+    [self.planner loadFacets:CIOMessageFacetFlags
+                 forMessages:messages
+                 listRequest:[self.client getMessagesForFolderWithPath:@"INBOX" sourceLabel:@"0"]
+                  completion:^(NSArray *loaded, NSDictionary *errors) {
+                    NSMutableDictionary *flags = [NSMutableDictionary dictionary];
+                    for (NSDictionary *message in loaded) {
+                        flags[message[@"message_id"]] = message[@"flags"] ?: [NSNull null];
+                    }
+                    result = @{@"flags": flags, @"errors": errors};
+                    [expectation fulfill];
+                  }];
+    [self waitForExpectationsWithTimeout:1 handler:nil];
+    return result;
+}
+
+- (void)testRefetchedPageIsMerged {
+    // m3 moved out of the folder since it was listed
+    self.client.page = @[@{@"message_id": @"m2", @"flags": @[@"\\Flagged"]},
+                         @{@"message_id": @"m1", @"flags": @{@"seen": @NO}}];
+    NSDictionary *result = [self loadFlagsOfMessagesWithIDs:@[@"m1", @"m2", @"m3"]];
+    XCTAssertEqualObjects(result[@"errors"], @{});
+    XCTAssertEqualObjects(result[@"flags"][@"m1"], @{@"seen": @NO});
+    XCTAssertEqualObjects(result[@"flags"][@"m2"],
+                          (@{@"seen": @NO, @"answered": @NO, @"flagged": @YES, @"deleted": @NO, @"draft": @NO}));
+    XCTAssertEqualObjects(result[@"flags"][@"m3"], @{@"seen": @YES});
+    XCTAssertEqualObjects(self.client.paths, (@[@"accounts/anAccountId/sources/0/folders/INBOX/messages",
+                                                @"accounts/anAccountId/messages/m3/flags"]));
+    XCTAssertLessThan(self.planner.requestLatency, 0.3);
+}
+
+- (void)testFailedRefetchFallsBackToPerMessageRequests {
+    self.client.failingMessageIDs = [NSSet setWithObject:@"m2"];
+    NSDictionary *result = [self loadFlagsOfMessagesWithIDs:@[@"m1", @"m2", @"m3"]];
+    XCTAssertEqualObjects([result[@"errors"] allKeys], @[@"m2"]);
+    XCTAssertEqualObjects(result[@"flags"][@"m1"], @{@"seen": @YES});
+    XCTAssertEqualObjects(result[@"flags"][@"m2"], [NSNull null]);
+    XCTAssertEqualObjects(result[@"flags"][@"m3"], @{@"seen": @YES});
+    XCTAssertEqualObjects(self.client.paths, (@[@"accounts/anAccountId/sources/0/folders/INBOX/messages",
+                                                @"accounts/anAccountId/messages/m1/flags",
+                                                @"accounts/anAccountId/messages/m2/flags",
+                                                @"accounts/anAccountId/messages/m3/flags"]));
+    XCTAssertEqual(self.planner.includeLatencyPerMessage, 0.05);
+}
+
+@end
@@ -0,0 +1,318 @@
+//
+//  CIOMessageIndexTests.m
+//  CIOAPIClient
+//
+//  Copyright © 2015 Context.io. All rights reserved.
+//
+
+#import <XCTest/XCTest.h>
+#import "CIOV2Client.h"
+#import "CIOMessageStore.h"
+#import "CIOMessageIndex.h"
+
+// Serves `recentMessages` newest first, filtered by `indexed_after` and paged like the API, 25 at a time by default
+@interface CIORecentMessagesClient : CIOV2Client
+
+@property (nonatomic) NSArray *recentMessages;
+@property (nonatomic) NSMutableArray *requests;
+
+@end
+
+@implementation CIORecentMessagesClient
+
+- (void)executeArrayRequest:(CIOArrayRequest *)request
+                    success:(void (^)(NSArray *))success
+                    failure:(void (^)(NSError *))failure {
+    [self.requests addObject:request.parameters];
+    NSNumber *indexedAfter = request.parameters[@"indexed_after"];
+    NSMutableArray *messages = [NSMutableArray array];
+    for (NSDictionary *message in self.recentMessages) {
+        if (!indexedAfter || [message[@"date_indexed"] compare:indexedAfter] == NSOrderedDescending) {
+            [messages addObject:message];
+        }
+    }
+    [messages sortUsingDescriptors:@[[NSSortDescriptor sortDescriptorWithKey:@"date" ascending:NO]]];
+    NSUInteger offset = MIN([request.parameters[@"offset"] unsignedIntegerValue], messages.count);
+    NSUInteger limit = request.parameters[@"limit"] ? MIN([request.parameters[@"limit"] unsignedIntegerValue], 100) : 25;
+    NSArray *page = [messages subarrayWithRange:NSMakeRange(offset, MIN(limit, messages.count - offset))];
+    dispatch_async(dispatch_get_main_queue(), ^{
+      success(page);
+    });
+}
+
+@end
+
+@interface CIOMessageIndexTests : XCTestCase
+
+@property (nonatomic) NSURL *fileURL;
+@property (nonatomic) CIOMessageStore *store;
+@property (nonatomic) CIOMessageIndex *index;
+@property (nonatomic) CIOV2Client *client;
+
+@end
+
+@implementation CIOMessageIndexTests
+
+- (void)setUp {
+    [super setUp];
+    NSString *path = [NSTemporaryDirectory() stringByAppendingPathComponent:[[NSUUID UUID] UUIDString]];
+    self.fileURL = [NSURL fileURLWithPath:path];
+    self.store = [[CIOMessageStore alloc] initWithFileURL:self.fileURL error:nil];
+    self.client = [[CIOV2Client alloc] initWithConsumerKey:@"consumer_key" consumerSecret:@"consumer_secret"];
+    [self.client setValue:@"anAccountId" forKey:@"accountID"];
+
+    [self.store addMessages:@[
+        @{@"message_id": @"m1", @"date": @100, @"date_indexed": @110, @"subject": @"Quarterly invoice for March",
+          @"folders": @[@"Inbox"], @"sources": @[@{@"label": @"work"}],
+          @"addresses": @{@"from": @{@"email": @"Billing@Example.com"}, @"to": @[@{@"email": @"me@home.org"}]},
+          @"files": @[@{@"file_name": @"Invoice-March.PDF", @"size": @2048}]},
+        @{@"message_id": @"m2", @"date": @200, @"date_indexed": @210, @"subject": @"Lunch tomorrow?",
+          @"folders": @[@"INBOX", @"Friends"],
+          @"addresses": @{@"from": @{@"email": @"pal@friends.net"}, @"to": @[@{@"email": @"me@home.org"}],
+                          @"cc": @[@{@"email": @"billing@example.com"}]}},
+        @{@"message_id": @"m3", @"date": @300, @"date_indexed": @310, @"subject": @"Re: invoices",
+          @"folders": @[@"Archive"],
+          @"addresses": @{@"from": @{@"email": @"me@home.org"}, @"to": @[@{@"email": @"billing@example.com"}]},
+          @"files": @[@{@"file_name": @"notes.txt", @"size": @10}]},
+    ] accountID:@"anAccountId"];
+    [self.store addMessages:@[@{@"message_id": @"other", @"date": @400, @"subject": @"invoice",
+                                @"folders": @[@"Inbox"]}]
+                  accountID:@"otherAccount"];
+    self.index = [[CIOMessageIndex alloc] initWithStore:self.store];
+}
+
+- (void)tearDown {
+    [self.client clearCredentials];
+    [[NSFileManager defaultManager] removeItemAtURL:self.fileURL error:nil];
+    [super tearDown];
+}
+
+- (NSArray *)messageIDsMatching:(void (^)(CIOMessagesRequest *request))configure {
+    CIOMessagesRequest *request = [self.client getMessages];
+    configure(request);
+    return [[self.index messagesMatchingRequest:request] valueForKey:@"message_id"];
+}
+
+- (void)testAccountScope {
+    XCTAssertEqual(self.index.count, 4u);
+    XCTAssertEqualObjects([self messageIDsMatching:^(CIOMessagesRequest *request) {}], (@[@"m3", @"m2", @"m1"]));
+}
+
+- (void)testAddressFilters {
+    XCTAssertEqualObjects([self messageIDsMatching:^(CIOMessagesRequest *request) {
+                            request.from = @"billing@example.com";
+                          }],
+                          @[@"m1"]);
+    XCTAssertEqualObjects([self messageIDsMatching:^(CIOMessagesRequest *request) {
+                            request.from = @[@"billing@example.com", @"pal@friends.net"];
+                          }],
+                          (@[@"m2", @"m1"]));
+    XCTAssertEqualObjects([self messageIDsMatching:^(CIOMessagesRequest *request) {
+                            request.email = @"billing@example.com";
+                          }],
+                          (@[@"m3", @"m2", @"m1"]));
+    XCTAssertEqualObjects([self messageIDsMatching:^(CIOMessagesRequest *request) {
+                            request.email = @"friends.net";
+                          }],
+                          @[@"m2"]);
+    XCTAssertEqualObjects([self messageIDsMatching:^(CIOMessagesRequest *request) {
+                            request.to = @"me@home.org";
+                            request.cc = @"billing@example.com";
+                          }],
+                          @[@"m2"]);
+}
+
+- (void)testSubjectFilter {
+    XCTAssertEqualObjects([self messageIDsMatching:^(CIOMessagesRequest *request) {
+                            request.subject = @"invoice";
+                          }],
+                          (@[@"m3", @"m1"]));
+    XCTAssertEqualObjects([self messageIDsMatching:^(CIOMessagesRequest *request) {
+                            request.subject = @"ly INVOICE fo";
+                          }],
+                          @[@"m1"]);
+    XCTAssertEqualObjects([self messageIDsMatching:^(CIOMessagesRequest *request) {
+                            request.subject = @"invoice for April";
+                          }],
+                          @[]);
+    XCTAssertEqualObjects([self messageIDsMatching:^(CIOMessagesRequest *request) {
+                            request.subject = @"/^Re:/";
+                          }],
+                          @[@"m3"]);
+}
+
+- (void)testFolderSourceAndFileFilters {
+    XCTAssertEqualObjects([self messageIDsMatching:^(CIOMessagesRequest *request) {
+                            request.folder = @"inbox";
+                          }],
+                          (@[@"m2", @"m1"]));
+    XCTAssertEqualObjects([self messageIDsMatching:^(CIOMessagesRequest *request) {
+                            request.source = @"work";
+                          }],
+                          @[@"m1"]);
+    XCTAssertEqualObjects([self messageIDsMatching:^(CIOMessagesRequest *request) {
+                            request.file_name = @"*.pdf";
+                          }],
+                          @[@"m1"]);
+    XCTAssertEqualObjects([self messageIDsMatching:^(CIOMessagesRequest *request) {
+                            request.file_name = @"/\\.(txt|pdf)$/";
+                          }],
+                          (@[@"m3", @"m1"]));
+    XCTAssertEqualObjects([self messageIDsMatching:^(CIOMessagesRequest *request) {
+                            request.file_name = @"notes.txt";
+                            request.file_size_min = @100;
+                          }],
+                          @[]);
+}
+
+- (void)testDateRangesSortingAndPaging {
+    XCTAssertEqualObjects([self messageIDsMatching:^(CIOMessagesRequest *request) {
+                            request.date_after = [NSDate dateWithTimeIntervalSince1970:100];
+                            request.date_before = [NSDate dateWithTimeIntervalSince1970:300];
+                          }],
+                          @[@"m2"]);
+    XCTAssertEqualObjects([self messageIDsMatching:^(CIOMessagesRequest *request) {
+                            request.to = @"me@home.org";
+                            request.date_before = [NSDate dateWithTimeIntervalSince1970:250];
+                          }],
+                          (@[@"m2", @"m1"]));
+    XCTAssertEqualObjects([self messageIDsMatching:^(CIOMessagesRequest *request) {
+                            request.indexed_after = [NSDate dateWithTimeIntervalSince1970:210];
+                          }],
+                          @[@"m3"]);
+    XCTAssertEqualObjects([self messageIDsMatching:^(CIOMessagesRequest *request) {
+                            request.sort_order = CIOSortOrderAscending;
+                            request.offset = 1;
+                            request.limit = 1;
+                          }],
+                          @[@"m2"]);
+}
+
+- (void)testFollowsStoreChanges {
+    [self.store removeMessagesWithIDs:@[@"m1"]];
+    [self.store addMessages:@[@{@"message_id": @"m4", @"date": @500, @"subject": @"Invoice reminder",
+                                @"folders": @[@"Inbox"]}]
+                  accountID:@"anAccountId"];
+    XCTAssertEqualObjects([self messageIDsMatching:^(CIOMessagesRequest *request) {
+                            request.subject = @"invoice";
+                          }],
+                          (@[@"m4", @"m3"]));
+    XCTAssertEqualObjects([self messageIDsMatching:^(CIOMessagesRequest *request) {
+                            request.folder = @"INBOX";
+                          }],
+                          (@[@"m4", @"m2"]));
+}
+
+- (void)testCompactsRemovedDocuments {
+    for (NSUInteger i = 0; i < 1100; i++) {
+        NSString *subject = i % 2 ? @"Lunch today?" : @"Lunch tomorrow?";
+        [self.store addMessages:@[@{@"message_id": @"m2", @"date": @200, @"subject": subject, @"folders": @[@"INBOX"],
+                                    @"addresses": @{@"from": @{@"email": @"pal@friends.net"}}}]
+                      accountID:@"anAccountId"];
+    }
+    XCTAssertLessThan([[self.index valueForKey:@"documents"] count], 1024u);
+    XCTAssertEqual(self.index.count, 4u);
+    XCTAssertEqualObjects([self messageIDsMatching:^(CIOMessagesRequest *request) {
+                            request.subject = @"today";
+                          }],
+                          @[@"m2"]);
+    XCTAssertEqualObjects([self messageIDsMatching:^(CIOMessagesRequest *request) {
+                            request.subject = @"invoice";
+                          }],
+                          (@[@"m3", @"m1"]));
+    XCTAssertEqualObjects([self messageIDsMatching:^(CIOMessagesRequest *request) {
+                            request.from = @"pal@friends.net";
+                          }],
+                          @[@"m2"]);
+}
+
+- (void)testRequestsNeedingTheServer {
+    CIOMessagesRequest *request = [self.client getMessages];
+    request.include_body = YES;
+    XCTAssertFalse([self.index canEvaluateRequest:request]);
+    XCTAssertNil([self.index messagesMatchingRequest:request]);
+    request = [self.client getMessages];
+    request.subject = @"/(unbalanced/";
+    XCTAssertFalse([self.index canEvaluateRequest:request]);
+}
+
+- (void)testExecuteWithinSyncedRange {
+    [self.store setHighWaterMark:[NSDate dateWithTimeIntervalSince1970:310] forAccountID:@"anAccountId"];
+    CIOMessagesRequest *request = [self.client getMessages];
+    request.indexed_before = [NSDate dateWithTimeIntervalSince1970:300];
+    XCTestExpectation *expectation = [self expectationWithDescription:@"local results"];
+    [self.index executeRequest:request
+                       success:^(NSArray *messages) {
+                         XCTAssertEqualObjects([messages valueForKey:@"message_id"], (@[@"m2", @"m1"]));
+                         [expectation fulfill];
+                       }
+                       failure:nil];
+    [self waitForExpectationsWithTimeout:1 handler:nil];
+}
+
+- (CIORecentMessagesClient *)recentMessagesClientWithCount:(NSInteger)count {
+    CIORecentMessagesClient *client = [[CIORecentMessagesClient alloc] initWithConsumerKey:@"consumer_key"
+                                                                            consumerSecret:@"consumer_secret"];
+    [client setValue:@"anAccountId" forKey:@"accountID"];
+    NSMutableArray *messages = [NSMutableArray array];
+    for (NSInteger i = 0; i < count; i++) {
+        [messages addObject:@{@"message_id": [NSString stringWithFormat:@"r%ld", (long)i], @"date": @(1000 + i),
+                              @"date_indexed": @(1000 + i), @"folders": @[@"Inbox"]}];
+    }
+    client.recentMessages = messages;
+    client.requests = [NSMutableArray array];
+    [self.store setHighWaterMark:[NSDate dateWithTimeIntervalSince1970:310] forAccountID:@"anAccountId"];
+    return client;
+}
+
+- (NSArray *)executeRequest:(CIOMessagesRequest *)request {
+    __block NSArray *result = nil;
+    XCTestExpectation *expectation = [self expectationWithDescription:@"merged results"];
+    [self.index executeRequest:request
+                       success:^(NSArray *messages) {
+                         result = messages;
+                         [expectation fulfill];
+                       }
+                       failure:^(NSError *error) {
+                         XCTFail(@"%@", error);
+                         [expectation fulfill];
+                       }];
+    [self waitForExpectationsWithTimeout:1 handler:nil];
+    return result;
+}
+
+- (void)testExecuteWithoutLimitFetchesEveryRecentMessage {
+    CIORecentMessagesClient *client = [self recentMessagesClientWithCount:130];
+    NSArray *messages = [self executeRequest:[client getMessages]];
+    XCTAssertEqual(messages.count, 133u);
+    XCTAssertEqualObjects([messages.firstObject valueForKey:@"message_id"], @"r129");
+    XCTAssertEqualObjects([messages.lastObject valueForKey:@"message_id"], @"m1");
+    XCTAssertEqualObjects([client.requests valueForKey:@"offset"], (@[@0, @100]));
+    XCTAssertEqualObjects([client.requests valueForKey:@"indexed_after"], (@[@310, @310]));
+    [client clearCredentials];
+}
+
+- (void)testExecutePageBeyondOneRecentPage {
+    CIORecentMessagesClient *client = [self recentMessagesClientWithCount:120];
+    CIOMessagesRequest *request = [client getMessages];
+    request.offset = 110;
+    request.limit = 20;
+    NSArray *messages = [self executeRequest:request];
+    XCTAssertEqualObjects([messages valueForKey:@"message_id"],
+                          (@[@"r9", @"r8", @"r7", @"r6", @"r5", @"r4", @"r3", @"r2", @"r1", @"r0",
+                             @"m3", @"m2", @"m1"]));
+    XCTAssertEqual(client.requests.count, 2u);
+    [client clearCredentials];
+}
+
+- (void)testExecuteFallsBackAfterTooManyRecentPages {
+    CIORecentMessagesClient *client = [self recentMessagesClientWithCount:1050];
+    NSArray *messages = [self executeRequest:[client getMessages]];
+    // The unchanged request gets the API's default page of 25
+    XCTAssertEqual(messages.count, 25u);
+    XCTAssertEqual(client.requests.count, 11u);
+    XCTAssertNil([client.requests.lastObject objectForKey:@"indexed_after"]);
+    [client clearCredentials];
+}
+
+@end
@@ -0,0 +1,142 @@
+//
+//  CIOMessageMetadataFileTests.m
+//  CIOAPIClient
+//
+//  Copyright © 2015 Context.io. All rights reserved.
+//
+
+#import <XCTest/XCTest.h>
+#import "CIOMessageMetadataFile.h"
+#import "CIOMessageFlags.h"
+
+@interface CIOMessageMetadataFileTests : XCTestCase
+
+@property (nonatomic) NSURL *directoryURL;
+
+@end
+
+@implementation CIOMessageMetadataFileTests
+
+- (void)setUp {
+    [super setUp];
+    NSString *path = [NSTemporaryDirectory() stringByAppendingPathComponent:[[NSUUID UUID] UUIDString]];
+    self.directoryURL = [NSURL fileURLWithPath:path isDirectory:YES];
+}
+
+- (void)tearDown {
+    [[NSFileManager defaultManager] removeItemAtURL:self.directoryURL error:nil];
+    [super tearDown];
+}
+
+- (NSArray *)sampleMessages {
+    return @[
+        @{@"message_id": @"m1", @"email_message_id": @"<m1@example.com>", @"gmail_thread_id": @"t1",
+          @"date": @1440000000, @"date_indexed": @1440000100, @"subject": @"Café menu",
+          @"addresses": @{@"from": @{@"email": @"chef@example.com"},
+                          @"to": @[@{@"email": @"a@example.com"}, @{@"email": @"b@example.com"}]},
+          @"folders": @[@"INBOX", @"Food"], @"files": @[@{}, @{}],
+          @"flags": @{@"seen": @YES, @"flagged": @NO}},
+        @{@"message_id": @"m2", @"date": @1440000200, @"subject": @"Café menu",
+          @"addresses": @{@"from": @{@"email": @"chef@example.com"}}, @"flags": @[@"\\Answered", @"\\Draft"]},
+    ];
+}
+
+- (void)testRoundTrip {
+    NSError *error = nil;
+    CIOMessageMetadataFile *file = [[CIOMessageMetadataFile alloc] initWithDirectoryURL:self.directoryURL error:&error];
+    XCTAssertNotNil(file, @"%@", error);
+    XCTAssertEqual(file.count, 0u);
+    XCTAssertTrue([file appendMessages:[self sampleMessages] error:&error], @"%@", error);
+    XCTAssertEqual(file.count, 2u);
+
+    XCTAssertEqual([file dateAtIndex:0], 1440000000);
+    XCTAssertEqual([file dateIndexedAtIndex:0], 1440000100);
+    XCTAssertEqualObjects([file stringForField:CIOMessageMetadataFieldSubject atIndex:0], @"Café menu");
+    XCTAssertEqualObjects([file stringForField:CIOMessageMetadataFieldTo atIndex:0], @"a@example.com\nb@example.com");
+    XCTAssertEqualObjects([file stringForField:CIOMessageMetadataFieldGmailThreadID atIndex:0], @"t1");
+    XCTAssertNil([file stringForField:CIOMessageMetadataFieldGmailThreadID atIndex:1]);
+    XCTAssertEqual([file fileCountAtIndex:0], 2u);
+    XCTAssertEqual([file fileCountAtIndex:1], 0u);
+
+    CIOMessageFlagBits known = 0;
+    XCTAssertEqual([file flagsAtIndex:0 knownFlags:&known], CIOMessageFlagBitSeen);
+    XCTAssertEqual(known, CIOMessageFlagBitSeen | CIOMessageFlagBitFlagged);
+    CIOMessageFlags *flags = [file messageFlagsAtIndex:1];
+    XCTAssertEqualObjects(flags.answered, @YES);
+    XCTAssertEqualObjects(flags.draft, @YES);
+    XCTAssertEqualObjects(flags.seen, @NO);
+
+    NSDictionary *message = [file messageAtIndex:0];
+    XCTAssertEqualObjects(message[@"message_id"], @"m1");
+    XCTAssertEqualObjects(message[@"folders"], (@[@"INBOX", @"Food"]));
+    XCTAssertEqualObjects(message[@"addresses"][@"from"], @{@"email": @"chef@example.com"});
+    XCTAssertEqualObjects(message[@"flags"], (@{@"seen": @YES, @"flagged": @NO}));
+    XCTAssertThrowsSpecificNamed([file dateAtIndex:2], NSException, NSRangeException);
+}
+
+- (void)testStringsAreShared {
+    CIOMessageMetadataFile *file = [[CIOMessageMetadataFile alloc] initWithDirectoryURL:self.directoryURL error:nil];
+    [file appendMessages:[self sampleMessages] error:nil];
+    NSURL *stringsURL = [self.directoryURL URLByAppendingPathComponent:@"strings"];
+    unsigned long long size = [[[NSFileManager defaultManager] attributesOfItemAtPath:stringsURL.path error:nil] fileSize];
+
+    // Reopened, the existing string table is reused for repeated values
+    file = [[CIOMessageMetadataFile alloc] initWithDirectoryURL:self.directoryURL error:nil];
+    XCTAssertTrue([file appendMessages:@[@{@"message_id": @"m1", @"subject": @"Café menu",
+                                          @"addresses": @{@"from": @{@"email": @"chef@example.com"}}}]
+                                 error:nil]);
+    XCTAssertEqual([[[NSFileManager defaultManager] attributesOfItemAtPath:stringsURL.path error:nil] fileSize], size);
+    XCTAssertEqual(file.count, 3u);
+    XCTAssertEqualObjects([file stringForField:CIOMessageMetadataFieldFrom atIndex:2], @"chef@example.com");
+}
+
+- (void)testPersistenceAndUncommittedTail {
+    CIOMessageMetadataFile *file = [[CIOMessageMetadataFile alloc] initWithDirectoryURL:self.directoryURL error:nil];
+    [file appendMessages:[self sampleMessages] error:nil];
+
+    // Bytes past the committed count, as left by an interrupted append, are ignored and then overwritten
+    NSURL *recordsURL = [self.directoryURL URLByAppendingPathComponent:@"records"];
+    NSFileHandle *handle = [NSFileHandle fileHandleForWritingToURL:recordsURL error:nil];
+    [handle seekToEndOfFile];
+    [handle writeData:[NSMutableData dataWithLength:30]];
+    [handle closeFile];
+
+    file = [[CIOMessageMetadataFile alloc] initWithDirectoryURL:self.directoryURL error:nil];
+    XCTAssertEqual(file.count, 2u);
+    XCTAssertEqualObjects([file stringForField:CIOMessageMetadataFieldMessageID atIndex:1], @"m2");
+    XCTAssertTrue([file appendMessages:@[@{@"message_id": @"m3", @"date": @5}] error:nil]);
+    file = [[CIOMessageMetadataFile alloc] initWithDirectoryURL:self.directoryURL error:nil];
+    XCTAssertEqual(file.count, 3u);
+    XCTAssertEqual([file dateAtIndex:2], 5);
+}
+
+- (void)testRejectsIncompatibleFiles {
+    CIOMessageMetadataFile *file = [[CIOMessageMetadataFile alloc] initWithDirectoryURL:self.directoryURL error:nil];
+    XCTAssertNotNil(file);
+    NSURL *recordsURL = [self.directoryURL URLByAppendingPathComponent:@"records"];
+    NSMutableData *records = [NSMutableData dataWithContentsOfURL:recordsURL];
+    uint16_t version = 99;
+    [records replaceBytesInRange:NSMakeRange(4, sizeof(version)) withBytes:&version];
+    [records writeToURL:recordsURL atomically:YES];
+
+    NSError *error = nil;
+    XCTAssertNil([[CIOMessageMetadataFile alloc] initWithDirectoryURL:self.directoryURL error:&error]);
+    XCTAssertEqual(error.code, NSFileReadCorruptFileError);
+}
+
+- (void)testRejectsRecordCountsPastTheFile {
+    CIOMessageMetadataFile *file = [[CIOMessageMetadataFile alloc] initWithDirectoryURL:self.directoryURL error:nil];
+    [file appendMessages:[self sampleMessages] error:nil];
+    NSURL *recordsURL = [self.directoryURL URLByAppendingPathComponent:@"records"];
+    NSMutableData *records = [NSMutableData dataWithContentsOfURL:recordsURL];
+    // Times the record size, this count wraps around to 0
+    uint64_t length = 1ull << 61;
+    [records replaceBytesInRange:NSMakeRange(8, sizeof(length)) withBytes:&length];
+    [records writeToURL:recordsURL atomically:YES];
+
+    NSError *error = nil;
+    XCTAssertNil([[CIOMessageMetadataFile alloc] initWithDirectoryURL:self.directoryURL error:&error]);
+    XCTAssertEqual(error.code, NSFileReadCorruptFileError);
+}
+
+@end
@@ -0,0 +1,275 @@
+//
+//  CIOMessageStoreTests.m
+//  CIOAPIClient
+//
+//  Copyright © 2015 Context.io. All rights reserved.
+//
+
+#import <XCTest/XCTest.h>
+#import "CIOV2Client.h"
+#import "CIOMessageStore.h"
+#import "CIOMessageSync.h"
+#import "CIOStubServer.h"
+
+// Serves `messages` as the API does: filtered by `indexed_after`, sorted by `date`, paged by `offset` and `limit`
+@interface CIOPagingClient : CIOV2Client
+
+@property (nonatomic) NSArray *messages;
+@property (nonatomic) NSMutableArray *requests;
+
+@end
+
+@implementation CIOPagingClient
+
+- (void)executeArrayRequest:(CIOArrayRequest *)request
+                    success:(void (^)(NSArray *))success
+                    failure:(void (^)(NSError *))failure {
+    [self.requests addObject:request];
+    NSNumber *indexedAfter = request.parameters[@"indexed_after"];
+    NSMutableArray *messages = [NSMutableArray array];
+    for (NSDictionary *message in self.messages) {
+        if (!indexedAfter || [message[@"date_indexed"] compare:indexedAfter] == NSOrderedDescending) {
+            [messages addObject:message];
+        }
+    }
+    [messages sortUsingDescriptors:@[[NSSortDescriptor sortDescriptorWithKey:@"date" ascending:YES]]];
+    NSRange range = NSMakeRange(MIN((NSUInteger)request.offset, messages.count), 0);
+    range.length = MIN((NSUInteger)request.limit, messages.count - range.location);
+    NSArray *page = [messages subarrayWithRange:range];
+    dispatch_async(dispatch_get_main_queue(), ^{
+      success(page);
+    });
+}
+
+@end
+
+@interface CIOMessageStoreTests : XCTestCase
+
+@property (nonatomic) NSURL *fileURL;
+@property (nonatomic) CIOMessageStore *store;
+
+@end
+
+@implementation CIOMessageStoreTests
+
+- (void)setUp {
+    [super setUp];
+    NSString *path = [NSTemporaryDirectory() stringByAppendingPathComponent:[[NSUUID UUID] UUIDString]];
+    self.fileURL = [NSURL fileURLWithPath:path];
+    self.store = [[CIOMessageStore alloc] initWithFileURL:self.fileURL error:nil];
+}
+
+- (void)tearDown {
+    [[NSFileManager defaultManager] removeItemAtURL:self.fileURL error:nil];
+    [super tearDown];
+}
+
+- (NSDictionary *)messageWithID:(NSString *)messageID date:(NSInteger)date folders:(NSArray *)folders {
+    return @{@"message_id": messageID, @"date": @(date), @"date_indexed": @(date + 10), @"folders": folders,
+             @"subject": [@"Subject " stringByAppendingString:messageID], @"body": @[@"dropped"]};
+}
+
+- (void)addSampleMessages {
+    [self.store addMessages:@[[self messageWithID:@"a" date:100 folders:@[@"Inbox"]],
+                              [self messageWithID:@"b" date:300 folders:@[@"INBOX", @"Work"]],
+                              [self messageWithID:@"c" date:200 folders:@[@"Work"]]]
+                  accountID:@"acct"];
+}
+
+- (void)testLatestMessagesInFolder {
+    [self addSampleMessages];
+    XCTAssertEqual(self.store.count, 3u);
+    NSArray *inbox = [self.store latestMessages:50 inFolder:@"inbox" accountID:@"acct"];
+    XCTAssertEqualObjects([inbox valueForKey:@"message_id"], (@[@"b", @"a"]));
+    NSArray *work = [self.store latestMessages:1 inFolder:@"Work" accountID:@"acct"];
+    XCTAssertEqualObjects([work valueForKey:@"message_id"], @[@"b"]);
+    XCTAssertEqualObjects([[self.store latestMessages:50 accountID:@"acct"] valueForKey:@"message_id"],
+                          (@[@"b", @"c", @"a"]));
+    XCTAssertEqualObjects([self.store latestMessages:50 inFolder:@"work" accountID:@"acct"], @[]);
+    XCTAssertEqualObjects([self.store latestMessages:50 accountID:@"other"], @[]);
+}
+
+- (void)testStoredMetadata {
+    [self addSampleMessages];
+    NSDictionary *message = [self.store messageWithID:@"a"];
+    XCTAssertEqualObjects(message[@"account_id"], @"acct");
+    XCTAssertEqualObjects(message[@"subject"], @"Subject a");
+    XCTAssertNil(message[@"body"]);
+
+    [self.store addMessages:@[@{@"message_id": @"d", @"headers": @{@"In-Reply-To": @[@"<a@example.com>"]}}]
+                  accountID:@"acct"];
+    XCTAssertNil([self.store messageWithID:@"d"][@"headers"]);
+    XCTAssertEqualObjects([self.store messageWithID:@"d"][@"references"], @[@"a@example.com"]);
+}
+
+- (void)testReplaceAndRemove {
+    [self addSampleMessages];
+    [self.store addMessages:@[[self messageWithID:@"a" date:400 folders:@[@"Archive"]]] accountID:@"acct"];
+    XCTAssertEqual(self.store.count, 3u);
+    XCTAssertEqualObjects([[self.store latestMessages:50 inFolder:@"INBOX" accountID:@"acct"] valueForKey:@"message_id"],
+                          @[@"b"]);
+    XCTAssertEqualObjects([[self.store latestMessages:50 accountID:@"acct"] valueForKey:@"message_id"],
+                          (@[@"a", @"b", @"c"]));
+    [self.store removeMessagesWithIDs:@[@"b", @"missing"]];
+    XCTAssertNil([self.store messageWithID:@"b"]);
+    XCTAssertEqualObjects([self.store latestMessages:50 inFolder:@"INBOX" accountID:@"acct"], @[]);
+}
+
+- (void)testPersistenceAndCompaction {
+    [self addSampleMessages];
+    [self.store removeMessagesWithIDs:@[@"c"]];
+    [self.store setHighWaterMark:[NSDate dateWithTimeIntervalSince1970:310] forAccountID:@"acct"];
+
+    CIOMessageStore *reopened = [[CIOMessageStore alloc] initWithFileURL:self.fileURL error:nil];
+    XCTAssertEqual(reopened.count, 2u);
+    XCTAssertEqualObjects([reopened highWaterMarkForAccountID:@"acct"], [NSDate dateWithTimeIntervalSince1970:310]);
+
+    unsigned long long before = [[[NSFileManager defaultManager] attributesOfItemAtPath:self.fileURL.path error:nil] fileSize];
+    XCTAssertTrue([reopened compact:nil]);
+    unsigned long long after = [[[NSFileManager defaultManager] attributesOfItemAtPath:self.fileURL.path error:nil] fileSize];
+    XCTAssertLessThan(after, before);
+    [reopened addMessages:@[[self messageWithID:@"d" date:500 folders:@[]]] accountID:@"acct"];
+
+    CIOMessageStore *compacted = [[CIOMessageStore alloc] initWithFileURL:self.fileURL error:nil];
+    XCTAssertEqual(compacted.count, 3u);
+    XCTAssertEqualObjects([compacted highWaterMarkForAccountID:@"acct"], [NSDate dateWithTimeIntervalSince1970:310]);
+}
+
+- (void)testTruncatedRecordIsDropped {
+    [self addSampleMessages];
+    NSFileHandle *handle = [NSFileHandle fileHandleForWritingToURL:self.fileURL error:nil];
+    [handle seekToEndOfFile];
+    [handle writeData:[@"{\"put\":{\"message_id\":\"partial" dataUsingEncoding:NSUTF8StringEncoding]];
+    [handle closeFile];
+
+    CIOMessageStore *reopened = [[CIOMessageStore alloc] initWithFileURL:self.fileURL error:nil];
+    XCTAssertEqual(reopened.count, 3u);
+    [reopened addMessages:@[[self messageWithID:@"e" date:600 folders:@[]]] accountID:@"acct"];
+    XCTAssertEqual([[CIOMessageStore alloc] initWithFileURL:self.fileURL error:nil].count, 4u);
+}
+
+- (void)testChangeNotification {
+    [self expectationForNotification:CIOMessageStoreDidChangeNotification
+                              object:self.store
+                             handler:^BOOL(NSNotification *notification) {
+                               return [notification.userInfo[CIOMessageStoreMessageIDsKey] isEqual:(@[@"a", @"b", @"c"])];
+                             }];
+    [self addSampleMessages];
+    [self waitForExpectationsWithTimeout:1 handler:nil];
+}
+
+- (void)testSyncRequest {
+    CIOV2Client *client = [[CIOV2Client alloc] initWithConsumerKey:@"consumer_key" consumerSecret:@"consumer_secret"];
+    [client setValue:@"anAccountId" forKey:@"accountID"];
+    CIOMessageSync *sync = [[CIOMessageSync alloc] initWithClient:client store:self.store];
+    sync.requestConfigurationBlock = ^(CIOMessagesRequest *request) {
+      request.include_flags = YES;
+    };
+    CIOMessagesRequest *request = [sync requestForPageAtOffset:0 indexedAfter:nil];
+    XCTAssertEqualObjects(request.path, @"accounts/anAccountId/messages");
+    XCTAssertEqualObjects(request.parameters[@"limit"], @100);
+    XCTAssertNil(request.parameters[@"offset"]);
+    XCTAssertEqualObjects(request.parameters[@"sort_order"], @"asc");
+    XCTAssertEqualObjects(request.parameters[@"include_flags"], @YES);
+    XCTAssertNil(request.parameters[@"indexed_after"]);
+    request = [sync requestForPageAtOffset:200 indexedAfter:[NSDate dateWithTimeIntervalSince1970:1000]];
+    XCTAssertEqualObjects(request.parameters[@"indexed_after"], @1000);
+    XCTAssertEqualObjects(request.parameters[@"offset"], @200);
+    sync.pageSize = 500;
+    XCTAssertEqual(sync.pageSize, 100);
+    [client clearCredentials];
+}
+
+
+- (void)testSyncKeepsFinishedPages {
+    CIOStubServer *server = [[CIOStubServer alloc] initWithFixturesURL:[CIOStubServer defaultFixturesURL]];
+    NSError *error = nil;
+    XCTAssertTrue([server startWithError:&error], @"%@", error);
+    server.failureInterval = 2;
+    CIOV2Client *client =
+        [[CIOV2Client alloc] initWithBaseURLString:[NSURL URLWithString:@"2.0/" relativeToURL:server.URL].absoluteString
+                                       consumerKey:@"consumer_key"
+                                    consumerSecret:@"consumer_secret"
+                                             token:@"token"
+                                       tokenSecret:@"token_secret"
+                                         accountID:@"anAccountId"];
+    client.URLScheme = @"http";
+    CIOMessageSync *sync = [[CIOMessageSync alloc] initWithClient:client store:self.store];
+    sync.pageSize = 4;
+
+    // The first page is stored, the request for the second one fails
+    XCTestExpectation *expectation = [self expectationWithDescription:@"sync"];
+    [sync syncWithCompletion:^(NSUInteger fetchedCount, NSError *syncError) {
+      XCTAssertEqual(fetchedCount, 4u);
+      XCTAssertNotNil(syncError);
+      [expectation fulfill];
+    }];
+    [self waitForExpectationsWithTimeout:5 handler:nil];
+    XCTAssertEqual(server.requestCount, 2u);
+    XCTAssertEqual(self.store.count, 4u);
+    // Later pages may hold messages indexed before the first page's, so the mark waits for the whole pass
+    XCTAssertNil([self.store highWaterMarkForAccountID:@"anAccountId"]);
+    [server stop];
+}
+
+- (CIOPagingClient *)pagingClientWithMessages:(NSArray *)messages {
+    CIOPagingClient *client = [[CIOPagingClient alloc] initWithConsumerKey:@"consumer_key"
+                                                            consumerSecret:@"consumer_secret"];
+    [client setValue:@"anAccountId" forKey:@"accountID"];
+    client.messages = messages;
+    client.requests = [NSMutableArray array];
+    return client;
+}
+
+- (void)syncAndWait:(CIOMessageSync *)sync {
+    XCTestExpectation *expectation = [self expectationWithDescription:@"sync"];
+    [sync syncWithCompletion:^(NSUInteger fetchedCount, NSError *syncError) {
+      XCTAssertNil(syncError);
+      [expectation fulfill];
+    }];
+    [self waitForExpectationsWithTimeout:5 handler:nil];
+}
+
+- (void)testSyncPagesIndexedOutOfDateOrder {
+    // By date a, b | c; by date_indexed b, c, a
+    CIOPagingClient *client = [self pagingClientWithMessages:@[
+        @{@"message_id": @"a", @"date": @100, @"date_indexed": @3000, @"folders": @[@"INBOX"]},
+        @{@"message_id": @"b", @"date": @200, @"date_indexed": @1000, @"folders": @[@"INBOX"]},
+        @{@"message_id": @"c", @"date": @300, @"date_indexed": @2000, @"folders": @[@"INBOX"]}
+    ]];
+    CIOMessageSync *sync = [[CIOMessageSync alloc] initWithClient:client store:self.store];
+    sync.pageSize = 2;
+    [self.store setHighWaterMark:[NSDate dateWithTimeIntervalSince1970:500] forAccountID:@"anAccountId"];
+    [self syncAndWait:sync];
+    XCTAssertEqual(self.store.count, 3u);
+    XCTAssertEqualObjects([client.requests valueForKeyPath:@"parameters.indexed_after"], (@[@499, @499]));
+    XCTAssertEqualObjects([client.requests valueForKeyPath:@"offset"], (@[@0, @2]));
+    XCTAssertEqualObjects([self.store highWaterMarkForAccountID:@"anAccountId"],
+                          [NSDate dateWithTimeIntervalSince1970:3000]);
+    [client clearCredentials];
+}
+
+- (void)testSyncPagesMessagesIndexedInTheSameSecond {
+    CIOPagingClient *client = [self pagingClientWithMessages:@[
+        @{@"message_id": @"a", @"date": @100, @"date_indexed": @1000, @"folders": @[@"INBOX"]},
+        @{@"message_id": @"b", @"date": @200, @"date_indexed": @1000, @"folders": @[@"INBOX"]},
+        @{@"message_id": @"c", @"date": @300, @"date_indexed": @1000, @"folders": @[@"INBOX"]}
+    ]];
+    CIOMessageSync *sync = [[CIOMessageSync alloc] initWithClient:client store:self.store];
+    sync.pageSize = 2;
+    [self syncAndWait:sync];
+    XCTAssertEqual(self.store.count, 3u);
+    XCTAssertEqualObjects([self.store highWaterMarkForAccountID:@"anAccountId"],
+                          [NSDate dateWithTimeIntervalSince1970:1000]);
+
+    // Another message indexed later in the same second is picked up by the overlap
+    client.messages = [client.messages arrayByAddingObject:
+        @{@"message_id": @"d", @"date": @50, @"date_indexed": @1000, @"folders": @[@"INBOX"]}];
+    [client.requests removeAllObjects];
+    [self syncAndWait:sync];
+    XCTAssertEqual(self.store.count, 4u);
+    XCTAssertEqualObjects([client.requests valueForKeyPath:@"parameters.indexed_after"], (@[@999, @999, @999]));
+    [client clearCredentials];
+}
+
+@end
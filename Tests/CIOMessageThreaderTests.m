@@ -0,0 +1,121 @@
+//
+//  CIOMessageThreaderTests.m
+//  CIOAPIClient
+//
+//  Copyright © 2015 Context.io. All rights reserved.
+//
+
+#import <XCTest/XCTest.h>
+#import "CIOV2Client.h"
+#import "CIOMessageThreader.h"
+
+@interface CIOMessageThreaderTests : XCTestCase
+
+@property (nonatomic) CIOV2Client *client;
+@property (nonatomic) CIOMessageThreader *threader;
+
+@end
+
+@implementation CIOMessageThreaderTests
+
+- (void)setUp {
+    [super setUp];
+    self.client = [[CIOV2Client alloc] initWithConsumerKey:@"consumer_key" consumerSecret:@"consumer_secret"];
+    [self.client setValue:@"anAccountId" forKey:@"accountID"];
+    self.threader = [[CIOMessageThreader alloc] initWithClient:self.client store:nil];
+}
+
+- (void)tearDown {
+    [self.client clearCredentials];
+    [super tearDown];
+}
+
+- (NSArray *)threadOf:(NSString *)messageID {
+    return [[self.threader messagesInThreadOfMessageWithID:messageID] valueForKey:@"message_id"];
+}
+
+- (void)testReferences {
+    XCTAssertEqualObjects([CIOMessageThreader referencesForMessage:@{@"references": @"<a@x> <b@x>",
+                                                                     @"in_reply_to": @"<c@x>"}],
+                          (@[@"a@x", @"b@x", @"c@x"]));
+    XCTAssertEqualObjects([CIOMessageThreader referencesForMessage:@{@"references": @[@"<a@x>", @"<b@x>"],
+                                                                     @"in_reply_to": @"<a@x>"}],
+                          (@[@"b@x", @"a@x"]));
+    XCTAssertEqualObjects([CIOMessageThreader referencesForMessage:@{@"headers": @{@"in-reply-to": @[@"<p@x>"]}}],
+                          @[@"p@x"]);
+    NSString *raw = @"Subject: Hi\r\nReferences: <r1@x>\r\n <r2@x>\r\n\r\n";
+    XCTAssertEqualObjects([CIOMessageThreader referencesForMessage:@{@"headers": raw}], (@[@"r1@x", @"r2@x"]));
+}
+
+- (void)testReplyChain {
+    [self.threader addMessages:@[
+        @{@"message_id": @"C", @"email_message_id": @"<c@x>", @"date": @3, @"references": @"<a@x> <b@x>"},
+        @{@"message_id": @"A", @"email_message_id": @"<a@x>", @"date": @1},
+        @{@"message_id": @"B", @"email_message_id": @"<b@x>", @"date": @2, @"in_reply_to": @"<a@x>"},
+        @{@"message_id": @"Z", @"email_message_id": @"<z@x>", @"date": @4},
+    ] accountID:@"anAccountId"];
+    XCTAssertEqualObjects([self threadOf:@"B"], (@[@"A", @"B", @"C"]));
+    XCTAssertEqualObjects([self threadOf:@"Z"], @[@"Z"]);
+    XCTAssertTrue([self.threader isThreadCompleteForMessageWithID:@"C"]);
+    XCTAssertNil([self.threader messagesInThreadOfMessageWithID:@"unknown"]);
+
+    // B's place in the tree is kept for C, but the thread now has a gap
+    [self.threader removeMessagesWithIDs:@[@"B"]];
+    XCTAssertEqualObjects([self threadOf:@"A"], (@[@"A", @"C"]));
+    XCTAssertFalse([self.threader isThreadCompleteForMessageWithID:@"A"]);
+    [self.threader addMessages:@[@{@"message_id": @"B", @"email_message_id": @"<b@x>", @"date": @2}]
+                     accountID:@"anAccountId"];
+    XCTAssertTrue([self.threader isThreadCompleteForMessageWithID:@"A"]);
+}
+
+- (void)testMissingParent {
+    [self.threader addMessages:@[
+        @{@"message_id": @"D", @"email_message_id": @"<d@x>", @"date": @1, @"in_reply_to": @"<gone@x>"},
+        @{@"message_id": @"E", @"email_message_id": @"<e@x>", @"date": @2, @"references": @"<gone@x>"},
+    ] accountID:@"anAccountId"];
+    XCTAssertEqualObjects([self threadOf:@"E"], (@[@"D", @"E"]));
+    XCTAssertFalse([self.threader isThreadCompleteForMessageWithID:@"D"]);
+}
+
+- (void)testGmailThreadsAndSubjects {
+    [self.threader addMessages:@[
+        @{@"message_id": @"F", @"email_message_id": @"<f@x>", @"date": @1, @"gmail_thread_id": @"123"},
+        @{@"message_id": @"G", @"email_message_id": @"<g@x>", @"date": @2, @"gmail_thread_id": @"123"},
+        @{@"message_id": @"H", @"email_message_id": @"<h@x>", @"date": @3, @"subject": @"Lunch"},
+        @{@"message_id": @"I", @"email_message_id": @"<i@x>", @"date": @4, @"subject": @"RE: Re: lunch "},
+        @{@"message_id": @"J", @"email_message_id": @"<j@x>", @"date": @5, @"subject": @"Fwd: Lunch"},
+    ] accountID:@"anAccountId"];
+    XCTAssertEqualObjects([self threadOf:@"G"], (@[@"F", @"G"]));
+    XCTAssertEqualObjects([self threadOf:@"H"], (@[@"H", @"I"]));
+    XCTAssertEqualObjects([self threadOf:@"I"], (@[@"H", @"I"]));
+    XCTAssertEqualObjects([self threadOf:@"J"], @[@"J"]);
+}
+
+- (void)testAccountsAndLoops {
+    [self.threader addMessages:@[
+        @{@"message_id": @"K", @"email_message_id": @"<k@x>", @"date": @1, @"references": @"<l@x>"},
+        @{@"message_id": @"L", @"email_message_id": @"<l@x>", @"date": @2, @"references": @"<k@x>"},
+    ] accountID:@"anAccountId"];
+    [self.threader addMessages:@[@{@"message_id": @"M", @"email_message_id": @"<m@x>", @"date": @3,
+                                   @"references": @"<k@x>"}]
+                     accountID:@"otherAccount"];
+    XCTAssertEqualObjects([self threadOf:@"K"], (@[@"K", @"L"]));
+    XCTAssertEqualObjects([self threadOf:@"M"], @[@"M"]);
+}
+
+- (void)testCompleteThreadIsServedLocally {
+    [self.threader addMessages:@[
+        @{@"message_id": @"A", @"email_message_id": @"<a@x>", @"date": @1},
+        @{@"message_id": @"B", @"email_message_id": @"<b@x>", @"date": @2, @"in_reply_to": @"<a@x>"},
+    ] accountID:@"anAccountId"];
+    XCTestExpectation *expectation = [self expectationWithDescription:@"local thread"];
+    [self.threader getThreadForMessageWithID:@"A"
+        success:^(NSArray *messages) {
+          XCTAssertEqualObjects([messages valueForKey:@"message_id"], (@[@"A", @"B"]));
+          [expectation fulfill];
+        }
+        failure:nil];
+    [self waitForExpectationsWithTimeout:1 handler:nil];
+}
+
+@end
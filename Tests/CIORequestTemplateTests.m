@@ -0,0 +1,89 @@
+//
+//  CIORequestTemplateTests.m
+//  CIOAPIClient
+//
+//  Copyright © 2015 Context.io. All rights reserved.
+//
+
+#import <XCTest/XCTest.h>
+#import "CIOLiteClient.h"
+#import "CIORequestTemplate.h"
+#import "TestUtil.h"
+
+@interface CIORequestTemplateTests : XCTestCase
+
+@property (nonatomic) CIOLiteClient *client;
+
+@end
+
+@implementation CIORequestTemplateTests
+
+- (void)setUp {
+    [super setUp];
+    self.client = [[CIOLiteClient alloc] initWithConsumerKey:@"consumer_key" consumerSecret:@"consumer_secret"];
+    [self.client setValue:@"anAccountId" forKey:@"accountID"];
+}
+
+- (void)tearDown {
+    [self.client clearCredentials];
+    [super tearDown];
+}
+
+- (void)assertRequest:(NSURLRequest *)request equalsRequest:(NSURLRequest *)expected {
+    XCTAssertEqualObjects(request.URL, expected.URL);
+    XCTAssertEqualObjects(request.HTTPMethod, expected.HTTPMethod);
+    XCTAssertEqualObjects([TestUtil OAuthSignature:[request valueForHTTPHeaderField:@"Authorization"]],
+                          [TestUtil OAuthSignature:[expected valueForHTTPHeaderField:@"Authorization"]]);
+}
+
+- (void)testParsesSlots {
+    CIORequestTemplate *template = [self.client messageFlagsRequestTemplate];
+    XCTAssertEqualObjects(template.pathPattern,
+                          @"users/anAccountId/email_accounts/{label}/folders/{folder}/messages/{message_id}/flags");
+    XCTAssertEqualObjects(template.slotNames, (@[@"label", @"folder", @"message_id"]));
+}
+
+- (void)testMessageFlagsMatchRequest {
+    CIORequestTemplate *template = [self.client messageFlagsRequestTemplate];
+    NSDictionary *values = @{@"label": @"0", @"folder": @"queso", @"message_id": @"<cil antro@x>"};
+    NSURLRequest *request = [template URLRequestWithValues:values parameters:@{@"delimiter": @"+"}];
+    CIOLiteMessageRequest *messageRequest =
+        [self.client requestForMessageWithID:@"<cil antro@x>" inFolder:@"queso" accountLabel:nil delimiter:@"+"];
+    [self assertRequest:request equalsRequest:[self.client requestForCIORequest:[messageRequest getFlags]]];
+}
+
+- (void)testFolderMatchesRequest {
+    CIORequestTemplate *template = [self.client folderRequestTemplate];
+    NSURLRequest *request =
+        [template URLRequestWithValues:@{@"label": @"tacos", @"folder": @"[Gmail]/All Mail"} parameters:nil];
+    CIODictionaryRequest *folderRequest =
+        [self.client getFolderNamed:@"[Gmail]/All Mail" forAccountWithLabel:@"tacos" delimiter:nil];
+    [self assertRequest:request equalsRequest:[self.client requestForCIORequest:folderRequest]];
+}
+
+- (void)testParametersReplaceConstants {
+    CIORequestTemplate *template = [[CIORequestTemplate alloc] initWithClient:self.client
+                                                                       method:@"GET"
+                                                                  pathPattern:@"discovery"
+                                                                   parameters:@{@"source_type": @"IMAP"}
+                                                                 requestClass:[CIODictionaryRequest class]];
+    XCTAssertEqual(template.slotNames.count, 0u);
+    NSURLRequest *request = [template URLRequestWithValues:@{} parameters:@{@"source_type": @"POP"}];
+    NSURLRequest *expected = [self.client requestForPath:@"discovery" method:@"GET" params:@{@"source_type": @"POP"}];
+    [self assertRequest:request equalsRequest:expected];
+}
+
+- (void)testPOSTSendsFormBody {
+    CIORequestTemplate *template = [[CIORequestTemplate alloc] initWithClient:self.client
+                                                                       method:@"POST"
+                                                                  pathPattern:@"users/anAccountId/email_accounts/{label}"
+                                                                   parameters:@{@"status": @"OK"}
+                                                                 requestClass:[CIODictionaryRequest class]];
+    NSURLRequest *request = [template URLRequestWithValues:@{@"label": @"0"} parameters:nil];
+    NSURLRequest *expected =
+        [self.client requestForPath:@"users/anAccountId/email_accounts/0" method:@"POST" params:@{@"status": @"OK"}];
+    [self assertRequest:request equalsRequest:expected];
+    XCTAssertEqualObjects(request.HTTPBody, expected.HTTPBody);
+}
+
+@end
@@ -10,6 +10,21 @@
 #import "CIORequest.h"
 #import "CIOSearchRequest.h"
 #import "CIOSourceRequests.h"
+#import "CIOMessageRequests.h"
+
+// Skips `+[CIORequest initialize]`, so its setters are never tracked
+@interface CIOUntrackedRequest : CIODictionaryRequest
+
+@property (nonatomic) BOOL include_extra;
+
+@end
+
+@implementation CIOUntrackedRequest
+
++ (void)initialize {
+}
+
+@end
 
 @interface CIORequestTests : XCTestCase
 
@@ -82,4 +97,35 @@
     XCTAssertNil(request.parameters[@"status"]);
 }
 
+- (void)testOnlySendsAssignedProperties {
+    CIOArrayRequest *request = [CIOArrayRequest requestWithPath:@"account/messages" method:@"GET" parameters:nil client:nil];
+    XCTAssertEqualObjects(request.parameters, @{});
+    request.limit = 0;
+    XCTAssertEqualObjects(request.parameters, @{@"limit": @0});
+
+    CIOMessagesRequest *messages = [CIOMessagesRequest requestWithPath:@"account/messages" method:@"GET" parameters:@{@"offset": @5} client:nil];
+    messages.subject = @"tacos";
+    [messages setValue:@YES forKey:@"include_body"];
+    messages.sort_order = CIOSortOrderUnspecified;
+    XCTAssertEqualObjects(messages.parameters, (@{@"subject": @"tacos", @"include_body": @YES, @"offset": @5}));
+    messages.subject = nil;
+    XCTAssertEqualObjects(messages.parameters, (@{@"include_body": @YES, @"offset": @5}));
+}
+
+- (void)testUntrackedSubclassSendsAllProperties {
+    CIOUntrackedRequest *request = [CIOUntrackedRequest requestWithPath:@"account" method:@"POST" parameters:nil client:nil];
+    XCTAssertEqualObjects(request.parameters, @{@"include_extra": @NO});
+    request.include_extra = YES;
+    XCTAssertEqualObjects(request.parameters, @{@"include_extra": @YES});
+}
+
+- (void)testModifyRequestOnlySendsChangedSettings {
+    CIOSourceModifyRequest *request =
+        [CIOSourceModifyRequest requestWithPath:@"accounts/anAccountId/sources/0" method:@"POST" parameters:nil client:nil];
+    request.password = @"hunter2";
+    XCTAssertEqualObjects(request.parameters, @{@"password": @"hunter2"});
+    request.sync_all_folders = NO;
+    XCTAssertEqualObjects(request.parameters, (@{@"password": @"hunter2", @"sync_all_folders": @NO}));
+}
+
 @end
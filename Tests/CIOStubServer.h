@@ -0,0 +1,110 @@
+//
+//  CIOStubServer.h
+//  CIOAPIClient
+//
+//  Copyright © 2015 Context.io. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+
+NS_ASSUME_NONNULL_BEGIN
+
+/**
+ `CIOStubServer` serves recorded Context.IO responses over HTTP/1.1 on the loopback interface. Tests and benchmarks can
+ then run `CIOAPISession` and the clients end to end without reaching api.context.io: create a client with
+ `initWithBaseURLString:` pointing at `URL`, whose `http` scheme it then sends requests with.
+
+ Responses come from a fixtures directory with a `routes.json` manifest. The manifest is an array of routes, each with
+ a `path` pattern, a `fixture` file relative to the directory, and an optional `method`. Pattern segments match
+ literally, except `*`, which matches one segment, and `**`, which matches one or more. The first matching route wins.
+ Requests matching no route get a Context.IO style 404 error.
+
+ Latency, bandwidth, failures and rate limiting are deterministic, so runs can be compared. Settings may be changed
+ while the server runs and apply from the next request. Each open connection is served on a thread of its own.
+ */
+@interface CIOStubServer : NSObject
+
+/**
+ *  The fixtures recorded in the test bundle, in its `Fixtures` directory.
+ */
++ (NSURL *)defaultFixturesURL;
+
+- (instancetype)initWithFixturesURL:(NSURL *)fixturesURL NS_DESIGNATED_INITIALIZER;
+
+- (instancetype)init NS_UNAVAILABLE;
+
+@property (readonly, nonatomic) NSURL *fixturesURL;
+
+/**
+ *  Binds a free port on 127.0.0.1 and starts accepting connections.
+ *
+ *  @param error set to an `NSPOSIXErrorDomain` error if the socket could not be set up
+ */
+- (BOOL)startWithError:(NSError **)error;
+
+/**
+ *  Closes the listening socket and all open connections.
+ */
+- (void)stop;
+
+/**
+ *  `http://127.0.0.1:<port>/` while the server runs. Base URLs of clients are relative to it, e.g. `2.0/`.
+ */
+@property (nullable, readonly, atomic) NSURL *URL;
+
+#pragma mark - Simulation
+
+/**
+ *  Delay before each response is sent. Defaults to `0`.
+ */
+@property (atomic) NSTimeInterval latency;
+
+/**
+ *  Rate response bodies are written at, in bytes per second. Defaults to `0`, as fast as possible.
+ */
+@property (atomic) NSUInteger bytesPerSecond;
+
+/**
+ *  When nonzero, every `failureInterval`th request is answered with a 500 error. Defaults to `0`.
+ */
+@property (atomic) NSUInteger failureInterval;
+
+/**
+ *  When nonzero, every `rateLimitInterval`th request is answered with 429 and a `Retry-After` of `retryAfter`. Takes
+ * precedence over `failureInterval`. Defaults to `0`.
+ */
+@property (atomic) NSUInteger rateLimitInterval;
+
+/**
+ *  Seconds sent in the `Retry-After` header of 429 responses. Defaults to `1`.
+ */
+@property (atomic) NSUInteger retryAfter;
+
+#pragma mark - OAuth
+
+/**
+ *  When set, requests must carry a valid HMAC-SHA1 OAuth signature made with this consumer secret and `tokenSecret`.
+ * Other requests are answered with 401. Defaults to `nil`, no verification.
+ */
+@property (nullable, atomic, copy) NSString *consumerSecret;
+
+/**
+ *  Token secret of verified signatures, `nil` for requests signed without a token.
+ */
+@property (nullable, atomic, copy) NSString *tokenSecret;
+
+#pragma mark - Statistics
+
+/**
+ *  Number of requests answered since the server was created, including failures.
+ */
+@property (readonly, atomic) NSUInteger requestCount;
+
+/**
+ *  Number of connections accepted since the server was created.
+ */
+@property (readonly, atomic) NSUInteger connectionCount;
+
+@end
+
+NS_ASSUME_NONNULL_END
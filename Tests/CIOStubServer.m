@@ -0,0 +1,520 @@
+//
+//  CIOStubServer.m
+//  CIOAPIClient
+//
+//  Copyright © 2015 Context.io. All rights reserved.
+//
+
+#import "CIOStubServer.h"
+#import <CommonCrypto/CommonHMAC.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+static NSUInteger const kCIOStubReadLength = 16 * 1024;
+
+static BOOL CIOStubPOSIXError(NSError **error) {
+    if (error) {
+        *error = [NSError errorWithDomain:NSPOSIXErrorDomain code:errno userInfo:nil];
+    }
+    return NO;
+}
+
+static BOOL CIOStubWrite(int fd, const void *bytes, size_t length) {
+    while (length > 0) {
+        ssize_t written = send(fd, bytes, length, 0);
+        if (written <= 0) {
+            return NO;
+        }
+        bytes = (const uint8_t *)bytes + written;
+        length -= (size_t)written;
+    }
+    return YES;
+}
+
+// Encodes like TDOAuth does when building signature base strings
+static NSString *CIOStubPercentEncode(NSString *string) {
+    return (__bridge_transfer NSString *)CFURLCreateStringByAddingPercentEscapes(
+        NULL, (__bridge CFStringRef)string, NULL, CFSTR("!*'();:@&=+$,/?%#[]"), kCFStringEncodingUTF8);
+}
+
+// Adds the still encoded `name=value` pairs of a query string or form body
+static void CIOStubAddParameters(NSMutableDictionary *parameters, NSString *string) {
+    for (NSString *pair in [string componentsSeparatedByString:@"&"]) {
+        if (pair.length == 0) {
+            continue;
+        }
+        NSRange equals = [pair rangeOfString:@"="];
+        if (equals.location == NSNotFound) {
+            parameters[pair] = @"";
+        } else {
+            parameters[[pair substringToIndex:equals.location]] = [pair substringFromIndex:NSMaxRange(equals)];
+        }
+    }
+}
+
+static NSArray *CIOStubPathSegments(NSString *path) {
+    return [[path componentsSeparatedByString:@"/"]
+        filteredArrayUsingPredicate:[NSPredicate predicateWithFormat:@"length > 0"]];
+}
+
+static BOOL CIOStubPathMatches(NSArray *pattern, NSUInteger p, NSArray *path, NSUInteger i) {
+    if (p == pattern.count) {
+        return i == path.count;
+    }
+    NSString *segment = pattern[p];
+    if ([segment isEqualToString:@"**"]) {
+        for (NSUInteger j = i + 1; j <= path.count; j++) {
+            if (CIOStubPathMatches(pattern, p + 1, path, j)) {
+                return YES;
+            }
+        }
+        return NO;
+    }
+    if (i == path.count || !([segment isEqualToString:@"*"] || [segment isEqualToString:path[i]])) {
+        return NO;
+    }
+    return CIOStubPathMatches(pattern, p + 1, path, i + 1);
+}
+
+// The part of `length` bytes a `Range` header asks for. Headers asking for several ranges, or not parsed, get
+// everything. The location is `NSNotFound` if the range can't be satisfied.
+static NSRange CIOStubByteRange(NSString *header, NSUInteger length) {
+    NSRange all = NSMakeRange(0, length);
+    if (![header hasPrefix:@"bytes="] || [header rangeOfString:@","].location != NSNotFound) {
+        return all;
+    }
+    NSArray *bounds = [[header substringFromIndex:6] componentsSeparatedByString:@"-"];
+    if (bounds.count != 2) {
+        return all;
+    }
+    NSString *first = bounds[0];
+    NSString *last = bounds[1];
+    if (first.length == 0) {
+        NSUInteger suffixLength = (NSUInteger)last.longLongValue;
+        if (suffixLength == 0 || length == 0) {
+            return NSMakeRange(NSNotFound, 0);
+        }
+        suffixLength = MIN(suffixLength, length);
+        return NSMakeRange(length - suffixLength, suffixLength);
+    }
+    NSUInteger start = (NSUInteger)first.longLongValue;
+    NSUInteger end = last.length > 0 ? MIN((NSUInteger)last.longLongValue, length - 1) : length - 1;
+    if (start >= length || end < start) {
+        return NSMakeRange(NSNotFound, 0);
+    }
+    return NSMakeRange(start, end - start + 1);
+}
+
+static NSString *CIOStubContentType(NSString *fixture) {
+    NSDictionary *types = @{
+        @"json": @"application/json",
+        @"eml": @"message/rfc822",
+        @"txt": @"text/plain; charset=utf-8",
+    };
+    return types[fixture.pathExtension] ?: @"application/octet-stream";
+}
+
+#pragma mark -
+
+@interface CIOStubRequest : NSObject
+
+@property (nonatomic) NSString *method;
+@property (nonatomic) NSString *path;
+@property (nonatomic) NSString *query;
+// Lowercased header name -> value
+@property (nonatomic) NSDictionary *headers;
+@property (nonatomic) NSData *body;
+
+@end
+
+@implementation CIOStubRequest
+@end
+
+@interface CIOStubResponse : NSObject
+
+@property (nonatomic) NSInteger statusCode;
+@property (nonatomic) NSMutableDictionary *headers;
+@property (nonatomic) NSData *body;
+
+@end
+
+@implementation CIOStubResponse
+
++ (instancetype)responseWithStatusCode:(NSInteger)statusCode contentType:(NSString *)contentType body:(NSData *)body {
+    CIOStubResponse *response = [self new];
+    response.statusCode = statusCode;
+    response.headers = [NSMutableDictionary dictionaryWithObject:contentType forKey:@"Content-Type"];
+    response.body = body;
+    return response;
+}
+
++ (instancetype)errorResponseWithStatusCode:(NSInteger)statusCode message:(NSString *)message {
+    NSDictionary *error = @{@"type": @"error", @"value": message};
+    NSData *body = [NSJSONSerialization dataWithJSONObject:error options:0 error:NULL];
+    return [self responseWithStatusCode:statusCode contentType:@"application/json" body:body];
+}
+
+@end
+
+#pragma mark -
+
+@interface CIOStubServer ()
+
+@property (nonatomic) NSArray *routes;
+// Fixture path -> data, read once so disk reads don't show in timings
+@property (nonatomic) NSMutableDictionary *fixtureData;
+@property (nonatomic) dispatch_queue_t connectionQueue;
+@property (nullable, nonatomic) dispatch_source_t listenSource;
+// NSNumber file descriptors of open connections
+@property (nonatomic) NSMutableSet *openSockets;
+@property (nullable, readwrite, atomic) NSURL *URL;
+@property (readwrite, atomic) NSUInteger requestCount;
+@property (readwrite, atomic) NSUInteger connectionCount;
+
+@end
+
+@implementation CIOStubServer
+
++ (NSURL *)defaultFixturesURL {
+    return [[NSBundle bundleForClass:self] URLForResource:@"Fixtures" withExtension:nil];
+}
+
+- (instancetype)initWithFixturesURL:(NSURL *)fixturesURL {
+    if ((self = [super init])) {
+        _fixturesURL = fixturesURL;
+        _retryAfter = 1;
+        _fixtureData = [NSMutableDictionary dictionary];
+        _openSockets = [NSMutableSet set];
+        _connectionQueue = dispatch_queue_create("io.context.stubserver.connections", DISPATCH_QUEUE_CONCURRENT);
+        NSData *manifest = [NSData dataWithContentsOfURL:[fixturesURL URLByAppendingPathComponent:@"routes.json"]];
+        NSArray *manifestRoutes =
+            manifest ? [NSJSONSerialization JSONObjectWithData:manifest options:0 error:NULL] : nil;
+        NSMutableArray *routes = [NSMutableArray array];
+        for (NSDictionary *route in manifestRoutes) {
+            NSMutableDictionary *parsedRoute = [route mutableCopy];
+            parsedRoute[@"segments"] = CIOStubPathSegments(route[@"path"]);
+            [routes addObject:parsedRoute];
+        }
+        _routes = routes;
+    }
+    return self;
+}
+
+- (void)dealloc {
+    [self stop];
+}
+
+#pragma mark - Listening
+
+- (BOOL)startWithError:(NSError **)error {
+    NSParameterAssert(self.listenSource == nil);
+    int fd = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    if (fd < 0) {
+        return CIOStubPOSIXError(error);
+    }
+    int yes = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes));
+    struct sockaddr_in address;
+    memset(&address, 0, sizeof(address));
+    address.sin_len = sizeof(address);
+    address.sin_family = AF_INET;
+    address.sin_port = 0;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t addressLength = sizeof(address);
+    if (bind(fd, (struct sockaddr *)&address, sizeof(address)) != 0 || listen(fd, SOMAXCONN) != 0 ||
+        getsockname(fd, (struct sockaddr *)&address, &addressLength) != 0) {
+        CIOStubPOSIXError(error);
+        close(fd);
+        return NO;
+    }
+
+    __weak typeof(self) weakSelf = self;
+    dispatch_source_t source = dispatch_source_create(DISPATCH_SOURCE_TYPE_READ, (uintptr_t)fd, 0,
+                                                      dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_HIGH, 0));
+    dispatch_source_set_event_handler(source, ^{
+      int connection = accept(fd, NULL, NULL);
+      if (connection >= 0) {
+          [weakSelf _acceptConnection:connection];
+      }
+    });
+    dispatch_source_set_cancel_handler(source, ^{
+      close(fd);
+    });
+    self.listenSource = source;
+    self.URL = [NSURL URLWithString:[NSString stringWithFormat:@"http://127.0.0.1:%u/", ntohs(address.sin_port)]];
+    dispatch_resume(source);
+    return YES;
+}
+
+- (void)stop {
+    if (self.listenSource) {
+        dispatch_source_cancel(self.listenSource);
+        self.listenSource = nil;
+    }
+    self.URL = nil;
+    @synchronized(self.openSockets) {
+        // Their threads see the connection end and close them
+        for (NSNumber *fd in self.openSockets) {
+            shutdown(fd.intValue, SHUT_RDWR);
+        }
+    }
+}
+
+- (void)_acceptConnection:(int)fd {
+#ifdef SO_NOSIGPIPE
+    int yes = 1;
+    setsockopt(fd, SOL_SOCKET, SO_NOSIGPIPE, &yes, sizeof(yes));
+#endif
+    @synchronized(self.openSockets) {
+        [self.openSockets addObject:@(fd)];
+    }
+    @synchronized(self) {
+        self.connectionCount++;
+    }
+    dispatch_async(self.connectionQueue, ^{
+      [self _serveConnection:fd];
+    });
+}
+
+- (void)_serveConnection:(int)fd {
+    NSMutableData *buffer = [NSMutableData data];
+    while (YES) {
+        CIOStubRequest *request = [self _readRequestFromSocket:fd buffer:buffer];
+        if (!request) {
+            break;
+        }
+        BOOL keepAlive = ![[request.headers[@"connection"] lowercaseString] isEqualToString:@"close"];
+        if (![self _respondToRequest:request socket:fd keepAlive:keepAlive] || !keepAlive) {
+            break;
+        }
+    }
+    @synchronized(self.openSockets) {
+        [self.openSockets removeObject:@(fd)];
+    }
+    close(fd);
+}
+
+#pragma mark - HTTP
+
+// Reads until `buffer` holds a whole request, which is then removed from it
+- (nullable CIOStubRequest *)_readRequestFromSocket:(int)fd buffer:(NSMutableData *)buffer {
+    NSData *separator = [@"\r\n\r\n" dataUsingEncoding:NSASCIIStringEncoding];
+    NSRange headerEnd = NSMakeRange(NSNotFound, 0);
+    NSUInteger requestLength = 0;
+    CIOStubRequest *request = nil;
+    uint8_t chunk[kCIOStubReadLength];
+    while (YES) {
+        if (!request) {
+            headerEnd = [buffer rangeOfData:separator options:0 range:NSMakeRange(0, buffer.length)];
+            if (headerEnd.location != NSNotFound) {
+                NSData *head = [buffer subdataWithRange:NSMakeRange(0, headerEnd.location)];
+                request = [self _requestWithHead:[[NSString alloc] initWithData:head encoding:NSUTF8StringEncoding]];
+                if (!request) {
+                    return nil;
+                }
+                requestLength = NSMaxRange(headerEnd) + (NSUInteger)[request.headers[@"content-length"] longLongValue];
+            }
+        }
+        if (request && buffer.length >= requestLength) {
+            NSUInteger bodyStart = NSMaxRange(headerEnd);
+            request.body = [buffer subdataWithRange:NSMakeRange(bodyStart, requestLength - bodyStart)];
+            [buffer replaceBytesInRange:NSMakeRange(0, requestLength) withBytes:NULL length:0];
+            return request;
+        }
+        ssize_t length = recv(fd, chunk, sizeof(chunk), 0);
+        if (length <= 0) {
+            return nil;
+        }
+        [buffer appendBytes:chunk length:(NSUInteger)length];
+    }
+}
+
+- (nullable CIOStubRequest *)_requestWithHead:(NSString *)head {
+    NSArray *lines = [head componentsSeparatedByString:@"\r\n"];
+    NSArray *requestLine = [lines.firstObject componentsSeparatedByString:@" "];
+    if (requestLine.count != 3) {
+        return nil;
+    }
+    CIOStubRequest *request = [CIOStubRequest new];
+    request.method = requestLine[0];
+    NSString *target = requestLine[1];
+    NSRange question = [target rangeOfString:@"?"];
+    request.path = question.location == NSNotFound ? target : [target substringToIndex:question.location];
+    request.query = question.location == NSNotFound ? @"" : [target substringFromIndex:NSMaxRange(question)];
+    NSMutableDictionary *headers = [NSMutableDictionary dictionary];
+    for (NSString *line in [lines subarrayWithRange:NSMakeRange(1, lines.count - 1)]) {
+        NSRange colon = [line rangeOfString:@":"];
+        if (colon.location == NSNotFound) {
+            continue;
+        }
+        NSString *value = [[line substringFromIndex:NSMaxRange(colon)]
+            stringByTrimmingCharactersInSet:[NSCharacterSet whitespaceCharacterSet]];
+        headers[[[line substringToIndex:colon.location] lowercaseString]] = value;
+    }
+    request.headers = headers;
+    return request;
+}
+
+- (BOOL)_respondToRequest:(CIOStubRequest *)request socket:(int)fd keepAlive:(BOOL)keepAlive {
+    NSUInteger number;
+    @synchronized(self) {
+        number = ++self.requestCount;
+    }
+    CIOStubResponse *response = [self _responseForRequest:request number:number];
+    NSTimeInterval latency = self.latency;
+    if (latency > 0) {
+        usleep((useconds_t)(latency * USEC_PER_SEC));
+    }
+
+    NSString *reason = [NSHTTPURLResponse localizedStringForStatusCode:response.statusCode];
+    NSMutableString *head =
+        [NSMutableString stringWithFormat:@"HTTP/1.1 %ld %@\r\n", (long)response.statusCode, reason];
+    response.headers[@"Content-Length"] = [@(response.body.length) stringValue];
+    response.headers[@"Connection"] = keepAlive ? @"keep-alive" : @"close";
+    for (NSString *name in response.headers) {
+        [head appendFormat:@"%@: %@\r\n", name, response.headers[name]];
+    }
+    [head appendString:@"\r\n"];
+    NSData *headData = [head dataUsingEncoding:NSUTF8StringEncoding];
+    if (!CIOStubWrite(fd, headData.bytes, headData.length)) {
+        return NO;
+    }
+    if ([request.method isEqualToString:@"HEAD"]) {
+        return YES;
+    }
+
+    NSUInteger bytesPerSecond = self.bytesPerSecond;
+    if (bytesPerSecond == 0) {
+        return CIOStubWrite(fd, response.body.bytes, response.body.length);
+    }
+    // Writes a twentieth of a second's worth at a time
+    NSUInteger chunkLength = MAX(bytesPerSecond / 20, 1u);
+    for (NSUInteger offset = 0; offset < response.body.length; offset += chunkLength) {
+        NSUInteger length = MIN(chunkLength, response.body.length - offset);
+        if (!CIOStubWrite(fd, (const uint8_t *)response.body.bytes + offset, length)) {
+            return NO;
+        }
+        usleep((useconds_t)((double)length / bytesPerSecond * USEC_PER_SEC));
+    }
+    return YES;
+}
+
+- (CIOStubResponse *)_responseForRequest:(CIOStubRequest *)request number:(NSUInteger)number {
+    NSUInteger rateLimitInterval = self.rateLimitInterval;
+    if (rateLimitInterval > 0 && number % rateLimitInterval == 0) {
+        CIOStubResponse *response =
+            [CIOStubResponse errorResponseWithStatusCode:429 message:@"Too many requests, please slow down."];
+        response.headers[@"Retry-After"] = [@(self.retryAfter) stringValue];
+        return response;
+    }
+    NSUInteger failureInterval = self.failureInterval;
+    if (failureInterval > 0 && number % failureInterval == 0) {
+        return [CIOStubResponse errorResponseWithStatusCode:500 message:@"Internal error, please try again."];
+    }
+    NSString *consumerSecret = self.consumerSecret;
+    if (consumerSecret && ![self _verifySignatureOfRequest:request consumerSecret:consumerSecret]) {
+        return [CIOStubResponse errorResponseWithStatusCode:401 message:@"Invalid signature."];
+    }
+
+    NSString *fixture = [self _fixtureForRequest:request];
+    NSData *data = fixture ? [self _dataForFixture:fixture] : nil;
+    if (!data) {
+        NSString *message = [NSString stringWithFormat:@"No fixture for %@ %@.", request.method, request.path];
+        return [CIOStubResponse errorResponseWithStatusCode:404 message:message];
+    }
+    CIOStubResponse *response =
+        [CIOStubResponse responseWithStatusCode:200 contentType:CIOStubContentType(fixture) body:data];
+    response.headers[@"Accept-Ranges"] = @"bytes";
+    NSString *rangeHeader = request.headers[@"range"];
+    if (rangeHeader && [request.method isEqualToString:@"GET"]) {
+        NSRange range = CIOStubByteRange(rangeHeader, data.length);
+        if (range.location == NSNotFound) {
+            response = [CIOStubResponse errorResponseWithStatusCode:416 message:@"Requested range not satisfiable."];
+            response.headers[@"Content-Range"] = [NSString stringWithFormat:@"bytes */%lu", (unsigned long)data.length];
+        } else if (range.length < data.length) {
+            response.statusCode = 206;
+            response.body = [data subdataWithRange:range];
+            response.headers[@"Content-Range"] =
+                [NSString stringWithFormat:@"bytes %lu-%lu/%lu", (unsigned long)range.location,
+                                           (unsigned long)NSMaxRange(range) - 1, (unsigned long)data.length];
+        }
+    }
+    return response;
+}
+
+#pragma mark - Fixtures
+
+- (nullable NSString *)_fixtureForRequest:(CIOStubRequest *)request {
+    NSArray *segments = CIOStubPathSegments(request.path);
+    // HEAD requests, like prewarms, are answered as the GET would be
+    NSString *method = [request.method isEqualToString:@"HEAD"] ? @"GET" : request.method;
+    for (NSDictionary *route in self.routes) {
+        NSString *routeMethod = route[@"method"] ?: @"GET";
+        if ([routeMethod isEqualToString:method] && CIOStubPathMatches(route[@"segments"], 0, segments, 0)) {
+            return route[@"fixture"];
+        }
+    }
+    return nil;
+}
+
+- (nullable NSData *)_dataForFixture:(NSString *)fixture {
+    @synchronized(self.fixtureData) {
+        NSData *data = self.fixtureData[fixture];
+        if (!data) {
+            data = [NSData dataWithContentsOfURL:[self.fixturesURL URLByAppendingPathComponent:fixture]];
+            self.fixtureData[fixture] = data;
+        }
+        return data;
+    }
+}
+
+#pragma mark - OAuth
+
+- (BOOL)_verifySignatureOfRequest:(CIOStubRequest *)request consumerSecret:(NSString *)consumerSecret {
+    NSString *authorization = request.headers[@"authorization"];
+    if (![authorization hasPrefix:@"OAuth "]) {
+        return NO;
+    }
+    NSMutableDictionary *parameters = [NSMutableDictionary dictionary];
+    NSString *signature = nil;
+    NSCharacterSet *quotes = [NSCharacterSet characterSetWithCharactersInString:@"\""];
+    for (NSString *field in [[authorization substringFromIndex:6] componentsSeparatedByString:@","]) {
+        NSString *pair = [field stringByTrimmingCharactersInSet:[NSCharacterSet whitespaceCharacterSet]];
+        NSRange equals = [pair rangeOfString:@"="];
+        if (equals.location == NSNotFound) {
+            return NO;
+        }
+        NSString *name = [pair substringToIndex:equals.location];
+        NSString *value = [[pair substringFromIndex:NSMaxRange(equals)] stringByTrimmingCharactersInSet:quotes];
+        if ([name isEqualToString:@"oauth_signature"]) {
+            signature = [value stringByRemovingPercentEncoding];
+        } else {
+            parameters[name] = value;
+        }
+    }
+    if (!signature) {
+        return NO;
+    }
+    CIOStubAddParameters(parameters, request.query);
+    if ([request.headers[@"content-type"] hasPrefix:@"application/x-www-form-urlencoded"]) {
+        CIOStubAddParameters(parameters, [[NSString alloc] initWithData:request.body encoding:NSUTF8StringEncoding]);
+    }
+
+    NSMutableArray *pairs = [NSMutableArray arrayWithCapacity:parameters.count];
+    for (NSString *name in [parameters.allKeys sortedArrayUsingSelector:@selector(compare:)]) {
+        [pairs addObject:[NSString stringWithFormat:@"%@=%@", name, parameters[name]]];
+    }
+    NSString *hostAndPath = [[request.headers[@"host"] lowercaseString] stringByAppendingString:request.path];
+    NSString *base = [NSString stringWithFormat:@"%@&http%%3A%%2F%%2F%@&%@", request.method,
+                                                CIOStubPercentEncode(hostAndPath),
+                                                CIOStubPercentEncode([pairs componentsJoinedByString:@"&"])];
+    NSData *baseData = [base dataUsingEncoding:NSUTF8StringEncoding];
+    NSData *secret = [[NSString stringWithFormat:@"%@&%@", consumerSecret, self.tokenSecret ?: @""]
+        dataUsingEncoding:NSUTF8StringEncoding];
+    NSMutableData *digest = [NSMutableData dataWithLength:CC_SHA1_DIGEST_LENGTH];
+    CCHmac(kCCHmacAlgSHA1, secret.bytes, secret.length, baseData.bytes, baseData.length, digest.mutableBytes);
+    return [[digest base64EncodedStringWithOptions:0] isEqualToString:signature];
+}
+
+@end
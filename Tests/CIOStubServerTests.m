@@ -0,0 +1,150 @@
+//
+//  CIOStubServerTests.m
+//  CIOAPIClient
+//
+//  Copyright © 2015 Context.io. All rights reserved.
+//
+
+#import <XCTest/XCTest.h>
+#import "CIOV2Client.h"
+#import "CIOLiteClient.h"
+#import "CIOAPISession.h"
+#import "CIOStubServer.h"
+
+@interface CIOStubServerTests : XCTestCase
+
+@property (nonatomic) CIOStubServer *server;
+@property (nonatomic) CIOV2Client *client;
+
+@end
+
+@implementation CIOStubServerTests
+
+- (void)setUp {
+    [super setUp];
+    self.server = [[CIOStubServer alloc] initWithFixturesURL:[CIOStubServer defaultFixturesURL]];
+    NSError *error = nil;
+    XCTAssertTrue([self.server startWithError:&error], @"%@", error);
+    NSString *baseURLString = [NSURL URLWithString:@"2.0/" relativeToURL:self.server.URL].absoluteString;
+    self.client = [[CIOV2Client alloc] initWithBaseURLString:baseURLString
+                                                 consumerKey:@"consumer_key"
+                                              consumerSecret:@"consumer_secret"
+                                                       token:@"token"
+                                                 tokenSecret:@"token_secret"
+                                                   accountID:@"anAccountId"];
+}
+
+- (void)tearDown {
+    [self.server stop];
+    [super tearDown];
+}
+
+// Executes `request` with its client, returning the response object or error once it finishes
+- (id)resultOfRequest:(CIORequest *)request {
+    XCTestExpectation *expectation = [self expectationWithDescription:@"response"];
+    __block id result = nil;
+    [request.client.session executeRequest:[request.client requestForCIORequest:request]
+        success:^(id responseObject) {
+          result = responseObject;
+          [expectation fulfill];
+        }
+        failure:^(NSError *error) {
+          result = error;
+          [expectation fulfill];
+        }];
+    [self waitForExpectationsWithTimeout:5 handler:nil];
+    return result;
+}
+
+- (void)testPrewarmsTheOriginOfRequests {
+    XCTAssertEqualObjects(self.client.URLScheme, @"http");
+    XCTestExpectation *expectation = [self expectationWithDescription:@"prewarm"];
+    [self.client prewarmWithCompletion:^(NSError *error) {
+      XCTAssertNil(error);
+      [expectation fulfill];
+    }];
+    [self waitForExpectationsWithTimeout:5 handler:nil];
+    XCTAssertEqual(self.server.requestCount, 1u);
+    XCTAssertTrue([[self resultOfRequest:[self.client getMessages]] isKindOfClass:[NSArray class]]);
+    XCTAssertEqual(self.server.connectionCount, 1u);
+}
+
+- (void)testServesFixtures {
+    NSArray *messages = [self resultOfRequest:[self.client getMessages]];
+    XCTAssertTrue([messages isKindOfClass:[NSArray class]]);
+    XCTAssertEqual(messages.count, 4u);
+    XCTAssertEqualObjects(messages.firstObject[@"subject"], @"Lunch on Friday?");
+    XCTAssertEqual(self.server.requestCount, 1u);
+}
+
+- (void)testNestedLiteFolder {
+    CIOLiteClient *client = [[CIOLiteClient alloc]
+        initWithBaseURLString:[NSURL URLWithString:@"lite/" relativeToURL:self.server.URL].absoluteString
+                  consumerKey:@"consumer_key"
+               consumerSecret:@"consumer_secret"
+                        token:@"token"
+                  tokenSecret:@"token_secret"
+                    accountID:@"anAccountId"];
+    client.URLScheme = @"http";
+    CIOLiteMessageRequest *request = [client requestForMessageWithID:@"<1530f1a2b3c4d5e6.1@example.com>"
+                                                            inFolder:@"[Gmail]/All Mail"
+                                                        accountLabel:nil
+                                                           delimiter:nil];
+    NSDictionary *flags = [self resultOfRequest:[request getFlags]];
+    XCTAssertEqualObjects(flags[@"nonjunk"], @YES);
+}
+
+- (void)testVerifiesSignatures {
+    self.server.consumerSecret = @"consumer_secret";
+    self.server.tokenSecret = @"token_secret";
+    XCTAssertTrue([[self resultOfRequest:[self.client getMessages]] isKindOfClass:[NSArray class]]);
+    CIODictionaryRequest *update = [self.client updateAccountWithFirstName:@"Bob" lastName:@"Example"];
+    XCTAssertEqualObjects([self resultOfRequest:update], @{@"success": @YES});
+
+    self.server.tokenSecret = @"other_secret";
+    NSError *error = [self resultOfRequest:[self.client getMessages]];
+    XCTAssertTrue([error isKindOfClass:[NSError class]]);
+    NSHTTPURLResponse *response = error.userInfo[CIOAPISessionURLResponseErrorKey];
+    XCTAssertEqual(response.statusCode, 401);
+}
+
+- (void)testRateLimitsAndFailures {
+    self.server.rateLimitInterval = 2;
+    self.server.failureInterval = 3;
+    self.server.retryAfter = 7;
+    XCTAssertTrue([[self resultOfRequest:[self.client getMessages]] isKindOfClass:[NSArray class]]);
+    NSError *error = [self resultOfRequest:[self.client getMessages]];
+    NSHTTPURLResponse *response = error.userInfo[CIOAPISessionURLResponseErrorKey];
+    XCTAssertEqual(response.statusCode, 429);
+    XCTAssertEqualObjects(response.allHeaderFields[@"Retry-After"], @"7");
+    error = [self resultOfRequest:[self.client getMessages]];
+    XCTAssertEqual([error.userInfo[CIOAPISessionURLResponseErrorKey] statusCode], 500);
+}
+
+- (void)testRange {
+    NSMutableURLRequest *request =
+        [[self.client requestForCIORequest:[self.client downloadContentsOfFileWithID:@"aFileId"]] mutableCopy];
+    [request setValue:@"bytes=10-19" forHTTPHeaderField:@"Range"];
+    XCTestExpectation *expectation = [self expectationWithDescription:@"response"];
+    [[[NSURLSession sharedSession]
+          dataTaskWithRequest:request
+            completionHandler:^(NSData *data, NSURLResponse *response, NSError *error) {
+              XCTAssertNil(error);
+              XCTAssertEqual([(NSHTTPURLResponse *)response statusCode], 206);
+              XCTAssertEqualObjects([(NSHTTPURLResponse *)response allHeaderFields][@"Content-Range"],
+                                    @"bytes 10-19/2884");
+              XCTAssertEqualObjects([[NSString alloc] initWithData:data encoding:NSUTF8StringEncoding],
+                                    @"planning a");
+              [expectation fulfill];
+            }] resume];
+    [self waitForExpectationsWithTimeout:5 handler:nil];
+}
+
+- (void)testLatency {
+    self.server.latency = 0.2;
+    NSDate *start = [NSDate date];
+    [self resultOfRequest:[self.client getMessages]];
+    XCTAssertGreaterThanOrEqual(-[start timeIntervalSinceNow], 0.2);
+}
+
+@end
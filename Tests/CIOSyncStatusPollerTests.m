@@ -0,0 +1,105 @@
+//
+//  CIOSyncStatusPollerTests.m
+//  CIOAPIClient
+//
+//  Copyright © 2015 Context.io. All rights reserved.
+//
+
+#import <XCTest/XCTest.h>
+#import "CIOV2Client.h"
+#import "CIOSyncStatusPoller.h"
+
+@interface CIOSyncStatusPollerTests : XCTestCase
+
+@property (nonatomic) CIOV2Client *client;
+@property (nonatomic) CIOSyncStatusPoller *poller;
+
+@end
+
+@implementation CIOSyncStatusPollerTests
+
+- (void)setUp {
+    [super setUp];
+    self.client = [[CIOV2Client alloc] initWithConsumerKey:@"consumer_key" consumerSecret:@"consumer_secret"];
+    [self.client setValue:@"anAccountId" forKey:@"accountID"];
+    self.poller = [CIOSyncStatusPoller new];
+    self.poller.minimumInterval = 10;
+    self.poller.maximumInterval = 60;
+    [self.poller addClient:self.client];
+}
+
+- (void)tearDown {
+    [self.client clearCredentials];
+    [super tearDown];
+}
+
+- (NSDictionary *)statusWithStart:(NSTimeInterval)start stop:(NSTimeInterval)stop {
+    double now = [[NSDate date] timeIntervalSince1970];
+    return @{@"0": @{@"IMAP": @{@"last_sync_start": @(now + start), @"last_sync_stop": @(now + stop),
+                                @"initial_import_finished": @YES}}};
+}
+
+- (void)testChanges {
+    NSDictionary *old = @{@"a": @{@"IMAP": @{@"last_sync_stop": @1}}, @"b": @{@"IMAP": @{@"last_sync_stop": @1}}};
+    NSDictionary *new = @{@"a": @{@"IMAP": @{@"last_sync_stop": @2}}, @"c": @{@"IMAP": @{@"last_sync_stop": @1}}};
+    NSDictionary *changes = [CIOSyncStatusPoller changesFromStatus:old toStatus:new];
+    XCTAssertEqualObjects(changes, (@{@"a": new[@"a"], @"b": [NSNull null], @"c": new[@"c"]}));
+    XCTAssertEqualObjects([CIOSyncStatusPoller changesFromStatus:new toStatus:[new copy]], @{});
+}
+
+- (void)testIntervalAdapts {
+    XCTAssertEqualObjects(self.poller.accountIDs, @[@"anAccountId"]);
+    XCTAssertEqual([self.poller intervalForAccountWithID:@"anAccountId"], 10);
+
+    NSDictionary *idle = [self statusWithStart:-100 stop:-90];
+    [self.poller updateStatus:idle forAccountWithID:@"anAccountId"];
+    XCTAssertEqual([self.poller intervalForAccountWithID:@"anAccountId"], 10, @"the first status is a baseline");
+    [self.poller updateStatus:idle forAccountWithID:@"anAccountId"];
+    XCTAssertEqual([self.poller intervalForAccountWithID:@"anAccountId"], 20);
+    [self.poller updateStatus:idle forAccountWithID:@"anAccountId"];
+    [self.poller updateStatus:idle forAccountWithID:@"anAccountId"];
+    XCTAssertEqual([self.poller intervalForAccountWithID:@"anAccountId"], 60);
+
+    // A sync in progress brings the interval back down, and keeps it there
+    NSDictionary *syncing = [self statusWithStart:-5 stop:-90];
+    [self.poller updateStatus:syncing forAccountWithID:@"anAccountId"];
+    XCTAssertEqual([self.poller intervalForAccountWithID:@"anAccountId"], 10);
+    [self.poller updateStatus:syncing forAccountWithID:@"anAccountId"];
+    XCTAssertEqual([self.poller intervalForAccountWithID:@"anAccountId"], 10);
+}
+
+- (void)testPostsOnlyChanges {
+    __block NSMutableArray *notifications = [NSMutableArray array];
+    id observer = [[NSNotificationCenter defaultCenter] addObserverForName:CIOSyncStatusPollerDidChangeNotification
+                                                                    object:self.poller
+                                                                     queue:nil
+                                                                usingBlock:^(NSNotification *note) {
+                                                                  [notifications addObject:note.userInfo];
+                                                                }];
+    NSDictionary *first = [self statusWithStart:-100 stop:-90];
+    NSDictionary *second = [self statusWithStart:-20 stop:-10];
+    [self.poller updateStatus:first forAccountWithID:@"anAccountId"];
+    [self.poller updateStatus:first forAccountWithID:@"anAccountId"];
+    NSDictionary *changes = [self.poller updateStatus:second forAccountWithID:@"anAccountId"];
+    [[NSNotificationCenter defaultCenter] removeObserver:observer];
+
+    XCTAssertEqualObjects(changes, @{@"0": second[@"0"]});
+    XCTAssertEqual(notifications.count, 1u);
+    XCTAssertEqualObjects(notifications.firstObject[CIOSyncStatusPollerAccountIDKey], @"anAccountId");
+    XCTAssertEqualObjects(notifications.firstObject[CIOSyncStatusPollerChangesKey], changes);
+    XCTAssertEqualObjects([self.poller statusForAccountWithID:@"anAccountId"], second);
+}
+
+- (void)testStaleSources {
+    double now = [[NSDate date] timeIntervalSince1970];
+    NSDictionary *status = @{
+        @"fresh": @{@"IMAP": @{@"last_sync_start": @(now - 70), @"last_sync_stop": @(now - 60)}},
+        @"stale": @{@"IMAP": @{@"last_sync_start": @(now - 7200), @"last_sync_stop": @(now - 7100)}},
+        @"syncing": @{@"IMAP": @{@"last_sync_start": @(now - 10), @"last_sync_stop": @(now - 7100)}},
+    };
+    XCTAssertEqualObjects([self.poller staleSourceLabelsInStatus:status], @[]);
+    self.poller.forceSyncAfter = 3600;
+    XCTAssertEqualObjects([self.poller staleSourceLabelsInStatus:status], @[@"stale"]);
+}
+
+@end
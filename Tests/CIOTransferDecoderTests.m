@@ -0,0 +1,285 @@
+//
+//  CIOTransferDecoderTests.m
+//  CIOAPIClient
+//
+//  Copyright © 2015 Context.io. All rights reserved.
+//
+
+#import <XCTest/XCTest.h>
+#import "CIOTransferDecoder.h"
+#import "CIOV2Client.h"
+#import "CIOStubServer.h"
+
+static const NSUInteger kCIOBenchmarkLength = 16 * 1024 * 1024;
+static const NSUInteger kCIOBenchmarkIterations = 5;
+
+@interface CIOTransferDecoderTests : XCTestCase
+
+@end
+
+@implementation CIOTransferDecoderTests
+
+- (NSData *)data:(NSString *)string {
+    return [string dataUsingEncoding:NSUTF8StringEncoding];
+}
+
+// Feeds `input` to a decoder `chunkSize` bytes at a time
+- (NSData *)decode:(NSString *)input encoding:(CIOTransferEncoding)encoding chunkSize:(NSUInteger)chunkSize {
+    NSData *data = [self data:input];
+    CIOTransferDecoder *decoder = [[CIOTransferDecoder alloc] initWithEncoding:encoding];
+    NSMutableData *output = [NSMutableData data];
+    NSMutableData *buffer = [NSMutableData dataWithLength:[CIOTransferDecoder maximumDecodedLengthForLength:chunkSize]];
+    for (NSUInteger offset = 0; offset < data.length; offset += chunkSize) {
+        NSUInteger length = MIN(chunkSize, data.length - offset);
+        NSUInteger written = [decoder decodeBytes:(const uint8_t *)data.bytes + offset
+                                           length:length
+                                       intoBuffer:buffer.mutableBytes];
+        [output appendBytes:buffer.bytes length:written];
+    }
+    NSUInteger written = [decoder finishIntoBuffer:buffer.mutableBytes];
+    [output appendBytes:buffer.bytes length:written];
+    return output;
+}
+
+// Random bytes, base64 encoded with 76 character CRLF lines as in a MIME body
+- (NSData *)encodedRandomDataOfLength:(NSUInteger)length original:(NSData **)original {
+    NSMutableData *data = [NSMutableData dataWithLength:length];
+    arc4random_buf(data.mutableBytes, length);
+    if (original) {
+        *original = data;
+    }
+    return [data base64EncodedDataWithOptions:NSDataBase64Encoding76CharacterLineLength |
+                                              NSDataBase64EncodingEndLineWithCarriageReturn |
+                                              NSDataBase64EncodingEndLineWithLineFeed];
+}
+
+- (NSData *)decodeData:(NSData *)data
+              encoding:(CIOTransferEncoding)encoding
+          acceleration:(CIOTransferDecoderAcceleration)acceleration {
+    CIOTransferDecoder *decoder = [[CIOTransferDecoder alloc] initWithEncoding:encoding];
+    decoder.acceleration = acceleration;
+    NSMutableData *output = [NSMutableData dataWithLength:[CIOTransferDecoder maximumDecodedLengthForLength:data.length]];
+    NSUInteger length = [decoder decodeBytes:data.bytes length:data.length intoBuffer:output.mutableBytes];
+    length += [decoder finishIntoBuffer:(uint8_t *)output.mutableBytes + length];
+    output.length = length;
+    return output;
+}
+
+- (void)testEncodingNames {
+    XCTAssertEqual([CIOTransferDecoder encodingForName:@"BASE64"], CIOTransferEncodingBase64);
+    XCTAssertEqual([CIOTransferDecoder encodingForName:@" Quoted-Printable "], CIOTransferEncodingQuotedPrintable);
+    XCTAssertEqual([CIOTransferDecoder encodingForName:@"8bit"], CIOTransferEncodingIdentity);
+    XCTAssertEqual([CIOTransferDecoder encodingForName:nil], CIOTransferEncodingIdentity);
+}
+
+- (void)testBase64AcrossChunks {
+    NSString *encoded = @"VGhlIHF1aWNrIGJyb3duIGZveA0KanVtcHMgb3Zl\r\ncg==";
+    NSData *expected = [self data:@"The quick brown fox\r\njumps over"];
+    for (NSUInteger chunkSize = 1; chunkSize <= encoded.length; chunkSize++) {
+        XCTAssertEqualObjects([self decode:encoded encoding:CIOTransferEncodingBase64 chunkSize:chunkSize], expected);
+    }
+}
+
+- (void)testBase64UnpaddedAndConcatenated {
+    XCTAssertEqualObjects([self decode:@"YQ" encoding:CIOTransferEncodingBase64 chunkSize:2], [self data:@"a"]);
+    XCTAssertEqualObjects([self decode:@"YQ==YWI=" encoding:CIOTransferEncodingBase64 chunkSize:8], [self data:@"aab"]);
+}
+
+- (void)testQuotedPrintableAcrossChunks {
+    NSString *encoded = @"a=3Db=\r\nc= \t\r\nd=0a=\n=E2=82=AC";
+    NSData *expected = [self data:@"a=bcd\n€"];
+    for (NSUInteger chunkSize = 1; chunkSize <= encoded.length; chunkSize++) {
+        XCTAssertEqualObjects([self decode:encoded encoding:CIOTransferEncodingQuotedPrintable chunkSize:chunkSize],
+                              expected);
+    }
+}
+
+- (void)testQuotedPrintableInvalidEscapes {
+    XCTAssertEqualObjects([CIOTransferDecoder decodeData:[self data:@"1=2x=Gy="]
+                                                encoding:CIOTransferEncodingQuotedPrintable],
+                          [self data:@"1=2x=Gy="]);
+}
+
+- (void)testAccelerationIsClamped {
+    CIOTransferDecoder *decoder = [[CIOTransferDecoder alloc] initWithEncoding:CIOTransferEncodingBase64];
+    XCTAssertEqual(decoder.acceleration, [CIOTransferDecoder supportedAcceleration]);
+    decoder.acceleration = CIOTransferDecoderAccelerationAVX2;
+    XCTAssertLessThanOrEqual(decoder.acceleration, [CIOTransferDecoder supportedAcceleration]);
+    decoder.acceleration = CIOTransferDecoderAccelerationNone;
+    XCTAssertEqual(decoder.acceleration, CIOTransferDecoderAccelerationNone);
+}
+
+- (void)testBase64AccelerationsAgree {
+    for (NSUInteger length = 0; length < 300; length += 7) {
+        NSData *original = nil;
+        NSData *encoded = [self encodedRandomDataOfLength:length original:&original];
+        for (NSInteger acceleration = CIOTransferDecoderAccelerationNone;
+             acceleration <= [CIOTransferDecoder supportedAcceleration]; acceleration++) {
+            XCTAssertEqualObjects([self decodeData:encoded encoding:CIOTransferEncodingBase64 acceleration:acceleration],
+                                  original, @"length %lu acceleration %ld", (unsigned long)length, (long)acceleration);
+        }
+    }
+}
+
+- (void)testQuotedPrintableAccelerationsAgree {
+    NSData *encoded = [self data:@"A long line of plain text which should be copied in runs=2C then an escape=\r\n"
+                                 @"and a soft break, and then more long plain text after it=3D=3D"];
+    NSData *expected = [self data:@"A long line of plain text which should be copied in runs, then an escape"
+                                  @"and a soft break, and then more long plain text after it=="];
+    for (NSInteger acceleration = CIOTransferDecoderAccelerationNone;
+         acceleration <= [CIOTransferDecoder supportedAcceleration]; acceleration++) {
+        XCTAssertEqualObjects(
+            [self decodeData:encoded encoding:CIOTransferEncodingQuotedPrintable acceleration:acceleration], expected);
+    }
+}
+
+- (void)testDecodeFile {
+    NSData *original = nil;
+    NSData *encoded = [self encodedRandomDataOfLength:600 * 1024 original:&original];
+    NSString *directory = NSTemporaryDirectory();
+    NSURL *sourceURL = [NSURL fileURLWithPath:[directory stringByAppendingPathComponent:[[NSUUID UUID] UUIDString]]];
+    NSURL *destinationURL =
+        [NSURL fileURLWithPath:[directory stringByAppendingPathComponent:[[NSUUID UUID] UUIDString]]];
+    [encoded writeToURL:sourceURL atomically:YES];
+    NSError *error = nil;
+    XCTAssertTrue([CIOTransferDecoder decodeFileAtURL:sourceURL
+                                            toFileURL:destinationURL
+                                             encoding:CIOTransferEncodingBase64
+                                                error:&error]);
+    XCTAssertNil(error);
+    XCTAssertEqualObjects([NSData dataWithContentsOfURL:destinationURL], original);
+    XCTAssertFalse([CIOTransferDecoder decodeFileAtURL:sourceURL
+                                             toFileURL:destinationURL
+                                              encoding:CIOTransferEncodingBase64
+                                                 error:&error]);
+    XCTAssertEqual(error.code, NSFileWriteFileExistsError);
+    [[NSFileManager defaultManager] removeItemAtURL:sourceURL error:nil];
+    [[NSFileManager defaultManager] removeItemAtURL:destinationURL error:nil];
+}
+
+- (void)testExtractMIMEPart {
+    NSString *fixturesPath = [NSTemporaryDirectory() stringByAppendingPathComponent:[[NSUUID UUID] UUIDString]];
+    NSURL *fixturesURL = [NSURL fileURLWithPath:fixturesPath isDirectory:YES];
+    [[NSFileManager defaultManager] createDirectoryAtURL:fixturesURL
+                             withIntermediateDirectories:YES
+                                              attributes:nil
+                                                   error:nil];
+    NSData *routes = [self data:@"[{\"path\": \"**\", \"fixture\": \"message.eml\"}]"];
+    [routes writeToURL:[fixturesURL URLByAppendingPathComponent:@"routes.json"] atomically:YES];
+    NSData *message = [self data:@"Content-Type: multipart/mixed; boundary=b\r\n"
+                                 @"\r\n"
+                                 @"--b\r\n"
+                                 @"Content-Type: text/plain\r\n"
+                                 @"Content-Transfer-Encoding: quoted-printable\r\n"
+                                 @"\r\n"
+                                 @"See attached=2E\r\n"
+                                 @"--b\r\n"
+                                 @"Content-Disposition: attachment; filename=\"hello.txt\"\r\n"
+                                 @"Content-Transfer-Encoding: base64\r\n"
+                                 @"\r\n"
+                                 @"SGVsbG8s\r\n"
+                                 @"IHdvcmxkIQ==\r\n"
+                                 @"--b--\r\n"];
+    [message writeToURL:[fixturesURL URLByAppendingPathComponent:@"message.eml"] atomically:YES];
+
+    CIOStubServer *server = [[CIOStubServer alloc] initWithFixturesURL:fixturesURL];
+    NSError *error = nil;
+    XCTAssertTrue([server startWithError:&error], @"%@", error);
+    CIOV2Client *client = [[CIOV2Client alloc] initWithBaseURLString:server.URL.absoluteString
+                                                         consumerKey:@"consumer_key"
+                                                      consumerSecret:@"consumer_secret"
+                                                               token:@"token"
+                                                         tokenSecret:@"token_secret"
+                                                           accountID:@"anAccountId"];
+    client.URLScheme = @"http";
+    NSURL *fileURL =
+        [NSURL fileURLWithPath:[NSTemporaryDirectory() stringByAppendingPathComponent:[[NSUUID UUID] UUIDString]]];
+
+    XCTestExpectation *extracted = [self expectationWithDescription:@"extracted"];
+    [client downloadRequest:[client getSourceForMessageWithID:@"aMessageID"]
+        extractingMIMEPartAtIndex:2
+                        toFileURL:fileURL
+                          success:^{
+                            [extracted fulfill];
+                          }
+                          failure:^(NSError *failure) {
+                            XCTFail(@"%@", failure);
+                            [extracted fulfill];
+                          }
+                         progress:nil];
+    [self waitForExpectationsWithTimeout:5 handler:nil];
+    XCTAssertEqualObjects([NSData dataWithContentsOfURL:fileURL], [self data:@"Hello, world!"]);
+    [[NSFileManager defaultManager] removeItemAtURL:fileURL error:nil];
+
+    XCTestExpectation *missing = [self expectationWithDescription:@"missing"];
+    [client downloadRequest:[client getSourceForMessageWithID:@"aMessageID"]
+        extractingMIMEPartAtIndex:3
+                        toFileURL:fileURL
+                          success:^{
+                            XCTFail(@"There is no part at index 3");
+                            [missing fulfill];
+                          }
+                          failure:^(NSError *failure) {
+                            XCTAssertNotNil(failure);
+                            [missing fulfill];
+                          }
+                         progress:nil];
+    [self waitForExpectationsWithTimeout:5 handler:nil];
+    XCTAssertFalse([[NSFileManager defaultManager] fileExistsAtPath:fileURL.path]);
+    [server stop];
+    [[NSFileManager defaultManager] removeItemAtURL:fixturesURL error:nil];
+}
+
+#pragma mark - Benchmarks
+
+// Logs decode throughput in MB/s of decoded output, checking every decode against `expected`
+- (void)logThroughputOf:(NSString *)name expecting:(NSData *)expected block:(NSData * (^)(void))block {
+    NSDate *start = [NSDate date];
+    for (NSUInteger i = 0; i < kCIOBenchmarkIterations; i++) {
+        XCTAssertEqualObjects(block(), expected, @"%@", name);
+    }
+    NSTimeInterval elapsed = -[start timeIntervalSinceNow];
+    NSLog(@"%@: %.1f MB/s", name, kCIOBenchmarkLength * kCIOBenchmarkIterations / elapsed / (1024 * 1024));
+}
+
+- (void)testBase64Throughput {
+    NSData *original = nil;
+    NSData *encoded = [self encodedRandomDataOfLength:kCIOBenchmarkLength original:&original];
+    NSString *encodedString = [[NSString alloc] initWithData:encoded encoding:NSASCIIStringEncoding];
+    [self logThroughputOf:@"NSData initWithBase64EncodedString"
+                expecting:original
+                    block:^{
+                      return [[NSData alloc] initWithBase64EncodedString:encodedString
+                                                                 options:NSDataBase64DecodingIgnoreUnknownCharacters];
+                    }];
+    NSArray *names = @[@"scalar", @"SSE2", @"AVX2"];
+    for (NSInteger acceleration = CIOTransferDecoderAccelerationNone;
+         acceleration <= [CIOTransferDecoder supportedAcceleration]; acceleration++) {
+        [self logThroughputOf:[NSString stringWithFormat:@"CIOTransferDecoder base64 %@", names[acceleration]]
+                    expecting:original
+                        block:^{
+                          return [self decodeData:encoded encoding:CIOTransferEncodingBase64 acceleration:acceleration];
+                        }];
+    }
+}
+
+- (void)testVectorizedBase64Performance {
+    NSData *original = nil;
+    NSData *encoded = [self encodedRandomDataOfLength:kCIOBenchmarkLength original:&original];
+    [self measureBlock:^{
+      XCTAssertEqualObjects([CIOTransferDecoder decodeData:encoded encoding:CIOTransferEncodingBase64], original);
+    }];
+}
+
+- (void)testFoundationBase64Performance {
+    NSData *original = nil;
+    NSData *encoded = [self encodedRandomDataOfLength:kCIOBenchmarkLength original:&original];
+    NSString *encodedString = [[NSString alloc] initWithData:encoded encoding:NSASCIIStringEncoding];
+    [self measureBlock:^{
+      XCTAssertEqualObjects([[NSData alloc] initWithBase64EncodedString:encodedString
+                                                                options:NSDataBase64DecodingIgnoreUnknownCharacters],
+                            original);
+    }];
+}
+
+@end
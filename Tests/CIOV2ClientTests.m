@@ -29,6 +29,20 @@
     [self.client clearCredentials];
 }
 
+#pragma mark Parameters
+
+- (void)testUnsetPropertiesAreNotSigned {
+    CIOFolderMessagesRequest *request = [self.client getMessagesForFolderWithPath:@"INBOX" sourceLabel:@"0"];
+    request.include_body = YES;
+    request.limit = 0;
+    NSURLRequest *urlRequest = [self.client requestForCIORequest:request];
+    NSURLRequest *expected = [self.client requestForPath:request.path method:@"GET" params:@{@"include_body": @YES, @"limit": @0}];
+    XCTAssertEqualObjects(urlRequest.URL, expected.URL);
+    XCTAssertEqualObjects([TestUtil OAuthSignature:[urlRequest valueForHTTPHeaderField:@"Authorization"]],
+                          [TestUtil OAuthSignature:[expected valueForHTTPHeaderField:@"Authorization"]]);
+    XCTAssertEqual([urlRequest.URL.query rangeOfString:@"include_flags"].location, NSNotFound);
+}
+
 #pragma mark Account
 
 - (void)testGetAccount {
@@ -154,6 +168,7 @@
                                 CIORequest,
                                 @"GET");
     XCTAssertTrue(request.parameters.count == 0);
+    XCTAssertEqualObjects(request.contentKey, @"accounts/anAccountId/files/aFileId/content");
 }
 
 - (void)testGetRelatedFiles {
@@ -0,0 +1,194 @@
+//
+//  CIOWebhookReceiverTests.m
+//  CIOAPIClient
+//
+//  Copyright © 2015 Context.io. All rights reserved.
+//
+
+#import <XCTest/XCTest.h>
+#import <CommonCrypto/CommonHMAC.h>
+#import "CIOWebhookReceiver.h"
+#import <arpa/inet.h>
+#import <netinet/in.h>
+#import <sys/socket.h>
+
+@interface CIOWebhookReceiverTests : XCTestCase
+
+@property (nonatomic) CIOWebhookReceiver *receiver;
+
+@end
+
+@implementation CIOWebhookReceiverTests
+
+- (void)setUp {
+    [super setUp];
+    self.receiver = [[CIOWebhookReceiver alloc] initWithConsumerSecret:@"consumer_secret"];
+}
+
+- (void)tearDown {
+    [self.receiver stop];
+    [super tearDown];
+}
+
+- (NSData *)bodyWithMessageID:(NSString *)messageID secret:(NSString *)secret {
+    return [self bodyWithMessageID:messageID secret:secret date:[NSDate date]];
+}
+
+- (NSData *)bodyWithMessageID:(NSString *)messageID secret:(NSString *)secret date:(NSDate *)date {
+    NSString *timestamp = [NSString stringWithFormat:@"%ld", (long)date.timeIntervalSince1970];
+    NSString *token = [[NSUUID UUID] UUIDString];
+    NSData *key = [secret dataUsingEncoding:NSUTF8StringEncoding];
+    NSData *message = [[timestamp stringByAppendingString:token] dataUsingEncoding:NSUTF8StringEncoding];
+    unsigned char digest[CC_SHA256_DIGEST_LENGTH];
+    CCHmac(kCCHmacAlgSHA256, key.bytes, key.length, message.bytes, message.length, digest);
+    NSMutableString *signature = [NSMutableString string];
+    for (int i = 0; i < CC_SHA256_DIGEST_LENGTH; i++) {
+        [signature appendFormat:@"%02x", digest[i]];
+    }
+    NSMutableDictionary *payload = [@{@"webhook_id": @"hook", @"account_id": @"anAccountId", @"timestamp": @(timestamp.integerValue),
+                                      @"token": token, @"signature": signature} mutableCopy];
+    if (messageID) {
+        payload[@"message_data"] = @{@"message_id": messageID, @"subject": @"Hello", @"folders": @[@"INBOX"]};
+    } else {
+        payload[@"data"] = @"IMAP connection lost";
+    }
+    return [NSJSONSerialization dataWithJSONObject:payload options:0 error:nil];
+}
+
+// Sends a request to the receiver and returns the response status code
+- (NSInteger)sendBody:(NSData *)body method:(NSString *)method {
+    NSString *URLString = [NSString stringWithFormat:@"http://127.0.0.1:%u/callback", self.receiver.port];
+    NSMutableURLRequest *request = [NSMutableURLRequest requestWithURL:[NSURL URLWithString:URLString]];
+    request.HTTPMethod = method;
+    request.HTTPBody = body;
+    __block NSInteger status = 0;
+    XCTestExpectation *expectation = [self expectationWithDescription:@"response"];
+    [[[NSURLSession sharedSession] dataTaskWithRequest:request
+                                     completionHandler:^(NSData *data, NSURLResponse *response, NSError *error) {
+                                       status = [(NSHTTPURLResponse *)response statusCode];
+                                       [expectation fulfill];
+                                     }] resume];
+    [self waitForExpectationsWithTimeout:5 handler:nil];
+    return status;
+}
+
+- (void)testParsesAndVerifiesEvents {
+    NSError *error = nil;
+    NSDate *date = [NSDate dateWithTimeIntervalSince1970:floor([NSDate date].timeIntervalSince1970)];
+    CIOWebhookEvent *event =
+        [self.receiver eventFromBody:[self bodyWithMessageID:@"m1" secret:@"consumer_secret" date:date] error:&error];
+    XCTAssertEqual(event.type, CIOWebhookEventTypeMessage);
+    XCTAssertEqualObjects(event.messageID, @"m1");
+    XCTAssertEqualObjects(event.webhookID, @"hook");
+    XCTAssertEqualObjects(event.accountID, @"anAccountId");
+    XCTAssertEqualObjects(event.timestamp, date);
+    XCTAssertEqualObjects(event.messageData[@"subject"], @"Hello");
+
+    event = [self.receiver eventFromBody:[self bodyWithMessageID:nil secret:@"consumer_secret"] error:&error];
+    XCTAssertEqual(event.type, CIOWebhookEventTypeFailure);
+    XCTAssertNil(event.messageID);
+
+    XCTAssertNil([self.receiver eventFromBody:[self bodyWithMessageID:@"m1" secret:@"wrong"] error:&error]);
+    XCTAssertEqual(error.code, 401);
+    XCTAssertNil([self.receiver eventFromBody:[@"[]" dataUsingEncoding:NSUTF8StringEncoding] error:&error]);
+    XCTAssertEqual(error.code, 400);
+}
+
+- (void)testRejectsStaleTimestamps {
+    NSError *error = nil;
+    NSData *stale =
+        [self bodyWithMessageID:@"m1" secret:@"consumer_secret" date:[NSDate dateWithTimeIntervalSinceNow:-600]];
+    XCTAssertNil([self.receiver eventFromBody:stale error:&error]);
+    XCTAssertEqual(error.code, 401);
+    NSData *future =
+        [self bodyWithMessageID:@"m1" secret:@"consumer_secret" date:[NSDate dateWithTimeIntervalSinceNow:600]];
+    XCTAssertNil([self.receiver eventFromBody:future error:&error]);
+    NSData *recent =
+        [self bodyWithMessageID:@"m1" secret:@"consumer_secret" date:[NSDate dateWithTimeIntervalSinceNow:-60]];
+    XCTAssertNotNil([self.receiver eventFromBody:recent error:&error]);
+    self.receiver.timestampTolerance = 0;
+    XCTAssertNotNil([self.receiver eventFromBody:stale error:&error]);
+}
+
+- (void)testDispatchesEventsOnce {
+    NSMutableArray *messageIDs = [NSMutableArray array];
+    XCTestExpectation *handled = [self expectationWithDescription:@"handled"];
+    [self.receiver addHandlerForEventType:CIOWebhookEventTypeMessage usingBlock:^(CIOWebhookEvent *event) {
+      @synchronized(messageIDs) {
+          [messageIDs addObject:event.messageID];
+      }
+      [handled fulfill];
+    }];
+    NSError *error = nil;
+    XCTAssertTrue([self.receiver startOnPort:0 error:&error], @"%@", error);
+    XCTAssertNotEqual(self.receiver.port, 0);
+
+    XCTAssertEqual([self sendBody:[self bodyWithMessageID:@"m1" secret:@"consumer_secret"] method:@"POST"], 200);
+    // Redelivery of an accepted message is acknowledged but not handled again
+    XCTAssertEqual([self sendBody:[self bodyWithMessageID:@"m1" secret:@"consumer_secret"] method:@"POST"], 200);
+    XCTAssertEqual([self sendBody:[self bodyWithMessageID:@"m2" secret:@"wrong"] method:@"POST"], 401);
+    XCTAssertEqual([self sendBody:nil method:@"GET"], 405);
+    @synchronized(messageIDs) {
+        XCTAssertEqualObjects(messageIDs, @[@"m1"]);
+    }
+}
+
+- (void)testDispatchesFailuresOnce {
+    __block NSUInteger failureCount = 0;
+    XCTestExpectation *handled = [self expectationWithDescription:@"handled"];
+    [self.receiver addHandlerForEventType:CIOWebhookEventTypeFailure usingBlock:^(CIOWebhookEvent *event) {
+      @synchronized(self) {
+          failureCount++;
+      }
+      [handled fulfill];
+    }];
+    XCTAssertTrue([self.receiver startOnPort:0 error:nil]);
+
+    NSData *body = [self bodyWithMessageID:nil secret:@"consumer_secret"];
+    XCTAssertEqual([self sendBody:body method:@"POST"], 200);
+    XCTAssertEqual([self sendBody:body method:@"POST"], 200);
+    @synchronized(self) {
+        XCTAssertEqual(failureCount, 1u);
+    }
+}
+
+- (void)testRequestTimeout {
+    self.receiver.requestTimeout = 0.2;
+    XCTAssertTrue([self.receiver startOnPort:0 error:nil]);
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in address;
+    memset(&address, 0, sizeof(address));
+    address.sin_len = sizeof(address);
+    address.sin_family = AF_INET;
+    address.sin_port = htons(self.receiver.port);
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    XCTAssertEqual(connect(fd, (struct sockaddr *)&address, sizeof(address)), 0);
+    const char *partial = "POST /callback HTTP/1.1\r\nContent-Length: 10\r\n";
+    write(fd, partial, strlen(partial));
+
+    struct timeval timeout = {.tv_sec = 5};
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    char response[64] = {0};
+    ssize_t count = read(fd, response, sizeof(response) - 1);
+    close(fd);
+    XCTAssertGreaterThan(count, 0);
+    XCTAssertTrue([@(response) hasPrefix:@"HTTP/1.1 408"], @"%s", response);
+}
+
+- (void)testBackpressure {
+    dispatch_semaphore_t release = dispatch_semaphore_create(0);
+    [self.receiver addHandlerForEventType:CIOWebhookEventTypeMessage usingBlock:^(CIOWebhookEvent *event) {
+      dispatch_semaphore_wait(release, dispatch_time(DISPATCH_TIME_NOW, 5 * NSEC_PER_SEC));
+    }];
+    self.receiver.maximumConcurrentHandlers = 1;
+    self.receiver.maximumPendingEvents = 2;
+    XCTAssertTrue([self.receiver startOnPort:0 error:nil]);
+
+    XCTAssertEqual([self sendBody:[self bodyWithMessageID:@"m1" secret:@"consumer_secret"] method:@"POST"], 200);
+    XCTAssertEqual([self sendBody:[self bodyWithMessageID:@"m2" secret:@"consumer_secret"] method:@"POST"], 200);
+    XCTAssertEqual([self sendBody:[self bodyWithMessageID:@"m3" secret:@"consumer_secret"] method:@"POST"], 503);
+    dispatch_semaphore_signal(release);
+    dispatch_semaphore_signal(release);
+}
+
+@end